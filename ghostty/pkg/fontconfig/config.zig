@@ -5,6 +5,7 @@ const CharSet = @import("char_set.zig").CharSet;
 const FontSet = @import("font_set.zig").FontSet;
 const ObjectSet = @import("object_set.zig").ObjectSet;
 const Pattern = @import("pattern.zig").Pattern;
+const StrList = @import("str_list.zig").StrList;
 const Result = @import("main.zig").Result;
 const MatchKind = @import("main.zig").MatchKind;
 
@@ -13,6 +14,17 @@ pub const Config = opaque {
         c.FcConfigDestroy(@ptrCast(self));
     }
 
+    /// The configuration files that were loaded for this config.
+    pub fn configFiles(self: *Config) *StrList {
+        return @ptrCast(c.FcConfigGetConfigFiles(self.cval()));
+    }
+
+    /// The font directories that were scanned for this config,
+    /// including subdirectories.
+    pub fn fontDirs(self: *Config) *StrList {
+        return @ptrCast(c.FcConfigGetFontDirs(self.cval()));
+    }
+
     pub fn fontList(self: *Config, pat: *Pattern, os: *ObjectSet) *FontSet {
         return @ptrCast(c.FcFontList(self.cval(), pat.cval(), os.cval()));
     }
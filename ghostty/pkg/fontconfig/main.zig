@@ -9,6 +9,7 @@ const matrix = @import("matrix.zig");
 const object_set = @import("object_set.zig");
 const pattern = @import("pattern.zig");
 const range = @import("range.zig");
+const str_list = @import("str_list.zig");
 const value = @import("value.zig");
 
 pub const c = @import("c.zig").c;
@@ -32,6 +33,7 @@ pub const Matrix = matrix.Matrix;
 pub const ObjectSet = object_set.ObjectSet;
 pub const Pattern = pattern.Pattern;
 pub const Range = range.Range;
+pub const StrList = str_list.StrList;
 pub const Type = value.Type;
 pub const Value = value.Value;
 pub const ValueBinding = value.ValueBinding;
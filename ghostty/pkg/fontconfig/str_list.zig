@@ -0,0 +1,17 @@
+const std = @import("std");
+const c = @import("c.zig").c;
+
+pub const StrList = opaque {
+    pub fn destroy(self: *StrList) void {
+        c.FcStrListDone(self.cval());
+    }
+
+    pub fn next(self: *StrList) ?[:0]const u8 {
+        const ptr = c.FcStrListNext(self.cval()) orelse return null;
+        return std.mem.sliceTo(ptr, 0);
+    }
+
+    pub inline fn cval(self: *StrList) *c.struct__FcStrList {
+        return @ptrCast(self);
+    }
+};
@@ -21,6 +21,19 @@ test "fc-list" {
     try testing.expect(fs.fonts().len > 0);
 }
 
+test "font dirs" {
+    const testing = std.testing;
+
+    var cfg = fontconfig.initLoadConfigAndFonts();
+    defer cfg.destroy();
+
+    const dirs = cfg.fontDirs();
+    defer dirs.destroy();
+
+    // Note: this is environmental, like fc-list above.
+    try testing.expect(dirs.next() != null);
+}
+
 test "fc-match" {
     const testing = std.testing;
 
@@ -21,6 +21,7 @@ const internal_os = @import("os/main.zig");
 const macos = @import("macos");
 const objc = @import("objc");
 const termio = @import("termio.zig");
+const PagePool = @import("terminal/PagePool.zig");
 
 const log = std.log.scoped(.app);
 
@@ -79,6 +80,11 @@ first: bool = true,
 /// Session manager for terminal-to-terminal communication
 session_manager: SessionManager,
 
+/// Returns free terminal page memory to the OS when idle or under
+/// memory pressure. This is null if it couldn't be started or isn't
+/// supported on this platform.
+page_purger: ?*PagePool.Purger = null,
+
 pub const CreateError = Allocator.Error || font.SharedGridSet.InitError;
 
 /// Create a new app instance. This returns a stable pointer to the app
@@ -110,6 +116,33 @@ pub fn init(
         .font_grid_set = font_grid_set,
         .config_conditional_state = .{},
         .session_manager = SessionManager.init(alloc),
+        .page_purger = initPagePurger(alloc),
+    };
+}
+
+fn initPagePurger(alloc: Allocator) ?*PagePool.Purger {
+    if (comptime builtin.os.tag == .windows) return null;
+
+    // On Linux, react to memory pressure in our cgroup (i.e. memory.high
+    // being exceeded). This is best effort: without cgroup v2 we only
+    // purge when idle.
+    const pressure: ?std.fs.File = if (comptime builtin.os.tag == .linux) pressure: {
+        const cgroup = internal_os.cgroup.current(
+            alloc,
+            std.os.linux.getpid(),
+        ) catch break :pressure null;
+        const path = cgroup orelse break :pressure null;
+        defer alloc.free(path);
+        break :pressure internal_os.cgroup.openMemoryEvents(path) catch null;
+    } else null;
+
+    return PagePool.Purger.create(alloc, PagePool.global(), .{
+        .pressure = pressure,
+    }) catch |err| {
+        log.warn("failed to start page purger, free scrollback memory " ++
+            "will not be returned to the OS err={}", .{err});
+        if (pressure) |f| f.close();
+        return null;
     };
 }
 
@@ -121,6 +154,8 @@ pub fn deinit(self: *App) void {
     // Clean up session manager
     self.session_manager.deinit();
 
+    if (self.page_purger) |v| v.destroy(self.alloc);
+
     // Clean up our font group cache
     // We should have zero items in the grid set at this point because
     // destroy only gets called when the app is shutting down and this
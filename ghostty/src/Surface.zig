@@ -39,6 +39,7 @@ const configpkg = @import("config.zig");
 const input = @import("input.zig");
 const App = @import("App.zig");
 const internal_os = @import("os/main.zig");
+const trace = @import("trace.zig");
 const inspectorpkg = @import("inspector/main.zig");
 const SurfaceMouse = @import("surface_mouse.zig");
 
@@ -2221,6 +2222,8 @@ pub fn keyCallback(
     crash.sentry.thread_state = self.crashThreadState();
     defer crash.sentry.thread_state = null;
 
+    if (event.action != .release) trace.instant(.key_input, 0);
+
     // Setup our inspector event if we have an inspector.
     var insp_ev: ?inspectorpkg.key.Event = if (self.inspector != null) ev: {
         var copy = event;
@@ -0,0 +1,213 @@
+//! This benchmark measures the throughput of transmitting raw (RGBA)
+//! Kitty graphics images the way a local image or video viewer does:
+//! each frame is written to a shared memory segment or temporary file by
+//! a producer and then transmitted to the terminal, replacing the previous
+//! frame. Each step transmits `--frames` frames, so frames per second is
+//! `frames / step time`.
+//!
+//! Use `--medium=direct` to compare against sending the pixels in the
+//! escape sequence payload (minus the base64 decoding).
+const KittyImageTransmit = @This();
+
+const std = @import("std");
+const builtin = @import("builtin");
+const Allocator = std.mem.Allocator;
+const terminalpkg = @import("../terminal/main.zig");
+const internal_os = @import("../os/main.zig");
+const Benchmark = @import("Benchmark.zig");
+const Terminal = terminalpkg.Terminal;
+const graphics = terminalpkg.kitty.graphics;
+
+const log = std.log.scoped(.@"kitty-image-transmit-bench");
+
+alloc: Allocator,
+opts: Options,
+terminal: Terminal,
+
+/// The pixels of a frame, filled during setup.
+frame: []u8 = &.{},
+
+/// The number of frames transmitted so far, used to vary the frames
+/// and to name the shared memory segments and files.
+count: u32 = 0,
+
+pub const Options = struct {
+    /// The size of each frame in pixels.
+    width: u32 = 1280,
+    height: u32 = 720,
+
+    /// The number of frames transmitted per step.
+    frames: u32 = 60,
+
+    /// How frames are transmitted.
+    medium: Medium = .@"shared-memory",
+};
+
+pub const Medium = enum {
+    direct,
+    @"shared-memory",
+    @"temporary-file",
+};
+
+pub fn create(
+    alloc: Allocator,
+    opts: Options,
+) !*KittyImageTransmit {
+    const ptr = try alloc.create(KittyImageTransmit);
+    errdefer alloc.destroy(ptr);
+
+    ptr.* = .{
+        .alloc = alloc,
+        .opts = opts,
+        .terminal = try .init(alloc, .{ .rows = 80, .cols = 120 }),
+    };
+
+    return ptr;
+}
+
+pub fn destroy(self: *KittyImageTransmit, alloc: Allocator) void {
+    alloc.free(self.frame);
+    self.terminal.deinit(alloc);
+    alloc.destroy(self);
+}
+
+pub fn benchmark(self: *KittyImageTransmit) Benchmark {
+    return .init(self, .{
+        .stepFn = step,
+        .setupFn = setup,
+    });
+}
+
+fn setup(ptr: *anyopaque) Benchmark.Error!void {
+    const self: *KittyImageTransmit = @ptrCast(@alignCast(ptr));
+
+    const len = @as(usize, self.opts.width) * self.opts.height * 4;
+    if (self.frame.len != len) {
+        self.alloc.free(self.frame);
+        self.frame = self.alloc.alloc(u8, len) catch |err| {
+            log.warn("error allocating frame err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+    }
+
+    // A gradient, so the frame isn't all zero pages.
+    for (self.frame, 0..) |*v, i| v.* = @truncate(i);
+}
+
+fn step(ptr: *anyopaque) Benchmark.Error!void {
+    const self: *KittyImageTransmit = @ptrCast(@alignCast(ptr));
+
+    for (0..self.opts.frames) |_| {
+        self.transmitFrame() catch |err| {
+            log.warn("error transmitting frame err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+    }
+}
+
+/// Produce the next frame and transmit it, replacing the last one.
+fn transmitFrame(self: *KittyImageTransmit) !void {
+    self.count +%= 1;
+
+    // Change a bit of every frame like a video would.
+    @memset(self.frame[0..@min(self.frame.len, 4096)], @truncate(self.count));
+
+    var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+    const data = switch (self.opts.medium) {
+        .direct => self.frame,
+        .@"shared-memory" => try self.writeSharedMemory(&path_buf),
+        .@"temporary-file" => try self.writeTemporaryFile(&path_buf),
+    };
+
+    var cmd: graphics.Command = .{
+        .control = .{ .transmit = .{
+            .format = .rgba,
+            .medium = switch (self.opts.medium) {
+                .direct => .direct,
+                .@"shared-memory" => .shared_memory,
+                .@"temporary-file" => .temporary_file,
+            },
+            .width = self.opts.width,
+            .height = self.opts.height,
+            .image_id = 1,
+        } },
+        .quiet = .failures,
+        .data = data,
+    };
+
+    if (self.terminal.kittyGraphics(self.alloc, &cmd)) |resp| {
+        if (!resp.ok()) {
+            log.warn("error transmitting frame message={s}", .{resp.message});
+            return error.TransmitFailed;
+        }
+    }
+}
+
+/// Write the frame to a new shared memory segment, returning its name.
+fn writeSharedMemory(self: *KittyImageTransmit, buf: []u8) ![]const u8 {
+    if (comptime builtin.os.tag == .windows or !builtin.link_libc) {
+        return error.UnsupportedMedium;
+    }
+
+    const name = try std.fmt.bufPrintZ(buf, "/ghostty-bench-{d}-{d}", .{
+        std.c.getpid(),
+        self.count,
+    });
+    const fd = std.c.shm_open(
+        name,
+        @as(c_int, @bitCast(std.c.O{ .ACCMODE = .RDWR, .CREAT = true, .EXCL = true })),
+        0o600,
+    );
+    if (fd < 0) return error.SharedMemoryOpenFailed;
+    defer std.posix.close(fd);
+    errdefer _ = std.c.shm_unlink(name);
+
+    try std.posix.ftruncate(fd, self.frame.len);
+    const map = try std.posix.mmap(
+        null,
+        self.frame.len,
+        std.posix.PROT.READ | std.posix.PROT.WRITE,
+        .{ .TYPE = .SHARED },
+        fd,
+        0,
+    );
+    defer std.posix.munmap(map);
+    @memcpy(map, self.frame);
+
+    return name;
+}
+
+/// Write the frame to a new temporary file, returning its path.
+fn writeTemporaryFile(self: *KittyImageTransmit, buf: []u8) ![]const u8 {
+    const tmp_dir = internal_os.allocTmpDir(self.alloc);
+    defer if (tmp_dir) |dir| internal_os.freeTmpDir(self.alloc, dir);
+
+    const path = try std.fmt.bufPrint(buf, "{s}/tty-graphics-protocol-ghostty-bench-{d}", .{
+        tmp_dir orelse "/tmp",
+        self.count,
+    });
+    try std.fs.cwd().writeFile(.{ .sub_path = path, .data = self.frame });
+    return path;
+}
+
+test KittyImageTransmit {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    const impl: *KittyImageTransmit = try .create(alloc, .{
+        .width = 16,
+        .height = 8,
+        .frames = 3,
+        .medium = .@"temporary-file",
+    });
+    defer impl.destroy(alloc);
+
+    const bench = impl.benchmark();
+    _ = try bench.run(.once);
+
+    // Only the last frame is kept.
+    const storage = &impl.terminal.screen.kitty_images;
+    const img = storage.imageById(1).?;
+    try testing.expectEqual(@as(u32, 16), img.width);
+    try testing.expectEqualSlices(u8, impl.frame, img.data);
+}
@@ -0,0 +1,165 @@
+//! This benchmark tests the performance of scrolling through the
+//! scrollback of a terminal screen. The data file is written to the
+//! terminal during setup (not benchmarked) and then each step scrolls
+//! from the top of the scrollback to the bottom one screen at a time,
+//! reading every cell of the viewport at each position as a renderer
+//! would.
+//!
+//! This is primarily useful to measure the effect of memory layout on
+//! walking large amounts of scrollback. Compare runs with `--huge-pages`
+//! (Linux only) to see the effect of huge page backed page memory.
+//!
+//! A good data set is a large amount of synthetic log output, i.e.
+//! `ghostty-gen ascii` piped to a file of the desired size.
+const ScreenScroll = @This();
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const terminalpkg = @import("../terminal/main.zig");
+const PagePool = @import("../terminal/PagePool.zig");
+const Benchmark = @import("Benchmark.zig");
+const options = @import("options.zig");
+const Terminal = terminalpkg.Terminal;
+const Stream = terminalpkg.Stream(*Handler);
+
+const log = std.log.scoped(.@"screen-scroll-bench");
+
+opts: Options,
+terminal: Terminal,
+handler: Handler,
+stream: Stream,
+
+pub const Options = struct {
+    /// The size of the terminal. This affects the number of pages
+    /// required to store the scrollback.
+    @"terminal-rows": u16 = 80,
+    @"terminal-cols": u16 = 120,
+
+    /// The maximum scrollback size in bytes. This should be large
+    /// enough to fit the entire data file if you want to scroll all of it.
+    @"max-scrollback": usize = 4 * 1024 * 1024 * 1024,
+
+    /// Allocate page memory from huge page backed chunks.
+    @"huge-pages": bool = false,
+
+    /// The data to read as a filepath. If this is "-" then
+    /// we will read stdin. If this is unset, then we will
+    /// do nothing (benchmark is a noop). It'd be more unixy to
+    /// use stdin by default but I find that a hanging CLI command
+    /// with no interaction is a bit annoying.
+    data: ?[]const u8 = null,
+};
+
+pub fn create(
+    alloc: Allocator,
+    opts: Options,
+) !*ScreenScroll {
+    // This must be set before the terminal allocates any pages.
+    PagePool.global().setHugePages(opts.@"huge-pages");
+
+    const ptr = try alloc.create(ScreenScroll);
+    errdefer alloc.destroy(ptr);
+
+    ptr.* = .{
+        .opts = opts,
+        .terminal = try .init(alloc, .{
+            .rows = opts.@"terminal-rows",
+            .cols = opts.@"terminal-cols",
+            .max_scrollback = opts.@"max-scrollback",
+        }),
+        .handler = .{ .t = &ptr.terminal },
+        .stream = .init(&ptr.handler),
+    };
+
+    return ptr;
+}
+
+pub fn destroy(self: *ScreenScroll, alloc: Allocator) void {
+    self.terminal.deinit(alloc);
+    alloc.destroy(self);
+}
+
+pub fn benchmark(self: *ScreenScroll) Benchmark {
+    return .init(self, .{
+        .stepFn = step,
+        .setupFn = setup,
+    });
+}
+
+fn setup(ptr: *anyopaque) Benchmark.Error!void {
+    const self: *ScreenScroll = @ptrCast(@alignCast(ptr));
+
+    // Always reset our terminal state
+    self.terminal.fullReset();
+
+    // Write our data file (if any) into the terminal.
+    const f = options.dataFile(self.opts.data) catch |err| {
+        log.warn("error opening data file err={}", .{err});
+        return error.BenchmarkFailed;
+    } orelse return;
+    defer f.close();
+
+    var r = std.io.bufferedReader(f.reader());
+    var buf: [4096]u8 = undefined;
+    while (true) {
+        const n = r.read(&buf) catch |err| {
+            log.warn("error reading data file err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+        if (n == 0) break; // EOF reached
+        self.stream.nextSlice(buf[0..n]) catch |err| {
+            log.warn("error processing data file chunk err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+    }
+}
+
+fn step(ptr: *anyopaque) Benchmark.Error!void {
+    const self: *ScreenScroll = @ptrCast(@alignCast(ptr));
+    const pages = &self.terminal.screen.pages;
+
+    var sum: u64 = 0;
+    pages.scroll(.top);
+    while (true) {
+        // Read every cell in the viewport.
+        var it = pages.rowIterator(.right_down, .{ .viewport = .{} }, null);
+        while (it.next()) |row| {
+            for (row.cells(.all)) |cell| sum +%= cell.codepoint();
+        }
+
+        if (pages.viewport == .active) break;
+        pages.scroll(.{ .delta_row = self.terminal.rows });
+    }
+
+    // Make sure the reads aren't optimized away.
+    std.mem.doNotOptimizeAway(sum);
+}
+
+/// Implements the handler interface for the terminal.Stream. We only
+/// need enough to build up realistic scrollback.
+const Handler = struct {
+    t: *Terminal,
+
+    pub fn print(self: *Handler, cp: u21) !void {
+        try self.t.print(cp);
+    }
+
+    pub fn linefeed(self: *Handler) !void {
+        try self.t.linefeed();
+    }
+
+    pub fn carriageReturn(self: *Handler) !void {
+        self.t.carriageReturn();
+    }
+};
+
+test ScreenScroll {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    const impl: *ScreenScroll = try .create(alloc, .{});
+    defer impl.destroy(alloc);
+
+    const bench = impl.benchmark();
+    _ = try bench.run(.once);
+}
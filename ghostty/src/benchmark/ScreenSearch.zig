@@ -0,0 +1,236 @@
+//! This benchmark tests the performance of searching the scrollback
+//! of a terminal screen. The data file is written to the terminal during
+//! setup (not benchmarked) and then each step searches the entire screen
+//! for the needle.
+//!
+//! The setup also performs one untimed search so that page summaries
+//! are built. The timed search therefore measures the repeated search
+//! case, which is what page summaries are designed to accelerate. Compare
+//! runs with `--summaries=false` to see the difference. The memory
+//! overhead of summaries is logged during setup.
+//!
+//! With `--regex` the needle is treated as a regular expression and
+//! the search uses RegexSearch instead, which doesn't use summaries.
+//!
+//! With `--huge-pages` page memory is allocated from huge page backed
+//! chunks (Linux only). Compare with `--summaries=false` to measure the
+//! effect of fewer TLB misses on a full scan of the scrollback.
+//!
+//! A good data set is a large amount of synthetic log output, i.e.
+//! `ghostty-gen ascii` piped to a file of the desired size.
+const ScreenSearch = @This();
+
+const std = @import("std");
+const assert = std.debug.assert;
+const Allocator = std.mem.Allocator;
+const oni = @import("oniguruma");
+const terminalpkg = @import("../terminal/main.zig");
+const PagePool = @import("../terminal/PagePool.zig");
+const PageSummary = @import("../terminal/PageSummary.zig");
+const Benchmark = @import("Benchmark.zig");
+const options = @import("options.zig");
+const Terminal = terminalpkg.Terminal;
+const Stream = terminalpkg.Stream(*Handler);
+
+const log = std.log.scoped(.@"screen-search-bench");
+
+opts: Options,
+terminal: Terminal,
+handler: Handler,
+stream: Stream,
+
+pub const Options = struct {
+    /// The size of the terminal. This affects the number of pages
+    /// required to store the scrollback.
+    @"terminal-rows": u16 = 80,
+    @"terminal-cols": u16 = 120,
+
+    /// The maximum scrollback size in bytes. This should be large
+    /// enough to fit the entire data file if you want to search all of it.
+    @"max-scrollback": usize = 4 * 1024 * 1024 * 1024,
+
+    /// The needle to search for.
+    needle: []const u8 = "needle",
+
+    /// Whether to use page summaries to skip pages during search.
+    summaries: bool = true,
+
+    /// Treat the needle as a regular expression.
+    regex: bool = false,
+
+    /// Allocate page memory from huge page backed chunks.
+    @"huge-pages": bool = false,
+
+    /// The data to read as a filepath. If this is "-" then
+    /// we will read stdin. If this is unset, then we will
+    /// do nothing (benchmark is a noop). It'd be more unixy to
+    /// use stdin by default but I find that a hanging CLI command
+    /// with no interaction is a bit annoying.
+    data: ?[]const u8 = null,
+};
+
+pub fn create(
+    alloc: Allocator,
+    opts: Options,
+) !*ScreenSearch {
+    // Regex search requires oniguruma to be initialized, which is
+    // normally done by our global state.
+    if (opts.regex) try oni.init(&.{oni.Encoding.utf8});
+
+    // This must be set before the terminal allocates any pages.
+    PagePool.global().setHugePages(opts.@"huge-pages");
+
+    const ptr = try alloc.create(ScreenSearch);
+    errdefer alloc.destroy(ptr);
+
+    ptr.* = .{
+        .opts = opts,
+        .terminal = try .init(alloc, .{
+            .rows = opts.@"terminal-rows",
+            .cols = opts.@"terminal-cols",
+            .max_scrollback = opts.@"max-scrollback",
+        }),
+        .handler = .{ .t = &ptr.terminal },
+        .stream = .init(&ptr.handler),
+    };
+
+    return ptr;
+}
+
+pub fn destroy(self: *ScreenSearch, alloc: Allocator) void {
+    self.terminal.deinit(alloc);
+    alloc.destroy(self);
+}
+
+pub fn benchmark(self: *ScreenSearch) Benchmark {
+    return .init(self, .{
+        .stepFn = step,
+        .setupFn = setup,
+    });
+}
+
+fn setup(ptr: *anyopaque) Benchmark.Error!void {
+    const self: *ScreenSearch = @ptrCast(@alignCast(ptr));
+
+    // Always reset our terminal state
+    self.terminal.fullReset();
+
+    // Write our data file (if any) into the terminal.
+    const f = options.dataFile(self.opts.data) catch |err| {
+        log.warn("error opening data file err={}", .{err});
+        return error.BenchmarkFailed;
+    } orelse return;
+    defer f.close();
+
+    var r = std.io.bufferedReader(f.reader());
+    var buf: [4096]u8 = undefined;
+    while (true) {
+        const n = r.read(&buf) catch |err| {
+            log.warn("error reading data file err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+        if (n == 0) break; // EOF reached
+        self.stream.nextSlice(buf[0..n]) catch |err| {
+            log.warn("error processing data file chunk err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+    }
+
+    // Build our summaries with an untimed search.
+    const matches = try self.search();
+
+    const pages = &self.terminal.screen.pages;
+    var count: usize = 0;
+    var it = pages.pages.first;
+    while (it) |node| : (it = node.next) count += 1;
+    log.info("pages={} page_bytes={} summary_bytes={} matches={}", .{
+        count,
+        pages.page_size,
+        count * @sizeOf(PageSummary),
+        matches,
+    });
+}
+
+fn step(ptr: *anyopaque) Benchmark.Error!void {
+    const self: *ScreenSearch = @ptrCast(@alignCast(ptr));
+    std.mem.doNotOptimizeAway(try self.search());
+}
+
+/// Search the entire screen and return the number of matches.
+fn search(self: *ScreenSearch) Benchmark.Error!usize {
+    if (self.opts.regex) return try self.searchRegex();
+
+    const alloc = self.terminal.screen.alloc;
+    var s = terminalpkg.search.PageListSearch.init(
+        alloc,
+        &self.terminal.screen.pages,
+        self.opts.needle,
+    ) catch return error.BenchmarkFailed;
+    defer s.deinit(alloc);
+    s.summaries = self.opts.summaries;
+
+    var count: usize = 0;
+    while (s.next(alloc) catch return error.BenchmarkFailed) |_| count += 1;
+    return count;
+}
+
+fn searchRegex(self: *ScreenSearch) Benchmark.Error!usize {
+    const alloc = self.terminal.screen.alloc;
+    var re = oni.Regex.init(
+        self.opts.needle,
+        .{},
+        oni.Encoding.utf8,
+        oni.Syntax.default,
+        null,
+    ) catch |err| {
+        log.warn("invalid regex err={}", .{err});
+        return error.BenchmarkFailed;
+    };
+    defer re.deinit();
+
+    var s = terminalpkg.search.RegexSearch.init(
+        alloc,
+        &self.terminal.screen.pages,
+        &re,
+    ) catch return error.BenchmarkFailed;
+    defer s.deinit(alloc);
+
+    var results: std.ArrayListUnmanaged(terminalpkg.Selection) = .{};
+    defer results.deinit(alloc);
+    var count: usize = 0;
+    while (s.next(alloc, &results) catch return error.BenchmarkFailed) {
+        count += results.items.len;
+        results.clearRetainingCapacity();
+    }
+
+    return count;
+}
+
+/// Implements the handler interface for the terminal.Stream. We only
+/// need enough to build up realistic scrollback.
+const Handler = struct {
+    t: *Terminal,
+
+    pub fn print(self: *Handler, cp: u21) !void {
+        try self.t.print(cp);
+    }
+
+    pub fn linefeed(self: *Handler) !void {
+        try self.t.linefeed();
+    }
+
+    pub fn carriageReturn(self: *Handler) !void {
+        self.t.carriageReturn();
+    }
+};
+
+test ScreenSearch {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    const impl: *ScreenSearch = try .create(alloc, .{});
+    defer impl.destroy(alloc);
+
+    const bench = impl.benchmark();
+    _ = try bench.run(.once);
+}
@@ -0,0 +1,186 @@
+//! This benchmark measures codepoint and glyph lookups in a font
+//! SharedGrid from multiple threads at once, as happens when many
+//! surfaces share a grid and their renderers rebuild at the same time.
+//! Every glyph is rendered during setup so each step only measures
+//! lookups that hit the cache.
+//!
+//! Run with `--threads` from 1 to 16 to see how lookups scale with the
+//! number of renderer threads. Ideally the time per step stays flat.
+const SharedGridLookup = @This();
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const font = @import("../font/main.zig");
+const Benchmark = @import("Benchmark.zig");
+
+const log = std.log.scoped(.@"shared-grid-lookup-bench");
+
+alloc: Allocator,
+opts: Options,
+lib: font.Library,
+grid: font.SharedGrid,
+
+/// The glyph index of every character we look up, found during setup.
+/// The renderer gets these from shaping so we don't measure this.
+glyphs: [chars.len]?u32 = @splat(null),
+
+/// The characters looked up in each step: printable ASCII.
+const chars: [95]u8 = chars: {
+    var result: [95]u8 = undefined;
+    for (&result, 32..) |*c, i| c.* = @intCast(i);
+    break :chars result;
+};
+
+pub const Options = struct {
+    /// The number of threads looking up glyphs at the same time.
+    threads: u8 = 1,
+
+    /// The number of times each thread looks up every printable
+    /// ASCII character in each step.
+    iterations: u32 = 1000,
+};
+
+pub fn create(
+    alloc: Allocator,
+    opts: Options,
+) !*SharedGridLookup {
+    const ptr = try alloc.create(SharedGridLookup);
+    errdefer alloc.destroy(ptr);
+
+    var lib = try font.Library.init(alloc);
+    errdefer lib.deinit();
+
+    var c: font.Collection = .init();
+    c.load_options = .{ .library = lib };
+    _ = try c.add(alloc, try .init(
+        lib,
+        font.embedded.regular,
+        .{ .size = .{ .points = 12, .xdpi = 96, .ydpi = 96 } },
+    ), .{
+        .style = .regular,
+        .fallback = false,
+        .size_adjustment = .none,
+    });
+
+    var r: font.CodepointResolver = .{ .collection = c };
+    errdefer r.deinit(alloc);
+
+    ptr.* = .{
+        .alloc = alloc,
+        .opts = opts,
+        .lib = lib,
+        .grid = try .init(alloc, r),
+    };
+
+    return ptr;
+}
+
+pub fn destroy(self: *SharedGridLookup, alloc: Allocator) void {
+    self.grid.deinit(alloc);
+    self.lib.deinit();
+    alloc.destroy(self);
+}
+
+pub fn benchmark(self: *SharedGridLookup) Benchmark {
+    return .init(self, .{
+        .stepFn = step,
+        .setupFn = setup,
+    });
+}
+
+fn setup(ptr: *anyopaque) Benchmark.Error!void {
+    const self: *SharedGridLookup = @ptrCast(@alignCast(ptr));
+
+    for (chars, &self.glyphs) |c, *glyph| {
+        const idx = self.grid.getIndex(
+            self.alloc,
+            c,
+            .regular,
+            null,
+        ) catch |err| {
+            log.warn("error finding font err={}", .{err});
+            return error.BenchmarkFailed;
+        } orelse continue;
+        const face = self.grid.resolver.collection.getFace(idx) catch |err| {
+            log.warn("error loading face err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+        glyph.* = face.glyphIndex(c);
+    }
+
+    // Render everything once so the steps only measure cache hits.
+    _ = self.lookupAll() catch |err| {
+        log.warn("error rendering glyphs err={}", .{err});
+        return error.BenchmarkFailed;
+    };
+}
+
+fn step(ptr: *anyopaque) Benchmark.Error!void {
+    const self: *SharedGridLookup = @ptrCast(@alignCast(ptr));
+
+    var threads: [std.math.maxInt(u8)]std.Thread = undefined;
+    const n = @max(self.opts.threads, 1);
+    var failed: std.atomic.Value(bool) = .init(false);
+    for (threads[0..n], 0..) |*thread, i| {
+        thread.* = std.Thread.spawn(.{}, worker, .{ self, &failed }) catch |err| {
+            for (threads[0..i]) |t| t.join();
+            log.warn("error spawning thread err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+    }
+
+    for (threads[0..n]) |thread| thread.join();
+    if (failed.load(.monotonic)) return error.BenchmarkFailed;
+}
+
+fn worker(self: *SharedGridLookup, failed: *std.atomic.Value(bool)) void {
+    var sum: u64 = 0;
+    for (0..self.opts.iterations) |_| {
+        sum +%= self.lookupAll() catch {
+            failed.store(true, .monotonic);
+            return;
+        };
+    }
+
+    // Make sure the lookups aren't optimized away.
+    std.mem.doNotOptimizeAway(sum);
+}
+
+/// Look up the font and render the glyph of every character, the same
+/// way the renderer does while shaping and building a row of text.
+fn lookupAll(self: *SharedGridLookup) !u64 {
+    const opts: font.face.RenderOptions = .{ .grid_metrics = self.grid.metrics };
+
+    var sum: u64 = 0;
+    for (chars, self.glyphs) |c, glyph| {
+        const idx = try self.grid.getIndex(
+            self.alloc,
+            c,
+            .regular,
+            null,
+        ) orelse continue;
+        const render = try self.grid.renderGlyph(
+            self.alloc,
+            idx,
+            glyph orelse continue,
+            opts,
+        );
+        sum +%= render.glyph.atlas_x;
+    }
+
+    return sum;
+}
+
+test SharedGridLookup {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    const impl: *SharedGridLookup = try .create(alloc, .{
+        .threads = 2,
+        .iterations = 1,
+    });
+    defer impl.destroy(alloc);
+
+    const bench = impl.benchmark();
+    _ = try bench.run(.once);
+}
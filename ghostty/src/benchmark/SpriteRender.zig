@@ -0,0 +1,168 @@
+//! This benchmark measures rendering every glyph of the built-in sprite
+//! face (box drawing, block elements, powerline symbols, legacy computing
+//! symbols, decorations, etc.) into an atlas, as happens whenever a new
+//! font size is used.
+//!
+//! By default each step renders every sprite at a few common cell sizes,
+//! since the cost of drawing depends a lot on the number of pixels. Use
+//! `--size` to only render at one cell height.
+const SpriteRender = @This();
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const font = @import("../font/main.zig");
+const Benchmark = @import("Benchmark.zig");
+
+const log = std.log.scoped(.@"sprite-render-bench");
+
+alloc: Allocator,
+opts: Options,
+
+/// The atlas we render into, cleared whenever it fills up.
+atlas: font.Atlas,
+
+/// Every codepoint the sprite face can render, found during setup.
+codepoints: std.ArrayListUnmanaged(u32) = .empty,
+
+/// The cell heights rendered when no size is given. Cells are half
+/// as wide as they are tall, which is typical for monospace fonts.
+const default_sizes: []const u32 = &.{ 16, 24, 40, 64 };
+
+pub const Options = struct {
+    /// The cell height to render at. If this isn't set then we render
+    /// at each of a few sizes from small to large (HiDPI) cells.
+    size: ?u32 = null,
+};
+
+pub fn create(
+    alloc: Allocator,
+    opts: Options,
+) !*SpriteRender {
+    const ptr = try alloc.create(SpriteRender);
+    errdefer alloc.destroy(ptr);
+
+    ptr.* = .{
+        .alloc = alloc,
+        .opts = opts,
+        .atlas = try .init(alloc, 1024, .grayscale),
+    };
+
+    return ptr;
+}
+
+pub fn destroy(self: *SpriteRender, alloc: Allocator) void {
+    self.codepoints.deinit(alloc);
+    self.atlas.deinit(alloc);
+    alloc.destroy(self);
+}
+
+pub fn benchmark(self: *SpriteRender) Benchmark {
+    return .init(self, .{
+        .stepFn = step,
+        .setupFn = setup,
+    });
+}
+
+fn setup(ptr: *anyopaque) Benchmark.Error!void {
+    const self: *SpriteRender = @ptrCast(@alignCast(ptr));
+
+    self.codepoints.clearRetainingCapacity();
+    self.atlas.clear();
+
+    // Sprite glyphs are all in the symbol planes of the BMP and SMP,
+    // plus our own special sprites above the Unicode range.
+    const face: font.SpriteFace = .{ .metrics = metrics(16) };
+    for (0x2500..0x1FC00) |cp| {
+        if (!face.hasCodepoint(@intCast(cp), null)) continue;
+        self.codepoints.append(self.alloc, @intCast(cp)) catch |err| {
+            log.warn("error collecting codepoints err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+    }
+    for (std.enums.values(font.Sprite)) |sprite| {
+        self.codepoints.append(self.alloc, @intFromEnum(sprite)) catch |err| {
+            log.warn("error collecting codepoints err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+    }
+}
+
+fn step(ptr: *anyopaque) Benchmark.Error!void {
+    const self: *SpriteRender = @ptrCast(@alignCast(ptr));
+
+    if (self.opts.size) |size| {
+        self.renderAll(size) catch |err| {
+            log.warn("error rendering sprites err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+        return;
+    }
+
+    for (default_sizes) |size| {
+        self.renderAll(size) catch |err| {
+            log.warn("error rendering sprites err={}", .{err});
+            return error.BenchmarkFailed;
+        };
+    }
+}
+
+/// Render every sprite once with the given cell height.
+fn renderAll(self: *SpriteRender, height: u32) !void {
+    const face: font.SpriteFace = .{ .metrics = metrics(height) };
+    const opts: font.face.RenderOptions = .{ .grid_metrics = face.metrics };
+
+    var sum: u64 = 0;
+    for (self.codepoints.items) |cp| {
+        const glyph = face.renderGlyph(
+            self.alloc,
+            &self.atlas,
+            cp,
+            opts,
+        ) catch |err| switch (err) {
+            // We only care about rendering, so just start
+            // over with an empty atlas when it's full.
+            error.AtlasFull => retry: {
+                self.atlas.clear();
+                break :retry try face.renderGlyph(
+                    self.alloc,
+                    &self.atlas,
+                    cp,
+                    opts,
+                );
+            },
+
+            else => return err,
+        };
+        sum +%= glyph.atlas_x;
+    }
+
+    // Make sure the renders aren't optimized away.
+    std.mem.doNotOptimizeAway(sum);
+}
+
+/// Grid metrics for a cell of the given height, calculated the same
+/// way as they would be for a typical monospace font.
+fn metrics(height: u32) font.Metrics {
+    const h: f64 = @floatFromInt(@max(height, 2));
+    return .calc(.{
+        .px_per_em = h * 0.8,
+        .cell_width = @round(h / 2),
+        .ascent = @round(h * 0.8),
+        .descent = -@round(h * 0.2),
+        .line_gap = 0.0,
+        .underline_thickness = @max(1, @round(h / 16)),
+        .strikethrough_thickness = @max(1, @round(h / 16)),
+    });
+}
+
+test SpriteRender {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    const impl: *SpriteRender = try .create(alloc, .{ .size = 12 });
+    defer impl.destroy(alloc);
+
+    const bench = impl.benchmark();
+    _ = try bench.run(.once);
+    try testing.expect(impl.codepoints.items.len > 0);
+}
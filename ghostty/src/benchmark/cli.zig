@@ -8,6 +8,11 @@ const cli = @import("../cli.zig");
 pub const Action = enum {
     @"codepoint-width",
     @"grapheme-break",
+    @"kitty-image-transmit",
+    @"screen-scroll",
+    @"screen-search",
+    @"shared-grid-lookup",
+    @"sprite-render",
     @"terminal-parser",
     @"terminal-stream",
 
@@ -24,6 +29,11 @@ pub const Action = enum {
             .@"terminal-stream" => @import("TerminalStream.zig"),
             .@"codepoint-width" => @import("CodepointWidth.zig"),
             .@"grapheme-break" => @import("GraphemeBreak.zig"),
+            .@"kitty-image-transmit" => @import("KittyImageTransmit.zig"),
+            .@"screen-scroll" => @import("ScreenScroll.zig"),
+            .@"screen-search" => @import("ScreenSearch.zig"),
+            .@"shared-grid-lookup" => @import("SharedGridLookup.zig"),
+            .@"sprite-render" => @import("SpriteRender.zig"),
             .@"terminal-parser" => @import("TerminalParser.zig"),
         };
     }
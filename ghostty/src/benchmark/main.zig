@@ -4,7 +4,12 @@ pub const CApi = @import("CApi.zig");
 pub const TerminalStream = @import("TerminalStream.zig");
 pub const CodepointWidth = @import("CodepointWidth.zig");
 pub const GraphemeBreak = @import("GraphemeBreak.zig");
+pub const KittyImageTransmit = @import("KittyImageTransmit.zig");
 pub const TerminalParser = @import("TerminalParser.zig");
+pub const ScreenScroll = @import("ScreenScroll.zig");
+pub const ScreenSearch = @import("ScreenSearch.zig");
+pub const SharedGridLookup = @import("SharedGridLookup.zig");
+pub const SpriteRender = @import("SpriteRender.zig");
 
 test {
     @import("std").testing.refAllDecls(@This());
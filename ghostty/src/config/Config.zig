@@ -1091,6 +1091,37 @@ input: RepeatableReadableIO = .{},
 /// This can be changed at runtime but will only affect new terminal surfaces.
 @"scrollback-limit": usize = 10_000_000, // 10MB
 
+/// The total size (in bytes) of scrollback that may be retained across
+/// all terminal surfaces. When this is exceeded, scrollback is removed
+/// from the surfaces that have been idle the longest first. The active
+/// area of a terminal is never removed so this is a soft limit.
+///
+/// This is independent of `scrollback-limit`, which limits each surface.
+/// A value of zero (the default) means there is no total limit.
+///
+/// Each surface checks the total against the value it was last configured
+/// with, so changing this at runtime applies to the surfaces that receive
+/// the new configuration.
+@"scrollback-total-limit": usize = 0,
+
+/// Allocate scrollback memory using transparent huge pages (2 MiB). This
+/// packs several scrollback pages into each huge page which reduces TLB
+/// misses when scrolling or searching large amounts of scrollback, at
+/// the cost of allocating memory in larger increments.
+///
+/// This requires transparent huge pages to be enabled in `madvise` or
+/// `always` mode (see `/sys/kernel/mm/transparent_hugepage/enabled`).
+///
+/// This only affects memory allocated after it is set.
+///
+/// All surfaces allocate scrollback from the same memory, so this is a
+/// single value for the whole process: whenever a surface is created or
+/// its configuration changes, its value replaces the current one for all
+/// surfaces. The last surface to set it wins.
+///
+/// This is only supported on Linux.
+@"scrollback-huge-pages": bool = false,
+
 /// Match a regular expression against the terminal text and associate clicking
 /// it with an action. This can be used to match URLs, file paths, etc. Actions
 /// can be opening using the system opener (e.g. `open` or `xdg-open`) or
@@ -1526,6 +1557,19 @@ keybind: Keybinds = .{},
 /// This setting is only supported currently on macOS.
 @"window-vsync": bool = true,
 
+/// The number of threads used to build the GPU cell data for a frame when
+/// the entire screen must be rebuilt, such as after a resize or a color
+/// change. Very large grids (a small font on a high resolution display)
+/// can exceed the frame budget when rebuilt on a single thread.
+///
+/// The rows of the screen are split into this many bands which are built
+/// in parallel. A value of `0` chooses automatically based on the number
+/// of CPUs, up to 4. A value of `1` disables parallel rebuilds. The maximum
+/// is 8. Partial rebuilds (only changed rows) always use a single thread.
+///
+/// Changing this value at runtime will only affect new terminals.
+@"renderer-threads": u8 = 0,
+
 /// If true, new windows and tabs will inherit the working directory of the
 /// previously focused window. If no window was previously focused, the default
 /// working directory will be used (the `working-directory` option).
@@ -0,0 +1,255 @@
+const std = @import("std");
+const assert = std.debug.assert;
+const Allocator = std.mem.Allocator;
+
+/// A fixed size hash table that can be read by any number of threads
+/// without taking a lock, intended as a fast path in front of a larger
+/// locked map of values that rarely change once inserted.
+///
+/// Keys are u64 values, which are compared exactly. Callers with larger
+/// keys should pack them (see font.SharedGrid). Values must be plain data
+/// that can be copied byte for byte.
+///
+/// Writes (`put`, `clear`) must be serialized by the caller, typically
+/// by only writing while holding the lock of the map this sits in front
+/// of. Reads may happen at any time, concurrently with a write.
+///
+/// Every slot is protected by a sequence number: a writer makes it odd
+/// while writing and even when done, and a reader retries the lookup as
+/// a miss if the sequence number changed while it read the slot. All
+/// slot memory is read and written with atomics so there are no data
+/// races, only torn reads that are detected and discarded.
+///
+/// The table never removes individual entries. `clear` invalidates every
+/// entry at once by bumping the table generation, which is stored in the
+/// high bits of each slot's sequence number, and slots from previous
+/// generations are reused by later writes. This means we never free
+/// memory that a reader may be looking at. If the table gets too full it
+/// clears itself, since a lookup that misses is always allowed to fall
+/// back to the locked map.
+///
+/// Parameters:
+///
+/// `V`
+///   The type of values.
+///
+/// `capacity`
+///   The number of slots. This must be a power of 2. The table is cleared
+///   when it reaches 3/4 of this.
+///
+pub fn ConcurrentTable(
+    comptime V: type,
+    comptime capacity: usize,
+) type {
+    return struct {
+        const Self = @This();
+
+        pub const Value = V;
+
+        comptime {
+            assert(std.math.isPowerOfTwo(capacity));
+        }
+
+        /// The number of u64 words a value takes up.
+        const value_words = std.math.divCeil(usize, @sizeOf(V), 8) catch unreachable;
+
+        /// The maximum number of slots a lookup or insert probes.
+        const probe_limit = 8;
+
+        /// Shift for the top bits of the hash, which pick the first slot.
+        const hash_shift: u6 = @intCast(64 - @ctz(@as(u64, capacity)));
+
+        const Slot = struct {
+            /// The high 32 bits are the generation this slot was written
+            /// in and the low 32 bits are a counter that is odd while
+            /// the slot is being written.
+            seq: std.atomic.Value(u64) = .init(0),
+            key: std.atomic.Value(u64) = .init(0),
+            value: [value_words]std.atomic.Value(u64) = @splat(.init(0)),
+        };
+
+        slots: []Slot,
+
+        /// The current generation. Slots from any other generation are
+        /// empty. This is never zero so that new slots are empty.
+        generation: std.atomic.Value(u32) = .init(1),
+
+        /// The number of entries written in the current generation. This
+        /// is only accessed by writers.
+        len: usize = 0,
+
+        pub fn init(alloc: Allocator) Allocator.Error!Self {
+            const slots = try alloc.alloc(Slot, capacity);
+            @memset(slots, .{});
+            return .{ .slots = slots };
+        }
+
+        /// Deinit. Assumes no concurrent access.
+        pub fn deinit(self: *Self, alloc: Allocator) void {
+            alloc.free(self.slots);
+        }
+
+        /// Get the value for the given key, or null if it's not in
+        /// the table. This never blocks.
+        pub fn get(self: *const Self, key: u64) ?V {
+            const gen = self.generation.load(.acquire);
+            var i = index(key);
+            for (0..probe_limit) |_| {
+                const slot = &self.slots[i];
+                const seq = slot.seq.load(.acquire);
+
+                // An empty slot ends the probe. A slot being written may
+                // be the one we want but we just treat it as a miss.
+                if (seq >> 32 != gen or seq & 1 == 1) return null;
+
+                // The acquire loads ensure the second load of the sequence
+                // number happens after we're done reading the slot.
+                const k = slot.key.load(.acquire);
+                var words: [value_words]u64 = undefined;
+                for (&words, &slot.value) |*w, *v| w.* = v.load(.acquire);
+                if (slot.seq.load(.monotonic) != seq) return null;
+
+                if (k == key) {
+                    var value: V = undefined;
+                    @memcpy(
+                        std.mem.asBytes(&value),
+                        std.mem.asBytes(&words)[0..@sizeOf(V)],
+                    );
+                    return value;
+                }
+
+                i = (i + 1) % capacity;
+            }
+
+            return null;
+        }
+
+        /// Insert a value for the given key. If the key is already in the
+        /// table the existing value is kept, since values are expected
+        /// to never change for a key within a generation. If there's no
+        /// room along the key's probe sequence the value isn't inserted,
+        /// which only means lookups for it will miss.
+        ///
+        /// The caller must serialize all writes.
+        pub fn put(self: *Self, key: u64, value: V) void {
+            if (self.len >= capacity / 4 * 3) self.clear();
+
+            const gen = self.generation.load(.monotonic);
+            var i = index(key);
+            for (0..probe_limit) |_| {
+                const slot = &self.slots[i];
+                const seq = slot.seq.load(.monotonic);
+                if (seq >> 32 == gen) {
+                    if (slot.key.load(.monotonic) == key) return;
+                    i = (i + 1) % capacity;
+                    continue;
+                }
+
+                var words: [value_words]u64 = @splat(0);
+                @memcpy(
+                    std.mem.asBytes(&words)[0..@sizeOf(V)],
+                    std.mem.asBytes(&value),
+                );
+
+                // Mark the slot as being written. The release stores of
+                // the contents ensure that any reader that sees them also
+                // sees this mark, or a later sequence number.
+                const counter: u32 = @truncate(seq);
+                slot.seq.store(seq & ~@as(u64, 0xFFFF_FFFF) | (counter +% 1), .monotonic);
+                slot.key.store(key, .release);
+                for (&slot.value, words) |*v, w| v.store(w, .release);
+                slot.seq.store(@as(u64, gen) << 32 | (counter +% 2), .release);
+
+                self.len += 1;
+                return;
+            }
+        }
+
+        /// Remove all entries from the table.
+        ///
+        /// The caller must serialize all writes.
+        pub fn clear(self: *Self) void {
+            var gen = self.generation.load(.monotonic) +% 1;
+            if (gen == 0) gen = 1;
+            self.generation.store(gen, .release);
+            self.len = 0;
+        }
+
+        fn index(key: u64) usize {
+            // Fibonacci hashing, since packed keys are rarely
+            // well distributed in their low bits.
+            const hash = key *% 0x9E3779B97F4A7C15;
+            return @intCast(hash >> hash_shift);
+        }
+    };
+}
+
+test ConcurrentTable {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    const Value = struct { a: u32, b: u8 };
+    const Table = ConcurrentTable(Value, 16);
+
+    var t: Table = try .init(alloc);
+    defer t.deinit(alloc);
+
+    try testing.expectEqual(null, t.get(0));
+    t.put(0, .{ .a = 1, .b = 2 });
+    t.put(42, .{ .a = 3, .b = 4 });
+    try testing.expectEqual(Value{ .a = 1, .b = 2 }, t.get(0).?);
+    try testing.expectEqual(Value{ .a = 3, .b = 4 }, t.get(42).?);
+    try testing.expectEqual(null, t.get(1));
+
+    // Existing values are kept.
+    t.put(42, .{ .a = 5, .b = 6 });
+    try testing.expectEqual(Value{ .a = 3, .b = 4 }, t.get(42).?);
+
+    // Clearing removes everything and slots are reused.
+    t.clear();
+    try testing.expectEqual(null, t.get(0));
+    try testing.expectEqual(null, t.get(42));
+    t.put(42, .{ .a = 5, .b = 6 });
+    try testing.expectEqual(Value{ .a = 5, .b = 6 }, t.get(42).?);
+
+    // Filling the table clears it rather than failing.
+    for (0..64) |i| t.put(i + 100, .{ .a = @intCast(i), .b = 0 });
+    try testing.expect(t.len < 12);
+}
+
+test "ConcurrentTable concurrent readers" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    const Table = ConcurrentTable([4]u64, 64);
+    var t: Table = try .init(alloc);
+    defer t.deinit(alloc);
+
+    // Readers check that every value they see is consistent
+    // while the writer repeatedly fills and clears the table.
+    const Reader = struct {
+        fn run(table: *const Table, done: *const std.atomic.Value(bool), torn: *std.atomic.Value(usize)) void {
+            while (!done.load(.acquire)) {
+                for (0..32) |k| if (table.get(k)) |v| {
+                    if (v[0] != k or v[1] != v[2] or v[2] != v[3]) {
+                        _ = torn.fetchAdd(1, .monotonic);
+                    }
+                };
+            }
+        }
+    };
+
+    var done: std.atomic.Value(bool) = .init(false);
+    var torn: std.atomic.Value(usize) = .init(0);
+    var threads: [4]std.Thread = undefined;
+    for (&threads) |*thread| thread.* = try .spawn(.{}, Reader.run, .{ &t, &done, &torn });
+
+    for (0..1000) |round| {
+        for (0..32) |k| t.put(k, .{ k, round, round, round });
+        t.clear();
+    }
+
+    done.store(true, .release);
+    for (threads) |thread| thread.join();
+    try testing.expectEqual(0, torn.load(.monotonic));
+}
@@ -49,6 +49,21 @@ modified: std.atomic.Value(usize) = .{ .raw = 0 },
 /// a resize operation.
 resized: std.atomic.Value(usize) = .{ .raw = 0 },
 
+/// The rows written by the most recent modifications, indexed by the
+/// value of `modified` after each one modulo the length. This lets users
+/// that keep a copy of the texture data only update what changed, see
+/// `dirtyRows`.
+dirty: [dirty_len]Rows = undefined,
+
+/// The value of `modified` after the most recent modification that
+/// affected the entire atlas, i.e. clearing or growing it.
+dirty_all: usize = 0,
+
+/// The number of modifications we keep track of in `dirty`. If more than
+/// this many modifications happened since a user last copied the data,
+/// the user must copy everything.
+const dirty_len = 64;
+
 pub const Format = enum(u8) {
     /// 1 byte per pixel grayscale.
     grayscale = 0,
@@ -72,6 +87,12 @@ const Node = struct {
     width: u32,
 };
 
+/// A range of rows within the texture.
+pub const Rows = struct {
+    y: u32,
+    height: u32,
+};
+
 pub const Error = error{
     /// Atlas cannot fit the desired region. You must enlarge the atlas.
     AtlasFull,
@@ -253,7 +274,7 @@ pub fn set(self: *Atlas, reg: Region, data: []const u8) void {
         );
     }
 
-    _ = self.modified.fetchAdd(1, .monotonic);
+    self.markDirty(reg);
 }
 
 /// Like `set` but allows specifying a width for the source data and an
@@ -284,7 +305,7 @@ pub fn setFromLarger(
         );
     }
 
-    _ = self.modified.fetchAdd(1, .monotonic);
+    self.markDirty(reg);
 }
 
 // Grow the texture to the new size, preserving all previously written data.
@@ -332,13 +353,13 @@ pub fn grow(self: *Atlas, alloc: Allocator, size_new: u32) Allocator.Error!void
     });
 
     // We are both modified and resized
-    _ = self.modified.fetchAdd(1, .monotonic);
+    self.dirty_all = self.modified.fetchAdd(1, .monotonic) + 1;
     _ = self.resized.fetchAdd(1, .monotonic);
 }
 
 // Empty the atlas. This doesn't reclaim any previously allocated memory.
 pub fn clear(self: *Atlas) void {
-    _ = self.modified.fetchAdd(1, .monotonic);
+    self.dirty_all = self.modified.fetchAdd(1, .monotonic) + 1;
     @memset(self.data, 0);
     self.nodes.clearRetainingCapacity();
 
@@ -348,6 +369,36 @@ pub fn clear(self: *Atlas) void {
     self.nodes.appendAssumeCapacity(.{ .x = 1, .y = 1, .width = self.size - 2 });
 }
 
+fn markDirty(self: *Atlas, reg: Region) void {
+    const modified = self.modified.fetchAdd(1, .monotonic) + 1;
+    self.dirty[modified % dirty_len] = .{ .y = reg.y, .height = reg.height };
+}
+
+/// Returns the rows that changed after the atlas was at the given
+/// `modified` value, or null if the entire atlas must be copied. The
+/// range is empty if nothing changed. Full width rows are returned
+/// rather than exact regions because full rows are contiguous in `data`,
+/// so they can be copied without a staging buffer.
+///
+/// Like reading `data`, this requires that nothing is modifying the
+/// atlas at the same time.
+pub fn dirtyRows(self: *const Atlas, since: usize) ?Rows {
+    const modified = self.modified.load(.monotonic);
+    if (since >= modified) return .{ .y = 0, .height = 0 };
+    if (since < self.dirty_all) return null;
+    if (modified - since > dirty_len) return null;
+
+    var top: u32 = std.math.maxInt(u32);
+    var bottom: u32 = 0;
+    for (since + 1..modified + 1) |i| {
+        const rows = self.dirty[i % dirty_len];
+        top = @min(top, rows.y);
+        bottom = @max(bottom, rows.y + rows.height);
+    }
+
+    return .{ .y = top, .height = bottom - top };
+}
+
 /// Dump the atlas as a PPM to a writer, for debug purposes.
 /// Only supports grayscale and bgr atlases.
 ///
@@ -599,6 +650,51 @@ test "writing data" {
     try testing.expectEqual(@as(u8, 4), atlas.data[66]);
 }
 
+test "dirty rows" {
+    const alloc = testing.allocator;
+    var atlas = try init(alloc, 32, .grayscale);
+    defer atlas.deinit(alloc);
+
+    // Everything is dirty for a user that never copied the atlas.
+    try testing.expectEqual(null, atlas.dirtyRows(0));
+
+    // Nothing is dirty if nothing changed.
+    const start = atlas.modified.load(.monotonic);
+    try testing.expectEqual(Rows{ .y = 0, .height = 0 }, atlas.dirtyRows(start).?);
+
+    // Writes are combined in to a single range of rows.
+    const reg1 = try atlas.reserve(alloc, 2, 2);
+    atlas.set(reg1, &[_]u8{ 1, 2, 3, 4 });
+    const reg2 = try atlas.reserve(alloc, 20, 3);
+    atlas.set(reg2, &([_]u8{5} ** 60));
+    const reg3 = try atlas.reserve(alloc, 20, 3);
+    atlas.set(reg3, &([_]u8{6} ** 60));
+    const rows = atlas.dirtyRows(start).?;
+    try testing.expectEqual(@min(reg1.y, reg2.y, reg3.y), rows.y);
+    try testing.expectEqual(
+        @max(reg1.y + reg1.height, reg2.y + reg2.height, reg3.y + reg3.height),
+        rows.y + rows.height,
+    );
+
+    // Only later writes are dirty for a user that copied in between.
+    const after = atlas.modified.load(.monotonic);
+    atlas.set(reg2, &([_]u8{7} ** 60));
+    try testing.expectEqual(
+        Rows{ .y = reg2.y, .height = reg2.height },
+        atlas.dirtyRows(after).?,
+    );
+
+    // Too many writes, clearing, or growing requires a full copy.
+    for (0..dirty_len) |_| atlas.set(reg1, &[_]u8{ 1, 2, 3, 4 });
+    try testing.expectEqual(null, atlas.dirtyRows(after));
+    const before_grow = atlas.modified.load(.monotonic);
+    try atlas.grow(alloc, 64);
+    try testing.expectEqual(null, atlas.dirtyRows(before_grow));
+    const before_clear = atlas.modified.load(.monotonic);
+    atlas.clear();
+    try testing.expectEqual(null, atlas.dirtyRows(before_clear));
+}
+
 test "writing data from a larger source" {
     const alloc = testing.allocator;
     var atlas = try init(alloc, 32, .grayscale);
@@ -123,10 +123,46 @@ pub fn getIndex(
     cp: u32,
     style: Style,
     p: ?Presentation,
+) ?Collection.Index {
+    return self.getIndexMode(alloc, cp, style, p, .discover);
+}
+
+/// Like getIndex, but rather than searching for a fallback font with
+/// discovery (step 6 above), which can block for a long time, this sets
+/// `deferred` to true and continues as if no fallback font was found.
+/// The caller can search later with `discoverFallback`, i.e. on another
+/// thread, and add the face it finds to the collection.
+pub fn getIndexDeferFallback(
+    self: *CodepointResolver,
+    alloc: Allocator,
+    cp: u32,
+    style: Style,
+    p: ?Presentation,
+    deferred: *bool,
+) ?Collection.Index {
+    return self.getIndexMode(alloc, cp, style, p, .{ .deferred = deferred });
+}
+
+/// How getIndex handles the fallback font search.
+const FallbackMode = union(enum) {
+    /// Search for and add a fallback font.
+    discover,
+
+    /// Don't search, but set the value to true if we would have.
+    deferred: *bool,
+};
+
+fn getIndexMode(
+    self: *CodepointResolver,
+    alloc: Allocator,
+    cp: u32,
+    style: Style,
+    p: ?Presentation,
+    mode: FallbackMode,
 ) ?Collection.Index {
     // If we've disabled a font style, then fall back to regular.
     if (style != .regular and !self.styles.get(style)) {
-        return self.getIndex(alloc, cp, .regular, p);
+        return self.getIndexMode(alloc, cp, .regular, p, mode);
     }
 
     // Codepoint overrides.
@@ -144,17 +180,7 @@ pub fn getIndex(
         }
     }
 
-    // Build our presentation mode. If we don't have an explicit presentation
-    // given then we use the UCD (Unicode Character Database) to determine
-    // the default presentation. Note there is some inefficiency here because
-    // we'll do this multiple times if we recurse, but this is a cached function
-    // call higher up (GroupCache) so this should be rare.
-    const p_mode: Collection.PresentationMode = if (p) |v| .{ .explicit = v } else .{
-        .default = if (ziglyph.emoji.isEmojiPresentation(@intCast(cp)))
-            .emoji
-        else
-            .text,
-    };
+    const p_mode = presentationMode(cp, p);
 
     // If we can find the exact value, then return that.
     if (self.collection.getIndex(cp, style, p_mode)) |value| return value;
@@ -163,58 +189,21 @@ pub fn getIndex(
     // that will satisfy this request. Blindly looking for unmatched styled
     // fonts to satisfy one codepoint results in some ugly rendering.
     if (style != .regular) {
-        if (self.getIndex(alloc, cp, .regular, p)) |value| return value;
+        if (self.getIndexMode(alloc, cp, .regular, p, mode)) |value| return value;
     }
 
     // If we are regular, try looking for a fallback using discovery.
-    if (style == .regular and font.Discover != void) {
-        log.debug("searching for a fallback font for cp={X}", .{cp});
-        if (self.discover) |disco| discover: {
-            const load_opts = self.collection.load_options orelse
-                break :discover;
-            var disco_it = disco.discoverFallback(alloc, &self.collection, .{
-                .codepoint = cp,
-                .size = load_opts.size.points,
-                .bold = style == .bold or style == .bold_italic,
-                .italic = style == .italic or style == .bold_italic,
-                .monospace = false,
-            }) catch break :discover;
-            defer disco_it.deinit();
-
-            while (true) {
-                var deferred_face = (disco_it.next() catch |err| {
-                    log.warn("fallback search failed with error err={}", .{err});
-                    break;
-                }) orelse break;
-
-                // Discovery is supposed to only return faces that have our
-                // codepoint but we can't search presentation in discovery so
-                // we have to check it here.
-                const face: Collection.Entry = .{
-                    .face = .{ .deferred = deferred_face },
-                    .fallback = true,
-                };
-                if (!face.hasCodepoint(cp, p_mode)) {
-                    deferred_face.deinit();
-                    continue;
-                }
-
-                var buf: [256]u8 = undefined;
-                log.info("found codepoint 0x{X} in fallback face={s}", .{
-                    cp,
-                    deferred_face.name(&buf) catch "<error>",
-                });
-                return self.collection.addDeferred(alloc, deferred_face, .{
+    if (style == .regular and font.Discover != void and self.discover != null) {
+        switch (mode) {
+            .deferred => |deferred| deferred.* = true,
+            .discover => if (self.discoverFallback(alloc, cp, p)) |deferred_face| {
+                var face = deferred_face;
+                if (self.collection.addDeferred(alloc, face, .{
                     .style = style,
                     .fallback = true,
                     .size_adjustment = font.default_fallback_adjustment,
-                }) catch {
-                    deferred_face.deinit();
-                    break :discover;
-                };
-            }
-
-            log.debug("no fallback face found for cp={X}", .{cp});
+                })) |idx| return idx else |_| face.deinit();
+            },
         }
     }
 
@@ -227,6 +216,75 @@ pub fn getIndex(
     return self.collection.getIndex(cp, .regular, .{ .any = {} });
 }
 
+/// Search for a fallback font for the given codepoint with discovery, in
+/// the regular style. This doesn't modify the resolver, so it only needs
+/// the collection to not be modified while it runs. The caller owns the
+/// returned face and would typically add it to the collection.
+pub fn discoverFallback(
+    self: *CodepointResolver,
+    alloc: Allocator,
+    cp: u32,
+    p: ?Presentation,
+) ?font.DeferredFace {
+    if (comptime font.Discover == void) return null;
+    const disco = self.discover orelse return null;
+    const load_opts = self.collection.load_options orelse return null;
+    const p_mode = presentationMode(cp, p);
+
+    log.debug("searching for a fallback font for cp={X}", .{cp});
+    var disco_it = disco.discoverFallback(alloc, &self.collection, .{
+        .codepoint = cp,
+        .size = load_opts.size.points,
+        .bold = false,
+        .italic = false,
+        .monospace = false,
+    }) catch return null;
+    defer disco_it.deinit();
+
+    while (true) {
+        var deferred_face = (disco_it.next() catch |err| {
+            log.warn("fallback search failed with error err={}", .{err});
+            break;
+        }) orelse break;
+
+        // Discovery is supposed to only return faces that have our
+        // codepoint but we can't search presentation in discovery so
+        // we have to check it here.
+        const face: Collection.Entry = .{
+            .face = .{ .deferred = deferred_face },
+            .fallback = true,
+        };
+        if (!face.hasCodepoint(cp, p_mode)) {
+            deferred_face.deinit();
+            continue;
+        }
+
+        var buf: [256]u8 = undefined;
+        log.info("found codepoint 0x{X} in fallback face={s}", .{
+            cp,
+            deferred_face.name(&buf) catch "<error>",
+        });
+        return deferred_face;
+    }
+
+    log.debug("no fallback face found for cp={X}", .{cp});
+    return null;
+}
+
+/// Build our presentation mode. If we don't have an explicit presentation
+/// given then we use the UCD (Unicode Character Database) to determine
+/// the default presentation. Note there is some inefficiency here because
+/// we'll do this multiple times if we recurse, but this is a cached function
+/// call higher up (GroupCache) so this should be rare.
+fn presentationMode(cp: u32, p: ?Presentation) Collection.PresentationMode {
+    return if (p) |v| .{ .explicit = v } else .{
+        .default = if (ziglyph.emoji.isEmojiPresentation(@intCast(cp)))
+            .emoji
+        else
+            .text,
+    };
+}
+
 /// Checks if the codepoint is in the map of codepoint overrides,
 /// finds the override font, and returns it.
 fn getIndexCodepointOverride(
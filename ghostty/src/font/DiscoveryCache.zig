@@ -0,0 +1,434 @@
+//! A persistent cache of font discovery results.
+//!
+//! Searching for fonts with fontconfig sorts every font on the system by
+//! how well it matches a pattern, which can take tens of milliseconds per
+//! search. We search for the configured families every time we start, and
+//! for a fallback font for every codepoint the configured fonts don't
+//! have, so most runs repeat the searches of the previous run. This cache
+//! stores the faces that previous searches returned (as a font file and
+//! face index) on disk, keyed by the descriptor hash, so that they can be
+//! loaded directly.
+//!
+//! The cache file is memory mapped and searched in place, so opening it
+//! doesn't depend on its size. Results found while running are kept in
+//! memory and written out, merged with the mapped results, by `save`.
+//!
+//! The file records a stamp of the discovery configuration (for fontconfig,
+//! the config files and font directories and their modification times)
+//! and is ignored if the stamp doesn't match, so installing or removing
+//! fonts or changing the font configuration invalidates it.
+const DiscoveryCache = @This();
+
+const std = @import("std");
+const assert = std.debug.assert;
+const Allocator = std.mem.Allocator;
+const posix = std.posix;
+const xdg = @import("../os/main.zig").xdg;
+
+const log = std.log.scoped(.discovery_cache);
+
+/// The maximum number of faces stored for a single search. Callers almost
+/// always stop at the first face. If a caller wants more faces than we
+/// stored, the search is done for real.
+pub const max_faces = 8;
+
+/// The version of the file format. This must be incremented whenever the
+/// format changes, or how keys or stamps are computed changes.
+const version = 1;
+
+const magic = "GFDC".*;
+
+const Header = extern struct {
+    magic: [4]u8 = magic,
+    version: u32 = version,
+    stamp: u64,
+    entries_len: u32,
+    faces_len: u32,
+    strings_len: u32,
+    _padding: u32 = 0,
+};
+
+/// The result of one search. Entries are sorted by key.
+const Entry = extern struct {
+    key: u64,
+    faces_start: u32,
+    faces_len: u16,
+    complete: u16,
+};
+
+const FaceRecord = extern struct {
+    /// The path is `path_len` bytes at `path_start` in the strings,
+    /// followed by a null terminator.
+    path_start: u32,
+    path_len: u32,
+    index: u32,
+};
+
+/// A face returned by a search.
+pub const Face = struct {
+    /// The path to the font file.
+    path: [:0]const u8,
+
+    /// The index of the face in the font file.
+    index: u32,
+};
+
+/// The result of a previous search.
+pub const Result = struct {
+    /// The faces the search returned, in order.
+    faces: []const Face,
+
+    /// True if the search returned no faces other than these.
+    complete: bool,
+};
+
+alloc: Allocator,
+
+/// The path of the cache file. This is owned.
+path: []const u8,
+
+/// The stamp of the current discovery configuration. The cache file
+/// is only used if it was written with the same stamp.
+stamp: u64,
+
+/// Protects everything below. Searches can happen on any thread.
+mutex: std.Thread.Mutex = .{},
+
+/// The mapped cache file, and the sections of it. These are all
+/// empty if there is no valid cache file.
+mapped: []align(std.heap.page_size_min) const u8 = &.{},
+entries: []const Entry = &.{},
+faces: []const FaceRecord = &.{},
+strings: []const u8 = &.{},
+
+/// Results added since the cache file was loaded. The faces and paths
+/// are allocated in the arena.
+added: std.AutoArrayHashMapUnmanaged(u64, Result) = .{},
+arena: std.heap.ArenaAllocator,
+
+/// Returns the default path for the cache.
+///
+/// On all platforms, this is `${XDG_CACHE_HOME}/ghostty/font_discovery`.
+///
+/// The returned value is allocated and must be freed by the caller.
+pub fn defaultPath(alloc: Allocator) ![]const u8 {
+    const cache_dir = try xdg.cache(alloc, .{ .subdir = "ghostty" });
+    defer alloc.free(cache_dir);
+    return try std.fs.path.join(alloc, &.{ cache_dir, "font_discovery" });
+}
+
+/// Open the cache at the given path. If there is no cache file, or it
+/// isn't valid for the given stamp, the cache starts empty.
+pub fn open(
+    alloc: Allocator,
+    path: []const u8,
+    stamp: u64,
+) Allocator.Error!DiscoveryCache {
+    var self: DiscoveryCache = .{
+        .alloc = alloc,
+        .path = try alloc.dupe(u8, path),
+        .stamp = stamp,
+        .arena = .init(alloc),
+    };
+
+    self.load() catch |err| switch (err) {
+        error.FileNotFound => {},
+        else => log.info("not using font discovery cache err={}", .{err}),
+    };
+
+    return self;
+}
+
+pub fn deinit(self: *DiscoveryCache) void {
+    if (self.mapped.len > 0) posix.munmap(self.mapped);
+    self.added.deinit(self.alloc);
+    self.arena.deinit();
+    self.alloc.free(self.path);
+}
+
+fn load(self: *DiscoveryCache) !void {
+    const file = try std.fs.cwd().openFile(self.path, .{});
+    defer file.close();
+    const stat = try file.stat();
+    if (stat.size < @sizeOf(Header)) return error.InvalidCache;
+
+    const mapped = try posix.mmap(
+        null,
+        stat.size,
+        posix.PROT.READ,
+        .{ .TYPE = .PRIVATE },
+        file.handle,
+        0,
+    );
+    errdefer posix.munmap(mapped);
+
+    const header: *const Header = @ptrCast(mapped.ptr);
+    if (!std.mem.eql(u8, &header.magic, &magic) or
+        header.version != version) return error.InvalidCache;
+    if (header.stamp != self.stamp) return error.StaleCache;
+
+    const entries_end = @sizeOf(Header) + @as(u64, header.entries_len) * @sizeOf(Entry);
+    const faces_end = entries_end + @as(u64, header.faces_len) * @sizeOf(FaceRecord);
+    const strings_end = faces_end + header.strings_len;
+    if (strings_end > mapped.len) return error.InvalidCache;
+
+    // These fit in a usize since they're within the mapping.
+    const entries_start: usize = @sizeOf(Header);
+    const faces_start: usize = @intCast(entries_end);
+    const strings_start: usize = @intCast(faces_end);
+
+    const entries: [*]const Entry = @ptrCast(@alignCast(mapped[entries_start..].ptr));
+    const faces: [*]const FaceRecord = @ptrCast(@alignCast(mapped[faces_start..].ptr));
+    self.mapped = mapped;
+    self.entries = entries[0..header.entries_len];
+    self.faces = faces[0..header.faces_len];
+    self.strings = mapped[strings_start..][0..header.strings_len];
+}
+
+/// Get the result of a previous search with the given key. The faces
+/// are written to `buf`. The paths are valid until the cache is deinit.
+pub fn get(
+    self: *DiscoveryCache,
+    key: u64,
+    buf: *[max_faces]Face,
+) ?Result {
+    self.mutex.lock();
+    defer self.mutex.unlock();
+
+    if (self.added.get(key)) |result| {
+        @memcpy(buf[0..result.faces.len], result.faces);
+        return .{
+            .faces = buf[0..result.faces.len],
+            .complete = result.complete,
+        };
+    }
+
+    const entry = self.find(key) orelse return null;
+    return self.read(entry, buf);
+}
+
+/// Binary search the mapped entries for a key.
+fn find(self: *const DiscoveryCache, key: u64) ?Entry {
+    var lo: usize = 0;
+    var hi: usize = self.entries.len;
+    while (lo < hi) {
+        const mid = lo + (hi - lo) / 2;
+        const entry = self.entries[mid];
+        if (entry.key == key) return entry;
+        if (entry.key < key) lo = mid + 1 else hi = mid;
+    }
+
+    return null;
+}
+
+/// Read a mapped entry. This returns null if the entry is invalid,
+/// which we don't check for until it's used so that loading the
+/// cache doesn't require reading all of it.
+fn read(
+    self: *const DiscoveryCache,
+    entry: Entry,
+    buf: *[max_faces]Face,
+) ?Result {
+    if (entry.faces_len > max_faces or
+        @as(u64, entry.faces_start) + entry.faces_len > self.faces.len) return null;
+
+    const records = self.faces[entry.faces_start..][0..entry.faces_len];
+    for (records, buf[0..records.len]) |record, *face| {
+        const start: usize = record.path_start;
+        if (start >= self.strings.len or
+            record.path_len >= self.strings.len - start) return null;
+        const end = start + record.path_len;
+        if (self.strings[end] != 0) return null;
+        face.* = .{
+            .path = self.strings[start..end :0],
+            .index = record.index,
+        };
+    }
+
+    return .{
+        .faces = buf[0..records.len],
+        .complete = entry.complete != 0,
+    };
+}
+
+/// Add the result of a search. Only the first `max_faces` faces are
+/// stored, and a result with more faces is never complete. The result
+/// is copied.
+pub fn put(
+    self: *DiscoveryCache,
+    key: u64,
+    result: Result,
+) Allocator.Error!void {
+    self.mutex.lock();
+    defer self.mutex.unlock();
+
+    const alloc = self.arena.allocator();
+    const len = @min(result.faces.len, max_faces);
+    const faces = try alloc.alloc(Face, len);
+    for (faces, result.faces[0..len]) |*dst, src| dst.* = .{
+        .path = try alloc.dupeZ(u8, src.path),
+        .index = src.index,
+    };
+
+    try self.added.put(self.alloc, key, .{
+        .faces = faces,
+        .complete = result.complete and result.faces.len <= max_faces,
+    });
+}
+
+/// Write the cache file, if any results were added since it was loaded.
+/// The file is replaced atomically so other processes reading or mapping
+/// the previous file aren't affected.
+pub fn save(self: *DiscoveryCache) !void {
+    self.mutex.lock();
+    defer self.mutex.unlock();
+    if (self.added.count() == 0) return;
+
+    var arena: std.heap.ArenaAllocator = .init(self.alloc);
+    defer arena.deinit();
+    const alloc = arena.allocator();
+
+    // Merge the mapped and added results. Added results replace
+    // mapped results with the same key.
+    const Merged = struct {
+        key: u64,
+        result: Result,
+
+        fn lessThan(_: void, a: @This(), b: @This()) bool {
+            return a.key < b.key;
+        }
+    };
+    var merged: std.ArrayListUnmanaged(Merged) = .{};
+    for (self.entries) |entry| {
+        if (self.added.contains(entry.key)) continue;
+        var buf: [max_faces]Face = undefined;
+        const result = self.read(entry, &buf) orelse continue;
+        try merged.append(alloc, .{ .key = entry.key, .result = .{
+            .faces = try alloc.dupe(Face, result.faces),
+            .complete = result.complete,
+        } });
+    }
+    var it = self.added.iterator();
+    while (it.next()) |entry| try merged.append(alloc, .{
+        .key = entry.key_ptr.*,
+        .result = entry.value_ptr.*,
+    });
+    std.mem.sortUnstable(Merged, merged.items, {}, Merged.lessThan);
+
+    var faces_len: u32 = 0;
+    var strings_len: u32 = 0;
+    for (merged.items) |m| {
+        faces_len += @intCast(m.result.faces.len);
+        for (m.result.faces) |face| strings_len += @intCast(face.path.len + 1);
+    }
+
+    var data: std.ArrayListUnmanaged(u8) = .{};
+    const writer = data.writer(alloc);
+    try writer.writeStruct(Header{
+        .stamp = self.stamp,
+        .entries_len = @intCast(merged.items.len),
+        .faces_len = faces_len,
+        .strings_len = strings_len,
+    });
+
+    var faces_start: u32 = 0;
+    for (merged.items) |m| {
+        try writer.writeStruct(Entry{
+            .key = m.key,
+            .faces_start = faces_start,
+            .faces_len = @intCast(m.result.faces.len),
+            .complete = @intFromBool(m.result.complete),
+        });
+        faces_start += @intCast(m.result.faces.len);
+    }
+
+    var path_start: u32 = 0;
+    for (merged.items) |m| for (m.result.faces) |face| {
+        try writer.writeStruct(FaceRecord{
+            .path_start = path_start,
+            .path_len = @intCast(face.path.len),
+            .index = face.index,
+        });
+        path_start += @intCast(face.path.len + 1);
+    };
+
+    for (merged.items) |m| for (m.result.faces) |face| {
+        try writer.writeAll(face.path);
+        try writer.writeByte(0);
+    };
+
+    var file = try std.fs.cwd().atomicFile(self.path, .{ .make_path = true });
+    defer file.deinit();
+    try file.file.writeAll(data.items);
+    try file.finish();
+}
+
+test DiscoveryCache {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+    const TempDir = @import("../os/main.zig").TempDir;
+
+    var td: TempDir = try .init();
+    defer td.deinit();
+    const dir = try td.dir.realpathAlloc(alloc, ".");
+    defer alloc.free(dir);
+    const path = try std.fs.path.join(alloc, &.{ dir, "cache", "font_discovery" });
+    defer alloc.free(path);
+
+    var buf: [max_faces]Face = undefined;
+
+    // Results are available immediately and after saving.
+    {
+        var cache: DiscoveryCache = try .open(alloc, path, 1);
+        defer cache.deinit();
+        try testing.expectEqual(null, cache.get(1, &buf));
+
+        try cache.put(1, .{
+            .faces = &.{
+                .{ .path = "/fonts/a.ttf", .index = 0 },
+                .{ .path = "/fonts/b.ttc", .index = 2 },
+            },
+            .complete = false,
+        });
+        try cache.put(2, .{ .faces = &.{}, .complete = true });
+        try testing.expectEqual(2, cache.get(1, &buf).?.faces.len);
+        try cache.save();
+    }
+
+    {
+        var cache: DiscoveryCache = try .open(alloc, path, 1);
+        defer cache.deinit();
+        try testing.expect(cache.mapped.len > 0);
+
+        const a = cache.get(1, &buf).?;
+        try testing.expect(!a.complete);
+        try testing.expectEqual(2, a.faces.len);
+        try testing.expectEqualStrings("/fonts/b.ttc", a.faces[1].path);
+        try testing.expectEqual(2, a.faces[1].index);
+
+        const b = cache.get(2, &buf).?;
+        try testing.expect(b.complete);
+        try testing.expectEqual(0, b.faces.len);
+
+        // Saving merges new results with the mapped ones.
+        try cache.put(3, .{
+            .faces = &.{.{ .path = "/fonts/c.otf", .index = 0 }},
+            .complete = true,
+        });
+        try cache.save();
+    }
+
+    {
+        var cache: DiscoveryCache = try .open(alloc, path, 1);
+        defer cache.deinit();
+        try testing.expectEqualStrings("/fonts/a.ttf", cache.get(1, &buf).?.faces[0].path);
+        try testing.expectEqualStrings("/fonts/c.otf", cache.get(3, &buf).?.faces[0].path);
+    }
+
+    // A different stamp ignores the file.
+    {
+        var cache: DiscoveryCache = try .open(alloc, path, 2);
+        defer cache.deinit();
+        try testing.expectEqual(null, cache.get(1, &buf));
+    }
+}
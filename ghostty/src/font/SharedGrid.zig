@@ -33,20 +33,71 @@ const Metrics = font.Metrics;
 const Presentation = font.Presentation;
 const Style = font.Style;
 const RenderOptions = font.face.RenderOptions;
+const ConcurrentTable = @import("../datastruct/main.zig").ConcurrentTable;
+const trace = @import("../trace.zig");
+const getConstraint = @import("nerd_font_attributes.zig").getConstraint;
 
 const log = std.log.scoped(.font_shared_grid);
 
+/// The default maximum atlas size. At typical font sizes this fits
+/// tens of thousands of glyphs, far more than a screen full of text.
+const atlas_max_size_default = 4096;
+
 /// Cache for codepoints to font indexes in a group.
 codepoints: std.AutoHashMapUnmanaged(CodepointKey, ?Collection.Index) = .{},
 
 /// Cache for glyph renders into the atlas.
 glyphs: std.HashMapUnmanaged(GlyphKey, Render, GlyphKey.Context, 80) = .{},
 
+/// Lock-free copies of recently used entries of `codepoints` and
+/// `glyphs`. These are checked before taking the lock at all, so that
+/// cache hits don't contend on the lock when many renderer threads share
+/// the grid. They can be read at any time but must only be written with
+/// the write lock held, or with the shared lock and `fast_lock` held.
+fast_codepoints: FastCodepoints,
+fast_glyphs: FastGlyphs,
+fast_lock: std.Thread.Mutex = .{},
+
+const FastCodepoints = ConcurrentTable(?Collection.Index, 4096);
+const FastGlyphs = ConcurrentTable(Render, 4096);
+
 /// The texture atlas to store renders in. The Glyph data in the glyphs
 /// cache is dependent on the atlas matching.
 atlas_grayscale: Atlas,
 atlas_color: Atlas,
 
+/// The size an atlas can grow to before we evict glyphs from it instead.
+/// This bounds the memory (and GPU memory, and upload size) of each
+/// atlas, which otherwise grows forever in sessions that use a lot of
+/// distinct glyphs, i.e. CJK text or emoji.
+atlas_max_size: u32 = atlas_max_size_default,
+
+/// Incremented every time glyphs are evicted from an atlas. Any glyph
+/// renders obtained before the generation changed may refer to regions
+/// of the atlas that now contain other glyphs, so users must re-render
+/// all of their glyphs when this changes. This can be read without a lock.
+atlas_generation: std.atomic.Value(u32) = .init(0),
+
+/// Shaping results shared by the shaper caches of every renderer
+/// using this grid. This has its own locking, see SharedCache.
+shaper_cache: font.shape.SharedCache,
+
+/// Whether to search for fallback fonts in the background, see
+/// `Fallback`. This can only be changed before the grid is used.
+async_fallback: bool = true,
+
+/// The state of the background fallback font search.
+fallback: Fallback = .{},
+
+/// Incremented every time a background fallback search changes the font
+/// used for a codepoint. Users that built cells with the previous font
+/// should build them again. This can be read without a lock.
+fallback_generation: std.atomic.Value(u32) = .init(0),
+
+/// The thread started by `warmup`, if it was called.
+warmup_thread: ?std.Thread = null,
+warmup_started: std.atomic.Value(bool) = .init(false),
+
 /// The underlying resolver for font data, fallbacks, etc. The shared
 /// grid takes ownership of the resolver and will free it.
 resolver: CodepointResolver,
@@ -81,11 +132,20 @@ pub fn init(
     errdefer atlas_grayscale.deinit(alloc);
     var atlas_color = try Atlas.init(alloc, 512, .bgra);
     errdefer atlas_color.deinit(alloc);
+    var shaper_cache = try font.shape.SharedCache.init(alloc);
+    errdefer shaper_cache.deinit();
+    var fast_codepoints = try FastCodepoints.init(alloc);
+    errdefer fast_codepoints.deinit(alloc);
+    var fast_glyphs = try FastGlyphs.init(alloc);
+    errdefer fast_glyphs.deinit(alloc);
 
     var result: SharedGrid = .{
         .resolver = resolver,
+        .fast_codepoints = fast_codepoints,
+        .fast_glyphs = fast_glyphs,
         .atlas_grayscale = atlas_grayscale,
         .atlas_color = atlas_color,
+        .shaper_cache = shaper_cache,
         .lock = .{},
         .metrics = undefined, // Loaded below
     };
@@ -103,10 +163,16 @@ pub fn init(
 
 /// Deinit. Assumes no concurrent access so no lock is taken.
 pub fn deinit(self: *SharedGrid, alloc: Allocator) void {
+    // Our threads access everything else so they must stop first.
+    if (self.warmup_thread) |thread| thread.join();
+    self.fallback.deinit(alloc);
     self.codepoints.deinit(alloc);
     self.glyphs.deinit(alloc);
+    self.fast_codepoints.deinit(alloc);
+    self.fast_glyphs.deinit(alloc);
     self.atlas_grayscale.deinit(alloc);
     self.atlas_color.deinit(alloc);
+    self.shaper_cache.deinit();
     self.resolver.deinit(alloc);
 }
 
@@ -145,12 +211,18 @@ pub fn getIndex(
 ) !?Collection.Index {
     const key: CodepointKey = .{ .style = style, .codepoint = cp, .presentation = p };
 
+    // Fastest path: the value is in the lock-free table.
+    if (self.fast_codepoints.get(key.pack())) |v| return v;
+
     // Fast path: the cache has the value. This is almost always true and
     // only requires a read lock.
     {
         self.lock.lockShared();
         defer self.lock.unlockShared();
-        if (self.codepoints.get(key)) |v| return v;
+        if (self.codepoints.get(key)) |v| {
+            self.putFastShared(FastCodepoints, &self.fast_codepoints, key.pack(), v);
+            return v;
+        }
     }
 
     // Slow path: we need to search this codepoint
@@ -159,11 +231,14 @@ pub fn getIndex(
 
     // Try to get it, if it is now in the cache another thread beat us to it.
     const gop = try self.codepoints.getOrPut(alloc, key);
-    if (gop.found_existing) return gop.value_ptr.*;
+    if (gop.found_existing) {
+        self.fast_codepoints.put(key.pack(), gop.value_ptr.*);
+        return gop.value_ptr.*;
+    }
     errdefer self.codepoints.removeByPtr(gop.key_ptr);
 
     // Load a value and cache it. This even caches negative matches.
-    const value = self.resolver.getIndex(alloc, cp, style, p);
+    const value = self.resolveIndex(alloc, key);
     gop.value_ptr.* = value;
 
     if (value) |idx| preload: {
@@ -177,9 +252,389 @@ pub fn getIndex(
         _ = try self.resolver.collection.getFace(idx);
     }
 
+    self.fast_codepoints.put(key.pack(), value);
+    return value;
+}
+
+/// Resolve the font for a codepoint that isn't cached yet. If we'd have
+/// to search for a fallback font, we do that in the background and return
+/// the best we can do with the fonts we have for now (which may be null,
+/// drawing nothing). The cached index is updated when the search is done.
+///
+/// The caller must hold the write lock.
+fn resolveIndex(
+    self: *SharedGrid,
+    alloc: Allocator,
+    key: CodepointKey,
+) ?Collection.Index {
+    const span = trace.begin();
+    defer trace.end(span, .font_resolve, key.codepoint);
+
+    if (!self.async_fallback) return self.resolver.getIndex(
+        alloc,
+        key.codepoint,
+        key.style,
+        key.presentation,
+    );
+
+    var deferred = false;
+    const value = self.resolver.getIndexDeferFallback(
+        alloc,
+        key.codepoint,
+        key.style,
+        key.presentation,
+        &deferred,
+    );
+    if (deferred) self.fallback.queue(alloc, self, key) catch |err| {
+        log.warn("error queueing fallback font search cp={X} err={}", .{
+            key.codepoint,
+            err,
+        });
+    };
+
     return value;
 }
 
+/// Search for a fallback font for a codepoint queued by resolveIndex,
+/// and update the cached index for it. This runs on the fallback thread.
+fn resolveFallback(
+    self: *SharedGrid,
+    alloc: Allocator,
+    key: CodepointKey,
+) void {
+    const span = trace.begin();
+    defer trace.end(span, .font_fallback, key.codepoint);
+
+    // A font found for an earlier codepoint may have this one too,
+    // in which case we don't need to search.
+    {
+        self.lock.lock();
+        defer self.lock.unlock();
+        var deferred = false;
+        const value = self.resolver.getIndexDeferFallback(
+            alloc,
+            key.codepoint,
+            key.style,
+            key.presentation,
+            &deferred,
+        );
+        if (!deferred) {
+            if (self.setIndex(key, value)) self.fallbackChanged();
+            return;
+        }
+    }
+
+    // Searching only reads the collection, so other threads
+    // can keep using the grid while we search.
+    var deferred_face = deferred_face: {
+        self.lock.lockShared();
+        defer self.lock.unlockShared();
+        break :deferred_face self.resolver.discoverFallback(
+            alloc,
+            key.codepoint,
+            key.presentation,
+        );
+    };
+
+    // Loading the face doesn't need the lock at all. The load
+    // options are never modified after the collection is set up.
+    var face_: ?Face = if (deferred_face) |*d| face: {
+        defer d.deinit();
+        const load_opts = self.resolver.collection.load_options orelse
+            break :face null;
+        break :face d.load(load_opts.library, load_opts.faceOptions()) catch |err| {
+            log.warn("error loading fallback face err={}", .{err});
+            break :face null;
+        };
+    } else null;
+
+    self.lock.lock();
+    defer self.lock.unlock();
+
+    if (face_) |*face| {
+        _ = self.resolver.collection.add(alloc, face.*, .{
+            .style = .regular,
+            .fallback = true,
+            .size_adjustment = font.default_fallback_adjustment,
+        }) catch |err| {
+            log.warn("error adding fallback face err={}", .{err});
+            face.deinit();
+        };
+    }
+
+    // Whether we found a face or not, this is the final answer.
+    var deferred = false;
+    const value = self.resolver.getIndexDeferFallback(
+        alloc,
+        key.codepoint,
+        key.style,
+        key.presentation,
+        &deferred,
+    );
+    if (self.setIndex(key, value)) self.fallbackChanged();
+}
+
+/// Replace the cached index for a codepoint, returning true if it
+/// changed. The caller must hold the write lock.
+fn setIndex(
+    self: *SharedGrid,
+    key: CodepointKey,
+    value: ?Collection.Index,
+) bool {
+    const entry = self.codepoints.getPtr(key) orelse return false;
+    if (std.meta.eql(entry.*, value)) return false;
+
+    // Make sure the face is loaded, like getIndex. If that fails
+    // we keep the previous value which we know works.
+    if (value) |idx| if (idx.special() == null) {
+        _ = self.resolver.collection.getFace(idx) catch |err| {
+            log.warn("error loading fallback face err={}", .{err});
+            return false;
+        };
+    };
+
+    entry.* = value;
+
+    // The lock-free table never changes values, so we start over.
+    self.fast_codepoints.clear();
+    return true;
+}
+
+/// Notify users that a fallback search changed the font for a codepoint.
+fn fallbackChanged(self: *SharedGrid) void {
+    _ = self.fallback_generation.fetchAdd(1, .release);
+    self.fallback.notify();
+}
+
+/// Register a callback to be called whenever users of the grid must
+/// rebuild their cells, i.e. to wake up a renderer. This is when a
+/// background fallback search changes the font for a codepoint or when
+/// glyphs are evicted from an atlas. The callback is called on whichever
+/// thread made the change (with the grid locked) so it should return
+/// quickly.
+pub fn addListener(
+    self: *SharedGrid,
+    alloc: Allocator,
+    listener: Fallback.Listener,
+) Allocator.Error!void {
+    self.fallback.mutex.lock();
+    defer self.fallback.mutex.unlock();
+    try self.fallback.listeners.append(alloc, listener);
+}
+
+/// Remove a callback added with addListener.
+pub fn removeListener(
+    self: *SharedGrid,
+    listener: Fallback.Listener,
+) void {
+    self.fallback.mutex.lock();
+    defer self.fallback.mutex.unlock();
+    for (self.fallback.listeners.items, 0..) |l, i| {
+        if (l.userdata == listener.userdata and l.callback == listener.callback) {
+            _ = self.fallback.listeners.swapRemove(i);
+            return;
+        }
+    }
+}
+
+/// The first use of a codepoint that isn't in any loaded font requires
+/// searching for a fallback font with discovery (i.e. fontconfig) and
+/// loading it. That can take tens of milliseconds, so rather than stall
+/// a frame we do it on a background thread and notify listeners when
+/// it's done. The thread is only started when it's first needed.
+pub const Fallback = struct {
+    /// Protects everything below.
+    mutex: std.Thread.Mutex = .{},
+    cond: std.Thread.Condition = .{},
+
+    /// The codepoints waiting for a search.
+    pending: std.ArrayListUnmanaged(CodepointKey) = .{},
+
+    /// The callbacks to call when a search changes a font or glyphs
+    /// are evicted, see `addListener`.
+    listeners: std.ArrayListUnmanaged(Listener) = .{},
+
+    thread: ?std.Thread = null,
+    stop: bool = false,
+
+    pub const Listener = struct {
+        userdata: ?*anyopaque,
+        callback: *const fn (?*anyopaque) void,
+    };
+
+    /// Stop the thread, if it's running, and free all memory.
+    fn deinit(self: *Fallback, alloc: Allocator) void {
+        const thread = thread: {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            self.stop = true;
+            self.cond.signal();
+            break :thread self.thread;
+        };
+        if (thread) |t| t.join();
+
+        self.pending.deinit(alloc);
+        self.listeners.deinit(alloc);
+    }
+
+    /// Queue a search for the given codepoint.
+    fn queue(
+        self: *Fallback,
+        alloc: Allocator,
+        grid: *SharedGrid,
+        key: CodepointKey,
+    ) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        try self.pending.append(alloc, key);
+        if (self.thread == null) {
+            self.thread = try std.Thread.spawn(.{}, threadMain, .{ self, alloc, grid });
+        }
+        self.cond.signal();
+    }
+
+    fn notify(self: *Fallback) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        for (self.listeners.items) |l| l.callback(l.userdata);
+    }
+
+    fn threadMain(self: *Fallback, alloc: Allocator, grid: *SharedGrid) void {
+        defer trace.threadExit();
+        while (true) {
+            const key = key: {
+                self.mutex.lock();
+                defer self.mutex.unlock();
+                while (self.pending.items.len == 0 and !self.stop) {
+                    self.cond.wait(&self.mutex);
+                }
+                if (self.stop) return;
+                break :key self.pending.orderedRemove(0);
+            };
+
+            grid.resolveFallback(alloc, key);
+        }
+    }
+};
+
+/// The options used to render glyphs while warming up. These must be the
+/// options the renderer will use, since they're part of the glyph key.
+pub const WarmupOptions = struct {
+    thicken: bool = false,
+    thicken_strength: u8 = 255,
+};
+
+/// Render the glyphs that nearly every screen uses, on a background thread,
+/// so that the first frame doesn't have to. This renders printable ASCII in
+/// the regular and bold styles, the box drawing, block and powerline sprites,
+/// and the cursor sprites. This is only done the first time it's called;
+/// the grid is shared so later callers benefit from the first warmup.
+///
+/// If the thread can't be started we just don't warm up.
+pub fn warmup(
+    self: *SharedGrid,
+    alloc: Allocator,
+    opts: WarmupOptions,
+) void {
+    if (self.warmup_started.swap(true, .acq_rel)) return;
+    self.warmup_thread = std.Thread.spawn(
+        .{},
+        warmupThread,
+        .{ self, alloc, opts },
+    ) catch |err| {
+        log.warn("error starting font warmup thread err={}", .{err});
+        return;
+    };
+}
+
+fn warmupThread(
+    self: *SharedGrid,
+    alloc: Allocator,
+    opts: WarmupOptions,
+) void {
+    defer trace.threadExit();
+    self.warm(alloc, opts) catch |err| {
+        log.warn("error warming up font grid err={}", .{err});
+    };
+}
+
+/// Render the warmup glyphs, see `warmup`.
+fn warm(
+    self: *SharedGrid,
+    alloc: Allocator,
+    opts: WarmupOptions,
+) !void {
+    const span = trace.begin();
+    var count: u32 = 0;
+    defer trace.end(span, .font_warmup, count);
+
+    for ([_]Style{ .regular, .bold }) |style| {
+        for (0x20..0x7F) |cp| {
+            if (try self.warmCodepoint(alloc, @intCast(cp), style, opts)) count += 1;
+        }
+    }
+
+    // Box drawing, block elements, and powerline symbols. We only render
+    // these if they're sprites, since otherwise we may trigger a fallback
+    // search for a codepoint that's never used.
+    const sprite = self.resolver.sprite orelse return;
+    for ([_][2]u32{
+        .{ 0x2500, 0x259F },
+        .{ 0xE0B0, 0xE0D4 },
+    }) |range| {
+        for (range[0]..range[1] + 1) |cp| {
+            if (!sprite.hasCodepoint(@intCast(cp), null)) continue;
+            if (try self.warmCodepoint(alloc, @intCast(cp), .regular, opts)) count += 1;
+        }
+    }
+
+    for ([_]font.Sprite{
+        .cursor_rect,
+        .cursor_hollow_rect,
+        .cursor_bar,
+        .cursor_underline,
+        .underline,
+    }) |s| {
+        _ = try self.renderGlyph(alloc, font.sprite_index, @intFromEnum(s), .{
+            .cell_width = 1,
+            .grid_metrics = self.metrics,
+        });
+        count += 1;
+    }
+}
+
+/// Render a codepoint in a single cell like the renderer would,
+/// returning false if there's no glyph for it.
+fn warmCodepoint(
+    self: *SharedGrid,
+    alloc: Allocator,
+    cp: u21,
+    style: Style,
+    opts: WarmupOptions,
+) !bool {
+    const idx = try self.getIndex(alloc, cp, style, null) orelse return false;
+
+    // Sprites use the codepoint as the glyph index. For fonts, this is
+    // the glyph the shaper picks for the codepoint on its own.
+    const glyph_index = if (idx.special() != null) cp else glyph_index: {
+        // getIndex loaded the face so this doesn't modify the collection.
+        self.lock.lockShared();
+        defer self.lock.unlockShared();
+        const face = try self.resolver.collection.getFace(idx);
+        break :glyph_index face.glyphIndex(cp) orelse return false;
+    };
+
+    _ = try self.renderGlyph(alloc, idx, glyph_index, .{
+        .grid_metrics = self.metrics,
+        .thicken = opts.thicken,
+        .thicken_strength = opts.thicken_strength,
+        .cell_width = 1,
+        .constraint = getConstraint(cp),
+        .constraint_width = 1,
+    });
+    return true;
+}
+
 /// Returns true if the given font index has the codepoint and presentation.
 pub fn hasCodepoint(
     self: *SharedGrid,
@@ -243,12 +698,18 @@ pub fn renderGlyph(
 ) !Render {
     const key: GlyphKey = .{ .index = index, .glyph = glyph_index, .opts = opts };
 
+    // Fastest path: the value is in the lock-free table.
+    if (self.fast_glyphs.get(key.pack())) |v| return v;
+
     // Fast path: the cache has the value. This is almost always true and
     // only requires a read lock.
     {
         self.lock.lockShared();
         defer self.lock.unlockShared();
-        if (self.glyphs.get(key)) |v| return v;
+        if (self.glyphs.get(key)) |v| {
+            self.putFastShared(FastGlyphs, &self.fast_glyphs, key.pack(), v);
+            return v;
+        }
     }
 
     // Slow path: we need to search this codepoint
@@ -256,7 +717,10 @@ pub fn renderGlyph(
     defer self.lock.unlock();
 
     const gop = try self.glyphs.getOrPut(alloc, key);
-    if (gop.found_existing) return gop.value_ptr.*;
+    if (gop.found_existing) {
+        self.fast_glyphs.put(key.pack(), gop.value_ptr.*);
+        return gop.value_ptr.*;
+    }
 
     // Get the presentation to determine what atlas to use
     const p = try self.resolver.getPresentation(index, glyph_index);
@@ -295,9 +759,15 @@ pub fn renderGlyph(
         glyph_index,
         render_opts,
     ) catch |err| switch (err) {
-        // If the atlas is full, we resize it
+        // If the atlas is full, we resize it, or if it's
+        // already as big as we allow, we make room in it.
         error.AtlasFull => blk: {
-            try atlas.grow(alloc, atlas.size * 2);
+            if (atlas.size < self.atlas_max_size) {
+                try atlas.grow(alloc, @min(atlas.size * 2, self.atlas_max_size));
+            } else {
+                self.evict(p, gop.key_ptr);
+            }
+
             break :blk try self.resolver.renderGlyph(
                 alloc,
                 atlas,
@@ -315,21 +785,105 @@ pub fn renderGlyph(
         .glyph = glyph,
         .presentation = p,
     };
+    self.fast_glyphs.put(key.pack(), gop.value_ptr.*);
 
     return gop.value_ptr.*;
 }
 
+/// Put an entry found while holding only the shared lock in to one of
+/// the fast tables. Other threads may be doing the same, so this takes
+/// `fast_lock`, but if it's busy we skip it rather than wait since the
+/// entry will be put there on a later lookup.
+fn putFastShared(
+    self: *SharedGrid,
+    comptime Table: type,
+    table: *Table,
+    key: u64,
+    value: Table.Value,
+) void {
+    if (!self.fast_lock.tryLock()) return;
+    defer self.fast_lock.unlock();
+    table.put(key, value);
+}
+
+/// Evict all glyphs from the atlas for the given presentation, except
+/// the glyph with the given key, which is being rendered.
+///
+/// We can't evict individual glyphs from the atlas since its packing
+/// doesn't support freeing regions, so we evict everything. The glyphs
+/// that are still in use are rendered again when every user of the grid
+/// rebuilds (see `atlas_generation`, listeners are notified), so this
+/// effectively keeps the glyphs that are on screen and drops the ones
+/// that aren't.
+///
+/// The caller must hold the write lock.
+fn evict(self: *SharedGrid, p: Presentation, keep: *const GlyphKey) void {
+    const atlas: *font.Atlas = switch (p) {
+        .text => &self.atlas_grayscale,
+        .emoji => &self.atlas_color,
+    };
+    atlas.clear();
+    self.fast_glyphs.clear();
+
+    // Removing entries doesn't move other entries so this is safe while
+    // iterating. The kept entry's value isn't initialized yet.
+    const before = self.glyphs.count();
+    var it = self.glyphs.iterator();
+    while (it.next()) |entry| {
+        if (entry.key_ptr == keep) continue;
+        if (entry.value_ptr.presentation != p) continue;
+        self.glyphs.removeByPtr(entry.key_ptr);
+    }
+
+    _ = self.atlas_generation.fetchAdd(1, .release);
+
+    // Every user of the grid has cells referring to the evicted glyphs,
+    // not only the one rendering now, so they must all rebuild.
+    self.fallback.notify();
+
+    log.info("atlas full, evicted glyphs presentation={} size={} count={}", .{
+        p,
+        atlas.size,
+        before - self.glyphs.count(),
+    });
+}
+
 const CodepointKey = struct {
     style: Style,
     codepoint: u32,
     presentation: ?Presentation,
+
+    /// Pack the key in to a u64 for the fast table.
+    fn pack(key: CodepointKey) u64 {
+        const Packed = packed struct(u64) {
+            codepoint: u32,
+            style: Style,
+            presentation: u2,
+            _padding: u27 = 0,
+        };
+
+        return @bitCast(Packed{
+            .codepoint = key.codepoint,
+            .style = key.style,
+            .presentation = if (key.presentation) |v|
+                @as(u2, @intFromEnum(v)) + 1
+            else
+                0,
+        });
+    }
 };
 
-const GlyphKey = struct {
+pub const GlyphKey = struct {
     index: Collection.Index,
     glyph: u32,
     opts: RenderOptions,
 
+    /// Pack the key in to a u64. Keys that pack to the same value are
+    /// the same glyph render.
+    pub fn pack(key: GlyphKey) u64 {
+        return @bitCast(Packed.from(key));
+    }
+
     const Context = struct {
         pub fn hash(_: Context, key: GlyphKey) u64 {
             return @bitCast(Packed.from(key));
@@ -423,3 +977,204 @@ test getIndex {
         try testing.expectEqual(@as(Collection.Index.IndexInt, 0), idx.idx);
     }
 }
+
+test "lookups are cached in the lock-free tables" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var lib = try Library.init(alloc);
+    defer lib.deinit();
+
+    var grid = try testGrid(.normal, alloc, lib);
+    defer grid.deinit(alloc);
+
+    const cp_key: CodepointKey = .{ .style = .regular, .codepoint = 'A', .presentation = null };
+    try testing.expectEqual(null, grid.fast_codepoints.get(cp_key.pack()));
+    const idx = (try grid.getIndex(alloc, 'A', .regular, null)).?;
+    try testing.expectEqual(idx, grid.fast_codepoints.get(cp_key.pack()).?.?);
+
+    const opts: RenderOptions = .{ .grid_metrics = grid.metrics };
+    const glyph_index = glyph_index: {
+        const face = try grid.resolver.collection.getFace(idx);
+        break :glyph_index face.glyphIndex('A').?;
+    };
+    const glyph_key: GlyphKey = .{ .index = idx, .glyph = glyph_index, .opts = opts };
+    const render = try grid.renderGlyph(alloc, idx, glyph_index, opts);
+    const fast = grid.fast_glyphs.get(glyph_key.pack()).?;
+    try testing.expectEqual(render.glyph, fast.glyph);
+    try testing.expectEqual(render.presentation, fast.presentation);
+}
+
+test "missing codepoints resolve synchronously without discovery" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var lib = try Library.init(alloc);
+    defer lib.deinit();
+
+    var grid = try testGrid(.normal, alloc, lib);
+    defer grid.deinit(alloc);
+
+    // Without discovery there is nothing to search for, so the
+    // result is final and no fallback thread is started.
+    try testing.expectEqual(null, try grid.getIndex(alloc, 0x1F600, .regular, .emoji));
+    try testing.expect(grid.fallback.thread == null);
+    try testing.expectEqual(0, grid.fallback_generation.load(.monotonic));
+
+    // A fallback search that finds nothing changes nothing.
+    grid.resolveFallback(alloc, .{
+        .style = .regular,
+        .codepoint = 0x1F600,
+        .presentation = .emoji,
+    });
+    try testing.expectEqual(0, grid.fallback_generation.load(.monotonic));
+}
+
+test "fallback thread updates the index and notifies listeners" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var lib = try Library.init(alloc);
+    defer lib.deinit();
+
+    var grid = try testGrid(.normal, alloc, lib);
+    defer grid.deinit(alloc);
+
+    // Our font doesn't have the codepoint so it's cached as missing,
+    // including in the lock-free table.
+    const key: CodepointKey = .{
+        .style = .regular,
+        .codepoint = 0x1F600,
+        .presentation = .emoji,
+    };
+    try testing.expectEqual(null, try grid.getIndex(alloc, key.codepoint, key.style, key.presentation));
+    try testing.expectEqual(null, grid.fast_codepoints.get(key.pack()).?);
+
+    const Listener = struct {
+        called: std.Thread.ResetEvent = .{},
+        count: std.atomic.Value(u32) = .init(0),
+
+        fn callback(ud: ?*anyopaque) void {
+            const self: *@This() = @ptrCast(@alignCast(ud.?));
+            _ = self.count.fetchAdd(1, .monotonic);
+            self.called.set();
+        }
+    };
+    var listener: Listener = .{};
+    try grid.addListener(alloc, .{
+        .userdata = &listener,
+        .callback = Listener.callback,
+    });
+
+    // Add a face with the codepoint the way the search would have found
+    // it with discovery, which we don't have in tests.
+    const fallback_idx = fallback_idx: {
+        grid.lock.lock();
+        defer grid.lock.unlock();
+        break :fallback_idx try grid.resolver.collection.add(alloc, try .init(
+            lib,
+            font.embedded.emoji,
+            .{ .size = .{ .points = 12, .xdpi = 96, .ydpi = 96 } },
+        ), .{
+            .style = .regular,
+            .fallback = true,
+            .size_adjustment = .none,
+        });
+    };
+
+    // Queue the search, which starts the fallback thread.
+    try grid.fallback.queue(alloc, &grid, key);
+    try listener.called.timedWait(5 * std.time.ns_per_s);
+
+    try testing.expectEqual(1, listener.count.load(.monotonic));
+    try testing.expectEqual(1, grid.fallback_generation.load(.acquire));
+    try testing.expectEqual(null, grid.fast_codepoints.get(key.pack()));
+    try testing.expectEqual(
+        fallback_idx,
+        (try grid.getIndex(alloc, key.codepoint, key.style, key.presentation)).?,
+    );
+
+    grid.removeListener(.{
+        .userdata = &listener,
+        .callback = Listener.callback,
+    });
+}
+
+test "warm renders common glyphs" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var lib = try Library.init(alloc);
+    defer lib.deinit();
+
+    var grid = try testGrid(.normal, alloc, lib);
+    defer grid.deinit(alloc);
+
+    try grid.warm(alloc, .{});
+
+    // The glyphs the renderer would use are already rendered.
+    const idx = (try grid.getIndex(alloc, 'A', .regular, null)).?;
+    const glyph_index = glyph_index: {
+        const face = try grid.resolver.collection.getFace(idx);
+        break :glyph_index face.glyphIndex('A').?;
+    };
+    const key: GlyphKey = .{ .index = idx, .glyph = glyph_index, .opts = .{
+        .grid_metrics = grid.metrics,
+        .cell_width = 1,
+    } };
+    try testing.expect(grid.glyphs.contains(key));
+
+    const box: GlyphKey = .{ .index = font.sprite_index, .glyph = 0x2500, .opts = .{
+        .grid_metrics = grid.metrics,
+        .cell_width = 1,
+        .constraint = getConstraint(0x2500),
+    } };
+    try testing.expect(grid.glyphs.contains(box));
+}
+
+test "renderGlyph evicts when the atlas is at its maximum size" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var lib = try Library.init(alloc);
+    defer lib.deinit();
+
+    var grid = try testGrid(.normal, alloc, lib);
+    defer grid.deinit(alloc);
+
+    // Use a tiny atlas that can only fit a handful of glyphs.
+    grid.atlas_grayscale.deinit(alloc);
+    grid.atlas_grayscale = try Atlas.init(alloc, 64, .grayscale);
+    grid.atlas_max_size = 64;
+
+    // Every eviction notifies the grid's listeners.
+    const Listener = struct {
+        count: u32 = 0,
+
+        fn callback(ud: ?*anyopaque) void {
+            const self: *@This() = @ptrCast(@alignCast(ud.?));
+            self.count += 1;
+        }
+    };
+    var listener: Listener = .{};
+    try grid.addListener(alloc, .{
+        .userdata = &listener,
+        .callback = Listener.callback,
+    });
+
+    const opts: RenderOptions = .{ .grid_metrics = grid.metrics };
+    for (33..127) |i| {
+        const idx = (try grid.getIndex(alloc, @intCast(i), .regular, null)).?;
+        const glyph_index = glyph_index: {
+            const face = try grid.resolver.collection.getFace(idx);
+            break :glyph_index face.glyphIndex(@intCast(i)).?;
+        };
+        _ = try grid.renderGlyph(alloc, idx, glyph_index, opts);
+    }
+
+    // We never grew but had to evict to fit everything.
+    try testing.expectEqual(64, grid.atlas_grayscale.size);
+    try testing.expect(grid.atlas_generation.load(.monotonic) > 0);
+    try testing.expect(grid.glyphs.count() < 127 - 33);
+    try testing.expectEqual(grid.atlas_generation.load(.monotonic), listener.count);
+}
@@ -26,6 +26,7 @@ const DesiredSize = font.face.DesiredSize;
 const Face = font.Face;
 const SharedGrid = font.SharedGrid;
 const discovery = @import("discovery.zig");
+const DiscoveryCache = font.DiscoveryCache;
 const configpkg = @import("../config.zig");
 const Config = configpkg.Config;
 
@@ -443,7 +444,20 @@ fn discover(self: *SharedGridSet) !?*Discover {
     if (self.font_discover) |*v| return v;
 
     self.font_discover = .init();
-    return &self.font_discover.?;
+    const disco = &self.font_discover.?;
+
+    // Reuse the results of searches from previous runs if we can. Tests
+    // shouldn't depend on or modify the user's cache.
+    if (comptime @hasDecl(Discover, "initCache") and !builtin.is_test) cache: {
+        const path = DiscoveryCache.defaultPath(self.alloc) catch |err| {
+            log.warn("error finding font discovery cache path err={}", .{err});
+            break :cache;
+        };
+        defer self.alloc.free(path);
+        try disco.initCache(self.alloc, path);
+    }
+
+    return disco;
 }
 
 /// Ref-counted SharedGrid.
@@ -8,6 +8,7 @@ const opentype = @import("opentype.zig");
 const options = @import("main.zig").options;
 const Collection = @import("main.zig").Collection;
 const DeferredFace = @import("main.zig").DeferredFace;
+const DiscoveryCache = @import("main.zig").DiscoveryCache;
 const Variation = @import("main.zig").face.Variation;
 
 const log = std.log.scoped(.discovery);
@@ -243,6 +244,9 @@ pub const Descriptor = struct {
 pub const Fontconfig = struct {
     fc_config: *fontconfig.Config,
 
+    /// The cache of previous search results, see initCache.
+    cache: ?*DiscoveryCache = null,
+
     pub fn init() Fontconfig {
         // safe to call multiple times and concurrently
         _ = fontconfig.init();
@@ -250,9 +254,58 @@ pub const Fontconfig = struct {
     }
 
     pub fn deinit(self: *Fontconfig) void {
+        if (self.cache) |cache| {
+            cache.save() catch |err| {
+                log.warn("error saving font discovery cache err={}", .{err});
+            };
+            const alloc = cache.alloc;
+            cache.deinit();
+            alloc.destroy(cache);
+        }
+
         self.fc_config.destroy();
     }
 
+    /// Use the cache file at the given path to skip searches that were
+    /// done before, by this or a previous process. New search results are
+    /// written to the file on deinit.
+    pub fn initCache(
+        self: *Fontconfig,
+        alloc: Allocator,
+        path: []const u8,
+    ) Allocator.Error!void {
+        assert(self.cache == null);
+        const cache = try alloc.create(DiscoveryCache);
+        errdefer alloc.destroy(cache);
+        cache.* = try .open(alloc, path, self.cacheStamp());
+        self.cache = cache;
+    }
+
+    /// A hash of the fontconfig configuration: the fontconfig version, and
+    /// the path and modification time of every config file and font
+    /// directory. Adding or removing a font changes the modification time
+    /// of its directory, so this changes whenever search results may.
+    fn cacheStamp(self: *const Fontconfig) u64 {
+        var hasher = std.hash.Wyhash.init(0);
+        std.hash.autoHash(&hasher, fontconfig.version());
+        hashPaths(&hasher, self.fc_config.configFiles());
+        hashPaths(&hasher, self.fc_config.fontDirs());
+        return hasher.final();
+    }
+
+    fn hashPaths(hasher: *std.hash.Wyhash, list: *fontconfig.StrList) void {
+        defer list.destroy();
+        while (list.next()) |path| {
+            hasher.update(path);
+            hasher.update(&.{0});
+            const mtime: i128 = if (std.fs.cwd().statFile(path)) |stat|
+                stat.mtime
+            else |_|
+                0;
+            std.hash.autoHash(hasher, mtime);
+        }
+    }
+
     /// Discover fonts from a descriptor. This returns an iterator that can
     /// be used to build up the deferred fonts.
     pub fn discover(
@@ -268,19 +321,29 @@ pub const Fontconfig = struct {
         assert(self.fc_config.substituteWithPat(pat, .pattern));
         pat.defaultSubstitute();
 
-        // Search
-        const res = self.fc_config.fontSort(pat, false, null);
-        if (res.result != .match) return error.FontConfigFailed;
-        errdefer res.fs.destroy();
-
-        return .{
+        var it: DiscoverIterator = .{
             .config = self.fc_config,
             .pattern = pat,
-            .set = res.fs,
-            .fonts = res.fs.fonts(),
             .variations = desc.variations,
-            .i = 0,
+            .cache = self.cache,
+            .key = desc.hashcode(),
         };
+
+        // If we did this search before, we return the same fonts without
+        // searching, and only search if the caller wants more than that.
+        if (self.cache) |cache| {
+            if (cache.get(it.key, &it.cached)) |result| {
+                it.cached_len = result.faces.len;
+                it.cached_complete = result.complete;
+                return it;
+            }
+
+            it.record = true;
+        }
+
+        // Search
+        it.sort() catch return error.FontConfigFailed;
+        return it;
     }
 
     pub fn discoverFallback(
@@ -296,31 +359,132 @@ pub const Fontconfig = struct {
     pub const DiscoverIterator = struct {
         config: *fontconfig.Config,
         pattern: *fontconfig.Pattern,
-        set: *fontconfig.FontSet,
-        fonts: []*fontconfig.Pattern,
         variations: []const Variation,
-        i: usize,
+        i: usize = 0,
+
+        /// The sorted fonts. This is null until we search, which we
+        /// may never do if the results are cached.
+        set: ?*fontconfig.FontSet = null,
+        fonts: []*fontconfig.Pattern = &.{},
+
+        /// The cache and the key of this search in it.
+        cache: ?*DiscoveryCache = null,
+        key: u64 = 0,
+
+        /// The fonts found by a previous search, if it was cached. These
+        /// are returned first. Their paths are owned by the cache.
+        cached: [DiscoveryCache.max_faces]DiscoveryCache.Face = undefined,
+        cached_len: ?usize = null,
+        cached_complete: bool = false,
+
+        /// Whether to add the fonts we return to the cache on deinit.
+        /// The paths are owned by `set`, so they're valid until then.
+        record: bool = false,
+        recorded: [DiscoveryCache.max_faces]DiscoveryCache.Face = undefined,
+        recorded_len: usize = 0,
+        recorded_complete: bool = false,
 
         pub fn deinit(self: *DiscoverIterator) void {
-            self.set.destroy();
+            if (self.record and (self.i > 0 or self.recorded_complete)) {
+                if (self.cache) |cache| cache.put(self.key, .{
+                    .faces = self.recorded[0..self.recorded_len],
+                    .complete = self.recorded_complete,
+                }) catch {};
+            }
+
+            if (self.set) |set| set.destroy();
             self.pattern.destroy();
             self.* = undefined;
         }
 
+        fn sort(self: *DiscoverIterator) fontconfig.Error!void {
+            assert(self.set == null);
+            const res = self.config.fontSort(self.pattern, false, null);
+            if (res.result != .match) return error.FontconfigFailed;
+            self.set = res.fs;
+            self.fonts = res.fs.fonts();
+        }
+
         pub fn next(self: *DiscoverIterator) fontconfig.Error!?DeferredFace {
-            if (self.i >= self.fonts.len) return null;
+            if (self.cached_len) |len| cached: {
+                if (self.i >= len) {
+                    if (self.cached_complete) return null;
+                    break :cached;
+                }
+
+                // If the font is gone, even though the stamp says nothing
+                // changed, the cache entry is stale. We search from the
+                // start and record it again so the entry is replaced. This
+                // may return fonts we already returned, which is harmless.
+                const face = try self.loadCached(self.cached[self.i]) orelse {
+                    log.info("cached font not found path={s}", .{self.cached[self.i].path});
+                    self.cached_len = null;
+                    self.i = 0;
+                    self.record = true;
+                    self.recorded_len = 0;
+                    break :cached;
+                };
+
+                self.i += 1;
+                return face;
+            }
+
+            // The cached fonts are the first fonts of the search, so we
+            // continue the search from where they left off.
+            if (self.set == null) try self.sort();
+
+            if (self.i >= self.fonts.len) {
+                self.recorded_complete = self.record and
+                    self.recorded_len == self.i;
+                return null;
+            }
+
+            const face = try self.prepare(self.fonts[self.i]);
+            if (self.record) self.recordFont(self.fonts[self.i]);
 
-            // Get the copied pattern from our fontset that has the
-            // attributes configured for rendering.
+            // Increment after we return
+            self.i += 1;
+            return face;
+        }
+
+        /// Load a font from the cache. We list the font by its file
+        /// and index, which is much cheaper than sorting all fonts.
+        fn loadCached(
+            self: *DiscoverIterator,
+            face: DiscoveryCache.Face,
+        ) fontconfig.Error!?DeferredFace {
+            const pat = fontconfig.Pattern.create();
+            defer pat.destroy();
+            if (!pat.add(.file, .{ .string = face.path }, false) or
+                !pat.add(.index, .{ .integer = @intCast(face.index) }, false))
+                return error.OutOfMemory;
+
+            // We need every property of the font for render prepare.
+            const os = fontconfig.ObjectSet.create();
+            defer os.destroy();
+            for (std.enums.values(fontconfig.Property)) |prop| {
+                if (!os.add(prop)) return error.OutOfMemory;
+            }
+
+            const set = self.config.fontList(pat, os);
+            defer set.destroy();
+            const fonts = set.fonts();
+            if (fonts.len == 0) return null;
+            return try self.prepare(fonts[0]);
+        }
+
+        /// Get the copied pattern from the given font with the
+        /// attributes configured for rendering.
+        fn prepare(
+            self: *DiscoverIterator,
+            font: *fontconfig.Pattern,
+        ) fontconfig.Error!DeferredFace {
             const font_pattern = try self.config.fontRenderPrepare(
                 self.pattern,
-                self.fonts[self.i],
+                font,
             );
             errdefer font_pattern.destroy();
 
-            // Increment after we return
-            defer self.i += 1;
-
             return DeferredFace{
                 .fc = .{
                     .pattern = font_pattern,
@@ -330,6 +494,34 @@ pub const Fontconfig = struct {
                 },
             };
         }
+
+        /// Record a font we returned to add it to the cache. If the font
+        /// doesn't have a file we can't cache this search at all.
+        fn recordFont(self: *DiscoverIterator, font: *fontconfig.Pattern) void {
+            if (self.recorded_len < self.recorded.len) {
+                const path = font.get(.file, 0) catch {
+                    self.record = false;
+                    return;
+                };
+                const index = font.get(.index, 0) catch {
+                    self.record = false;
+                    return;
+                };
+                if (path != .string or index != .integer) {
+                    self.record = false;
+                    return;
+                }
+
+                self.recorded[self.recorded_len] = .{
+                    .path = path.string,
+                    .index = std.math.cast(u32, index.integer) orelse {
+                        self.record = false;
+                        return;
+                    },
+                };
+                self.recorded_len += 1;
+            }
+        }
     };
 };
 
@@ -923,6 +1115,52 @@ test "fontconfig codepoint" {
     try testing.expect(face.hasCodepoint('B', null));
 }
 
+test "fontconfig cache" {
+    if (options.backend != .fontconfig_freetype) return error.SkipZigTest;
+
+    const testing = std.testing;
+    const alloc = testing.allocator;
+    const TempDir = @import("../os/main.zig").TempDir;
+
+    var td: TempDir = try .init();
+    defer td.deinit();
+    const dir = try td.dir.realpathAlloc(alloc, ".");
+    defer alloc.free(dir);
+    const path = try std.fs.path.join(alloc, &.{ dir, "font_discovery" });
+    defer alloc.free(path);
+
+    const desc: Descriptor = .{ .codepoint = 'A', .size = 12 };
+    var buf: [256]u8 = undefined;
+
+    // Search without a cache file, which saves the result.
+    const name = name: {
+        var fc = Fontconfig.init();
+        defer fc.deinit();
+        try fc.initCache(alloc, path);
+
+        var it = try fc.discover(alloc, desc);
+        defer it.deinit();
+        var face = (try it.next()).?;
+        defer face.deinit();
+        break :name try alloc.dupe(u8, try face.name(&buf));
+    };
+    defer alloc.free(name);
+
+    // The same search with the cache file returns the same font
+    // without searching.
+    var fc = Fontconfig.init();
+    defer fc.deinit();
+    try fc.initCache(alloc, path);
+
+    var it = try fc.discover(alloc, desc);
+    defer it.deinit();
+    var face = (try it.next()).?;
+    defer face.deinit();
+    try testing.expect(it.set == null);
+    try testing.expectEqualStrings(name, try face.name(&buf));
+    try testing.expect(face.hasCodepoint('A', null));
+}
+
 test "coretext" {
     if (options.backend != .coretext and options.backend != .coretext_freetype)
         return error.SkipZigTest;
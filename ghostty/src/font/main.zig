@@ -12,6 +12,7 @@ pub const CodepointMap = @import("CodepointMap.zig");
 pub const CodepointResolver = @import("CodepointResolver.zig");
 pub const Collection = @import("Collection.zig");
 pub const DeferredFace = @import("DeferredFace.zig");
+pub const DiscoveryCache = @import("DiscoveryCache.zig");
 pub const Face = face.Face;
 pub const Glyph = @import("Glyph.zig");
 pub const Metrics = @import("Metrics.zig");
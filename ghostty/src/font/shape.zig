@@ -10,6 +10,7 @@ pub const harfbuzz = @import("shaper/harfbuzz.zig");
 pub const coretext = @import("shaper/coretext.zig");
 pub const web_canvas = @import("shaper/web_canvas.zig");
 pub const Cache = @import("shaper/Cache.zig");
+pub const SharedCache = @import("shaper/SharedCache.zig");
 pub const TextRun = run.TextRun;
 pub const RunIterator = run.RunIterator;
 pub const Feature = feature.Feature;
@@ -98,6 +99,7 @@ pub const RunOptions = struct {
 
 test {
     _ = Cache;
+    _ = SharedCache;
     _ = Shaper;
 
     // Always test noop
@@ -8,6 +8,15 @@
 //! The cache key is the text run. The text run builds its own hash value
 //! based on the font, style, codepoint, etc. This just utilizes the hash that
 //! the text run provides.
+//!
+//! The cache is made up of one or more fixed size tables, with each run
+//! stored in the table picked by its hash. We start with a single table
+//! and add more if the working set turns out to be larger than our
+//! capacity, which we detect by watching the miss and eviction rates.
+//!
+//! Optionally, a cache can be backed by a SharedCache that is shared
+//! with the caches of other surfaces using the same font grid. It is
+//! consulted on a miss and receives every run we shape.
 pub const Cache = @This();
 
 const std = @import("std");
@@ -15,6 +24,7 @@ const assert = std.debug.assert;
 const Allocator = std.mem.Allocator;
 const font = @import("../main.zig");
 const CacheTable = @import("../../datastruct/main.zig").CacheTable;
+const SharedCache = @import("SharedCache.zig");
 
 const log = std.log.scoped(.font_shaper_cache);
 
@@ -35,31 +45,145 @@ const CellCacheTable = CacheTable(
     u64,
     []font.shape.Cell,
     CellCacheTableContext,
-
-    // Capacity is slightly arbitrary. These numbers are guesses.
-    //
-    // I'd expect then an average of 256 frequently cached runs is a
-    // safe guess most terminal screens.
-    256,
+    table_buckets,
     // 8 items per bucket to give decent resilliency to important runs.
     8,
 );
 
-/// The cache table of shaped cells.
-map: CellCacheTable,
+/// The number of buckets in each table. Runs are assigned to a table
+/// by the bits of their hash above the ones that pick the bucket.
+const table_buckets = 256;
+
+/// The number of runs a single table can hold. One table is enough
+/// for most terminal screens, which have a few hundred distinct runs.
+pub const table_capacity = table_buckets * 8;
+
+/// The maximum number of tables we grow to. Each table is about 50KB.
+const max_tables = 8;
+
+/// The number of lookups we consider before deciding whether to grow.
+const window_lookups = 4096;
+
+/// We grow if more than this fraction of the lookups in a window missed
+/// and at least one of those misses evicted another run. If nothing is
+/// being evicted, misses are for new runs, and more room won't help.
+const grow_miss_ratio = 0.25;
+
+/// Counters for how well the cache is working. These are written by the
+/// thread that owns the cache but may be read from any thread, i.e. by
+/// the inspector.
+pub const Stats = struct {
+    hits: std.atomic.Value(u64) = .init(0),
+
+    /// Lookups that missed this cache but hit the shared cache.
+    shared_hits: std.atomic.Value(u64) = .init(0),
+
+    misses: std.atomic.Value(u64) = .init(0),
+    evictions: std.atomic.Value(u64) = .init(0),
+
+    /// The number of runs the cache can currently hold.
+    capacity: std.atomic.Value(u64) = .init(0),
+
+    pub const Snapshot = struct {
+        hits: u64,
+        shared_hits: u64,
+        misses: u64,
+        evictions: u64,
+        capacity: u64,
+    };
+
+    pub fn snapshot(self: *const Stats) Snapshot {
+        return .{
+            .hits = self.hits.load(.monotonic),
+            .shared_hits = self.shared_hits.load(.monotonic),
+            .misses = self.misses.load(.monotonic),
+            .evictions = self.evictions.load(.monotonic),
+            .capacity = self.capacity.load(.monotonic),
+        };
+    }
+};
+
+/// The cache tables of shaped cells. This is empty until the first
+/// put, and always has a power of two length after that.
+tables: []CellCacheTable = &.{},
+
+stats: Stats = .{},
+
+/// The cache shared with other surfaces, if any, and the seed for
+/// our keys in it. See `setShared`.
+shared: ?*SharedCache = null,
+shared_seed: u64 = 0,
+
+/// Counts for the current sizing window, see `window_lookups`.
+window: struct {
+    lookups: u32 = 0,
+    misses: u32 = 0,
+    evictions: u32 = 0,
+} = .{},
 
 pub fn init() Cache {
-    return .{ .map = .{ .context = .{} } };
+    return .{};
 }
 
 pub fn deinit(self: *Cache, alloc: Allocator) void {
     self.clear(alloc);
+    alloc.free(self.tables);
+}
+
+/// Use the given shared cache on a miss, and add everything we shape to
+/// it. The features are the features our shaper was created with, since
+/// other caches may use the same shared cache with different features.
+pub fn setShared(
+    self: *Cache,
+    shared: ?*SharedCache,
+    features: []const [:0]const u8,
+) void {
+    self.shared = shared;
+    self.shared_seed = SharedCache.featuresSeed(features);
 }
 
 /// Get the shaped cells for the given text run,
 /// or null if they are not in the cache.
-pub fn get(self: *Cache, run: font.shape.TextRun) ?[]const font.shape.Cell {
-    return self.map.get(run.hash);
+pub fn get(
+    self: *Cache,
+    alloc: Allocator,
+    run: font.shape.TextRun,
+) ?[]const font.shape.Cell {
+    self.window.lookups += 1;
+    if (self.tables.len > 0) {
+        if (self.table(run.hash).get(run.hash)) |cells| {
+            _ = self.stats.hits.fetchAdd(1, .monotonic);
+            return cells;
+        }
+    }
+
+    // Even if the shared cache hits this is a miss for sizing purposes,
+    // since our own working set doesn't fit.
+    self.window.misses += 1;
+
+    if (self.getShared(alloc, run)) |cells| {
+        _ = self.stats.shared_hits.fetchAdd(1, .monotonic);
+        return cells;
+    }
+
+    _ = self.stats.misses.fetchAdd(1, .monotonic);
+    return null;
+}
+
+/// Look up the run in the shared cache and copy it in to ours if found.
+fn getShared(
+    self: *Cache,
+    alloc: Allocator,
+    run: font.shape.TextRun,
+) ?[]const font.shape.Cell {
+    const shared = self.shared orelse return null;
+    const k = SharedCache.key(self.shared_seed, run.hash);
+    const cells = (shared.get(alloc, k) catch return null) orelse return null;
+    self.insert(alloc, run.hash, cells) catch {
+        alloc.free(cells);
+        return null;
+    };
+    return cells;
 }
 
 /// Insert the shaped cells for the given text run into the cache.
@@ -71,20 +195,112 @@ pub fn put(
     run: font.shape.TextRun,
     cells: []const font.shape.Cell,
 ) Allocator.Error!void {
+    if (self.shared) |shared| {
+        shared.put(SharedCache.key(self.shared_seed, run.hash), cells) catch |err| {
+            log.warn("error adding to shared shaper cache err={}", .{err});
+        };
+    }
+
     const copy = try alloc.dupe(font.shape.Cell, cells);
-    const evicted = self.map.put(run.hash, copy);
+    errdefer alloc.free(copy);
+    try self.insert(alloc, run.hash, copy);
+}
+
+/// Insert cells that we take ownership of.
+fn insert(
+    self: *Cache,
+    alloc: Allocator,
+    hash: u64,
+    cells: []font.shape.Cell,
+) Allocator.Error!void {
+    if (self.tables.len == 0) {
+        try self.resize(alloc, 1);
+    } else if (self.window.lookups >= window_lookups) {
+        self.adapt(alloc);
+    }
+
+    const evicted = self.table(hash).put(hash, cells);
     if (evicted) |kv| {
         alloc.free(kv.value);
+        _ = self.stats.evictions.fetchAdd(1, .monotonic);
+        self.window.evictions += 1;
     }
 }
 
+/// Remove all cached runs and shrink back to a single table, since
+/// the working set will be rebuilt from scratch. Stats are kept.
+pub fn reset(self: *Cache, alloc: Allocator) void {
+    self.clear(alloc);
+    self.window = .{};
+    if (self.tables.len > 1) self.resize(alloc, 1) catch |err| {
+        // We're shrinking, so this should never happen, but if it
+        // does it's fine to keep our larger tables.
+        log.warn("error shrinking shaper cache err={}", .{err});
+    };
+}
+
+/// Grow if the last window suggests our working set doesn't fit.
+fn adapt(self: *Cache, alloc: Allocator) void {
+    const w = self.window;
+    self.window = .{};
+
+    if (self.tables.len >= max_tables) return;
+    if (w.evictions == 0) return;
+    const miss_ratio = @as(f64, @floatFromInt(w.misses)) /
+        @as(f64, @floatFromInt(w.lookups));
+    if (miss_ratio <= grow_miss_ratio) return;
+
+    self.resize(alloc, self.tables.len * 2) catch |err| {
+        log.warn("error growing shaper cache err={}", .{err});
+        return;
+    };
+    log.debug("grew shaper cache capacity={} miss_ratio={d:.2}", .{
+        self.tables.len * table_capacity,
+        miss_ratio,
+    });
+}
+
+/// Resize to the given number of tables, moving all existing runs.
+fn resize(self: *Cache, alloc: Allocator, len: usize) Allocator.Error!void {
+    assert(std.math.isPowerOfTwo(len));
+    const tables = try alloc.alloc(CellCacheTable, len);
+    for (tables) |*t| t.* = .{ .context = .{} };
+
+    const old = self.tables;
+    self.tables = tables;
+    defer alloc.free(old);
+
+    for (old) |*t| {
+        for (t.buckets, t.lengths) |b, l| {
+            for (b[0..l]) |kv| {
+                // When growing, every run in a bucket lands in the same
+                // bucket of a new table, so nothing can be evicted. When
+                // shrinking we only ever shrink empty tables.
+                const evicted = self.table(kv.key).put(kv.key, kv.value);
+                assert(evicted == null);
+            }
+        }
+    }
+
+    self.stats.capacity.store(len * table_capacity, .monotonic);
+}
+
+/// Returns the table for the given run hash.
+fn table(self: *Cache, hash: u64) *CellCacheTable {
+    assert(self.tables.len > 0);
+    const idx = @as(usize, @truncate(hash / table_buckets)) & (self.tables.len - 1);
+    return &self.tables[idx];
+}
+
 fn clear(self: *Cache, alloc: Allocator) void {
-    for (self.map.buckets, self.map.lengths) |b, l| {
-        for (b[0..l]) |kv| {
-            alloc.free(kv.value);
+    for (self.tables) |*t| {
+        for (t.buckets, t.lengths) |b, l| {
+            for (b[0..l]) |kv| {
+                alloc.free(kv.value);
+            }
         }
+        t.clear();
     }
-    self.map.clear();
 }
 
 test Cache {
@@ -96,12 +312,78 @@ test Cache {
 
     var run: font.shape.TextRun = undefined;
     run.hash = 1;
-    try testing.expect(c.get(run) == null);
+    try testing.expect(c.get(alloc, run) == null);
     try c.put(alloc, run, &.{
         .{ .x = 0, .glyph_index = 0 },
         .{ .x = 1, .glyph_index = 1 },
     });
 
-    const actual = c.get(run).?;
+    const actual = c.get(alloc, run).?;
     try testing.expect(actual.len == 2);
+
+    const stats = c.stats.snapshot();
+    try testing.expectEqual(1, stats.hits);
+    try testing.expectEqual(1, stats.misses);
+    try testing.expectEqual(0, stats.evictions);
+    try testing.expectEqual(table_capacity, stats.capacity);
+}
+
+test "Cache grows when the working set doesn't fit" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var c = Cache.init();
+    defer c.deinit(alloc);
+
+    // Cycle through more runs than we can hold, so that every lookup
+    // misses and every put evicts something.
+    var run: font.shape.TextRun = undefined;
+    for (0..window_lookups * 2) |i| {
+        run.hash = i % (table_capacity * 2);
+        if (c.get(alloc, run) == null) try c.put(alloc, run, &.{});
+    }
+
+    try testing.expectEqual(2 * table_capacity, c.stats.snapshot().capacity);
+
+    // Runs we added before growing are still there.
+    run.hash = table_capacity * 2 - 1;
+    try testing.expect(c.get(alloc, run) != null);
+
+    // Resetting shrinks back down but keeps stats.
+    c.reset(alloc);
+    try testing.expectEqual(table_capacity, c.stats.snapshot().capacity);
+    try testing.expect(c.stats.snapshot().evictions > 0);
+    try testing.expect(c.get(alloc, run) == null);
+}
+
+test "Cache with shared cache" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var shared = try SharedCache.init(alloc);
+    defer shared.deinit();
+
+    var a = Cache.init();
+    defer a.deinit(alloc);
+    a.setShared(&shared, &.{});
+    var b = Cache.init();
+    defer b.deinit(alloc);
+    b.setShared(&shared, &.{});
+
+    // A run shaped by one cache is found by the other.
+    var run: font.shape.TextRun = undefined;
+    run.hash = 1;
+    try a.put(alloc, run, &.{.{ .x = 0, .glyph_index = 0 }});
+    try testing.expectEqual(1, b.get(alloc, run).?.len);
+    try testing.expectEqual(1, b.stats.snapshot().shared_hits);
+
+    // It's now in the other cache too.
+    try testing.expectEqual(1, b.get(alloc, run).?.len);
+    try testing.expectEqual(1, b.stats.snapshot().hits);
+
+    // A cache with different features doesn't see it.
+    var c = Cache.init();
+    defer c.deinit(alloc);
+    c.setShared(&shared, &.{"-calt"});
+    try testing.expect(c.get(alloc, run) == null);
 }
@@ -0,0 +1,160 @@
+//! A cache of shaped cells that can be used by many threads at once.
+//!
+//! Every renderer has its own shaper cache which it can use without any
+//! locking, but surfaces that use the same font grid tend to shape the same
+//! runs (the same shell prompt, the same tools). So every SharedGrid has one
+//! of these which renderers fall back to on a miss in their own cache,
+//! meaning a new surface starts out with the runs other surfaces have
+//! already shaped.
+//!
+//! The cache is split in to shards, each with its own lock and picked by
+//! the key, so that renderers rarely contend with each other. Lookups must
+//! take the lock too, since a lookup updates the least recently used order.
+//!
+//! Keys are run hashes mixed with a hash of the shaper features used, see
+//! `key`, since the same run can be shaped differently with different
+//! features and surfaces sharing a grid may not share features.
+pub const SharedCache = @This();
+
+const std = @import("std");
+const assert = std.debug.assert;
+const Allocator = std.mem.Allocator;
+const font = @import("../main.zig");
+const CacheTable = @import("../../datastruct/main.zig").CacheTable;
+
+const log = std.log.scoped(.font_shaper_cache);
+
+/// Context for cache table.
+const CellCacheTableContext = struct {
+    pub fn hash(self: *const CellCacheTableContext, k: u64) u64 {
+        _ = self;
+        return k;
+    }
+    pub fn eql(self: *const CellCacheTableContext, a: u64, b: u64) bool {
+        _ = self;
+        return a == b;
+    }
+};
+
+/// Cache table for key -> shaped cells, one per shard.
+const CellCacheTable = CacheTable(
+    u64,
+    []font.shape.Cell,
+    CellCacheTableContext,
+    shard_buckets,
+    8,
+);
+
+/// The number of shards. This is more than the number of renderer
+/// threads we'd expect to be rebuilding at the same time.
+const shard_count = 16;
+
+/// The number of buckets in each shard. Shards are picked by the bits
+/// of the key above the ones that pick the bucket.
+const shard_buckets = 128;
+
+const Shard = struct {
+    mutex: std.Thread.Mutex = .{},
+    map: CellCacheTable = .{ .context = .{} },
+};
+
+/// The allocator used for the cached cells. We keep this since the
+/// cache is used and freed by different owners.
+alloc: Allocator,
+
+shards: []Shard,
+
+pub fn init(alloc: Allocator) Allocator.Error!SharedCache {
+    const shards = try alloc.alloc(Shard, shard_count);
+    for (shards) |*shard| shard.* = .{};
+    return .{ .alloc = alloc, .shards = shards };
+}
+
+/// Deinit. Assumes no concurrent access so no lock is taken.
+pub fn deinit(self: *SharedCache) void {
+    for (self.shards) |*shard| {
+        for (shard.map.buckets, shard.map.lengths) |b, l| {
+            for (b[0..l]) |kv| {
+                self.alloc.free(kv.value);
+            }
+        }
+    }
+    self.alloc.free(self.shards);
+}
+
+/// Returns the key for the given run hash, shaped with
+/// features that hash to the given seed.
+pub fn key(seed: u64, run_hash: u64) u64 {
+    return std.hash.Wyhash.hash(seed, std.mem.asBytes(&run_hash));
+}
+
+/// Returns a hash of the given shaper features, to use as the seed for keys.
+pub fn featuresSeed(features: []const [:0]const u8) u64 {
+    var hasher = std.hash.Wyhash.init(0);
+    for (features) |feature| {
+        std.hash.autoHash(&hasher, feature.len);
+        hasher.update(feature);
+    }
+    return hasher.final();
+}
+
+/// Get a copy of the shaped cells for the given key, allocated with the
+/// given allocator and owned by the caller, or null if they aren't cached.
+pub fn get(
+    self: *SharedCache,
+    alloc: Allocator,
+    k: u64,
+) Allocator.Error!?[]font.shape.Cell {
+    const shard = self.shardFor(k);
+    shard.mutex.lock();
+    defer shard.mutex.unlock();
+    const cells = shard.map.get(k) orelse return null;
+    return try alloc.dupe(font.shape.Cell, cells);
+}
+
+/// Insert the shaped cells for the given key into the cache.
+///
+/// The cells will be duplicated.
+pub fn put(
+    self: *SharedCache,
+    k: u64,
+    cells: []const font.shape.Cell,
+) Allocator.Error!void {
+    const copy = try self.alloc.dupe(font.shape.Cell, cells);
+    const evicted = evicted: {
+        const shard = self.shardFor(k);
+        shard.mutex.lock();
+        defer shard.mutex.unlock();
+        break :evicted shard.map.put(k, copy);
+    };
+    if (evicted) |kv| self.alloc.free(kv.value);
+}
+
+fn shardFor(self: *SharedCache, k: u64) *Shard {
+    return &self.shards[@as(usize, @truncate(k / shard_buckets)) % shard_count];
+}
+
+test SharedCache {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var c = try SharedCache.init(alloc);
+    defer c.deinit();
+
+    const seed = featuresSeed(&.{"-calt"});
+    try testing.expect(seed != featuresSeed(&.{}));
+
+    const k = key(seed, 1);
+    try testing.expect(try c.get(alloc, k) == null);
+    try c.put(k, &.{
+        .{ .x = 0, .glyph_index = 0 },
+        .{ .x = 1, .glyph_index = 1 },
+    });
+
+    const actual = (try c.get(alloc, k)).?;
+    defer alloc.free(actual);
+    try testing.expectEqual(2, actual.len);
+
+    // Different features don't see the same results.
+    try testing.expect(try c.get(alloc, key(featuresSeed(&.{}), 1)) == null);
+}
@@ -67,6 +67,55 @@ pub fn Quad(comptime T: type) type {
     };
 }
 
+/// The number of pixels we process at once in bulk operations on the
+/// canvas buffer, which we do with vectors rather than pixel by pixel.
+const vec_len = std.simd.suggestVectorLength(u8) orelse 16;
+const Vec = @Vector(vec_len, u8);
+
+/// Returns true if every byte is zero.
+fn allZero(bytes: []const u8) bool {
+    var i: usize = 0;
+    while (i + vec_len <= bytes.len) : (i += vec_len) {
+        const v: Vec = bytes[i..][0..vec_len].*;
+        if (@reduce(.Or, v) != 0) return false;
+    }
+    for (bytes[i..]) |b| if (b != 0) return false;
+    return true;
+}
+
+/// Multiply each alpha value in `dst` by the one in `src`, i.e. to mask.
+fn multiply(dst: []u8, src: []const u8) void {
+    assert(dst.len == src.len);
+    var i: usize = 0;
+    while (i + vec_len <= dst.len) : (i += vec_len) {
+        dst[i..][0..vec_len].* = multiplyVec(
+            dst[i..][0..vec_len].*,
+            src[i..][0..vec_len].*,
+        );
+    }
+
+    // Do the remainder with one more vector, padded with zeroes.
+    if (i < dst.len) {
+        var d: [vec_len]u8 = @splat(0);
+        var s: [vec_len]u8 = @splat(0);
+        @memcpy(d[0 .. dst.len - i], dst[i..]);
+        @memcpy(s[0 .. dst.len - i], src[i..]);
+        const result: [vec_len]u8 = multiplyVec(d, s);
+        @memcpy(dst[i..], result[0 .. dst.len - i]);
+    }
+}
+
+/// Computes `round(d * s / 255)` for each element, exactly, without
+/// division: for `t = d * s + 128`, that is `(t + (t >> 8)) >> 8`.
+fn multiplyVec(d: Vec, s: Vec) Vec {
+    const Wide = @Vector(vec_len, u16);
+    const shift: @Vector(vec_len, u4) = @splat(8);
+    const dw: Wide = @intCast(d);
+    const sw: Wide = @intCast(s);
+    const t = dw * sw + @as(Wide, @splat(128));
+    return @intCast((t + (t >> shift)) >> shift);
+}
+
 /// We only use alpha-channel so a pixel can only be "on" or "off".
 pub const Color = enum(u8) {
     on = 255,
@@ -172,9 +221,7 @@ pub const Canvas = struct {
             const y = self.clip_top;
             const x0 = self.clip_left;
             const x1 = width - self.clip_right;
-            for (buf[y * width ..][x0..x1]) |v| {
-                if (v != 0) break :top;
-            }
+            if (!allZero(buf[y * width ..][x0..x1])) break :top;
             self.clip_top += 1;
         }
 
@@ -182,9 +229,7 @@ pub const Canvas = struct {
             const y = height - self.clip_bottom -| 1;
             const x0 = self.clip_left;
             const x1 = width - self.clip_right;
-            for (buf[y * width ..][x0..x1]) |v| {
-                if (v != 0) break :bottom;
-            }
+            if (!allZero(buf[y * width ..][x0..x1])) break :bottom;
             self.clip_bottom += 1;
         }
 
@@ -273,17 +318,26 @@ pub const Canvas = struct {
 
     /// Draw and fill a rectangle. This is the main primitive for drawing
     /// lines as well (which are just generally skinny rectangles...)
+    ///
+    /// This is the same as drawing every pixel in the rectangle with
+    /// `pixel`, but fills each row at once.
     pub fn rect(self: *Canvas, v: Rect(i32), color: Color) void {
-        var y = v.y;
-        while (y < v.y + v.height) : (y += 1) {
-            var x = v.x;
-            while (x < v.x + v.width) : (x += 1) {
-                self.pixel(
-                    @intCast(x),
-                    @intCast(y),
-                    color,
-                );
-            }
+        const width: i64 = @intCast(self.sfc.getWidth());
+        const height: i64 = @intCast(self.sfc.getHeight());
+
+        // Offset by our padding and clip to the surface.
+        const x: i64 = @as(i64, v.x) + self.padding_x;
+        const y: i64 = @as(i64, v.y) + self.padding_y;
+        const x0: usize = @intCast(std.math.clamp(x, 0, width));
+        const x1: usize = @intCast(std.math.clamp(x + v.width, 0, width));
+        const y0: usize = @intCast(std.math.clamp(y, 0, height));
+        const y1: usize = @intCast(std.math.clamp(y + v.height, 0, height));
+        if (x0 >= x1 or y0 >= y1) return;
+
+        const buf = std.mem.sliceAsBytes(self.sfc.image_surface_alpha8.buf);
+        const stride: usize = @intCast(width);
+        for (y0..y1) |row| {
+            @memset(buf[row * stride ..][x0..x1], @intFromEnum(color));
         }
     }
 
@@ -440,16 +494,10 @@ pub const Canvas = struct {
         // We multiply the stroke sfc on to the fill surface.
         // The z2d composite operation doesn't seem to work for
         // this with alpha8 surfaces, so we have to do it manually.
-        for (
+        multiply(
             std.mem.sliceAsBytes(fill_sfc.image_surface_alpha8.buf),
             std.mem.sliceAsBytes(stroke_sfc.image_surface_alpha8.buf),
-        ) |*d, s| {
-            d.* = @intFromFloat(@round(
-                255.0 *
-                    (@as(f64, @floatFromInt(s)) / 255.0) *
-                    (@as(f64, @floatFromInt(d.*)) / 255.0),
-            ));
-        }
+        );
 
         // Then we composite the result on to the main surface.
         self.sfc.composite(&fill_sfc, .src_over, 0, 0, .{});
@@ -475,38 +523,72 @@ pub const Canvas = struct {
 
     /// Invert all pixels on the canvas.
     pub fn invert(self: *Canvas) void {
-        for (std.mem.sliceAsBytes(self.sfc.image_surface_alpha8.buf)) |*v| {
-            v.* = 255 - v.*;
+        const buf = std.mem.sliceAsBytes(self.sfc.image_surface_alpha8.buf);
+        var i: usize = 0;
+        while (i + vec_len <= buf.len) : (i += vec_len) {
+            const v: Vec = buf[i..][0..vec_len].*;
+            buf[i..][0..vec_len].* = ~v;
         }
+        for (buf[i..]) |*v| v.* = ~v.*;
     }
 
     /// Mirror the canvas horizontally.
-    pub fn flipHorizontal(self: *Canvas) Allocator.Error!void {
+    pub fn flipHorizontal(self: *Canvas) void {
         const buf = std.mem.sliceAsBytes(self.sfc.image_surface_alpha8.buf);
-        const clone = try self.alloc.dupe(u8, buf);
-        defer self.alloc.free(clone);
         const width: usize = @intCast(self.sfc.getWidth());
         const height: usize = @intCast(self.sfc.getHeight());
-        for (0..height) |y| {
-            for (0..width) |x| {
-                buf[y * width + x] = clone[y * width + width - x - 1];
-            }
-        }
+        for (0..height) |y| std.mem.reverse(u8, buf[y * width ..][0..width]);
         std.mem.swap(u32, &self.clip_left, &self.clip_right);
     }
 
     /// Mirror the canvas vertically.
-    pub fn flipVertical(self: *Canvas) Allocator.Error!void {
+    pub fn flipVertical(self: *Canvas) void {
         const buf = std.mem.sliceAsBytes(self.sfc.image_surface_alpha8.buf);
-        const clone = try self.alloc.dupe(u8, buf);
-        defer self.alloc.free(clone);
         const width: usize = @intCast(self.sfc.getWidth());
         const height: usize = @intCast(self.sfc.getHeight());
-        for (0..height) |y| {
-            for (0..width) |x| {
-                buf[y * width + x] = clone[(height - y - 1) * width + x];
-            }
+        for (0..height / 2) |y| {
+            const top = buf[y * width ..][0..width];
+            const bottom = buf[(height - y - 1) * width ..][0..width];
+            for (top, bottom) |*t, *b| std.mem.swap(u8, t, b);
         }
         std.mem.swap(u32, &self.clip_top, &self.clip_bottom);
     }
 };
+
+test "multiply matches scalar rounding" {
+    const testing = std.testing;
+
+    // Every pair of values so every rounding case is checked.
+    var dst: [256 * 256]u8 = undefined;
+    var src: [256 * 256]u8 = undefined;
+    for (0..256) |d| {
+        for (0..256) |s| {
+            dst[d * 256 + s] = @intCast(d);
+            src[d * 256 + s] = @intCast(s);
+        }
+    }
+
+    // Lengths that aren't a multiple of the vector length go through
+    // the padded remainder. The start offsets vary the remainder values.
+    const lens = [_]usize{ 0, 1, vec_len - 1, vec_len + 1, 3 * vec_len + 5, dst.len - 7 };
+    for (lens, 0..) |len, start| {
+        var result = dst;
+        multiply(result[start..][0..len], src[start..][0..len]);
+        for (
+            result[start..][0..len],
+            dst[start..][0..len],
+            src[start..][0..len],
+        ) |r, d, s| {
+            // round(d * s / 255) with halves rounded up.
+            const expected = (@as(u32, d) * s * 2 + 255) / 510;
+            try testing.expectEqual(expected, r);
+        }
+    }
+
+    // The whole buffer in vectors.
+    var all = dst;
+    multiply(&all, &src);
+    for (all, dst, src) |r, d, s| {
+        try testing.expectEqual((@as(u32, d) * s * 2 + 255) / 510, r);
+    }
+}
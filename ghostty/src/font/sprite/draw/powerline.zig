@@ -230,7 +230,7 @@ pub fn drawE0B3(
     metrics: font.Metrics,
 ) !void {
     try drawE0B1(cp, canvas, width, height, metrics);
-    try canvas.flipHorizontal();
+    canvas.flipHorizontal();
 }
 
 /// 
@@ -329,7 +329,7 @@ pub fn drawE0B6(
     metrics: font.Metrics,
 ) !void {
     try drawE0B4(cp, canvas, width, height, metrics);
-    try canvas.flipHorizontal();
+    canvas.flipHorizontal();
 }
 
 /// 
@@ -341,7 +341,7 @@ pub fn drawE0B7(
     metrics: font.Metrics,
 ) !void {
     try drawE0B5(cp, canvas, width, height, metrics);
-    try canvas.flipHorizontal();
+    canvas.flipHorizontal();
 }
 
 /// 
@@ -392,5 +392,5 @@ pub fn drawE0D4(
     metrics: font.Metrics,
 ) !void {
     try drawE0D2(cp, canvas, width, height, metrics);
-    try canvas.flipHorizontal();
+    canvas.flipHorizontal();
 }
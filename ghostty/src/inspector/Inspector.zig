@@ -13,9 +13,13 @@ const font = @import("../font/main.zig");
 const input = @import("../input.zig");
 const renderer = @import("../renderer.zig");
 const terminal = @import("../terminal/main.zig");
+const trace = @import("../trace.zig");
+const internal_os = @import("../os/main.zig");
 const inspector = @import("main.zig");
 const units = @import("units.zig");
 
+const log = std.log.scoped(.inspector);
+
 /// The window names. These are used with docking so we need to have access.
 const window_cell = "Cell";
 const window_modes = "Modes";
@@ -23,6 +27,7 @@ const window_keyboard = "Keyboard";
 const window_termio = "Terminal IO";
 const window_screen = "Screen";
 const window_size = "Surface Info";
+const window_latency = "Latency";
 const window_imgui_demo = "Dear ImGui Demo";
 
 /// The surface that we're inspecting.
@@ -62,6 +67,9 @@ need_scroll_to_selected: bool = false,
 /// Flag indicating whether the selection was made by keyboard
 is_keyboard_selection: bool = false,
 
+/// The path of the last exported trace file, if any.
+trace_export_path: ?[:0]const u8 = null,
+
 /// Enum representing keyboard navigation actions
 const KeyAction = enum {
     down,
@@ -183,6 +191,8 @@ pub fn init(surface: *Surface) !Inspector {
 pub fn deinit(self: *Inspector) void {
     self.cell.deinit();
 
+    if (self.trace_export_path) |v| self.surface.alloc.free(v);
+
     {
         var it = self.key_events.iterator(.forward);
         while (it.next()) |v| v.deinit(self.surface.alloc);
@@ -246,6 +256,9 @@ pub fn render(self: *Inspector) void {
         self.renderSizeWindow();
     }
 
+    // Tracing data is independent of the terminal so we don't need the lock.
+    self.renderLatencyWindow();
+
     // In debug we show the ImGui demo window so we can easily view available
     // widgets and such.
     if (builtin.mode == .Debug) {
@@ -296,6 +309,7 @@ fn setupLayout(self: *Inspector, dock_id_main: cimgui.c.ImGuiID) void {
     cimgui.c.igDockBuilderDockWindow(window_screen, dock_id.left);
     cimgui.c.igDockBuilderDockWindow(window_imgui_demo, dock_id.left);
     cimgui.c.igDockBuilderDockWindow(window_size, dock_id.right);
+    cimgui.c.igDockBuilderDockWindow(window_latency, dock_id.right);
     cimgui.c.igDockBuilderFinish(dock_id_main);
 }
 
@@ -548,6 +562,33 @@ fn renderScreenWindow(self: *Inspector) void {
                 }
             }
 
+            {
+                const page_pool = terminal.PagePool.global();
+                const in_use = page_pool.used.load(.monotonic);
+                const free = page_pool.freeBytes();
+                const purged = page_pool.stats.purged_bytes.load(.monotonic);
+
+                cimgui.c.igTableNextRow(cimgui.c.ImGuiTableRowFlags_None, 0);
+                {
+                    _ = cimgui.c.igTableSetColumnIndex(0);
+                    cimgui.c.igText("Total Page Memory");
+                }
+                {
+                    _ = cimgui.c.igTableSetColumnIndex(1);
+                    cimgui.c.igText("%d KiB used, %d KiB free", units.toKibiBytes(in_use), units.toKibiBytes(free));
+                }
+
+                cimgui.c.igTableNextRow(cimgui.c.ImGuiTableRowFlags_None, 0);
+                {
+                    _ = cimgui.c.igTableSetColumnIndex(0);
+                    cimgui.c.igText("Purged Page Memory");
+                }
+                {
+                    _ = cimgui.c.igTableSetColumnIndex(1);
+                    cimgui.c.igText("%d KiB", units.toKibiBytes(purged));
+                }
+            }
+
             {
                 cimgui.c.igTableNextRow(cimgui.c.ImGuiTableRowFlags_None, 0);
                 {
@@ -905,6 +946,187 @@ fn renderSizeWindow(self: *Inspector) void {
     }
 }
 
+fn renderLatencyWindow(self: *Inspector) void {
+    // Start our window. If we're collapsed we do nothing.
+    defer cimgui.c.igEnd();
+    if (!cimgui.c.igBegin(
+        window_latency,
+        null,
+        cimgui.c.ImGuiWindowFlags_NoFocusOnAppearing,
+    )) return;
+
+    {
+        var enabled = trace.isEnabled();
+        if (cimgui.c.igCheckbox("Enable Tracing", &enabled)) {
+            trace.setEnabled(enabled);
+        }
+
+        cimgui.c.igSameLine(0, cimgui.c.igGetStyle().*.ItemInnerSpacing.x);
+        if (cimgui.c.igButton("Export Chrome Trace", .{ .x = 0, .y = 0 })) {
+            self.exportTrace() catch |err| {
+                log.warn("failed to export trace err={}", .{err});
+            };
+        }
+
+        if (self.trace_export_path) |path| {
+            cimgui.c.igText("Exported to %s", path.ptr);
+        }
+    }
+
+    // The shaper cache stats are always collected, not just when tracing.
+    if (cimgui.c.igCollapsingHeader_TreeNodeFlags(
+        "Shaper Cache",
+        cimgui.c.ImGuiTreeNodeFlags_DefaultOpen,
+    )) {
+        const stats = self.surface.renderer.font_shaper_cache.stats.snapshot();
+        const hits = stats.hits + stats.shared_hits;
+        const lookups = hits + stats.misses;
+
+        _ = cimgui.c.igBeginTable(
+            "table_shaper_cache",
+            2,
+            cimgui.c.ImGuiTableFlags_None,
+            .{ .x = 0, .y = 0 },
+            0,
+        );
+        defer cimgui.c.igEndTable();
+
+        inline for (.{
+            .{ "Hits", stats.hits },
+            .{ "Shared Hits", stats.shared_hits },
+            .{ "Misses", stats.misses },
+            .{ "Evictions", stats.evictions },
+            .{ "Capacity", stats.capacity },
+        }) |row| {
+            cimgui.c.igTableNextRow(cimgui.c.ImGuiTableRowFlags_None, 0);
+            _ = cimgui.c.igTableSetColumnIndex(0);
+            cimgui.c.igText(row[0]);
+            _ = cimgui.c.igTableSetColumnIndex(1);
+            cimgui.c.igText("%llu", @as(c_ulonglong, row[1]));
+        }
+
+        cimgui.c.igTableNextRow(cimgui.c.ImGuiTableRowFlags_None, 0);
+        _ = cimgui.c.igTableSetColumnIndex(0);
+        cimgui.c.igText("Hit Rate");
+        _ = cimgui.c.igTableSetColumnIndex(1);
+        if (lookups > 0) cimgui.c.igText(
+            "%.1f%%",
+            @as(f64, @floatFromInt(hits)) * 100 / @as(f64, @floatFromInt(lookups)),
+        );
+    }
+
+    // Only the render thread's glyph cache, which is used for every
+    // frame. Full rebuilds split in to bands use other caches too.
+    if (cimgui.c.igCollapsingHeader_TreeNodeFlags(
+        "Glyph Cache",
+        cimgui.c.ImGuiTreeNodeFlags_DefaultOpen,
+    )) {
+        const stats = self.surface.renderer.glyph_cache.stats.snapshot();
+        const lookups = stats.hits + stats.misses;
+
+        _ = cimgui.c.igBeginTable(
+            "table_glyph_cache",
+            2,
+            cimgui.c.ImGuiTableFlags_None,
+            .{ .x = 0, .y = 0 },
+            0,
+        );
+        defer cimgui.c.igEndTable();
+
+        inline for (.{
+            .{ "Hits", stats.hits },
+            .{ "Misses", stats.misses },
+        }) |row| {
+            cimgui.c.igTableNextRow(cimgui.c.ImGuiTableRowFlags_None, 0);
+            _ = cimgui.c.igTableSetColumnIndex(0);
+            cimgui.c.igText(row[0]);
+            _ = cimgui.c.igTableSetColumnIndex(1);
+            cimgui.c.igText("%llu", @as(c_ulonglong, row[1]));
+        }
+
+        cimgui.c.igTableNextRow(cimgui.c.ImGuiTableRowFlags_None, 0);
+        _ = cimgui.c.igTableSetColumnIndex(0);
+        cimgui.c.igText("Hit Rate");
+        _ = cimgui.c.igTableSetColumnIndex(1);
+        if (lookups > 0) cimgui.c.igText(
+            "%.1f%%",
+            @as(f64, @floatFromInt(stats.hits)) * 100 / @as(f64, @floatFromInt(lookups)),
+        );
+    }
+
+    cimgui.c.igSeparator();
+
+    const summary = trace.summarize(self.surface.alloc) catch |err| {
+        log.warn("failed to summarize trace err={}", .{err});
+        return;
+    };
+
+    _ = cimgui.c.igBeginTable(
+        "table_latency",
+        5,
+        cimgui.c.ImGuiTableFlags_RowBg |
+            cimgui.c.ImGuiTableFlags_Borders,
+        .{ .x = 0, .y = 0 },
+        0,
+    );
+    defer cimgui.c.igEndTable();
+
+    {
+        _ = cimgui.c.igTableSetupColumn("Event", cimgui.c.ImGuiTableColumnFlags_WidthStretch, 0, 0);
+        _ = cimgui.c.igTableSetupColumn("Count", cimgui.c.ImGuiTableColumnFlags_None, 0, 0);
+        _ = cimgui.c.igTableSetupColumn("p50", cimgui.c.ImGuiTableColumnFlags_None, 0, 0);
+        _ = cimgui.c.igTableSetupColumn("p99", cimgui.c.ImGuiTableColumnFlags_None, 0, 0);
+        _ = cimgui.c.igTableSetupColumn("Max", cimgui.c.ImGuiTableColumnFlags_None, 0, 0);
+        cimgui.c.igTableHeadersRow();
+    }
+
+    inline for (@typeInfo(trace.Event).@"enum".fields) |field| {
+        const event: trace.Event = @enumFromInt(field.value);
+        const hist = summary.get(event);
+
+        cimgui.c.igTableNextRow(cimgui.c.ImGuiTableRowFlags_None, 0);
+        _ = cimgui.c.igTableSetColumnIndex(0);
+        cimgui.c.igText("%s", field.name.ptr);
+        _ = cimgui.c.igTableSetColumnIndex(1);
+        cimgui.c.igText("%d", @as(c_int, @intCast(@min(hist.count, std.math.maxInt(c_int)))));
+
+        // Percentiles are bucket upper bounds, so they're only
+        // accurate to within a factor of two.
+        if (event.isSpan() and hist.count > 0) {
+            const us: f64 = std.time.ns_per_us;
+            _ = cimgui.c.igTableSetColumnIndex(2);
+            cimgui.c.igText("<%.0fus", @as(f64, @floatFromInt(hist.percentile(50))) / us);
+            _ = cimgui.c.igTableSetColumnIndex(3);
+            cimgui.c.igText("<%.0fus", @as(f64, @floatFromInt(hist.percentile(99))) / us);
+            _ = cimgui.c.igTableSetColumnIndex(4);
+            cimgui.c.igText("%.0fus", @as(f64, @floatFromInt(hist.max)) / us);
+        }
+    }
+}
+
+/// Write the current trace to a file in the temporary directory.
+fn exportTrace(self: *Inspector) !void {
+    const alloc = self.surface.alloc;
+    const dir = internal_os.allocTmpDir(alloc) orelse return error.NoTmpDir;
+    defer internal_os.freeTmpDir(alloc, dir);
+
+    const path = try std.fmt.allocPrintZ(
+        alloc,
+        "{s}{c}ghostty-trace-{d}.json",
+        .{ dir, std.fs.path.sep, std.time.milliTimestamp() },
+    );
+    errdefer alloc.free(path);
+
+    const file = try std.fs.createFileAbsolute(path, .{});
+    defer file.close();
+    var buf = std.io.bufferedWriter(file.writer());
+    try trace.writeChromeTrace(alloc, buf.writer());
+    try buf.flush();
+
+    if (self.trace_export_path) |v| alloc.free(v);
+    self.trace_export_path = path;
+}
+
 fn renderCellWindow(self: *Inspector) void {
     // Start our window. If we're collapsed we do nothing.
     defer cimgui.c.igEnd();
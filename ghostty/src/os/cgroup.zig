@@ -244,3 +244,20 @@ pub fn configureLimit(cgroup: []const u8, limit: Limit) !void {
     // Write our limit in bytes
     try file.writer().print("{}", .{size});
 }
+
+/// Open the memory.events file for the given cgroup. This file changes
+/// whenever the cgroup hits its memory.low, memory.high, or memory.max
+/// boundaries and can be polled for POLLPRI to be notified of changes.
+/// Note that after each event, the file must be read again to re-arm
+/// the notification.
+pub fn openMemoryEvents(cgroup: []const u8) !std.fs.File {
+    assert(cgroup[0] == '/');
+
+    var buf: [std.fs.max_path_bytes]u8 = undefined;
+    const path = try std.fmt.bufPrint(
+        &buf,
+        "/sys/fs/cgroup{s}/memory.events",
+        .{cgroup},
+    );
+    return try std.fs.cwd().openFile(path, .{});
+}
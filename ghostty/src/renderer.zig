@@ -19,10 +19,12 @@ pub const shadertoy = @import("renderer/shadertoy.zig");
 pub const GenericRenderer = @import("renderer/generic.zig").Renderer;
 pub const Metal = @import("renderer/Metal.zig");
 pub const OpenGL = @import("renderer/OpenGL.zig");
+pub const Software = @import("renderer/Software.zig");
 pub const WebGL = @import("renderer/WebGL.zig");
 pub const Options = @import("renderer/Options.zig");
 pub const Thread = @import("renderer/Thread.zig");
 pub const State = @import("renderer/State.zig");
+pub const Histogram = @import("renderer/Histogram.zig");
 pub const CursorStyle = cursor.Style;
 pub const Message = message.Message;
 pub const Size = size.Size;
@@ -39,6 +41,10 @@ pub const Impl = enum {
     metal,
     webgl,
 
+    /// CPU rasterizer with no display output, for headless
+    /// testing and benchmarking. Never chosen by default.
+    software,
+
     pub fn default(
         target: std.Target,
         wasm_target: WasmTarget,
@@ -60,6 +66,7 @@ pub const Renderer = switch (build_config.renderer) {
     .metal => GenericRenderer(Metal),
     .opengl => GenericRenderer(OpenGL),
     .webgl => WebGL,
+    .software => GenericRenderer(Software),
 };
 
 /// The health status of a renderer. These must be shared across all
@@ -76,8 +83,13 @@ test {
 
     _ = cursor;
     _ = message;
+    _ = Histogram;
     _ = shadertoy;
     _ = size;
+    _ = Software;
     _ = Thread;
     _ = State;
+    _ = @import("renderer/GlyphCache.zig");
+    _ = @import("renderer/image.zig");
+    _ = @import("renderer/RowCache.zig");
 }
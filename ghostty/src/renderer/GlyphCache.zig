@@ -0,0 +1,164 @@
+//! A small cache of glyph renders in front of the font grid.
+//!
+//! Building cells asks the font grid for the same few hundred glyphs
+//! over and over, every frame. The grid caches renders itself, but it
+//! is shared by every surface so looking a glyph up there means hashing
+//! the key and synchronizing with other threads. This cache is owned by
+//! a single thread (every band of a parallel rebuild has its own) and is
+//! direct-mapped, so a hit is one multiply and one comparison.
+//!
+//! Renders refer to regions of the font atlas, which are only valid
+//! until the grid evicts glyphs from the atlas, so the owner must call
+//! `validate` with the grid's atlas generation before using the cache,
+//! and `reset` if the font grid or render options change.
+pub const GlyphCache = @This();
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const font = @import("../font/main.zig");
+
+/// The number of entries. This must be a power of two.
+const len = 512;
+
+/// Shift for the top bits of the hash, which pick the entry.
+const slot_shift: u6 = @intCast(64 - @ctz(@as(u64, len)));
+
+/// The key of an empty entry. This is never a valid key since it
+/// has the padding bits of the packed key set.
+const empty = std.math.maxInt(u64);
+
+const Entry = struct {
+    key: u64 = empty,
+    render: font.SharedGrid.Render = undefined,
+};
+
+/// Counters for how well the cache is working. These are only written
+/// by the thread that owns the cache, so they're updated without
+/// read-modify-write operations, but may be read from any thread, i.e.
+/// by the inspector.
+pub const Stats = struct {
+    hits: std.atomic.Value(u64) = .init(0),
+    misses: std.atomic.Value(u64) = .init(0),
+
+    pub const Snapshot = struct {
+        hits: u64,
+        misses: u64,
+    };
+
+    pub fn snapshot(self: *const Stats) Snapshot {
+        return .{
+            .hits = self.hits.load(.monotonic),
+            .misses = self.misses.load(.monotonic),
+        };
+    }
+
+    fn increment(v: *std.atomic.Value(u64)) void {
+        v.store(v.load(.monotonic) +% 1, .monotonic);
+    }
+};
+
+entries: [len]Entry = @splat(.{}),
+
+/// The font grid atlas generation the entries are from.
+generation: u32 = 0,
+
+stats: Stats = .{},
+
+/// Render a glyph with the given grid, returning the cached
+/// render if we've rendered the same glyph before.
+pub fn renderGlyph(
+    self: *GlyphCache,
+    alloc: Allocator,
+    grid: *font.SharedGrid,
+    index: font.Collection.Index,
+    glyph_index: u32,
+    opts: font.face.RenderOptions,
+) !font.SharedGrid.Render {
+    const key = font.SharedGrid.GlyphKey.pack(.{
+        .index = index,
+        .glyph = glyph_index,
+        .opts = opts,
+    });
+
+    const entry = &self.entries[slot(key)];
+    if (entry.key == key) {
+        Stats.increment(&self.stats.hits);
+        return entry.render;
+    }
+
+    Stats.increment(&self.stats.misses);
+    const render = try grid.renderGlyph(alloc, index, glyph_index, opts);
+    entry.* = .{ .key = key, .render = render };
+    return render;
+}
+
+/// Remove all entries if they're from a different atlas generation
+/// than the given one, see `font.SharedGrid.atlas_generation`.
+pub fn validate(self: *GlyphCache, generation: u32) void {
+    if (generation == self.generation) return;
+    self.reset();
+    self.generation = generation;
+}
+
+/// Remove all entries. Stats are kept.
+pub fn reset(self: *GlyphCache) void {
+    for (&self.entries) |*entry| entry.key = empty;
+}
+
+fn slot(key: u64) usize {
+    // Fibonacci hashing, since the glyph index is
+    // in the middle bits of the packed key.
+    const hash = key *% 0x9E3779B97F4A7C15;
+    return @intCast(hash >> slot_shift);
+}
+
+test GlyphCache {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var lib = try font.Library.init(alloc);
+    defer lib.deinit();
+
+    var c: font.Collection = .init();
+    c.load_options = .{ .library = lib };
+    _ = try c.add(alloc, try .init(
+        lib,
+        font.embedded.regular,
+        .{ .size = .{ .points = 12, .xdpi = 96, .ydpi = 96 } },
+    ), .{
+        .style = .regular,
+        .fallback = false,
+        .size_adjustment = .none,
+    });
+    var grid = try font.SharedGrid.init(alloc, .{ .collection = c });
+    defer grid.deinit(alloc);
+
+    const idx = (try grid.getIndex(alloc, 'A', .regular, null)).?;
+    const glyph_index = glyph_index: {
+        const face = try grid.resolver.collection.getFace(idx);
+        break :glyph_index face.glyphIndex('A').?;
+    };
+    const opts: font.face.RenderOptions = .{ .grid_metrics = grid.metrics };
+
+    var cache: GlyphCache = .{};
+    const first = try cache.renderGlyph(alloc, &grid, idx, glyph_index, opts);
+    const second = try cache.renderGlyph(alloc, &grid, idx, glyph_index, opts);
+    try testing.expectEqual(first.glyph, second.glyph);
+    try testing.expectEqual(1, cache.stats.snapshot().hits);
+    try testing.expectEqual(1, cache.stats.snapshot().misses);
+
+    // A new atlas generation empties the cache.
+    cache.validate(cache.generation);
+    _ = try cache.renderGlyph(alloc, &grid, idx, glyph_index, opts);
+    try testing.expectEqual(2, cache.stats.snapshot().hits);
+    cache.validate(cache.generation + 1);
+    _ = try cache.renderGlyph(alloc, &grid, idx, glyph_index, opts);
+    try testing.expectEqual(2, cache.stats.snapshot().misses);
+
+    // Different options are different entries.
+    _ = try cache.renderGlyph(alloc, &grid, idx, glyph_index, .{
+        .grid_metrics = grid.metrics,
+        .cell_width = 2,
+    });
+    try testing.expectEqual(3, cache.stats.snapshot().misses);
+}
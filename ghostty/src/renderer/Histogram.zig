@@ -0,0 +1,106 @@
+//! A fixed size histogram of durations with power-of-two buckets. This
+//! is cheap enough to record on every frame and is used to collect
+//! renderer timing statistics (i.e. how long we hold the terminal mutex)
+//! without allocation.
+//!
+//! Bucket `i` counts values in `[2^i, 2^(i+1))` nanoseconds, except
+//! bucket 0 which also counts zero. Percentiles are therefore only
+//! accurate to within a factor of two, which is plenty to see shifts
+//! in behavior.
+const Histogram = @This();
+
+const std = @import("std");
+const assert = std.debug.assert;
+
+/// The number of buckets. The last bucket starts at 2^31 ns (~2s) and
+/// counts everything larger.
+pub const bucket_count = 32;
+
+buckets: [bucket_count]u64 = @splat(0),
+count: u64 = 0,
+sum: u64 = 0,
+max: u64 = 0,
+
+/// Record a single value in nanoseconds.
+pub fn record(self: *Histogram, ns: u64) void {
+    self.buckets[bucket(ns)] += 1;
+    self.count += 1;
+    self.sum +|= ns;
+    self.max = @max(self.max, ns);
+}
+
+/// Record the time elapsed since the given instant.
+pub fn recordSince(self: *Histogram, start: std.time.Instant) void {
+    const now = std.time.Instant.now() catch return;
+    self.record(now.since(start));
+}
+
+/// Returns the (exclusive) upper bound of the bucket that contains
+/// the given percentile (0 to 100) or 0 if the histogram is empty.
+pub fn percentile(self: *const Histogram, p: f64) u64 {
+    assert(p >= 0 and p <= 100);
+    if (self.count == 0) return 0;
+
+    const threshold: u64 = @intFromFloat(@ceil(
+        @as(f64, @floatFromInt(self.count)) * p / 100,
+    ));
+
+    var seen: u64 = 0;
+    for (self.buckets, 0..) |n, i| {
+        seen += n;
+        if (seen >= @max(threshold, 1)) return upperBound(i);
+    }
+
+    unreachable;
+}
+
+/// The mean of all recorded values.
+pub fn mean(self: *const Histogram) u64 {
+    if (self.count == 0) return 0;
+    return self.sum / self.count;
+}
+
+pub fn reset(self: *Histogram) void {
+    self.* = .{};
+}
+
+fn bucket(ns: u64) usize {
+    if (ns == 0) return 0;
+    return @min(bucket_count - 1, std.math.log2_int(u64, ns));
+}
+
+fn upperBound(i: usize) u64 {
+    return @as(u64, 1) << @intCast(i + 1);
+}
+
+test "Histogram percentiles" {
+    const testing = std.testing;
+
+    var h: Histogram = .{};
+    try testing.expectEqual(0, h.percentile(50));
+
+    for (0..99) |_| h.record(100);
+    h.record(10_000);
+    try testing.expectEqual(100, h.count);
+    try testing.expectEqual(10_000, h.max);
+
+    // 100 is in [64, 128)
+    try testing.expectEqual(128, h.percentile(50));
+    try testing.expectEqual(128, h.percentile(99));
+
+    // 10_000 is in [8192, 16384)
+    try testing.expectEqual(16384, h.percentile(100));
+
+    h.reset();
+    try testing.expectEqual(0, h.count);
+}
+
+test "Histogram zero and huge values" {
+    const testing = std.testing;
+
+    var h: Histogram = .{};
+    h.record(0);
+    h.record(std.math.maxInt(u64));
+    try testing.expectEqual(1, h.buckets[0]);
+    try testing.expectEqual(1, h.buckets[bucket_count - 1]);
+}
@@ -0,0 +1,214 @@
+//! This structure caches the final GPU cells for whole rows of the viewport.
+//!
+//! The font shaper cache avoids re-shaping runs we've seen before, but
+//! building a row still requires splitting it in to runs, hashing them,
+//! resolving colors and looking up every glyph. When scrolling back and
+//! forth the same rows leave and re-enter the viewport over and over, so
+//! we cache the cells that were built for a row and copy them back in if
+//! an identical row needs to be built again.
+//!
+//! The cache key is a hash of the row contents, including the resolved
+//! styles and graphemes, plus everything else that affects how the row
+//! is built: the colors, the grid width, and the selection and cursor
+//! position within the row. The caller is responsible for clearing the
+//! cache when anything else changes, such as the font grid or config.
+//! Like the shaper cache, hash collisions would result in rendering
+//! issues but not crashes.
+pub const RowCache = @This();
+
+const std = @import("std");
+const assert = std.debug.assert;
+const Allocator = std.mem.Allocator;
+const autoHash = std.hash.autoHash;
+const Hasher = std.hash.Wyhash;
+const terminal = @import("../terminal/main.zig");
+const renderer = @import("../renderer.zig");
+const shaderpkg = renderer.Renderer.API.shaders;
+const CacheTable = @import("../datastruct/main.zig").CacheTable;
+
+/// The cells built for a single row. The grid position of the
+/// fg cells is for whatever row they were originally built at.
+pub const Row = struct {
+    bg: []shaderpkg.CellBg,
+    fg: []shaderpkg.CellText,
+};
+
+/// Context for cache table.
+const RowCacheTableContext = struct {
+    pub fn hash(self: *const RowCacheTableContext, key: u64) u64 {
+        _ = self;
+        return key;
+    }
+    pub fn eql(self: *const RowCacheTableContext, a: u64, b: u64) bool {
+        _ = self;
+        return a == b;
+    }
+};
+
+/// Cache table for row hash -> built cells.
+const RowCacheTable = CacheTable(
+    u64,
+    Row,
+    RowCacheTableContext,
+
+    // Enough for a few screens of rows, which covers
+    // scrolling back and forth over a short distance.
+    64,
+    4,
+);
+
+/// The cache table of built rows.
+map: RowCacheTable,
+
+pub fn init() RowCache {
+    return .{ .map = .{ .context = .{} } };
+}
+
+pub fn deinit(self: *RowCache, alloc: Allocator) void {
+    self.clear(alloc);
+}
+
+/// Get the cells for the row with the given key,
+/// or null if they are not in the cache.
+pub fn get(self: *RowCache, key: u64) ?Row {
+    return self.map.get(key);
+}
+
+/// Insert the cells for the row with the given key into the cache.
+///
+/// The cells will be duplicated.
+pub fn put(
+    self: *RowCache,
+    alloc: Allocator,
+    key: u64,
+    bg: []const shaderpkg.CellBg,
+    fg: []const shaderpkg.CellText,
+) Allocator.Error!void {
+    const bg_copy = try alloc.dupe(shaderpkg.CellBg, bg);
+    errdefer alloc.free(bg_copy);
+    const fg_copy = try alloc.dupe(shaderpkg.CellText, fg);
+    const evicted = self.map.put(key, .{ .bg = bg_copy, .fg = fg_copy });
+    if (evicted) |kv| free(alloc, kv.value);
+}
+
+/// Remove all rows from the cache.
+pub fn clear(self: *RowCache, alloc: Allocator) void {
+    for (self.map.buckets, self.map.lengths) |b, l| {
+        for (b[0..l]) |kv| free(alloc, kv.value);
+    }
+    self.map.clear();
+}
+
+fn free(alloc: Allocator, row: Row) void {
+    alloc.free(row.bg);
+    alloc.free(row.fg);
+}
+
+/// Everything other than the row contents that goes in to a row's key.
+pub const KeyOptions = struct {
+    /// A hash of the state shared by all rows, such as the colors.
+    seed: u64,
+
+    /// The number of columns of the row that are built.
+    columns: terminal.size.CellCountInt,
+
+    /// The first and last selected column in this row, if any.
+    selection: ?[2]terminal.size.CellCountInt = null,
+
+    /// The cursor column, if the cursor is in this row
+    /// and affects how it is shaped.
+    cursor_x: ?terminal.size.CellCountInt = null,
+};
+
+/// Compute the cache key for the given row.
+pub fn hashRow(row: terminal.Pin, opts: KeyOptions) u64 {
+    var hasher = Hasher.init(opts.seed);
+    autoHash(&hasher, opts.columns);
+    autoHash(&hasher, opts.selection);
+    autoHash(&hasher, opts.cursor_x);
+
+    const cells_all = row.cells(.all);
+    const cells = cells_all[0..@min(cells_all.len, opts.columns)];
+
+    // Style IDs are only meaningful within a page, so we hash the
+    // style itself, but only where it changes since runs of cells
+    // with the same style are common.
+    var style_id: u64 = 0;
+    for (cells, 0..) |*cell, x| {
+        var raw = cell.*;
+        if (raw.style_id != style_id) {
+            style_id = raw.style_id;
+            const style = row.style(cell);
+            autoHash(&hasher, x);
+            autoHash(&hasher, style.hash());
+        }
+        raw.style_id = 0;
+        autoHash(&hasher, @as(u64, @bitCast(raw)));
+
+        if (cell.hasGrapheme()) {
+            if (row.grapheme(cell)) |cps| {
+                autoHash(&hasher, cps.len);
+                hasher.update(std.mem.sliceAsBytes(cps));
+            }
+        }
+    }
+
+    return hasher.final();
+}
+
+test RowCache {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var c = RowCache.init();
+    defer c.deinit(alloc);
+
+    try testing.expect(c.get(1) == null);
+    try c.put(alloc, 1, &.{ .{ 1, 2, 3, 4 }, .{ 5, 6, 7, 8 } }, &.{.{
+        .atlas = .grayscale,
+        .grid_pos = .{ 1, 3 },
+        .color = .{ 0, 0, 0, 255 },
+    }});
+
+    const actual = c.get(1).?;
+    try testing.expectEqual(2, actual.bg.len);
+    try testing.expectEqual(1, actual.fg.len);
+    try testing.expectEqual(3, actual.fg[0].grid_pos[1]);
+
+    // Replacing an entry frees the old one.
+    try c.put(alloc, 1, &.{}, &.{});
+    try testing.expectEqual(0, c.get(1).?.bg.len);
+}
+
+test "RowCache hashRow" {
+    const testing = std.testing;
+
+    var s = try terminal.Screen.init(testing.allocator, 10, 3, 0);
+    defer s.deinit();
+    try s.testWriteString("hello\nhello\nworld");
+
+    const row0 = s.pages.pin(.{ .viewport = .{ .y = 0 } }).?;
+    const row1 = s.pages.pin(.{ .viewport = .{ .y = 1 } }).?;
+    const row2 = s.pages.pin(.{ .viewport = .{ .y = 2 } }).?;
+
+    const opts: KeyOptions = .{ .seed = 0, .columns = 10 };
+    const k = hashRow(row0, opts);
+
+    // Identical rows have the same key, different rows do not.
+    try testing.expectEqual(k, hashRow(row1, opts));
+    try testing.expect(k != hashRow(row2, opts));
+
+    // Anything in the options changes the key.
+    try testing.expect(k != hashRow(row0, .{ .seed = 1, .columns = 10 }));
+    try testing.expect(k != hashRow(row0, .{ .seed = 0, .columns = 5 }));
+    try testing.expect(k != hashRow(row0, .{
+        .seed = 0,
+        .columns = 10,
+        .selection = .{ 0, 2 },
+    }));
+    try testing.expect(k != hashRow(row0, .{
+        .seed = 0,
+        .columns = 10,
+        .cursor_x = 0,
+    }));
+}
@@ -0,0 +1,493 @@
+//! Graphics API wrapper for a software rasterizer.
+//!
+//! This renders in to a framebuffer in system memory using the CPU, so
+//! it doesn't need a GPU, a display server, or any graphics drivers.
+//! It's selected with `-Drenderer=software` and is intended for headless
+//! use: deterministic screenshot tests and measuring end-to-end frame
+//! times on machines without a GPU. The apprt does not display anything,
+//! the most recently presented frame is available in `last_target`.
+//!
+//! Custom shaders are not supported and are ignored.
+pub const Software = @This();
+
+const std = @import("std");
+const assert = std.debug.assert;
+const Allocator = std.mem.Allocator;
+const shadertoy = @import("shadertoy.zig");
+const font = @import("../font/main.zig");
+const configpkg = @import("../config.zig");
+const rendererpkg = @import("../renderer.zig");
+const Histogram = @import("Histogram.zig");
+const Renderer = rendererpkg.GenericRenderer(Software);
+
+pub const GraphicsAPI = Software;
+pub const Target = @import("software/Target.zig");
+pub const Frame = @import("software/Frame.zig");
+pub const RenderPass = @import("software/RenderPass.zig");
+pub const Pipeline = @import("software/Pipeline.zig");
+const bufferpkg = @import("software/buffer.zig");
+pub const Buffer = bufferpkg.Buffer;
+pub const Texture = @import("software/Texture.zig");
+pub const shaders = @import("software/shaders.zig");
+
+// Custom shaders are never run, but they're still loaded
+// by the renderer so we need to pick some target for them.
+pub const custom_shader_target: shadertoy.Target = .glsl;
+pub const custom_shader_y_is_down = true;
+
+/// Frames are drawn synchronously so there's no need for multi-buffering.
+pub const swap_chain_count = 1;
+
+/// How many frames to collect before logging a frame time summary.
+const frame_time_log_interval = 300;
+
+const log = std.log.scoped(.software);
+
+alloc: std.mem.Allocator,
+
+/// Alpha blending mode
+blending: configpkg.Config.AlphaBlending,
+
+/// The size of our framebuffer. Since there's no real surface this is
+/// whatever the renderer was last told the screen size is.
+size: rendererpkg.ScreenSize,
+
+/// The most recently presented target, in case we need to present it again.
+/// This is owned by the renderer's swap chain, so it is only valid until
+/// the next frame is drawn.
+last_target: ?Target = null,
+
+/// How long it takes to rasterize each frame.
+frame_time: Histogram = .{},
+
+pub fn init(alloc: Allocator, opts: rendererpkg.Options) error{}!Software {
+    return .{
+        .alloc = alloc,
+        .blending = opts.config.blending,
+        .size = opts.size.screen,
+    };
+}
+
+pub fn deinit(self: *Software) void {
+    self.* = undefined;
+}
+
+/// Called by the renderer when the screen size changes, since we
+/// have no surface to query it from.
+pub fn setSurfaceSize(self: *Software, size: rendererpkg.ScreenSize) void {
+    self.size = size;
+}
+
+/// Actions taken before doing anything in `drawFrame`.
+///
+/// Right now there's nothing we need to do.
+pub fn drawFrameStart(self: *Software) void {
+    _ = self;
+}
+
+/// Actions taken after `drawFrame` is done.
+///
+/// Right now there's nothing we need to do.
+pub fn drawFrameEnd(self: *Software) void {
+    _ = self;
+}
+
+pub fn initShaders(
+    self: *const Software,
+    alloc: Allocator,
+    custom_shaders: []const [:0]const u8,
+) !shaders.Shaders {
+    _ = self;
+    return try shaders.Shaders.init(alloc, custom_shaders);
+}
+
+/// Get the current size of the runtime surface.
+pub fn surfaceSize(self: *const Software) !struct { width: u32, height: u32 } {
+    return .{
+        .width = self.size.width,
+        .height = self.size.height,
+    };
+}
+
+/// Initialize a new render target which can be presented by this API.
+pub fn initTarget(self: *const Software, width: usize, height: usize) !Target {
+    return Target.init(.{
+        .alloc = self.alloc,
+        .width = width,
+        .height = height,
+        .srgb = self.blending.isLinear(),
+    });
+}
+
+/// Present the provided target. There's nowhere to present
+/// to, so we just keep track of it so it can be inspected.
+pub fn present(self: *Software, target: Target) !void {
+    self.last_target = target;
+}
+
+/// Present the last presented target again.
+pub fn presentLastTarget(self: *Software) !void {
+    if (self.last_target) |target| try self.present(target);
+}
+
+/// Record the time taken to draw a frame and
+/// periodically log a summary of frame times.
+pub fn recordFrameTime(self: *Software, start: std.time.Instant) void {
+    const hist = &self.frame_time;
+    hist.recordSince(start);
+    if (hist.count < frame_time_log_interval) return;
+    log.debug(
+        "frame time width={} height={} frames={} p50={}us p99={}us max={}us",
+        .{
+            self.size.width,
+            self.size.height,
+            hist.count,
+            hist.percentile(50) / std.time.ns_per_us,
+            hist.percentile(99) / std.time.ns_per_us,
+            hist.max / std.time.ns_per_us,
+        },
+    );
+    hist.reset();
+}
+
+/// Returns the options to use when constructing buffers.
+pub inline fn bufferOptions(self: Software) bufferpkg.Options {
+    return .{ .alloc = self.alloc };
+}
+
+pub const instanceBufferOptions = bufferOptions;
+pub const uniformBufferOptions = bufferOptions;
+pub const fgBufferOptions = bufferOptions;
+pub const bgBufferOptions = bufferOptions;
+pub const imageBufferOptions = bufferOptions;
+pub const bgImageBufferOptions = bufferOptions;
+
+/// Returns the options to use when constructing textures.
+pub inline fn textureOptions(self: Software) Texture.Options {
+    return .{
+        .alloc = self.alloc,
+        .format = .rgba,
+        .srgb = true,
+    };
+}
+
+/// Pixel format for image texture options.
+pub const ImageTextureFormat = Texture.Format;
+
+/// Returns the options to use when constructing textures for images.
+pub inline fn imageTextureOptions(
+    self: Software,
+    format: ImageTextureFormat,
+    srgb: bool,
+) Texture.Options {
+    return .{
+        .alloc = self.alloc,
+        .format = format,
+        .srgb = srgb,
+    };
+}
+
+/// Initializes a Texture suitable for the provided font atlas.
+pub fn initAtlasTexture(
+    self: *const Software,
+    atlas: *const font.Atlas,
+) (Texture.Error || error{UnsupportedAtlasFormat})!Texture {
+    const format: Texture.Format, const srgb: bool = switch (atlas.format) {
+        .grayscale => .{ .gray, false },
+        .bgra => .{ .bgra, true },
+        else => {
+            log.warn("unsupported atlas format format={}", .{atlas.format});
+            return error.UnsupportedAtlasFormat;
+        },
+    };
+
+    return try Texture.init(
+        .{
+            .alloc = self.alloc,
+            .format = format,
+            .srgb = srgb,
+        },
+        atlas.size,
+        atlas.size,
+        null,
+    );
+}
+
+/// Begin a frame.
+pub inline fn beginFrame(
+    self: *const Software,
+    /// Once the frame has been completed, the `frameCompleted` method
+    /// on the renderer is called with the health status of the frame.
+    renderer: *Renderer,
+    /// The target is presented via the provided renderer's API when completed.
+    target: *Target,
+) !Frame {
+    _ = self;
+    return try Frame.begin(.{}, renderer, target);
+}
+
+/// Draw cells the way the renderer does, for tests: a grid of 4x4 cells
+/// with 1px of padding all around on a blue background. The target must
+/// be exactly the size of the grid and padding.
+fn testDrawCells(
+    alloc: Allocator,
+    target: Target,
+    grid_size: [2]u16,
+    bg: []const shaders.CellBg,
+    text: []const shaders.CellText,
+    grayscale: Texture,
+    color: Texture,
+) !void {
+    const math = @import("../math.zig");
+    const width: f32 = @floatFromInt(target.width);
+    const height: f32 = @floatFromInt(target.height);
+    assert(target.width == @as(usize, grid_size[0]) * 4 + 2);
+    assert(target.height == @as(usize, grid_size[1]) * 4 + 2);
+
+    const api: Software = .{
+        .alloc = alloc,
+        .blending = .native,
+        .size = .{
+            .width = @intCast(target.width),
+            .height = @intCast(target.height),
+        },
+    };
+    const pipelines = (try api.initShaders(alloc, &.{})).pipelines;
+
+    var uniforms: Buffer(shaders.Uniforms) = try .initFill(api.uniformBufferOptions(), &.{.{
+        .projection_matrix = math.ortho2d(-1, width - 1, height - 1, -1),
+        .screen_size = .{ width, height },
+        .cell_size = .{ 4, 4 },
+        .grid_size = grid_size,
+        .grid_padding = .{ 1, 1, 1, 1 },
+        .padding_extend = .{},
+        .min_contrast = 1,
+        .cursor_pos = .{ std.math.maxInt(u16), std.math.maxInt(u16) },
+        .cursor_color = .{ 0, 0, 0, 0 },
+        .bg_color = .{ 0, 0, 255, 255 },
+        .bools = .{
+            .cursor_wide = false,
+            .use_display_p3 = false,
+            .use_linear_blending = false,
+        },
+    }});
+    defer uniforms.deinit();
+
+    var cells_bg: Buffer(shaders.CellBg) = try .initFill(api.bgBufferOptions(), bg);
+    defer cells_bg.deinit();
+    var cells: Buffer(shaders.CellText) = try .initFill(api.fgBufferOptions(), text);
+    defer cells.deinit();
+
+    var pass = RenderPass.begin(.{ .attachments = &.{.{
+        .target = .{ .target = target },
+        .clear_color = .{ 0, 0, 0, 0 },
+    }} });
+    pass.step(.{
+        .pipeline = pipelines.bg_color,
+        .uniforms = uniforms.buffer,
+        .buffers = &.{ null, cells_bg.buffer },
+        .draw = .{ .type = .triangle, .vertex_count = 3 },
+    });
+    pass.step(.{
+        .pipeline = pipelines.cell_bg,
+        .uniforms = uniforms.buffer,
+        .buffers = &.{ null, cells_bg.buffer },
+        .draw = .{ .type = .triangle, .vertex_count = 3 },
+    });
+    pass.step(.{
+        .pipeline = pipelines.cell_text,
+        .uniforms = uniforms.buffer,
+        .buffers = &.{ cells.buffer, cells_bg.buffer },
+        .textures = &.{ grayscale, color },
+        .draw = .{
+            .type = .triangle_strip,
+            .vertex_count = 4,
+            .instance_count = text.len,
+        },
+    });
+    pass.complete();
+}
+
+/// Compare a target to a reference image, one character per pixel
+/// mapped to colors by the legend. Unknown colors are shown as '?'.
+fn testExpectImage(
+    alloc: Allocator,
+    target: Target,
+    legend: []const struct { u8, [4]u8 },
+    expected: []const u8,
+) !void {
+    var actual: std.ArrayListUnmanaged(u8) = .empty;
+    defer actual.deinit(alloc);
+    for (0..target.height) |y| {
+        if (y > 0) try actual.append(alloc, '\n');
+        for (0..target.width) |x| {
+            const px = target.pixel(x, y);
+            const c = for (legend) |entry| {
+                if (std.mem.eql(u8, &entry[1], &px)) break entry[0];
+            } else '?';
+            try actual.append(alloc, c);
+        }
+    }
+
+    try std.testing.expectEqualStrings(expected, actual.items);
+}
+
+test "draw cells" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    // A 2x1 grid of 4x4 cells with 1px of padding all around.
+    var target: Target = try .init(.{
+        .alloc = alloc,
+        .width = 10,
+        .height = 6,
+        .srgb = false,
+    });
+    defer target.deinit();
+
+    const api: Software = .{
+        .alloc = alloc,
+        .blending = .native,
+        .size = .{ .width = 10, .height = 6 },
+    };
+
+    // A 2x2 white glyph in the middle of the first cell.
+    const grayscale: Texture = try .init(
+        api.imageTextureOptions(.gray, false),
+        2,
+        2,
+        &.{ 255, 255, 255, 255 },
+    );
+    defer grayscale.deinit();
+    const color: Texture = try .init(api.imageTextureOptions(.bgra, true), 1, 1, null);
+    defer color.deinit();
+
+    // The second cell has a red background.
+    try testDrawCells(alloc, target, .{ 2, 1 }, &.{
+        .{ 0, 0, 0, 0 },
+        .{ 255, 0, 0, 255 },
+    }, &.{.{
+        .glyph_pos = .{ 0, 0 },
+        .glyph_size = .{ 2, 2 },
+        .bearings = .{ 1, 3 },
+        .grid_pos = .{ 0, 0 },
+        .color = .{ 255, 255, 255, 255 },
+        .atlas = .grayscale,
+    }}, grayscale, color);
+
+    const blue: [4]u8 = .{ 0, 0, 255, 255 };
+    const red: [4]u8 = .{ 255, 0, 0, 255 };
+    const white: [4]u8 = .{ 255, 255, 255, 255 };
+
+    // Padding and the first cell are the background color.
+    try testing.expectEqual(blue, target.pixel(0, 0));
+    try testing.expectEqual(blue, target.pixel(1, 1));
+    try testing.expectEqual(blue, target.pixel(9, 5));
+
+    // The second cell is red, but not its padding.
+    try testing.expectEqual(red, target.pixel(5, 1));
+    try testing.expectEqual(red, target.pixel(8, 4));
+    try testing.expectEqual(blue, target.pixel(9, 4));
+
+    // The glyph covers x 2..4, y 2..4 in the first cell.
+    try testing.expectEqual(white, target.pixel(2, 2));
+    try testing.expectEqual(white, target.pixel(3, 3));
+    try testing.expectEqual(blue, target.pixel(1, 2));
+    try testing.expectEqual(blue, target.pixel(4, 3));
+    try testing.expectEqual(blue, target.pixel(2, 4));
+}
+
+test "draw cells reference image" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    // A 3x2 grid of 4x4 cells with 1px of padding all around.
+    var target: Target = try .init(.{
+        .alloc = alloc,
+        .width = 14,
+        .height = 10,
+        .srgb = false,
+    });
+    defer target.deinit();
+
+    const api: Software = .{
+        .alloc = alloc,
+        .blending = .native,
+        .size = .{ .width = 14, .height = 10 },
+    };
+
+    // A 2x2 white glyph and a 1x1 green color glyph.
+    const grayscale: Texture = try .init(
+        api.imageTextureOptions(.gray, false),
+        2,
+        2,
+        &.{ 255, 255, 255, 255 },
+    );
+    defer grayscale.deinit();
+    const color: Texture = try .init(
+        api.imageTextureOptions(.bgra, true),
+        1,
+        1,
+        &.{ 0, 255, 0, 255 },
+    );
+    defer color.deinit();
+
+    const none: shaders.CellBg = .{ 0, 0, 0, 0 };
+    const red: shaders.CellBg = .{ 255, 0, 0, 255 };
+    try testDrawCells(alloc, target, .{ 3, 2 }, &.{
+        none, red,  none,
+        none, none, red,
+    }, &.{
+        // Centered in the first cell.
+        .{
+            .glyph_pos = .{ 0, 0 },
+            .glyph_size = .{ 2, 2 },
+            .bearings = .{ 1, 3 },
+            .grid_pos = .{ 0, 0 },
+            .color = .{ 255, 255, 255, 255 },
+            .atlas = .grayscale,
+        },
+        // The top-left of the last cell, over a red background.
+        .{
+            .glyph_pos = .{ 0, 0 },
+            .glyph_size = .{ 2, 2 },
+            .bearings = .{ 0, 4 },
+            .grid_pos = .{ 2, 1 },
+            .color = .{ 255, 255, 255, 255 },
+            .atlas = .grayscale,
+        },
+        // Near the bottom of the middle cell.
+        .{
+            .glyph_pos = .{ 0, 0 },
+            .glyph_size = .{ 1, 1 },
+            .bearings = .{ 2, 1 },
+            .grid_pos = .{ 1, 1 },
+            .color = .{ 0, 0, 0, 255 },
+            .atlas = .color,
+        },
+    }, grayscale, color);
+
+    try testExpectImage(alloc, target, &.{
+        .{ '.', .{ 0, 0, 255, 255 } },
+        .{ 'r', .{ 255, 0, 0, 255 } },
+        .{ 'w', .{ 255, 255, 255, 255 } },
+        .{ 'g', .{ 0, 255, 0, 255 } },
+    },
+        \\..............
+        \\.....rrrr.....
+        \\..ww.rrrr.....
+        \\..ww.rrrr.....
+        \\.....rrrr.....
+        \\.........wwrr.
+        \\.........wwrr.
+        \\.........rrrr.
+        \\.......g.rrrr.
+        \\..............
+    );
+}
+
+test {
+    _ = @import("software/raster.zig");
+    _ = bufferpkg;
+    _ = Texture;
+}
@@ -8,9 +8,11 @@ const assert = std.debug.assert;
 const xev = @import("../global.zig").xev;
 const crash = @import("../crash/main.zig");
 const internal_os = @import("../os/main.zig");
+const trace = @import("../trace.zig");
 const rendererpkg = @import("../renderer.zig");
 const apprt = @import("../apprt.zig");
 const configpkg = @import("../config.zig");
+const terminalpkg = @import("../terminal/main.zig");
 const BlockingQueue = @import("../datastruct/main.zig").BlockingQueue;
 const App = @import("../App.zig");
 
@@ -208,6 +210,13 @@ pub fn threadMain(self: *Thread) void {
 fn threadMain_(self: *Thread) !void {
     defer log.debug("renderer thread exited", .{});
 
+    // Screen clones made by the renderer free their page memory on
+    // this thread, so give the cached pages back to the shared pool.
+    defer terminalpkg.PagePool.global().flushThreadCache();
+
+    // Release our trace buffer for reuse when we exit.
+    defer trace.threadExit();
+
     // Right now, on Darwin, `std.Thread.setName` can only name the current
     // thread, and we have no way to get the current thread from within it,
     // so instead we use this code to name the thread instead.
@@ -297,7 +306,8 @@ fn startDrawTimer(self: *Thread) void {
     // If our renderer doesn't support animations then we never run this.
     if (!@hasDecl(rendererpkg.Renderer, "hasAnimations")) return;
     if (!self.renderer.hasAnimations()) return;
-    if (self.config.custom_shader_animation == .false) return;
+    if (self.config.custom_shader_animation == .false and
+        !self.hasImageAnimations()) return;
 
     // Set our active state so it knows we're running. We set this before
     // even checking the active state in case we have a pending shutdown.
@@ -322,6 +332,20 @@ fn stopDrawTimer(self: *Thread) void {
     self.draw_active = false;
 }
 
+/// True if the renderer is playing Kitty graphics animations. These
+/// are drawn by the draw timer regardless of custom shader settings.
+fn hasImageAnimations(self: *const Thread) bool {
+    if (!@hasDecl(rendererpkg.Renderer, "hasImageAnimations")) return false;
+    return self.renderer.hasImageAnimations();
+}
+
+/// True if the next frame of a Kitty graphics animation is due, which
+/// requires the frame data to be updated before drawing.
+fn imageAnimationDue(self: *const Thread) bool {
+    if (!@hasDecl(rendererpkg.Renderer, "imageAnimationDue")) return false;
+    return self.renderer.imageAnimationDue();
+}
+
 /// Drain the mailbox.
 fn drainMailbox(self: *Thread) !void {
     // There's probably a more elegant way to do this...
@@ -379,7 +403,9 @@ fn drainMailbox(self: *Thread) !void {
                 try self.renderer.setFocus(v);
 
                 if (!v) {
-                    if (self.config.custom_shader_animation != .always) {
+                    if (self.config.custom_shader_animation != .always and
+                        !self.hasImageAnimations())
+                    {
                         // Stop the draw timer
                         self.stopDrawTimer();
                     }
@@ -574,9 +600,33 @@ fn drawCallback(
         return .disarm;
     };
 
+    // If an image animation has a new frame, update our frame data
+    // to show it. Otherwise nothing changed since the last update.
+    if (t.imageAnimationDue()) {
+        t.renderer.updateFrame(
+            t.state,
+            t.flags.cursor_blink_visible,
+        ) catch |err|
+            log.warn("error rendering err={}", .{err});
+    }
+
     // Draw
     t.drawFrame(false);
 
+    // Stop once image animations finished playing unless we'd be
+    // running for custom shaders anyways.
+    if (@hasDecl(rendererpkg.Renderer, "hasAnimations") and
+        !t.hasImageAnimations())
+    {
+        const shader_animation = t.config.custom_shader_animation;
+        if (!t.renderer.hasAnimations() or
+            shader_animation == .false or
+            (!t.flags.focused and shader_animation != .always))
+        {
+            t.draw_active = false;
+        }
+    }
+
     // Only continue if we're still active
     if (t.draw_active) {
         t.draw_h.run(&t.loop, &t.draw_c, DRAW_INTERVAL, Thread, t, drawCallback);
@@ -610,6 +660,10 @@ fn renderCallback(
     ) catch |err|
         log.warn("error rendering err={}", .{err});
 
+    // If the frame shows a playing image animation, make sure the draw
+    // timer is running to play it.
+    if (t.hasImageAnimations()) t.startDrawTimer();
+
     // Draw
     t.drawFrame(false);
 
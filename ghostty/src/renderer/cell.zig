@@ -221,6 +221,82 @@ pub const Contents = struct {
         // the correct index.
         self.fg_rows.lists[y + 1].clearRetainingCapacity();
     }
+
+    /// The cells of a single row, see `getRow` and `setRow`.
+    pub const Row = struct {
+        bg: []const shaderpkg.CellBg,
+        fg: []const shaderpkg.CellText,
+    };
+
+    /// Get all of the cell contents for a given row.
+    pub fn getRow(self: *const Contents, y: terminal.size.CellCountInt) Row {
+        assert(y < self.size.rows);
+        return .{
+            .bg = self.bg_cells[@as(usize, y) * self.size.columns ..][0..self.size.columns],
+            .fg = self.fg_rows.lists[y + 1].items,
+        };
+    }
+
+    /// Replace all of the cell contents for a given row. The fg cells
+    /// may have been built for a different row, their grid position is
+    /// updated to match `y`.
+    pub fn setRow(
+        self: *Contents,
+        alloc: Allocator,
+        y: terminal.size.CellCountInt,
+        bg: []const shaderpkg.CellBg,
+        fg: []const shaderpkg.CellText,
+    ) Allocator.Error!void {
+        assert(y < self.size.rows);
+        assert(bg.len == self.size.columns);
+
+        @memcpy(self.bg_cells[@as(usize, y) * self.size.columns ..][0..self.size.columns], bg);
+
+        const list = &self.fg_rows.lists[y + 1];
+        list.clearRetainingCapacity();
+        try list.appendSlice(alloc, fg);
+        for (list.items) |*cell| cell.grid_pos[1] = y;
+    }
+
+    /// Shift the contents of every row to follow the viewport scrolling
+    /// by `delta` rows. A positive delta moves content up (new rows are
+    /// exposed at the bottom) and a negative delta moves content down.
+    /// The exposed rows are cleared and must be rebuilt by the caller.
+    ///
+    /// The foreground rows are rotated in place like a ring buffer so no
+    /// foreground cells are copied, but we still need to update the grid
+    /// position of each retained cell since it is baked into the vertex.
+    pub fn scroll(self: *Contents, delta: isize) void {
+        const rows: usize = self.size.rows;
+        const n: usize = @abs(delta);
+        assert(n < rows);
+        if (n == 0) return;
+
+        const cols: usize = self.size.columns;
+        const lists = self.fg_rows.lists[1 .. rows + 1];
+        const moved = (rows - n) * cols;
+        if (delta > 0) {
+            std.mem.rotate(std.ArrayListUnmanaged(shaderpkg.CellText), lists, n);
+            std.mem.copyForwards(
+                shaderpkg.CellBg,
+                self.bg_cells[0..moved],
+                self.bg_cells[n * cols ..][0..moved],
+            );
+            for (rows - n..rows) |y| self.clear(@intCast(y));
+        } else {
+            std.mem.rotate(std.ArrayListUnmanaged(shaderpkg.CellText), lists, rows - n);
+            std.mem.copyBackwards(
+                shaderpkg.CellBg,
+                self.bg_cells[n * cols ..][0..moved],
+                self.bg_cells[0..moved],
+            );
+            for (0..n) |y| self.clear(@intCast(y));
+        }
+
+        for (lists, 0..) |list, y| {
+            for (list.items) |*cell| cell.grid_pos[1] = @intCast(y);
+        }
+    }
 };
 
 /// Returns true if a codepoint for a cell is a covering character. A covering
@@ -436,6 +512,83 @@ test "Contents clear retains other content" {
     try testing.expectEqual(fg_cell_2, c.fg_rows.lists[3].items[0]);
 }
 
+test "Contents scroll" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    const rows = 10;
+    const cols = 10;
+
+    var c: Contents = .{};
+    try c.resize(alloc, .{ .rows = rows, .columns = cols });
+    defer c.deinit(alloc);
+
+    // One bg and fg cell per row, tagged with the row in the color.
+    for (0..rows) |y| {
+        c.bgCell(y, 4).* = .{ 0, 0, 0, @intCast(y) };
+        try c.add(alloc, .text, .{
+            .atlas = .grayscale,
+            .grid_pos = .{ 4, @intCast(y) },
+            .color = .{ 0, 0, 0, @intCast(y) },
+        });
+    }
+
+    // Scroll up by 3, rows 3..10 are now 0..7
+    c.scroll(3);
+    for (0..rows - 3) |y| {
+        try testing.expectEqual(y + 3, c.bgCell(y, 4).*[3]);
+        const items = c.fg_rows.lists[y + 1].items;
+        try testing.expectEqual(1, items.len);
+        try testing.expectEqual(y + 3, items[0].color[3]);
+        try testing.expectEqual(y, items[0].grid_pos[1]);
+    }
+    for (rows - 3..rows) |y| {
+        try testing.expectEqual(0, c.bgCell(y, 4).*[3]);
+        try testing.expectEqual(0, c.fg_rows.lists[y + 1].items.len);
+    }
+
+    // Scroll back down by 2, rows 0..5 are now 2..7
+    c.scroll(-2);
+    for (2..rows - 1) |y| {
+        try testing.expectEqual(y + 1, c.bgCell(y, 4).*[3]);
+        const items = c.fg_rows.lists[y + 1].items;
+        try testing.expectEqual(1, items.len);
+        try testing.expectEqual(y + 1, items[0].color[3]);
+        try testing.expectEqual(y, items[0].grid_pos[1]);
+    }
+    for (0..2) |y| {
+        try testing.expectEqual(0, c.fg_rows.lists[y + 1].items.len);
+    }
+}
+
+test "Contents setRow" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var c: Contents = .{};
+    try c.resize(alloc, .{ .rows = 3, .columns = 2 });
+    defer c.deinit(alloc);
+
+    // Copy row 0 to row 2.
+    c.bgCell(0, 1).* = .{ 1, 2, 3, 4 };
+    try c.add(alloc, .text, .{
+        .atlas = .grayscale,
+        .grid_pos = .{ 1, 0 },
+        .color = .{ 0, 0, 0, 1 },
+    });
+    const row = c.getRow(0);
+    try c.setRow(alloc, 2, row.bg, row.fg);
+
+    try testing.expectEqual([4]u8{ 1, 2, 3, 4 }, c.bgCell(2, 1).*);
+    const items = c.getRow(2).fg;
+    try testing.expectEqual(1, items.len);
+    try testing.expectEqual(1, items[0].color[3]);
+    try testing.expectEqual(2, items[0].grid_pos[1]);
+
+    // The source row is untouched.
+    try testing.expectEqual(0, c.getRow(0).fg[0].grid_pos[1]);
+}
+
 test "Contents clear last added content" {
     const testing = std.testing;
     const alloc = testing.allocator;
@@ -15,6 +15,8 @@ const cellpkg = @import("cell.zig");
 const noMinContrast = cellpkg.noMinContrast;
 const constraintWidth = cellpkg.constraintWidth;
 const isCovering = cellpkg.isCovering;
+const GlyphCache = @import("GlyphCache.zig");
+const RowCache = @import("RowCache.zig");
 const imagepkg = @import("image.zig");
 const Image = imagepkg.Image;
 const ImageMap = imagepkg.ImageMap;
@@ -29,6 +31,7 @@ const Health = renderer.Health;
 const getConstraint = @import("../font/nerd_font_attributes.zig").getConstraint;
 
 const FileType = @import("../file_type.zig").FileType;
+const trace = @import("../trace.zig");
 
 const macos = switch (builtin.os.tag) {
     .macos => @import("macos"),
@@ -42,6 +45,24 @@ const DisplayLink = switch (builtin.os.tag) {
 
 const log = std.log.scoped(.generic_renderer);
 
+/// The number of frames between logging updateFrame lock time summaries.
+const lock_time_log_interval = 1000;
+
+/// The number of full rebuilds between logging rebuild time summaries.
+/// Full rebuilds are rare so this is much smaller than the above.
+const rebuild_time_log_interval = 50;
+
+/// The maximum number of bands a full rebuild is split into.
+const max_rebuild_bands = 8;
+
+/// Full rebuilds with fewer cells than this are built on a single thread
+/// since the cost of dispatching to workers would exceed the savings.
+const rebuild_parallel_min_cells = 120 * 40;
+
+/// The number of times we build our cells in one frame when glyphs are
+/// evicted from the font atlas while we build them, see rebuildCells.
+const rebuild_max_attempts = 4;
+
 /// Create a renderer type with the provided graphics API wrapper.
 ///
 /// The graphics API wrapper must provide the interface outlined below.
@@ -148,11 +169,33 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
         /// termio thread. We treat the pointers as integers for comparison only.
         cells_viewport: ?terminal.Pin = null,
 
+        /// The PageList grow count at the time of cells_viewport. This
+        /// tells us how far the active area scrolled since then.
+        cells_grow_count: usize = 0,
+
+        /// The PageList erase count at the time of cells_viewport. If
+        /// pages were freed since then, cells_viewport may match a pin
+        /// into a reused page and can't be used to find the scroll delta.
+        cells_erase_count: usize = 0,
+
         /// Set to true after rebuildCells is called. This can be used
         /// to determine if any possible changes have been made to the
         /// cells for the draw call.
         cells_rebuilt: bool = false,
 
+        /// A persistent copy of the terminal viewport that we build our
+        /// cells from. This is updated under the terminal lock by copying
+        /// only the rows that are dirty, so the time we hold the lock is
+        /// proportional to what changed rather than to the viewport size.
+        /// This is null until our first frame.
+        screen_shadow: ?terminal.Screen = null,
+
+        /// How long updateFrame holds the terminal lock, split by whether
+        /// we cloned the full viewport or only copied the dirty rows. These
+        /// are logged and reset periodically.
+        lock_time_full: renderer.Histogram = .{},
+        lock_time_partial: renderer.Histogram = .{},
+
         /// The current GPU uniform values.
         uniforms: shaderpkg.Uniforms,
 
@@ -174,6 +217,41 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
         font_shaper: font.Shaper,
         font_shaper_cache: font.ShaperCache,
 
+        /// The cells built for recently seen rows, so that rows which
+        /// leave and re-enter the viewport can be copied back in.
+        row_cache: RowCache,
+
+        /// Recent glyph renders, used while building cells on the render
+        /// thread. Bands built on other threads have their own.
+        glyph_cache: GlyphCache = .{},
+
+        /// The font grid atlas generation our cells were built with,
+        /// see `font.SharedGrid.atlas_generation`.
+        atlas_generation: u32,
+
+        /// The font grid fallback generation our cells were built with,
+        /// see `font.SharedGrid.fallback_generation`.
+        fallback_generation: u32,
+
+        /// The async handle the font grid notifies when we must rebuild
+        /// our cells, i.e. a background fallback font search finished or
+        /// glyphs were evicted from its atlas. This is set while the
+        /// renderer thread is running, see loopEnter.
+        grid_wakeup: ?*xev.Async = null,
+
+        /// The worker pool used to build bands of rows in parallel on a
+        /// full rebuild. This is null if we only use a single thread.
+        rebuild_pool: ?*std.Thread.Pool = null,
+
+        /// The shapers for every band but the first, which always uses
+        /// font_shaper and font_shaper_cache. Shapers and their caches
+        /// aren't thread safe so every band needs its own.
+        rebuild_bands: []RebuildBand = &.{},
+
+        /// The time taken by full rebuilds. This is logged and reset
+        /// periodically along with the number of bands used.
+        rebuild_time_full: renderer.Histogram = .{},
+
         /// The images that we may render.
         images: ImageMap = .{},
         image_placements: ImagePlacementList = .{},
@@ -181,6 +259,17 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
         image_text_end: u32 = 0,
         image_virtual: bool = false,
 
+        /// The mip level each image is uploaded at, i.e. the finest level
+        /// needed by any of its placements. Only used while preparing
+        /// placements and kept around to reuse the memory.
+        image_levels: std.AutoHashMapUnmanaged(u32, imagepkg.MipLevel) = .{},
+
+        /// If any animated images we display are playing, the time until
+        /// the next frame of one of them is due, counted from
+        /// `image_animation_time`. See `imageAnimationDue`.
+        image_animation_delay: ?u64 = null,
+        image_animation_time: std.time.Instant = undefined,
+
         /// Background image, if we have one.
         bg_image: ?imagepkg.Image = null,
         /// Set whenever the background image changes, singalling
@@ -501,6 +590,56 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             }
         };
 
+        /// The state to build a band of rows on another thread.
+        const RebuildBand = struct {
+            shaper: font.Shaper,
+            cache: font.ShaperCache,
+            glyph_cache: GlyphCache = .{},
+
+            fn init(
+                alloc: Allocator,
+                features: []const [:0]const u8,
+            ) !RebuildBand {
+                return .{
+                    .shaper = try font.Shaper.init(alloc, .{
+                        .features = features,
+                    }),
+                    .cache = font.ShaperCache.init(),
+                };
+            }
+
+            fn deinit(self: *RebuildBand, alloc: Allocator) void {
+                self.shaper.deinit();
+                self.cache.deinit(alloc);
+            }
+        };
+
+        /// A row to build in rebuildCells.
+        const RowJob = struct {
+            pin: terminal.Pin,
+            y: terminal.size.CellCountInt,
+        };
+
+        /// The range of the preedit text in the grid, if any.
+        const PreeditRange = struct {
+            y: terminal.size.CellCountInt,
+            x: [2]terminal.size.CellCountInt,
+            cp_offset: usize,
+        };
+
+        /// The per-frame state shared by every row in rebuildCells. This
+        /// is read concurrently when rows are built in parallel.
+        const RowContext = struct {
+            screen: *terminal.Screen,
+            links: *link.MatchSet,
+            preedit_range: ?PreeditRange,
+            color_palette: *const terminal.color.Palette,
+
+            /// The seed for row cache keys, or null if
+            /// the row cache can't be used for this frame.
+            row_cache_seed: ?u64,
+        };
+
         /// The configuration for this renderer that is derived from the main
         /// configuration. This must be exported so that we don't need to
         /// pass around Config pointers which makes memory management a pain.
@@ -532,6 +671,7 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             bg_image_repeat: bool,
             links: link.Set,
             vsync: bool,
+            renderer_threads: u8,
             colorspace: configpkg.Config.WindowColorspace,
             blending: configpkg.Config.AlphaBlending,
 
@@ -599,6 +739,7 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                     .bg_image_repeat = config.@"background-image-repeat",
                     .links = links,
                     .vsync = config.@"window-vsync",
+                    .renderer_threads = config.@"renderer-threads",
                     .colorspace = config.@"window-colorspace",
                     .blending = config.@"alpha-blending",
                     .arena = arena,
@@ -717,6 +858,9 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 .font_grid = options.font_grid,
                 .font_shaper = font_shaper,
                 .font_shaper_cache = font.ShaperCache.init(),
+                .row_cache = RowCache.init(),
+                .atlas_generation = options.font_grid.atlas_generation.load(.acquire),
+                .fallback_generation = options.font_grid.fallback_generation.load(.acquire),
 
                 // Shaders (initialized below)
                 .shaders = undefined,
@@ -735,6 +879,18 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             result.updateBgImageBuffer();
             try result.prepBackgroundImage();
 
+            // Parallel rebuilds are purely an optimization so if we
+            // can't set them up we continue with a single thread.
+            result.initRebuildPool(options.config.renderer_threads) catch |err| {
+                log.warn("error creating rebuild worker pool, using a single thread err={}", .{err});
+            };
+
+            result.shareShaperCaches(options.config.font_features.items);
+
+            // Render common glyphs while the pty starts up, so that
+            // our first frame (likely) doesn't have to.
+            options.font_grid.warmup(alloc, result.warmupOptions());
+
             return result;
         }
 
@@ -749,9 +905,12 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             }
 
             self.cells.deinit(self.alloc);
+            if (self.screen_shadow) |*screen| screen.deinit();
 
             self.font_shaper.deinit();
             self.font_shaper_cache.deinit(self.alloc);
+            self.row_cache.deinit(self.alloc);
+            self.deinitRebuildPool();
 
             self.config.deinit();
 
@@ -761,6 +920,7 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 self.images.deinit(self.alloc);
             }
             self.image_placements.deinit(self.alloc);
+            self.image_levels.deinit(self.alloc);
 
             if (self.bg_image) |img| img.deinit(self.alloc);
 
@@ -790,14 +950,16 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 break :err &.{};
             };
 
-            const has_custom_shaders = custom_shaders.len > 0;
-
             var shaders = try self.api.initShaders(
                 self.alloc,
                 custom_shaders,
             );
             errdefer shaders.deinit(self.alloc);
 
+            // The API may have been unable to build some or all of the
+            // custom shaders, so only render through them if we have any.
+            const has_custom_shaders = shaders.post_pipelines.len > 0;
+
             self.shaders = shaders;
             self.has_custom_shaders = has_custom_shaders;
         }
@@ -842,6 +1004,19 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 self.api.loopEnter();
             }
 
+            // Wake up to rebuild our cells when the font grid finds a
+            // fallback font for a codepoint we're showing or evicts glyphs
+            // we may be showing, possibly while rendering for another
+            // surface. The wakeup handle lives as long as the thread so
+            // this is stable.
+            try self.font_grid.addListener(
+                self.alloc,
+                gridListener(&thr.wakeup),
+            );
+            errdefer self.font_grid.removeListener(gridListener(&thr.wakeup));
+            self.grid_wakeup = &thr.wakeup;
+            errdefer self.grid_wakeup = null;
+
             // If we don't support a display link we have no work to do.
             if (comptime DisplayLink == void) return;
 
@@ -864,6 +1039,11 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 self.api.loopExit();
             }
 
+            if (self.grid_wakeup) |wakeup| {
+                self.font_grid.removeListener(gridListener(wakeup));
+                self.grid_wakeup = null;
+            }
+
             // If we don't support a display link we have no work to do.
             if (comptime DisplayLink == void) return;
 
@@ -935,6 +1115,36 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             };
         }
 
+        fn warmupOptions(self: *const Self) font.SharedGrid.WarmupOptions {
+            return .{
+                .thicken = self.config.font_thicken,
+                .thicken_strength = self.config.font_thicken_strength,
+            };
+        }
+
+        /// Returns true if glyphs were evicted from the font atlas since
+        /// we built our cells, so they may refer to regions of the atlas
+        /// that now contain other glyphs. In that case this also wakes up
+        /// the renderer thread to rebuild them. This must be called with
+        /// the draw mutex held.
+        fn atlasStale(self: *Self) bool {
+            const generation = self.font_grid.atlas_generation.load(.acquire);
+            if (generation == self.atlas_generation) return false;
+            if (self.grid_wakeup) |wakeup| gridCallback(wakeup);
+            return true;
+        }
+
+        fn gridListener(wakeup: *xev.Async) font.SharedGrid.Fallback.Listener {
+            return .{ .userdata = wakeup, .callback = &gridCallback };
+        }
+
+        fn gridCallback(ud: ?*anyopaque) void {
+            const wakeup: *xev.Async = @ptrCast(@alignCast(ud orelse return));
+            wakeup.notify() catch |err| {
+                log.err("error notifying wakeup err={}", .{err});
+            };
+        }
+
         /// Mark the full screen as dirty so that we redraw everything.
         pub fn markDirty(self: *Self) void {
             self.cells_viewport = null;
@@ -953,7 +1163,20 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
         /// True if our renderer has animations so that a higher frequency
         /// timer is used.
         pub fn hasAnimations(self: *const Self) bool {
-            return self.has_custom_shaders;
+            return self.has_custom_shaders or self.hasImageAnimations();
+        }
+
+        /// True if Kitty graphics animations we display are playing.
+        pub fn hasImageAnimations(self: *const Self) bool {
+            return self.image_animation_delay != null;
+        }
+
+        /// True if the next frame of a playing Kitty graphics animation
+        /// is due, in which case `updateFrame` must be called to show it.
+        pub fn imageAnimationDue(self: *const Self) bool {
+            const delay = self.image_animation_delay orelse return false;
+            const now = std.time.Instant.now() catch return true;
+            return now.since(self.image_animation_time) >= delay;
         }
 
         /// True if our renderer is using vsync. If true, the renderer or apprt
@@ -1008,8 +1231,25 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             self.draw_mutex.lock();
             defer self.draw_mutex.unlock();
 
+            // Move our listener to the new grid. If this fails we just
+            // won't be woken up to rebuild when a fallback font is found,
+            // which the next change to the screen will do anyway. Atlas
+            // evictions are still caught by drawFrame.
+            if (self.grid_wakeup) |wakeup| {
+                self.font_grid.removeListener(gridListener(wakeup));
+                grid.addListener(
+                    self.alloc,
+                    gridListener(wakeup),
+                ) catch |err| {
+                    log.warn("error adding font grid listener err={}", .{err});
+                };
+            }
+
             // Update our grid
             self.font_grid = grid;
+            grid.warmup(self.alloc, self.warmupOptions());
+            self.atlas_generation = grid.atlas_generation.load(.acquire);
+            self.fallback_generation = grid.fallback_generation.load(.acquire);
 
             // Update all our textures so that they sync on the next frame.
             // We can modify this without a lock because the GPU does not
@@ -1027,9 +1267,14 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             // Reset our shaper cache. If our font changed (not just the size) then
             // the data in the shaper cache may be invalid and cannot be used, so we
             // always clear the cache just in case.
-            const font_shaper_cache = font.ShaperCache.init();
-            self.font_shaper_cache.deinit(self.alloc);
-            self.font_shaper_cache = font_shaper_cache;
+            self.font_shaper_cache.reset(self.alloc);
+            for (self.rebuild_bands) |*band| band.cache.reset(self.alloc);
+            self.shareShaperCaches(self.config.font_features.items);
+
+            // Cached rows and glyphs refer to the old grid's atlas.
+            self.row_cache.clear(self.alloc);
+            self.glyph_cache.reset();
+            for (self.rebuild_bands) |*band| band.glyph_cache.reset();
 
             // Update cell size.
             self.size.cell = .{
@@ -1060,7 +1305,7 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             // Data we extract out of the critical area.
             const Critical = struct {
                 bg: terminal.color.RGB,
-                screen: terminal.Screen,
+                screen: *terminal.Screen,
                 screen_type: terminal.ScreenType,
                 mouse: renderer.State.Mouse,
                 preedit: ?renderer.State.Preedit,
@@ -1069,20 +1314,18 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
 
                 /// If true, rebuild the full screen.
                 full_rebuild: bool,
+
+                /// The number of rows the viewport scrolled since the last
+                /// frame if this isn't a full rebuild, see rebuildCells.
+                scroll: isize,
             };
 
             // Update all our data as tightly as possible within the mutex.
             var critical: Critical = critical: {
-                // const start = try std.time.Instant.now();
-                // const start_micro = std.time.microTimestamp();
-                // defer {
-                //     const end = std.time.Instant.now() catch unreachable;
-                //     // "[updateFrame critical time] <START us>\t<TIME_TAKEN us>"
-                //     std.log.err("[updateFrame critical time] {}\t{}", .{start_micro, end.since(start) / std.time.ns_per_us});
-                // }
-
+                const lock_span = trace.begin();
                 state.mutex.lock();
                 defer state.mutex.unlock();
+                trace.end(lock_span, .lock_wait, 0);
 
                 // If we're in a synchronized output state, we pause all rendering.
                 if (state.terminal.modes.get(.synchronized_output)) {
@@ -1090,6 +1333,12 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                     return;
                 }
 
+                // Record how long we hold the lock. This runs before the
+                // unlock above since defers run in reverse order.
+                const lock_start = std.time.Instant.now() catch null;
+                var partial = false;
+                defer if (lock_start) |start| self.recordLockTime(start, partial);
+
                 // Swap bg/fg if the terminal is reversed
                 const bg = self.background_color orelse self.default_background_color;
                 const fg = self.foreground_color orelse self.default_foreground_color;
@@ -1124,16 +1373,6 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 // Get the viewport pin so that we can compare it to the current.
                 const viewport_pin = state.terminal.screen.pages.pin(.{ .viewport = .{} }).?;
 
-                // We used to share terminal state, but we've since learned through
-                // analysis that it is faster to copy the terminal state than to
-                // hold the lock while rebuilding GPU cells.
-                var screen_copy = try state.terminal.screen.clone(
-                    self.alloc,
-                    .{ .viewport = .{} },
-                    null,
-                );
-                errdefer screen_copy.deinit();
-
                 // Whether to draw our cursor or not.
                 const cursor_style = if (state.terminal.flags.password_input)
                     .lock
@@ -1163,11 +1402,14 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                     self.image_virtual)
                 {
                     try self.prepKittyGraphics(state.terminal);
+                } else if (self.imageAnimationDue()) {
+                    try self.prepKittyAnimations(&state.terminal.screen.kitty_images);
                 }
 
                 // If we have any terminal dirty flags set then we need to rebuild
                 // the entire screen. This can be optimized in the future.
-                const full_rebuild: bool = rebuild: {
+                var scroll: isize = 0;
+                var full_rebuild: bool = rebuild: {
                     {
                         const Int = @typeInfo(terminal.Terminal.Dirty).@"struct".backing_integer.?;
                         const v: Int = @bitCast(state.terminal.flags.dirty);
@@ -1179,56 +1421,99 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                         if (v > 0) break :rebuild true;
                     }
 
-                    // If our viewport changed then we need to rebuild the entire
-                    // screen because it means we scrolled. If we have no previous
-                    // viewport then we must rebuild.
+                    // If our viewport changed then it means we scrolled. If it
+                    // is a pure scroll of less than a screen then we can shift
+                    // our existing cells and only build the rows that were
+                    // exposed, which is the common case of tailing output.
+                    // Otherwise, or if we have no previous viewport, we must
+                    // rebuild the entire screen.
                     const prev_viewport = self.cells_viewport orelse break :rebuild true;
-                    if (!prev_viewport.eql(viewport_pin)) break :rebuild true;
+                    if (!prev_viewport.eql(viewport_pin)) {
+                        if (preedit != null) break :rebuild true;
+                        if (state.terminal.screen.pages.erase_count != self.cells_erase_count) break :rebuild true;
+                        scroll = viewportScrollDelta(
+                            &state.terminal.screen.pages,
+                            prev_viewport,
+                            viewport_pin,
+                            state.terminal.screen.pages.grow_count -% self.cells_grow_count,
+                        ) orelse break :rebuild true;
+                    }
 
                     break :rebuild false;
                 };
 
+                // We used to share terminal state, but we've since learned through
+                // analysis that it is faster to copy the terminal state than to
+                // hold the lock while rebuilding GPU cells. We keep our copy
+                // around between frames so we only need to copy what changed.
+                const shadow_update = try self.updateScreenShadow(
+                    &state.terminal.screen,
+                    if (full_rebuild)
+                        .full
+                    else if (scroll != 0)
+                        .{ .scroll = scroll }
+                    else
+                        .dirty,
+                );
+                partial = shadow_update != .full;
+
+                // If we wanted to scroll but had to copy the full screen then
+                // our shadow no longer reflects the scroll so we rebuild.
+                if (scroll != 0 and shadow_update == .full) {
+                    scroll = 0;
+                    full_rebuild = true;
+                }
+
                 // Reset the dirty flags in the terminal and screen. We assume
                 // that our rebuild will be successful since so we optimize for
                 // success and reset while we hold the lock. This is much easier
                 // than coordinating row by row or as changes are persisted.
+                //
+                // We only read the rows in the viewport so we only clear
+                // those, which keeps this independent of the scrollback
+                // size. Rows outside the viewport may stay dirty but any
+                // change to the viewport copies every row it shows anyways.
                 state.terminal.flags.dirty = .{};
                 state.terminal.screen.dirty = .{};
                 {
                     var it = state.terminal.screen.pages.pageIterator(
                         .right_down,
-                        .{ .screen = .{} },
+                        .{ .viewport = .{} },
                         null,
                     );
                     while (it.next()) |chunk| {
                         var dirty_set = chunk.node.data.dirtyBitSet();
-                        dirty_set.unsetAll();
+                        dirty_set.setRangeValue(
+                            .{ .start = chunk.start, .end = chunk.end },
+                            false,
+                        );
                     }
                 }
 
                 // Update our viewport pin
                 self.cells_viewport = viewport_pin;
+                self.cells_grow_count = state.terminal.screen.pages.grow_count;
+                self.cells_erase_count = state.terminal.screen.pages.erase_count;
 
                 break :critical .{
                     .bg = self.background_color orelse self.default_background_color,
-                    .screen = screen_copy,
+                    .screen = &self.screen_shadow.?,
                     .screen_type = state.terminal.active_screen,
                     .mouse = state.mouse,
                     .preedit = preedit,
                     .cursor_style = cursor_style,
                     .color_palette = state.terminal.color_palette.colors,
                     .full_rebuild = full_rebuild,
+                    .scroll = scroll,
                 };
             };
-            defer {
-                critical.screen.deinit();
-                if (critical.preedit) |p| p.deinit(self.alloc);
-            }
+            defer if (critical.preedit) |p| p.deinit(self.alloc);
 
             // Build our GPU cells
             try self.rebuildCells(
                 critical.full_rebuild,
-                &critical.screen,
+                critical.scroll,
+                critical.screen,
                 critical.screen_type,
                 critical.mouse,
                 critical.preedit,
@@ -1239,6 +1524,7 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             // Notify our shaper we're done for the frame. For some shapers,
             // such as CoreText, this triggers off-thread cleanup logic.
             self.font_shaper.endFrame();
+            for (self.rebuild_bands) |*band| band.shaper.endFrame();
 
             // Acquire the draw mutex because we're modifying state here.
             {
@@ -1255,6 +1541,276 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             }
         }
 
+        /// How to bring our shadow screen up to date, see updateScreenShadow.
+        const ShadowUpdate = union(enum) {
+            /// Clone the entire viewport.
+            full,
+
+            /// Copy only the rows that are dirty.
+            dirty,
+
+            /// The viewport scrolled by this many rows (see rebuildCells).
+            /// Every row is copied but only the rows that are dirty or
+            /// were exposed by the scroll are marked dirty.
+            scroll: isize,
+        };
+
+        /// Bring our shadow screen up to date with the viewport of the
+        /// given screen. This must be called with the terminal lock held.
+        ///
+        /// Anything but a full update requires a shadow screen of the
+        /// same size and is only done if there is no selection. Afterwards
+        /// only the rows that need to be rebuilt are dirty in the shadow.
+        /// Returns the update that was done, which is `.full` if we had
+        /// to fall back to cloning the viewport.
+        fn updateScreenShadow(
+            self: *Self,
+            screen: *const terminal.Screen,
+            update: ShadowUpdate,
+        ) !ShadowUpdate {
+            // Selections hold tracked pins that the terminal may move
+            // around independently of the dirty rows, so we always
+            // clone if we have one for simplicity.
+            if (update != .full and screen.selection == null) {
+                if (self.screen_shadow) |*shadow| {
+                    const scroll: isize = switch (update) {
+                        .scroll => |v| v,
+                        else => 0,
+                    };
+
+                    if (copyViewportRows(shadow, screen, scroll)) {
+                        return update;
+                    } else |err| {
+                        log.debug("partial screen copy failed, cloning err={}", .{err});
+                    }
+                }
+            }
+
+            const copy = try screen.clone(
+                self.alloc,
+                .{ .viewport = .{} },
+                null,
+            );
+            if (self.screen_shadow) |*shadow| shadow.deinit();
+            self.screen_shadow = copy;
+            return .full;
+        }
+
+        /// Copy the rows in the viewport of `src` to the same rows in the
+        /// active area of `dst` and move the cursor of `dst` to match.
+        /// `dst` must have been cloned from the viewport of `src`.
+        ///
+        /// If `scroll` is zero then only the dirty rows are copied.
+        /// Otherwise every row moved so all of them are copied, but only
+        /// those that are dirty or were exposed by the scroll are marked
+        /// dirty. On error `dst` is partially updated and must be discarded.
+        fn copyViewportRows(
+            dst: *terminal.Screen,
+            src: *const terminal.Screen,
+            scroll: isize,
+        ) !void {
+            if (dst.pages.rows != src.pages.rows or
+                dst.pages.cols != src.pages.cols) return error.ShadowSizeMismatch;
+
+            // Only the rows we copy should be dirty for rebuildCells.
+            {
+                var it = dst.pages.pageIterator(.right_down, .{ .screen = .{} }, null);
+                while (it.next()) |chunk| {
+                    var dirty_set = chunk.node.data.dirtyBitSet();
+                    dirty_set.unsetAll();
+                }
+            }
+
+            const rows: usize = src.pages.rows;
+            const exposed: usize = @abs(scroll);
+            var src_it = src.pages.rowIterator(.right_down, .{ .viewport = .{} }, null);
+            var dst_it = dst.pages.rowIterator(.right_down, .{ .active = .{} }, null);
+            var y: usize = 0;
+            while (src_it.next()) |src_pin| : (y += 1) {
+                const dst_pin = dst_it.next() orelse return error.ShadowSizeMismatch;
+                const dirty = src_pin.isDirty() or
+                    (scroll > 0 and y >= rows - exposed) or
+                    (scroll < 0 and y < exposed);
+                if (scroll == 0 and !dirty) continue;
+
+                const src_rac = src_pin.rowAndCell();
+                const dst_rac = dst_pin.rowAndCell();
+                try dst_pin.node.data.cloneRowFrom(
+                    &src_pin.node.data,
+                    dst_rac.row,
+                    src_rac.row,
+                );
+                if (dirty) dst_pin.markDirty();
+            }
+
+            // Move our cursor. If the cursor isn't in the viewport we put
+            // it at the top-left, the same as Screen.clone does.
+            const cursor_pt: terminal.point.Coordinate = pt: {
+                const pt = src.pages.pointFromPin(
+                    .viewport,
+                    src.cursor.page_pin.*,
+                ) orelse break :pt .{};
+                break :pt pt.viewport;
+            };
+            const cursor_pin = dst.pages.pin(.{ .active = cursor_pt }).?;
+            const cursor_rac = cursor_pin.rowAndCell();
+            dst.cursor.x = @intCast(cursor_pt.x);
+            dst.cursor.y = @intCast(cursor_pt.y);
+            dst.cursor.page_pin.* = cursor_pin;
+            dst.cursor.page_row = cursor_rac.row;
+            dst.cursor.page_cell = cursor_rac.cell;
+        }
+
+        /// Returns how many rows the viewport content moved up (positive)
+        /// or down (negative) from `prev` to `current`, both the top-left
+        /// pins of the viewport, if it is a pure scroll of less than a
+        /// screen. `grown` is the number of rows grown in between.
+        ///
+        /// `prev` may point to freed memory so it is only ever compared
+        /// to live pins, never dereferenced. The caller must make sure no
+        /// pages were erased since `prev` was saved (see
+        /// `PageList.erase_count`), otherwise a reused node could match.
+        fn viewportScrollDelta(
+            pages: *const terminal.PageList,
+            prev: terminal.Pin,
+            current: terminal.Pin,
+            grown: usize,
+        ) ?isize {
+            // If we grew then the active area scrolled by exactly that much,
+            // but the viewport only followed it if it is at the bottom, so
+            // we still verify. A node freed by pruning can only be reused as
+            // the last page which can't contain rows above the active area
+            // this soon, so this comparison is safe.
+            if (grown > 0) {
+                if (grown >= pages.rows) return null;
+                const p = current.up(grown) orelse return null;
+                if (!p.eql(prev)) return null;
+                return @intCast(grown);
+            }
+
+            // Otherwise the viewport was scrolled explicitly so we search
+            // both ways. Without growing, pages are only replaced when their
+            // capacity changes which keeps rows at the same offsets, so a
+            // match is always the same row.
+            var up: ?terminal.Pin = current;
+            var down: ?terminal.Pin = current;
+            for (1..pages.rows) |n| {
+                up = if (up) |p| p.up(1) else null;
+                down = if (down) |p| p.down(1) else null;
+                if (up) |p| if (p.eql(prev)) return @intCast(n);
+                if (down) |p| if (p.eql(prev)) return -@as(isize, @intCast(n));
+                if (up == null and down == null) break;
+            }
+
+            return null;
+        }
+
+        /// Create the worker pool and band shapers for parallel full
+        /// rebuilds. `threads` is the renderer-threads configuration.
+        fn initRebuildPool(self: *Self, threads: u8) !void {
+            const bands: usize = if (threads > 0)
+                @min(threads, max_rebuild_bands)
+            else
+                std.math.clamp((std.Thread.getCpuCount() catch 1) / 2, 1, 4);
+            if (bands <= 1) return;
+
+            // Our allocator is shared by the workers, which is fine because
+            // the renderer allocator is always thread safe.
+            const rebuild_bands = try self.alloc.alloc(RebuildBand, bands - 1);
+            errdefer self.alloc.free(rebuild_bands);
+            var initialized: usize = 0;
+            errdefer for (rebuild_bands[0..initialized]) |*band| band.deinit(self.alloc);
+            for (rebuild_bands) |*band| {
+                band.* = try .init(self.alloc, self.config.font_features.items);
+                initialized += 1;
+            }
+
+            // The calling thread works too so we need one fewer worker.
+            const pool = try self.alloc.create(std.Thread.Pool);
+            errdefer self.alloc.destroy(pool);
+            try pool.init(.{
+                .allocator = self.alloc,
+                .n_jobs = bands - 1,
+            });
+
+            self.rebuild_pool = pool;
+            self.rebuild_bands = rebuild_bands;
+        }
+
+        /// Back all of our shaper caches with the shared cache of our font
+        /// grid, so that we can use runs shaped by other surfaces.
+        fn shareShaperCaches(self: *Self, features: []const [:0]const u8) void {
+            const shared = &self.font_grid.shaper_cache;
+            self.font_shaper_cache.setShared(shared, features);
+            for (self.rebuild_bands) |*band| band.cache.setShared(shared, features);
+        }
+
+        fn deinitRebuildPool(self: *Self) void {
+            if (self.rebuild_pool) |pool| {
+                pool.deinit();
+                self.alloc.destroy(pool);
+            }
+            for (self.rebuild_bands) |*band| band.deinit(self.alloc);
+            self.alloc.free(self.rebuild_bands);
+            self.rebuild_pool = null;
+            self.rebuild_bands = &.{};
+        }
+
+        /// Record the time of a full rebuild and periodically log a summary.
+        fn recordRebuildTime(self: *Self, start: std.time.Instant) void {
+            const hist = &self.rebuild_time_full;
+            hist.recordSince(start);
+            if (hist.count < rebuild_time_log_interval) return;
+            log.debug(
+                "full rebuild time bands={} rows={} cols={} rebuilds={} p50={}us p99={}us max={}us",
+                .{
+                    self.rebuild_bands.len + 1,
+                    self.cells.size.rows,
+                    self.cells.size.columns,
+                    hist.count,
+                    hist.percentile(50) / std.time.ns_per_us,
+                    hist.percentile(99) / std.time.ns_per_us,
+                    hist.max / std.time.ns_per_us,
+                },
+            );
+            hist.reset();
+        }
+
+        /// Record the time we held the terminal lock in updateFrame and
+        /// periodically log a summary.
+        fn recordLockTime(
+            self: *Self,
+            start: std.time.Instant,
+            partial: bool,
+        ) void {
+            const hist = if (partial)
+                &self.lock_time_partial
+            else
+                &self.lock_time_full;
+            hist.recordSince(start);
+
+            const total = self.lock_time_full.count + self.lock_time_partial.count;
+            if (total < lock_time_log_interval) return;
+            const hists = [_]struct { []const u8, *renderer.Histogram }{
+                .{ "full", &self.lock_time_full },
+                .{ "partial", &self.lock_time_partial },
+            };
+            for (hists) |entry| {
+                const h = entry[1];
+                log.debug(
+                    "updateFrame lock time kind={s} frames={} p50={}us p99={}us max={}us",
+                    .{
+                        entry[0],
+                        h.count,
+                        h.percentile(50) / std.time.ns_per_us,
+                        h.percentile(99) / std.time.ns_per_us,
+                        h.max / std.time.ns_per_us,
+                    },
+                );
+                h.reset();
+            }
+        }
+
         /// Draw the frame to the screen.
         ///
         /// If `sync` is true, this will synchronously block until
@@ -1280,6 +1836,14 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             // then drawing is absurd, so we just return.
             if (surface_size.width == 0 or surface_size.height == 0) return;
 
+            // We may be drawing without rebuilding our cells (e.g. when
+            // we become visible or for custom shaders), so if glyphs were
+            // evicted from the font atlas since, we must not draw them.
+            if (self.atlasStale()) {
+                try self.api.presentLastTarget();
+                return;
+            }
+
             const size_changed =
                 self.size.screen.width != surface_size.width or
                 self.size.screen.height != surface_size.height;
@@ -1289,7 +1853,7 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             const needs_redraw =
                 size_changed or
                 self.cells_rebuilt or
-                self.hasAnimations() or
+                self.has_custom_shaders or
                 sync;
 
             if (!needs_redraw) {
@@ -1301,6 +1865,11 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             }
             self.cells_rebuilt = false;
 
+            // Only frames that actually draw something are traced, so
+            // that input latency is measured to a frame with new content.
+            const span = trace.begin();
+            defer trace.end(span, .draw_frame, 0);
+
             // Wait for a frame to be available.
             const frame = try self.swap_chain.nextFrame();
             errdefer self.swap_chain.releaseFrame();
@@ -1379,22 +1948,31 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 frame.bg_image_buffer_modified = self.bg_image_buffer_modified;
             }
 
-            // If our font atlas changed, sync the texture data
-            texture: {
-                const modified = self.font_grid.atlas_grayscale.modified.load(.monotonic);
-                if (modified <= frame.grayscale_modified) break :texture;
-                self.font_grid.lock.lockShared();
-                defer self.font_grid.lock.unlockShared();
-                frame.grayscale_modified = self.font_grid.atlas_grayscale.modified.load(.monotonic);
-                try self.syncAtlasTexture(&self.font_grid.atlas_grayscale, &frame.grayscale);
-            }
-            texture: {
-                const modified = self.font_grid.atlas_color.modified.load(.monotonic);
-                if (modified <= frame.color_modified) break :texture;
+            // If our font atlas changed, sync the texture data. Glyphs may
+            // have been evicted since we checked above, in which case the
+            // atlas no longer matches our cells so we don't draw them. The
+            // grid lock keeps it from changing while we check and sync.
+            {
                 self.font_grid.lock.lockShared();
                 defer self.font_grid.lock.unlockShared();
-                frame.color_modified = self.font_grid.atlas_color.modified.load(.monotonic);
-                try self.syncAtlasTexture(&self.font_grid.atlas_color, &frame.color);
+
+                if (self.atlasStale()) {
+                    // If this fails our errdefer releases the frame.
+                    try self.api.presentLastTarget();
+                    self.swap_chain.releaseFrame();
+                    return;
+                }
+
+                if (self.font_grid.atlas_grayscale.modified.load(.monotonic) > frame.grayscale_modified) {
+                    const since = frame.grayscale_modified;
+                    frame.grayscale_modified = self.font_grid.atlas_grayscale.modified.load(.monotonic);
+                    try self.syncAtlasTexture(&self.font_grid.atlas_grayscale, &frame.grayscale, since);
+                }
+                if (self.font_grid.atlas_color.modified.load(.monotonic) > frame.color_modified) {
+                    const since = frame.color_modified;
+                    frame.color_modified = self.font_grid.atlas_color.modified.load(.monotonic);
+                    try self.syncAtlasTexture(&self.font_grid.atlas_color, &frame.color, since);
+                }
             }
 
             // Get a frame context from the graphics API.
@@ -1552,6 +2130,9 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                     return;
                 };
 
+                // The texture may be downscaled, see imagepkg.mipLevel.
+                const scale: f32 = @floatFromInt(@as(u32, 1) << image.level);
+
                 // Get the texture
                 const texture = switch (image.image) {
                     .ready => |t| t,
@@ -1577,10 +2158,10 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                         },
 
                         .source_rect = .{
-                            @as(f32, @floatFromInt(p.source_x)),
-                            @as(f32, @floatFromInt(p.source_y)),
-                            @as(f32, @floatFromInt(p.source_width)),
-                            @as(f32, @floatFromInt(p.source_height)),
+                            @as(f32, @floatFromInt(p.source_x)) / scale,
+                            @as(f32, @floatFromInt(p.source_y)) / scale,
+                            @as(f32, @floatFromInt(p.source_width)) / scale,
+                            @as(f32, @floatFromInt(p.source_height)) / scale,
                         },
 
                         .dest_size = .{
@@ -1684,6 +2265,10 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 );
             }
 
+            // Now that we know how big every image is drawn we can
+            // prepare them for the GPU.
+            try self.prepKittyImages(storage);
+
             // Sort the placements by their Z value.
             std.mem.sortUnstable(
                 imagepkg.Placement,
@@ -1739,6 +2324,9 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 return;
             };
 
+            // Images that are still being decoded have nothing to draw.
+            if (image.pending != null) return;
+
             const rp = p.renderPlacement(
                 storage,
                 &image,
@@ -1763,8 +2351,8 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 unreachable;
             };
 
-            // Prepare the image for the GPU and store the placement.
-            try self.prepKittyImage(&image);
+            // Store the placement. The image is prepared for
+            // the GPU once we have all placements.
             try self.image_placements.append(self.alloc, .{
                 .image_id = image.id,
                 .x = @intCast(rp.top_left.x),
@@ -1791,6 +2379,9 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             image: *const terminal.kitty.graphics.Image,
             p: *const terminal.kitty.graphics.ImageStorage.Placement,
         ) !void {
+            // Images that are still being decoded have nothing to draw.
+            if (image.pending != null) return;
+
             // Get the rect for the placement. If this placement doesn't have
             // a rect then its virtual or something so skip it.
             const rect = p.rect(image.*, t) orelse return;
@@ -1803,11 +2394,6 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             if (img_top_y > bot_y) return;
             if (img_bot_y < top_y) return;
 
-            // We need to prep this image for upload if it isn't in the
-            // cache OR it is in the cache but the transmit time doesn't
-            // match meaning this image is different.
-            try self.prepKittyImage(image);
-
             // Calculate the dimensions of our image, taking in to
             // account the rows / columns specified by the placement.
             const dest_size = p.calculatedSize(image.*, t);
@@ -1846,23 +2432,122 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             }
         }
 
+        /// Prepare the images of all of our placements for upload to the
+        /// GPU, each at the mip level needed by its largest placement, and
+        /// mark them as displayed so that storage evicts them last.
+        fn prepKittyImages(
+            self: *Self,
+            storage: *terminal.kitty.graphics.ImageStorage,
+        ) !void {
+            self.image_levels.clearRetainingCapacity();
+            for (self.image_placements.items) |p| {
+                const level = imagepkg.mipLevel(
+                    p.source_width,
+                    p.source_height,
+                    p.width,
+                    p.height,
+                );
+                const gop = try self.image_levels.getOrPut(self.alloc, p.image_id);
+                if (!gop.found_existing or level < gop.value_ptr.*) {
+                    gop.value_ptr.* = level;
+                }
+            }
+
+            const now = std.time.Instant.now() catch null;
+            self.image_animation_delay = null;
+            var it = self.image_levels.iterator();
+            while (it.next()) |kv| {
+                const image = storage.imageById(kv.key_ptr.*) orelse continue;
+
+                // We play the animations we display, and come back
+                // when the next frame of any of them is due.
+                if (image.animation) |anim| animate: {
+                    const delay = anim.advance(now orelse break :animate) orelse
+                        break :animate;
+                    const prev = self.image_animation_delay orelse delay;
+                    self.image_animation_delay = @min(prev, delay);
+                }
+
+                try self.prepKittyImage(&image, kv.value_ptr.*);
+                if (now) |v| storage.markDisplayed(image.id, v);
+            }
+            if (now) |v| self.image_animation_time = v;
+        }
+
+        /// Show the next frames of the Kitty graphics animations we
+        /// display. Unlike prepKittyGraphics this doesn't rebuild the
+        /// placements since they can't change without the storage
+        /// being marked dirty.
+        fn prepKittyAnimations(
+            self: *Self,
+            storage: *terminal.kitty.graphics.ImageStorage,
+        ) !void {
+            self.draw_mutex.lock();
+            defer self.draw_mutex.unlock();
+            try self.prepKittyImages(storage);
+        }
+
         /// Prepare the provided image for upload to the GPU by copying its
-        /// data with our allocator and setting it to the pending state.
+        /// data with our allocator, downscaled to the given mip level, and
+        /// setting it to the pending state.
         fn prepKittyImage(
             self: *Self,
             image: *const terminal.kitty.graphics.Image,
+            level: imagepkg.MipLevel,
         ) !void {
+            // Animated images show their current frame, which is composed
+            // into the animation's canvas.
+            const anim = image.animation;
+            const generation = if (anim) |a| a.generation else 0;
+            const image_data = if (anim) |a| a.canvas else image.data;
+
             // If this image exists and its transmit time is the same we assume
-            // it is the identical image so we don't need to send it to the GPU.
+            // it is the identical image so we don't need to send it to the GPU,
+            // unless we need it at a different size or its animation frame
+            // changed.
             const gop = try self.images.getOrPut(self.alloc, image.id);
             if (gop.found_existing and
-                gop.value_ptr.transmit_time.order(image.transmit_time) == .eq)
+                gop.value_ptr.transmit_time.order(image.transmit_time) == .eq and
+                gop.value_ptr.level == level)
             {
-                return;
+                if (gop.value_ptr.generation == generation) return;
+
+                // Frames of an animation usually only differ in a small
+                // region, so when the texture is at full size we only
+                // update the region that changed.
+                if (level == 0 and gop.value_ptr.image == .ready) partial: {
+                    const a = anim.?;
+                    const region = a.takeDirty() orelse break :partial;
+                    const data = try imagepkg.crop(
+                        self.alloc,
+                        a.canvas,
+                        a.width,
+                        4,
+                        region.x,
+                        region.y,
+                        region.width,
+                        region.height,
+                    );
+                    errdefer self.alloc.free(data);
+
+                    try gop.value_ptr.image.markForReplace(self.alloc, .{
+                        .pending = .{
+                            .width = region.width,
+                            .height = region.height,
+                            .pixel_format = .rgba,
+                            .data = data.ptr,
+                            .offset = .{ .x = region.x, .y = region.y },
+                        },
+                    });
+                    gop.value_ptr.generation = generation;
+                    return;
+                }
             }
 
-            // Copy the data into the pending state.
-            const data = try self.alloc.dupe(u8, image.data);
+            // Copy the data into the pending state. Any downscaling happens
+            // when the image is prepared for upload, which isn't done while
+            // the terminal is locked.
+            const data = try self.alloc.dupe(u8, image_data);
             errdefer self.alloc.free(data);
 
             // Store it in the map
@@ -1877,6 +2562,7 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                     .png => unreachable, // should be decoded by now
                 },
                 .data = data.ptr,
+                .level = level,
             };
 
             const new_image: Image = .{ .pending = pending };
@@ -1893,9 +2579,12 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 );
             }
 
-            try gop.value_ptr.image.prepForUpload(self.alloc);
-
             gop.value_ptr.transmit_time = image.transmit_time;
+            gop.value_ptr.level = level;
+            gop.value_ptr.generation = generation;
+
+            // The whole canvas was uploaded, so any dirty region is too.
+            if (anim) |a| _ = a.takeDirty();
         }
 
         /// Upload any images to the GPU that need to be uploaded,
@@ -2028,9 +2717,21 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
 
             // We also need to reset the shaper cache so shaper info
             // from the previous font isn't re-used for the new font.
-            const font_shaper_cache = font.ShaperCache.init();
-            self.font_shaper_cache.deinit(self.alloc);
-            self.font_shaper_cache = font_shaper_cache;
+            self.font_shaper_cache.reset(self.alloc);
+
+            // Cached rows may have been built with different fonts
+            // or colors, so they're no longer valid either. The same goes
+            // for glyphs, which depend on i.e. the font thicken options.
+            self.row_cache.clear(self.alloc);
+            self.glyph_cache.reset();
+
+            // Our band shapers need the same treatment.
+            for (self.rebuild_bands) |*band| {
+                const new = try RebuildBand.init(self.alloc, config.font_features.items);
+                band.deinit(self.alloc);
+                band.* = new;
+            }
+            self.shareShaperCaches(config.font_features.items);
 
             // Set our new minimum contrast
             self.uniforms.min_contrast = config.min_contrast;
@@ -2104,6 +2805,11 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             // everything else is derived elsewhere.
             self.size.padding = size.padding;
 
+            // APIs without a real surface to query need to be told.
+            if (@hasDecl(GraphicsAPI, "setSurfaceSize")) {
+                self.api.setSurfaceSize(size.screen);
+            }
+
             self.updateScreenSizeUniforms();
 
             log.debug("screen size size={}", .{size});
@@ -2276,9 +2982,14 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
         /// Convert the terminal state to GPU cells stored in CPU memory. These
         /// are then synced to the GPU in the next frame. This only updates CPU
         /// memory and doesn't touch the GPU.
+        ///
+        /// If `scroll` is non-zero then the viewport scrolled by that many
+        /// rows since the last frame (positive is towards the bottom) and
+        /// the screen rows that were exposed must be dirty.
         fn rebuildCells(
             self: *Self,
             wants_rebuild: bool,
+            scroll: isize,
             screen: *terminal.Screen,
             screen_type: terminal.ScreenType,
             mouse: renderer.State.Mouse,
@@ -2289,13 +3000,11 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             self.draw_mutex.lock();
             defer self.draw_mutex.unlock();
 
-            // const start = try std.time.Instant.now();
-            // const start_micro = std.time.microTimestamp();
-            // defer {
-            //     const end = std.time.Instant.now() catch unreachable;
-            //     // "[rebuildCells time] <START us>\t<TIME_TAKEN us>"
-            //     std.log.warn("[rebuildCells time] {}\t{}", .{start_micro, end.since(start) / std.time.ns_per_us});
-            // }
+            const start = std.time.Instant.now() catch null;
+            defer if (start) |v| if (wants_rebuild) self.recordRebuildTime(v);
+
+            const span = trace.begin();
+            defer trace.end(span, .rebuild_cells, @intFromBool(wants_rebuild));
 
             _ = screen_type; // we might use this again later so not deleting it yet
 
@@ -2314,11 +3023,7 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
 
             // Determine our x/y range for preedit. We don't want to render anything
             // here because we will render the preedit separately.
-            const preedit_range: ?struct {
-                y: terminal.size.CellCountInt,
-                x: [2]terminal.size.CellCountInt,
-                cp_offset: usize,
-            } = if (preedit) |preedit_v| preedit: {
+            const preedit_range: ?PreeditRange = if (preedit) |preedit_v| preedit: {
                 const range = preedit_v.range(screen.cursor.x, screen.pages.cols - 1);
                 break :preedit .{
                     .y = screen.cursor.y,
@@ -2342,447 +3047,139 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 self.uniforms.grid_size = .{ new_size.columns, new_size.rows };
             }
 
-            const rebuild = wants_rebuild or grid_size_diff;
-
-            if (rebuild) {
-                // If we are doing a full rebuild, then we clear the entire cell buffer.
-                self.cells.reset();
-
-                // We also reset our padding extension depending on the screen type
-                switch (self.config.padding_color) {
-                    .background => {},
-
-                    // For extension, assume we are extending in all directions.
-                    // For "extend" this may be disabled due to heuristics below.
-                    .extend, .@"extend-always" => {
-                        self.uniforms.padding_extend = .{
-                            .up = true,
-                            .down = true,
-                            .left = true,
-                            .right = true,
-                        };
-                    },
+            // If glyphs were evicted from the font atlas since we last built
+            // our cells, the cells we kept may refer to the wrong glyphs.
+            var atlas_generation = self.font_grid.atlas_generation.load(.acquire);
+
+            // If a fallback font was found since we last built our cells,
+            // codepoints we drew with the wrong font (or not at all) may
+            // be in any row, not just the dirty ones.
+            const fallback_generation = self.font_grid.fallback_generation.load(.acquire);
+
+            // Link highlights depend on the mouse position, not the row,
+            // so we can't keep cells we've shifted if we have any.
+            var rebuild = wants_rebuild or
+                grid_size_diff or
+                atlas_generation != self.atlas_generation or
+                fallback_generation != self.fallback_generation or
+                (scroll != 0 and link_match_set.matches.len > 0);
+
+            // Glyphs can also be evicted while we're building, by us or by
+            // another surface using the same font grid, in which case we
+            // build everything again until no glyphs were evicted while we
+            // built. If the screen needs more glyphs than fit in the atlas
+            // that never happens, so after a few attempts we give up and
+            // leave our cells stale, which drawFrame won't draw and which
+            // wakes us up to try again.
+            var attempts: u8 = 0;
+            while (true) : (attempts += 1) {
+                // Cached rows refer to glyphs from before the eviction.
+                if (atlas_generation != self.atlas_generation) {
+                    self.row_cache.clear(self.alloc);
+                    self.atlas_generation = atlas_generation;
                 }
-            }
-
-            // We rebuild the cells row-by-row because we
-            // do font shaping and dirty tracking by row.
-            var row_it = screen.pages.rowIterator(.left_up, .{ .viewport = .{} }, null);
-            // If our cell contents buffer is shorter than the screen viewport,
-            // we render the rows that fit, starting from the bottom. If instead
-            // the viewport is shorter than the cell contents buffer, we align
-            // the top of the viewport with the top of the contents buffer.
-            var y: terminal.size.CellCountInt = @min(
-                screen.pages.rows,
-                self.cells.size.rows,
-            );
-            while (row_it.next()) |row| {
-                // The viewport may have more rows than our cell contents,
-                // so we need to break from the loop early if we hit y = 0.
-                if (y == 0) break;
-
-                y -= 1;
-
-                if (!rebuild) {
-                    // Only rebuild if we are doing a full rebuild or this row is dirty.
-                    if (!row.isDirty()) continue;
-
-                    // Clear the cells if the row is dirty
-                    self.cells.clear(y);
-                }
-
-                // True if we want to do font shaping around the cursor.
-                // We want to do font shaping as long as the cursor is enabled.
-                const shape_cursor = screen.viewportIsBottom() and
-                    y == screen.cursor.y;
-
-                // We need to get this row's selection, if
-                // there is one, for proper run splitting.
-                const row_selection = sel: {
-                    const sel = screen.selection orelse break :sel null;
-                    const pin = screen.pages.pin(.{ .viewport = .{ .y = y } }) orelse
-                        break :sel null;
-                    break :sel sel.containedRow(screen, pin) orelse null;
-                };
-
-                // On primary screen, we still apply vertical padding
-                // extension under certain conditions we feel are safe.
-                //
-                // This helps make some scenarios look better while
-                // avoiding scenarios we know do NOT look good.
-                switch (self.config.padding_color) {
-                    // These already have the correct values set above.
-                    .background, .@"extend-always" => {},
-
-                    // Apply heuristics for padding extension.
-                    .extend => if (y == 0) {
-                        self.uniforms.padding_extend.up = !row.neverExtendBg(
-                            color_palette,
-                            self.background_color orelse self.default_background_color,
-                        );
-                    } else if (y == self.cells.size.rows - 1) {
-                        self.uniforms.padding_extend.down = !row.neverExtendBg(
-                            color_palette,
-                            self.background_color orelse self.default_background_color,
-                        );
-                    },
+                if (fallback_generation != self.fallback_generation) {
+                    self.row_cache.clear(self.alloc);
+                    self.fallback_generation = fallback_generation;
                 }
-
-                // Iterator of runs for shaping.
-                var run_iter_opts: font.shape.RunOptions = .{
-                    .grid = self.font_grid,
-                    .screen = screen,
-                    .row = row,
-                    .selection = row_selection,
-                    .cursor_x = if (shape_cursor) screen.cursor.x else null,
-                };
-                run_iter_opts.applyBreakConfig(self.config.font_shaping_break);
-                var run_iter = self.font_shaper.runIterator(run_iter_opts);
-                var shaper_run: ?font.shape.TextRun = try run_iter.next(self.alloc);
-                var shaper_cells: ?[]const font.shape.Cell = null;
-                var shaper_cells_i: usize = 0;
-
-                const row_cells_all = row.cells(.all);
-
-                // If our viewport is wider than our cell contents buffer,
-                // we still only process cells up to the width of the buffer.
-                const row_cells = row_cells_all[0..@min(row_cells_all.len, self.cells.size.columns)];
-
-                for (row_cells, 0..) |*cell, x| {
-                    // If this cell falls within our preedit range then we
-                    // skip this because preedits are setup separately.
-                    if (preedit_range) |range| preedit: {
-                        // We're not on the preedit line, no actions necessary.
-                        if (range.y != y) break :preedit;
-                        // We're before the preedit range, no actions necessary.
-                        if (x < range.x[0]) break :preedit;
-                        // We're in the preedit range, skip this cell.
-                        if (x <= range.x[1]) continue;
-                        // After exiting the preedit range we need to catch
-                        // the run position up because of the missed cells.
-                        // In all other cases, no action is necessary.
-                        if (x != range.x[1] + 1) break :preedit;
-
-                        // Step the run iterator until we find a run that ends
-                        // after the current cell, which will be the soonest run
-                        // that might contain glyphs for our cell.
-                        while (shaper_run) |run| {
-                            if (run.offset + run.cells > x) break;
-                            shaper_run = try run_iter.next(self.alloc);
-                            shaper_cells = null;
-                            shaper_cells_i = 0;
-                        }
-
-                        const run = shaper_run orelse break :preedit;
-
-                        // If we haven't shaped this run, do so now.
-                        shaper_cells = shaper_cells orelse
-                            // Try to read the cells from the shaping cache if we can.
-                            self.font_shaper_cache.get(run) orelse
-                            cache: {
-                                // Otherwise we have to shape them.
-                                const cells = try self.font_shaper.shape(run);
-
-                                // Try to cache them. If caching fails for any reason we
-                                // continue because it is just a performance optimization,
-                                // not a correctness issue.
-                                self.font_shaper_cache.put(
-                                    self.alloc,
-                                    run,
-                                    cells,
-                                ) catch |err| {
-                                    log.warn(
-                                        "error caching font shaping results err={}",
-                                        .{err},
-                                    );
-                                };
-
-                                // The cells we get from direct shaping are always owned
-                                // by the shaper and valid until the next shaping call so
-                                // we can safely use them.
-                                break :cache cells;
+                self.glyph_cache.validate(atlas_generation);
+                for (self.rebuild_bands) |*band| band.glyph_cache.validate(atlas_generation);
+
+                if (rebuild) {
+                    // If we are doing a full rebuild, then we clear the entire cell buffer.
+                    self.cells.reset();
+
+                    // We also reset our padding extension depending on the screen type
+                    switch (self.config.padding_color) {
+                        .background => {},
+
+                        // For extension, assume we are extending in all directions.
+                        // For "extend" this may be disabled due to heuristics below.
+                        .extend, .@"extend-always" => {
+                            self.uniforms.padding_extend = .{
+                                .up = true,
+                                .down = true,
+                                .left = true,
+                                .right = true,
                             };
-
-                        // Advance our index until we reach or pass
-                        // our current x position in the shaper cells.
-                        while (shaper_cells.?[shaper_cells_i].x < x) {
-                            shaper_cells_i += 1;
-                        }
+                        },
                     }
+                }
 
-                    const wide = cell.wide;
-
-                    const style = row.style(cell);
-
-                    const cell_pin: terminal.Pin = cell: {
-                        var copy = row;
-                        copy.x = @intCast(x);
-                        break :cell copy;
-                    };
-
-                    // True if this cell is selected
-                    const selected: bool = if (screen.selection) |sel|
-                        sel.contains(screen, .{
-                            .node = row.node,
-                            .y = row.y,
-                            .x = @intCast(
-                                // Spacer tails should show the selection
-                                // state of the wide cell they belong to.
-                                if (wide == .spacer_tail)
-                                    x -| 1
-                                else
-                                    x,
-                            ),
-                        })
-                    else
-                        false;
-
-                    // The `_style` suffixed values are the colors based on
-                    // the cell style (SGR), before applying any additional
-                    // configuration, inversions, selections, etc.
-                    const bg_style = style.bg(cell, color_palette);
-                    const fg_style = style.fg(.{
-                        .default = self.foreground_color orelse self.default_foreground_color,
-                        .palette = color_palette,
-                        .bold = self.config.bold_color,
-                    });
-
-                    // The final background color for the cell.
-                    const bg = bg: {
-                        if (selected) {
-                            // If we have an explicit selection background color
-                            // specified int he config, use that
-                            if (self.config.selection_background) |v| {
-                                break :bg switch (v) {
-                                    .color => |color| color.toTerminalRGB(),
-                                    .@"cell-foreground" => if (style.flags.inverse) bg_style else fg_style,
-                                    .@"cell-background" => if (style.flags.inverse) fg_style else bg_style,
-                                };
-                            }
-
-                            // If no configuration, then our selection background
-                            // is our foreground color.
-                            break :bg self.foreground_color orelse self.default_foreground_color;
-                        }
-
-                        // Not selected
-                        break :bg if (style.flags.inverse != isCovering(cell.codepoint()))
-                            // Two cases cause us to invert (use the fg color as the bg)
-                            // - The "inverse" style flag.
-                            // - A "covering" glyph; we use fg for bg in that
-                            //   case to help make sure that padding extension
-                            //   works correctly.
-                            //
-                            // If one of these is true (but not the other)
-                            // then we use the fg style color for the bg.
-                            fg_style
-                        else
-                            // Otherwise they cancel out.
-                            bg_style;
-                    };
-
-                    const fg = fg: {
-                        // Our happy-path non-selection background color
-                        // is our style or our configured defaults.
-                        const final_bg = bg_style orelse
-                            self.background_color orelse
-                            self.default_background_color;
-
-                        // Whether we need to use the bg color as our fg color:
-                        // - Cell is selected, inverted, and set to cell-foreground
-                        // - Cell is selected, not inverted, and set to cell-background
-                        // - Cell is inverted and not selected
-                        if (selected) {
-                            // Use the selection foreground if set
-                            if (self.config.selection_foreground) |v| {
-                                break :fg switch (v) {
-                                    .color => |color| color.toTerminalRGB(),
-                                    .@"cell-foreground" => if (style.flags.inverse) final_bg else fg_style,
-                                    .@"cell-background" => if (style.flags.inverse) fg_style else final_bg,
-                                };
-                            }
-
-                            break :fg self.background_color orelse self.default_background_color;
+                // If we scrolled, shift our existing cells to follow. The rows
+                // this exposes are dirty so they are built below.
+                if (!rebuild and scroll != 0) self.cells.scroll(scroll);
+
+                // We rebuild the cells row-by-row because we
+                // do font shaping and dirty tracking by row.
+                // First collect the rows that need to be built.
+                var rows: std.ArrayListUnmanaged(RowJob) = .empty;
+                try rows.ensureTotalCapacity(arena_alloc, self.cells.size.rows);
+                var row_it = screen.pages.rowIterator(.left_up, .{ .viewport = .{} }, null);
+                // If our cell contents buffer is shorter than the screen viewport,
+                // we render the rows that fit, starting from the bottom. If instead
+                // the viewport is shorter than the cell contents buffer, we align
+                // the top of the viewport with the top of the contents buffer.
+                var y: terminal.size.CellCountInt = @min(
+                    screen.pages.rows,
+                    self.cells.size.rows,
+                );
+                while (row_it.next()) |row| {
+                    // The viewport may have more rows than our cell contents,
+                    // so we need to break from the loop early if we hit y = 0.
+                    if (y == 0) break;
+
+                    y -= 1;
+
+                    if (!rebuild) {
+                        // Only rebuild if we are doing a full rebuild or this row is dirty.
+                        if (!row.isDirty()) {
+                            // A row we shifted may now be at the edge of the grid.
+                            if (scroll != 0) self.updatePaddingExtend(row, y, color_palette);
+                            continue;
                         }
 
-                        break :fg if (style.flags.inverse)
-                            final_bg
-                        else
-                            fg_style;
-                    };
-
-                    // Foreground alpha for this cell.
-                    const alpha: u8 = if (style.flags.faint) 175 else 255;
-
-                    // Set the cell's background color.
-                    {
-                        const rgb = bg orelse self.background_color orelse self.default_background_color;
-
-                        // Determine our background alpha. If we have transparency configured
-                        // then this is dynamic depending on some situations. This is all
-                        // in an attempt to make transparency look the best for various
-                        // situations. See inline comments.
-                        const bg_alpha: u8 = bg_alpha: {
-                            const default: u8 = 255;
-
-                            // Cells that are selected should be fully opaque.
-                            if (selected) break :bg_alpha default;
-
-                            // Cells that are reversed should be fully opaque.
-                            if (style.flags.inverse) break :bg_alpha default;
-
-                            // If the user requested to have opacity on all cells, apply it.
-                            if (self.config.background_opacity_cells and bg_style != null) {
-                                var opacity: f64 = @floatFromInt(default);
-                                opacity *= self.config.background_opacity;
-                                break :bg_alpha @intFromFloat(opacity);
-                            }
-
-                            // Cells that have an explicit bg color should be fully opaque.
-                            if (bg_style != null) break :bg_alpha default;
-
-                            // Otherwise, we won't draw the bg for this cell,
-                            // we'll let the already-drawn background color
-                            // show through.
-                            break :bg_alpha 0;
-                        };
-
-                        self.cells.bgCell(y, x).* = .{
-                            rgb.r, rgb.g, rgb.b, bg_alpha,
-                        };
+                        // Clear the cells if the row is dirty
+                        self.cells.clear(y);
                     }
 
-                    // If the invisible flag is set on this cell then we
-                    // don't need to render any foreground elements, so
-                    // we just skip all glyphs with this x coordinate.
-                    //
-                    // NOTE: This behavior matches xterm. Some other terminal
-                    // emulators, e.g. Alacritty, still render text decorations
-                    // and only make the text itself invisible. The decision
-                    // has been made here to match xterm's behavior for this.
-                    if (style.flags.invisible) {
-                        continue;
-                    }
+                    self.updatePaddingExtend(row, y, color_palette);
+                    try rows.append(arena_alloc, .{ .pin = row, .y = y });
+                }
 
-                    // Give links a single underline, unless they already have
-                    // an underline, in which case use a double underline to
-                    // distinguish them.
-                    const underline: terminal.Attribute.Underline = if (link_match_set.contains(screen, cell_pin))
-                        if (style.flags.underline == .single)
-                            .double
-                        else
-                            .single
+                // Build our rows. Full rebuilds of large grids are split into
+                // bands that are built in parallel. Otherwise (and typically)
+                // only a few rows are dirty and we build them on this thread.
+                const row_ctx: RowContext = .{
+                    .screen = screen,
+                    .links = &link_match_set,
+                    .preedit_range = preedit_range,
+                    .color_palette = color_palette,
+
+                    // Link highlights depend on the mouse rather than the row
+                    // contents, so we don't use the row cache if we have any.
+                    .row_cache_seed = if (link_match_set.matches.len > 0)
+                        null
                     else
-                        style.flags.underline;
-
-                    // We draw underlines first so that they layer underneath text.
-                    // This improves readability when a colored underline is used
-                    // which intersects parts of the text (descenders).
-                    if (underline != .none) self.addUnderline(
-                        @intCast(x),
-                        @intCast(y),
-                        underline,
-                        style.underlineColor(color_palette) orelse fg,
-                        alpha,
-                    ) catch |err| {
-                        log.warn(
-                            "error adding underline to cell, will be invalid x={} y={}, err={}",
-                            .{ x, y, err },
-                        );
-                    };
-
-                    if (style.flags.overline) self.addOverline(@intCast(x), @intCast(y), fg, alpha) catch |err| {
-                        log.warn(
-                            "error adding overline to cell, will be invalid x={} y={}, err={}",
-                            .{ x, y, err },
-                        );
-                    };
-
-                    // If we're at or past the end of our shaper run then
-                    // we need to get the next run from the run iterator.
-                    if (shaper_cells != null and shaper_cells_i >= shaper_cells.?.len) {
-                        shaper_run = try run_iter.next(self.alloc);
-                        shaper_cells = null;
-                        shaper_cells_i = 0;
-                    }
-
-                    if (shaper_run) |run| glyphs: {
-                        // If we haven't shaped this run yet, do so.
-                        shaper_cells = shaper_cells orelse
-                            // Try to read the cells from the shaping cache if we can.
-                            self.font_shaper_cache.get(run) orelse
-                            cache: {
-                                // Otherwise we have to shape them.
-                                const cells = try self.font_shaper.shape(run);
-
-                                // Try to cache them. If caching fails for any reason we
-                                // continue because it is just a performance optimization,
-                                // not a correctness issue.
-                                self.font_shaper_cache.put(
-                                    self.alloc,
-                                    run,
-                                    cells,
-                                ) catch |err| {
-                                    log.warn(
-                                        "error caching font shaping results err={}",
-                                        .{err},
-                                    );
-                                };
-
-                                // The cells we get from direct shaping are always owned
-                                // by the shaper and valid until the next shaping call so
-                                // we can safely use them.
-                                break :cache cells;
-                            };
-
-                        const cells = shaper_cells orelse break :glyphs;
-
-                        // If there are no shaper cells for this run, ignore it.
-                        // This can occur for runs of empty cells, and is fine.
-                        if (cells.len == 0) break :glyphs;
-
-                        // If we encounter a shaper cell to the left of the current
-                        // cell then we have some problems. This logic relies on x
-                        // position monotonically increasing.
-                        assert(cells[shaper_cells_i].x >= x);
-
-                        // NOTE: An assumption is made here that a single cell will never
-                        // be present in more than one shaper run. If that assumption is
-                        // violated, this logic breaks.
-
-                        while (shaper_cells_i < cells.len and cells[shaper_cells_i].x == x) : ({
-                            shaper_cells_i += 1;
-                        }) {
-                            self.addGlyph(
-                                @intCast(x),
-                                @intCast(y),
-                                cell_pin,
-                                cells[shaper_cells_i],
-                                shaper_run.?,
-                                fg,
-                                alpha,
-                            ) catch |err| {
-                                log.warn(
-                                    "error adding glyph to cell, will be invalid x={} y={}, err={}",
-                                    .{ x, y, err },
-                                );
-                            };
-                        }
-                    }
+                        self.rowCacheSeed(color_palette),
+                };
+                if (rebuild and
+                    self.rebuild_pool != null and
+                    rows.items.len * self.cells.size.columns >= rebuild_parallel_min_cells)
+                {
+                    try self.rebuildRowsParallel(&row_ctx, rows.items);
+                } else for (rows.items) |job| {
+                    try self.rebuildRowCached(&row_ctx, job.pin, job.y);
+                }
 
-                    // Finally, draw a strikethrough if necessary.
-                    if (style.flags.strikethrough) self.addStrikethrough(
-                        @intCast(x),
-                        @intCast(y),
-                        fg,
-                        alpha,
-                    ) catch |err| {
-                        log.warn(
-                            "error adding strikethrough to cell, will be invalid x={} y={}, err={}",
-                            .{ x, y, err },
-                        );
-                    };
+                const generation = self.font_grid.atlas_generation.load(.acquire);
+                if (generation == atlas_generation) break;
+                if (attempts + 1 >= rebuild_max_attempts) {
+                    log.warn("glyphs evicted on every rebuild, font atlas may be too small", .{});
+                    break;
                 }
+                atlas_generation = generation;
+                rebuild = true;
             }
 
             // Setup our cursor rendering information.
@@ -2912,9 +3309,591 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             // });
         }
 
+        /// On primary screen, we still apply vertical padding extension
+        /// under certain conditions we feel are safe. This updates the
+        /// extension for the given row if it is at the top or bottom.
+        ///
+        /// This helps make some scenarios look better while
+        /// avoiding scenarios we know do NOT look good.
+        fn updatePaddingExtend(
+            self: *Self,
+            row: terminal.Pin,
+            y: terminal.size.CellCountInt,
+            color_palette: *const terminal.color.Palette,
+        ) void {
+            switch (self.config.padding_color) {
+                // These already have the correct values set in rebuildCells.
+                .background, .@"extend-always" => {},
+
+                // Apply heuristics for padding extension.
+                .extend => if (y == 0) {
+                    self.uniforms.padding_extend.up = !row.neverExtendBg(
+                        color_palette,
+                        self.background_color orelse self.default_background_color,
+                    );
+                } else if (y == self.cells.size.rows - 1) {
+                    self.uniforms.padding_extend.down = !row.neverExtendBg(
+                        color_palette,
+                        self.background_color orelse self.default_background_color,
+                    );
+                },
+            }
+        }
+
+        /// Build the GPU cells for a single row of the viewport, copying
+        /// them from the row cache if we've built an identical row before.
+        /// The row cache isn't thread safe so this must only be called
+        /// from the thread that holds the draw mutex.
+        fn rebuildRowCached(
+            self: *Self,
+            ctx: *const RowContext,
+            row: terminal.Pin,
+            y: terminal.size.CellCountInt,
+        ) !void {
+            const key = self.rowCacheKey(ctx, row, y) orelse return try self.rebuildRow(
+                ctx,
+                &self.font_shaper,
+                &self.font_shaper_cache,
+                &self.glyph_cache,
+                row,
+                y,
+            );
+
+            if (self.row_cache.get(key)) |cached| {
+                try self.cells.setRow(self.alloc, y, cached.bg, cached.fg);
+                return;
+            }
+
+            try self.rebuildRow(
+                ctx,
+                &self.font_shaper,
+                &self.font_shaper_cache,
+                &self.glyph_cache,
+                row,
+                y,
+            );
+
+            // Caching is just a performance optimization,
+            // so if it fails for any reason we continue.
+            const built = self.cells.getRow(y);
+            self.row_cache.put(self.alloc, key, built.bg, built.fg) catch |err| {
+                log.warn("error caching row cells err={}", .{err});
+            };
+        }
+
+        /// Returns the row cache key for the given row, or null if
+        /// the row can't be cached.
+        fn rowCacheKey(
+            self: *const Self,
+            ctx: *const RowContext,
+            row: terminal.Pin,
+            y: terminal.size.CellCountInt,
+        ) ?u64 {
+            const seed = ctx.row_cache_seed orelse return null;
+            const screen = ctx.screen;
+
+            // Preedit cells are skipped when building a row and drawn
+            // separately, so the built row doesn't match its contents.
+            if (ctx.preedit_range) |range| if (range.y == y) return null;
+
+            // The selection and cursor both split runs and the
+            // selection changes colors, so they're part of the key.
+            const selection: ?[2]terminal.size.CellCountInt = sel: {
+                const sel = screen.selection orelse break :sel null;
+                const row_sel = sel.containedRow(screen, row) orelse break :sel null;
+                break :sel .{
+                    row_sel.topLeft(screen).x,
+                    row_sel.bottomRight(screen).x,
+                };
+            };
+            const cursor_x: ?terminal.size.CellCountInt =
+                if (screen.viewportIsBottom() and y == screen.cursor.y)
+                    screen.cursor.x
+                else
+                    null;
+
+            return RowCache.hashRow(row, .{
+                .seed = seed,
+                .columns = self.cells.size.columns,
+                .selection = selection,
+                .cursor_x = cursor_x,
+            });
+        }
+
+        /// Returns a hash of the state that affects how every row is
+        /// built but isn't part of the row itself. Anything else that
+        /// affects rows (fonts, config) clears the row cache instead.
+        fn rowCacheSeed(
+            self: *const Self,
+            color_palette: *const terminal.color.Palette,
+        ) u64 {
+            var hasher = std.hash.Wyhash.init(0);
+            hasher.update(std.mem.asBytes(color_palette));
+            std.hash.autoHash(&hasher, self.foreground_color);
+            std.hash.autoHash(&hasher, self.background_color);
+            std.hash.autoHash(&hasher, self.default_foreground_color);
+            std.hash.autoHash(&hasher, self.default_background_color);
+            return hasher.final();
+        }
+
+        /// Build the GPU cells for a single row of the viewport. This only
+        /// writes row `y` of `self.cells` so it is safe to call concurrently
+        /// for different rows as long as each caller has its own shaper,
+        /// shaper cache and glyph cache.
+        fn rebuildRow(
+            self: *Self,
+            ctx: *const RowContext,
+            shaper: *font.Shaper,
+            cache: *font.ShaperCache,
+            glyph_cache: *GlyphCache,
+            row: terminal.Pin,
+            y: terminal.size.CellCountInt,
+        ) !void {
+            const screen = ctx.screen;
+            const color_palette = ctx.color_palette;
+            const preedit_range = ctx.preedit_range;
+            const link_match_set = ctx.links;
+
+            // True if we want to do font shaping around the cursor.
+            // We want to do font shaping as long as the cursor is enabled.
+            const shape_cursor = screen.viewportIsBottom() and
+                y == screen.cursor.y;
+
+            // We need to get this row's selection, if
+            // there is one, for proper run splitting.
+            const row_selection = sel: {
+                const sel = screen.selection orelse break :sel null;
+                const pin = screen.pages.pin(.{ .viewport = .{ .y = y } }) orelse
+                    break :sel null;
+                break :sel sel.containedRow(screen, pin) orelse null;
+            };
+
+            // Iterator of runs for shaping.
+            var run_iter_opts: font.shape.RunOptions = .{
+                .grid = self.font_grid,
+                .screen = screen,
+                .row = row,
+                .selection = row_selection,
+                .cursor_x = if (shape_cursor) screen.cursor.x else null,
+            };
+            run_iter_opts.applyBreakConfig(self.config.font_shaping_break);
+            var run_iter = shaper.runIterator(run_iter_opts);
+            var shaper_run: ?font.shape.TextRun = try run_iter.next(self.alloc);
+            var shaper_cells: ?[]const font.shape.Cell = null;
+            var shaper_cells_i: usize = 0;
+
+            const row_cells_all = row.cells(.all);
+
+            // If our viewport is wider than our cell contents buffer,
+            // we still only process cells up to the width of the buffer.
+            const row_cells = row_cells_all[0..@min(row_cells_all.len, self.cells.size.columns)];
+
+            for (row_cells, 0..) |*cell, x| {
+                // If this cell falls within our preedit range then we
+                // skip this because preedits are setup separately.
+                if (preedit_range) |range| preedit: {
+                    // We're not on the preedit line, no actions necessary.
+                    if (range.y != y) break :preedit;
+                    // We're before the preedit range, no actions necessary.
+                    if (x < range.x[0]) break :preedit;
+                    // We're in the preedit range, skip this cell.
+                    if (x <= range.x[1]) continue;
+                    // After exiting the preedit range we need to catch
+                    // the run position up because of the missed cells.
+                    // In all other cases, no action is necessary.
+                    if (x != range.x[1] + 1) break :preedit;
+
+                    // Step the run iterator until we find a run that ends
+                    // after the current cell, which will be the soonest run
+                    // that might contain glyphs for our cell.
+                    while (shaper_run) |run| {
+                        if (run.offset + run.cells > x) break;
+                        shaper_run = try run_iter.next(self.alloc);
+                        shaper_cells = null;
+                        shaper_cells_i = 0;
+                    }
+
+                    const run = shaper_run orelse break :preedit;
+
+                    // If we haven't shaped this run, do so now.
+                    shaper_cells = shaper_cells orelse
+                        // Try to read the cells from the shaping cache if we can.
+                        cache.get(self.alloc, run) orelse
+                        cache: {
+                            // Otherwise we have to shape them.
+                            const cells = try shaper.shape(run);
+
+                            // Try to cache them. If caching fails for any reason we
+                            // continue because it is just a performance optimization,
+                            // not a correctness issue.
+                            cache.put(
+                                self.alloc,
+                                run,
+                                cells,
+                            ) catch |err| {
+                                log.warn(
+                                    "error caching font shaping results err={}",
+                                    .{err},
+                                );
+                            };
+
+                            // The cells we get from direct shaping are always owned
+                            // by the shaper and valid until the next shaping call so
+                            // we can safely use them.
+                            break :cache cells;
+                        };
+
+                    // Advance our index until we reach or pass
+                    // our current x position in the shaper cells.
+                    while (shaper_cells.?[shaper_cells_i].x < x) {
+                        shaper_cells_i += 1;
+                    }
+                }
+
+                const wide = cell.wide;
+
+                const style = row.style(cell);
+
+                const cell_pin: terminal.Pin = cell: {
+                    var copy = row;
+                    copy.x = @intCast(x);
+                    break :cell copy;
+                };
+
+                // True if this cell is selected
+                const selected: bool = if (screen.selection) |sel|
+                    sel.contains(screen, .{
+                        .node = row.node,
+                        .y = row.y,
+                        .x = @intCast(
+                            // Spacer tails should show the selection
+                            // state of the wide cell they belong to.
+                            if (wide == .spacer_tail)
+                                x -| 1
+                            else
+                                x,
+                        ),
+                    })
+                else
+                    false;
+
+                // The `_style` suffixed values are the colors based on
+                // the cell style (SGR), before applying any additional
+                // configuration, inversions, selections, etc.
+                const bg_style = style.bg(cell, color_palette);
+                const fg_style = style.fg(.{
+                    .default = self.foreground_color orelse self.default_foreground_color,
+                    .palette = color_palette,
+                    .bold = self.config.bold_color,
+                });
+
+                // The final background color for the cell.
+                const bg = bg: {
+                    if (selected) {
+                        // If we have an explicit selection background color
+                        // specified int he config, use that
+                        if (self.config.selection_background) |v| {
+                            break :bg switch (v) {
+                                .color => |color| color.toTerminalRGB(),
+                                .@"cell-foreground" => if (style.flags.inverse) bg_style else fg_style,
+                                .@"cell-background" => if (style.flags.inverse) fg_style else bg_style,
+                            };
+                        }
+
+                        // If no configuration, then our selection background
+                        // is our foreground color.
+                        break :bg self.foreground_color orelse self.default_foreground_color;
+                    }
+
+                    // Not selected
+                    break :bg if (style.flags.inverse != isCovering(cell.codepoint()))
+                        // Two cases cause us to invert (use the fg color as the bg)
+                        // - The "inverse" style flag.
+                        // - A "covering" glyph; we use fg for bg in that
+                        //   case to help make sure that padding extension
+                        //   works correctly.
+                        //
+                        // If one of these is true (but not the other)
+                        // then we use the fg style color for the bg.
+                        fg_style
+                    else
+                        // Otherwise they cancel out.
+                        bg_style;
+                };
+
+                const fg = fg: {
+                    // Our happy-path non-selection background color
+                    // is our style or our configured defaults.
+                    const final_bg = bg_style orelse
+                        self.background_color orelse
+                        self.default_background_color;
+
+                    // Whether we need to use the bg color as our fg color:
+                    // - Cell is selected, inverted, and set to cell-foreground
+                    // - Cell is selected, not inverted, and set to cell-background
+                    // - Cell is inverted and not selected
+                    if (selected) {
+                        // Use the selection foreground if set
+                        if (self.config.selection_foreground) |v| {
+                            break :fg switch (v) {
+                                .color => |color| color.toTerminalRGB(),
+                                .@"cell-foreground" => if (style.flags.inverse) final_bg else fg_style,
+                                .@"cell-background" => if (style.flags.inverse) fg_style else final_bg,
+                            };
+                        }
+
+                        break :fg self.background_color orelse self.default_background_color;
+                    }
+
+                    break :fg if (style.flags.inverse)
+                        final_bg
+                    else
+                        fg_style;
+                };
+
+                // Foreground alpha for this cell.
+                const alpha: u8 = if (style.flags.faint) 175 else 255;
+
+                // Set the cell's background color.
+                {
+                    const rgb = bg orelse self.background_color orelse self.default_background_color;
+
+                    // Determine our background alpha. If we have transparency configured
+                    // then this is dynamic depending on some situations. This is all
+                    // in an attempt to make transparency look the best for various
+                    // situations. See inline comments.
+                    const bg_alpha: u8 = bg_alpha: {
+                        const default: u8 = 255;
+
+                        // Cells that are selected should be fully opaque.
+                        if (selected) break :bg_alpha default;
+
+                        // Cells that are reversed should be fully opaque.
+                        if (style.flags.inverse) break :bg_alpha default;
+
+                        // If the user requested to have opacity on all cells, apply it.
+                        if (self.config.background_opacity_cells and bg_style != null) {
+                            var opacity: f64 = @floatFromInt(default);
+                            opacity *= self.config.background_opacity;
+                            break :bg_alpha @intFromFloat(opacity);
+                        }
+
+                        // Cells that have an explicit bg color should be fully opaque.
+                        if (bg_style != null) break :bg_alpha default;
+
+                        // Otherwise, we won't draw the bg for this cell,
+                        // we'll let the already-drawn background color
+                        // show through.
+                        break :bg_alpha 0;
+                    };
+
+                    self.cells.bgCell(y, x).* = .{
+                        rgb.r, rgb.g, rgb.b, bg_alpha,
+                    };
+                }
+
+                // If the invisible flag is set on this cell then we
+                // don't need to render any foreground elements, so
+                // we just skip all glyphs with this x coordinate.
+                //
+                // NOTE: This behavior matches xterm. Some other terminal
+                // emulators, e.g. Alacritty, still render text decorations
+                // and only make the text itself invisible. The decision
+                // has been made here to match xterm's behavior for this.
+                if (style.flags.invisible) {
+                    continue;
+                }
+
+                // Give links a single underline, unless they already have
+                // an underline, in which case use a double underline to
+                // distinguish them.
+                const underline: terminal.Attribute.Underline = if (link_match_set.contains(screen, cell_pin))
+                    if (style.flags.underline == .single)
+                        .double
+                    else
+                        .single
+                else
+                    style.flags.underline;
+
+                // We draw underlines first so that they layer underneath text.
+                // This improves readability when a colored underline is used
+                // which intersects parts of the text (descenders).
+                if (underline != .none) self.addUnderline(
+                    glyph_cache,
+                    @intCast(x),
+                    @intCast(y),
+                    underline,
+                    style.underlineColor(color_palette) orelse fg,
+                    alpha,
+                ) catch |err| {
+                    log.warn(
+                        "error adding underline to cell, will be invalid x={} y={}, err={}",
+                        .{ x, y, err },
+                    );
+                };
+
+                if (style.flags.overline) self.addOverline(glyph_cache, @intCast(x), @intCast(y), fg, alpha) catch |err| {
+                    log.warn(
+                        "error adding overline to cell, will be invalid x={} y={}, err={}",
+                        .{ x, y, err },
+                    );
+                };
+
+                // If we're at or past the end of our shaper run then
+                // we need to get the next run from the run iterator.
+                if (shaper_cells != null and shaper_cells_i >= shaper_cells.?.len) {
+                    shaper_run = try run_iter.next(self.alloc);
+                    shaper_cells = null;
+                    shaper_cells_i = 0;
+                }
+
+                if (shaper_run) |run| glyphs: {
+                    // If we haven't shaped this run yet, do so.
+                    shaper_cells = shaper_cells orelse
+                        // Try to read the cells from the shaping cache if we can.
+                        cache.get(self.alloc, run) orelse
+                        cache: {
+                            // Otherwise we have to shape them.
+                            const cells = try shaper.shape(run);
+
+                            // Try to cache them. If caching fails for any reason we
+                            // continue because it is just a performance optimization,
+                            // not a correctness issue.
+                            cache.put(
+                                self.alloc,
+                                run,
+                                cells,
+                            ) catch |err| {
+                                log.warn(
+                                    "error caching font shaping results err={}",
+                                    .{err},
+                                );
+                            };
+
+                            // The cells we get from direct shaping are always owned
+                            // by the shaper and valid until the next shaping call so
+                            // we can safely use them.
+                            break :cache cells;
+                        };
+
+                    const cells = shaper_cells orelse break :glyphs;
+
+                    // If there are no shaper cells for this run, ignore it.
+                    // This can occur for runs of empty cells, and is fine.
+                    if (cells.len == 0) break :glyphs;
+
+                    // If we encounter a shaper cell to the left of the current
+                    // cell then we have some problems. This logic relies on x
+                    // position monotonically increasing.
+                    assert(cells[shaper_cells_i].x >= x);
+
+                    // NOTE: An assumption is made here that a single cell will never
+                    // be present in more than one shaper run. If that assumption is
+                    // violated, this logic breaks.
+
+                    while (shaper_cells_i < cells.len and cells[shaper_cells_i].x == x) : ({
+                        shaper_cells_i += 1;
+                    }) {
+                        self.addGlyph(
+                            glyph_cache,
+                            @intCast(x),
+                            @intCast(y),
+                            cell_pin,
+                            cells[shaper_cells_i],
+                            shaper_run.?,
+                            fg,
+                            alpha,
+                        ) catch |err| {
+                            log.warn(
+                                "error adding glyph to cell, will be invalid x={} y={}, err={}",
+                                .{ x, y, err },
+                            );
+                        };
+                    }
+                }
+
+                // Finally, draw a strikethrough if necessary.
+                if (style.flags.strikethrough) self.addStrikethrough(
+                    glyph_cache,
+                    @intCast(x),
+                    @intCast(y),
+                    fg,
+                    alpha,
+                ) catch |err| {
+                    log.warn(
+                        "error adding strikethrough to cell, will be invalid x={} y={}, err={}",
+                        .{ x, y, err },
+                    );
+                };
+            }
+        }
+
+        /// Build the given rows split into one contiguous band per shaper,
+        /// using our worker pool. The calling thread also builds bands.
+        fn rebuildRowsParallel(
+            self: *Self,
+            ctx: *const RowContext,
+            rows: []const RowJob,
+        ) !void {
+            const pool = self.rebuild_pool.?;
+            const band_count = self.rebuild_bands.len + 1;
+            const band_len = std.math.divCeil(usize, rows.len, band_count) catch unreachable;
+
+            var errs: [max_rebuild_bands]?anyerror = @splat(null);
+            var wg: std.Thread.WaitGroup = .{};
+            for (0..band_count) |i| {
+                const start = @min(rows.len, i * band_len);
+                const end = @min(rows.len, start + band_len);
+                if (start == end) break;
+
+                // The first band uses our primary shaper so that its
+                // cache stays warm for the partial rebuilds that follow.
+                const shaper: *font.Shaper, const cache: *font.ShaperCache, const glyph_cache: *GlyphCache =
+                    if (i == 0)
+                        .{ &self.font_shaper, &self.font_shaper_cache, &self.glyph_cache }
+                    else
+                        .{
+                            &self.rebuild_bands[i - 1].shaper,
+                            &self.rebuild_bands[i - 1].cache,
+                            &self.rebuild_bands[i - 1].glyph_cache,
+                        };
+
+                pool.spawnWg(&wg, rebuildBand, .{
+                    self,
+                    ctx,
+                    shaper,
+                    cache,
+                    glyph_cache,
+                    rows[start..end],
+                    &errs[i],
+                });
+            }
+            pool.waitAndWork(&wg);
+
+            for (errs) |err| if (err) |e| return e;
+        }
+
+        fn rebuildBand(
+            self: *Self,
+            ctx: *const RowContext,
+            shaper: *font.Shaper,
+            cache: *font.ShaperCache,
+            glyph_cache: *GlyphCache,
+            rows: []const RowJob,
+            err: *?anyerror,
+        ) void {
+            for (rows) |job| {
+                self.rebuildRow(ctx, shaper, cache, glyph_cache, job.pin, job.y) catch |e| {
+                    err.* = e;
+                    return;
+                };
+            }
+        }
+
         /// Add an underline decoration to the specified cell
         fn addUnderline(
             self: *Self,
+            glyph_cache: *GlyphCache,
             x: terminal.size.CellCountInt,
             y: terminal.size.CellCountInt,
             style: terminal.Attribute.Underline,
@@ -2930,8 +3909,9 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
                 .curly => .underline_curly,
             };
 
-            const render = try self.font_grid.renderGlyph(
+            const render = try glyph_cache.renderGlyph(
                 self.alloc,
+                self.font_grid,
                 font.sprite_index,
                 @intFromEnum(sprite),
                 .{
@@ -2956,13 +3936,15 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
         /// Add a overline decoration to the specified cell
         fn addOverline(
             self: *Self,
+            glyph_cache: *GlyphCache,
             x: terminal.size.CellCountInt,
             y: terminal.size.CellCountInt,
             color: terminal.color.RGB,
             alpha: u8,
         ) !void {
-            const render = try self.font_grid.renderGlyph(
+            const render = try glyph_cache.renderGlyph(
                 self.alloc,
+                self.font_grid,
                 font.sprite_index,
                 @intFromEnum(font.Sprite.overline),
                 .{
@@ -2987,13 +3969,15 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
         /// Add a strikethrough decoration to the specified cell
         fn addStrikethrough(
             self: *Self,
+            glyph_cache: *GlyphCache,
             x: terminal.size.CellCountInt,
             y: terminal.size.CellCountInt,
             color: terminal.color.RGB,
             alpha: u8,
         ) !void {
-            const render = try self.font_grid.renderGlyph(
+            const render = try glyph_cache.renderGlyph(
                 self.alloc,
+                self.font_grid,
                 font.sprite_index,
                 @intFromEnum(font.Sprite.strikethrough),
                 .{
@@ -3018,6 +4002,7 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
         // Add a glyph to the specified cell.
         fn addGlyph(
             self: *Self,
+            glyph_cache: *GlyphCache,
             x: terminal.size.CellCountInt,
             y: terminal.size.CellCountInt,
             cell_pin: terminal.Pin,
@@ -3032,8 +4017,9 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
             const cp = cell.codepoint();
 
             // Render
-            const render = try self.font_grid.renderGlyph(
+            const render = try glyph_cache.renderGlyph(
                 self.alloc,
+                self.font_grid,
                 shaper_run.font_index,
                 shaper_cell.glyph_index,
                 .{
@@ -3208,20 +4194,43 @@ pub fn Renderer(comptime GraphicsAPI: type) type {
         /// Sync the atlas data to the given texture. This copies the bytes
         /// associated with the atlas to the given texture. If the atlas no
         /// longer fits into the texture, the texture will be resized.
+        ///
+        /// `since` is the `modified` value of the atlas when the texture
+        /// was last synced, so that only the rows that changed since then
+        /// need to be copied.
         fn syncAtlasTexture(
             self: *const Self,
             atlas: *const font.Atlas,
             texture: *Texture,
+            since: usize,
         ) !void {
-            if (atlas.size > texture.width) {
-                // Free our old texture
-                texture.*.deinit();
+            const rows: font.Atlas.Rows = rows: {
+                if (atlas.size > texture.width) {
+                    // Free our old texture
+                    texture.*.deinit();
+
+                    // Reallocate, the new texture needs all of the data.
+                    texture.* = try self.api.initAtlasTexture(atlas);
+                    break :rows .{ .y = 0, .height = atlas.size };
+                }
 
-                // Reallocate
-                texture.* = try self.api.initAtlasTexture(atlas);
-            }
+                break :rows atlas.dirtyRows(since) orelse
+                    .{ .y = 0, .height = atlas.size };
+            };
+            if (rows.height == 0) return;
+
+            // Full width rows are contiguous in the atlas data.
+            const stride = atlas.size * atlas.format.depth();
+            const data = atlas.data[rows.y * stride ..][0 .. rows.height * stride];
+
+            const span = trace.begin();
+            defer trace.end(
+                span,
+                .atlas_upload,
+                std.math.lossyCast(u32, data.len),
+            );
 
-            try texture.replaceRegion(0, 0, atlas.size, atlas.size, atlas.data);
+            try texture.replaceRegion(0, rows.y, atlas.size, rows.height, data);
         }
     };
 }
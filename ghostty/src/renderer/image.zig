@@ -38,8 +38,131 @@ pub const Placement = struct {
 pub const ImageMap = std.AutoHashMapUnmanaged(u32, struct {
     image: Image,
     transmit_time: std.time.Instant,
+
+    /// The mip level of the image data, see `mipLevel`. The texture is
+    /// the image downscaled by 2^level in each dimension so source rects
+    /// must be scaled down to match.
+    level: MipLevel = 0,
+
+    /// The generation of the animation frame the texture has, see
+    /// `terminal.kitty.graphics.Animation.generation`. This is zero if
+    /// the image isn't animated.
+    generation: u64 = 0,
 });
 
+pub const MipLevel = u5;
+
+/// The highest mip level we downscale images to.
+const max_mip_level: MipLevel = 8;
+
+/// Returns the mip level to upload an image at so that the texture is
+/// no smaller than it is drawn on screen: the number of times the source
+/// rect can be halved in both dimensions and still be at least as big as
+/// the destination. Images drawn much smaller than their native size
+/// (which is common, e.g. thumbnails in a few cells) then take up much
+/// less memory and upload bandwidth.
+pub fn mipLevel(
+    source_width: u32,
+    source_height: u32,
+    dest_width: u32,
+    dest_height: u32,
+) MipLevel {
+    var level: MipLevel = 0;
+    while (level < max_mip_level) : (level += 1) {
+        const next = level + 1;
+        if (source_width >> next < dest_width or
+            source_height >> next < dest_height) break;
+    }
+    return level;
+}
+
+/// Downscale image data by 2^level in each dimension, averaging each
+/// block of pixels, or copy it if the level is zero. A block is partial
+/// at the right and bottom edges if the size isn't a multiple of it, so
+/// that source coordinates always map to texels by dividing by 2^level.
+/// The returned data is owned by the caller and is `mipSize` big.
+pub fn downscale(
+    alloc: Allocator,
+    data: []const u8,
+    width: u32,
+    height: u32,
+    bpp: usize,
+    level: MipLevel,
+) Allocator.Error![]u8 {
+    assert(data.len == width * height * bpp);
+    assert(bpp <= 4);
+    if (level == 0) return try alloc.dupe(u8, data);
+
+    const block = @as(u32, 1) << level;
+    const size = mipSize(width, height, level);
+    const result = try alloc.alloc(u8, size.width * size.height * bpp);
+    errdefer alloc.free(result);
+
+    for (0..size.height) |y| {
+        const y0 = y * block;
+        const y1 = @min(height, y0 + block);
+        for (0..size.width) |x| {
+            const x0 = x * block;
+            const x1 = @min(width, x0 + block);
+
+            var sum: [4]u32 = @splat(0);
+            for (y0..y1) |sy| {
+                const row = data[(sy * width + x0) * bpp .. (sy * width + x1) * bpp];
+                var i: usize = 0;
+                while (i < row.len) : (i += bpp) {
+                    for (sum[0..bpp], row[i..][0..bpp]) |*s, v| s.* += v;
+                }
+            }
+
+            const n: u32 = @intCast((x1 - x0) * (y1 - y0));
+            const out = result[(y * size.width + x) * bpp ..][0..bpp];
+            for (out, sum[0..bpp]) |*o, s| o.* = @intCast((s + n / 2) / n);
+        }
+    }
+
+    return result;
+}
+
+/// Copy a rectangle out of image data, e.g. to upload only the part of
+/// an image that changed. The returned data is owned by the caller.
+pub fn crop(
+    alloc: Allocator,
+    data: []const u8,
+    width: u32,
+    bpp: usize,
+    x: u32,
+    y: u32,
+    crop_width: u32,
+    crop_height: u32,
+) Allocator.Error![]u8 {
+    assert(x + crop_width <= width);
+    assert((y + crop_height) * width * bpp <= data.len);
+
+    const row_len = crop_width * bpp;
+    const result = try alloc.alloc(u8, row_len * crop_height);
+    for (0..crop_height) |row| {
+        const start = ((y + row) * width + x) * bpp;
+        @memcpy(
+            result[row * row_len ..][0..row_len],
+            data[start..][0..row_len],
+        );
+    }
+
+    return result;
+}
+
+/// The size of an image at the given mip level.
+pub fn mipSize(width: u32, height: u32, level: MipLevel) struct {
+    width: u32,
+    height: u32,
+} {
+    const block = @as(u32, 1) << level;
+    return .{
+        .width = std.math.divCeil(u32, width, block) catch unreachable,
+        .height = std.math.divCeil(u32, height, block) catch unreachable,
+    };
+}
+
 /// The state for a single image that is to be rendered.
 pub const Image = union(enum) {
     /// The image data is pending upload to the GPU.
@@ -76,6 +199,23 @@ pub const Image = union(enum) {
         /// Data is always expected to be (width * height * bpp).
         data: [*]u8,
 
+        /// If set, the data is only a region of the image at this offset
+        /// (e.g. the part of an animation that changed between frames)
+        /// and it updates that region of the existing texture. This is
+        /// only valid when replacing an uploaded image.
+        offset: ?struct { x: u32, y: u32 } = null,
+
+        /// If non-zero, the data is the image at full size (and width
+        /// and height are its full size) and it's downscaled to this mip
+        /// level in `prepForUpload`. This lets the expensive downscale
+        /// run at upload time rather than while the terminal is locked.
+        level: MipLevel = 0,
+
+        /// Free the data.
+        pub fn deinit(self: Pending, alloc: Allocator) void {
+            alloc.free(self.dataSlice());
+        }
+
         pub fn dataSlice(self: Pending) []u8 {
             return self.data[0..self.len()];
         }
@@ -116,10 +256,10 @@ pub const Image = union(enum) {
         switch (self) {
             .pending,
             .unload_pending,
-            => |p| alloc.free(p.dataSlice()),
+            => |p| p.deinit(alloc),
 
             .replace, .unload_replace => |r| {
-                alloc.free(r.pending.dataSlice());
+                r.pending.deinit(alloc);
                 r.texture.deinit();
             },
 
@@ -148,10 +288,12 @@ pub const Image = union(enum) {
     /// will act like a new upload.
     pub fn markForReplace(self: *Image, alloc: Allocator, img: Image) !void {
         assert(img.isPending());
+        assert(img.getPending().?.offset == null or self.* == .ready);
+        assert(img.getPending().?.offset == null or img.getPending().?.level == 0);
 
         // If we have pending data right now, free it.
         if (self.getPending()) |p| {
-            alloc.free(p.dataSlice());
+            p.deinit(alloc);
         }
         // If we have an existing texture, use it in the replace.
         if (self.getTexture()) |t| {
@@ -209,16 +351,38 @@ pub const Image = union(enum) {
             .rgba => unreachable,
             .bgra => wuffs.swizzle.bgraToRgba(alloc, data),
         };
-        alloc.free(data);
+        p.deinit(alloc);
         p.data = rgba.ptr;
         p.pixel_format = .rgba;
     }
 
+    /// Downscales the pending image data to its mip level, if it has one.
+    /// This is done before converting so there's less data to convert.
+    fn downscalePending(self: *Image, alloc: Allocator) Allocator.Error!void {
+        const p = self.getPendingPointer().?;
+        if (p.level == 0) return;
+        const data = try downscale(
+            alloc,
+            p.dataSlice(),
+            p.width,
+            p.height,
+            p.pixel_format.bpp(),
+            p.level,
+        );
+        const size = mipSize(p.width, p.height, p.level);
+        p.deinit(alloc);
+        p.data = data.ptr;
+        p.width = size.width;
+        p.height = size.height;
+        p.level = 0;
+    }
+
     /// Prepare the pending image data for upload to the GPU.
     /// This doesn't need GPU access so is safe to call any time.
     pub fn prepForUpload(self: *Image, alloc: Allocator) !void {
         assert(self.isPending());
 
+        try self.downscalePending(alloc);
         try self.convert(alloc);
     }
 
@@ -236,6 +400,22 @@ pub const Image = union(enum) {
         // Get our pending info
         const p = self.getPending().?;
 
+        // If this is only a region of the image then we update
+        // the texture we already have.
+        if (p.offset) |offset| {
+            const texture = self.replace.texture;
+            try texture.replaceRegion(
+                offset.x,
+                offset.y,
+                p.width,
+                p.height,
+                p.dataSlice(),
+            );
+            p.deinit(alloc);
+            self.* = .{ .ready = texture };
+            return;
+        }
+
         // Create our texture
         const texture = try Texture.init(
             api.imageTextureOptions(.rgba, true),
@@ -300,3 +480,92 @@ pub const Image = union(enum) {
         };
     }
 };
+
+test mipLevel {
+    const testing = std.testing;
+
+    // Drawn at or above native size.
+    try testing.expectEqual(0, mipLevel(100, 100, 100, 100));
+    try testing.expectEqual(0, mipLevel(100, 100, 200, 50));
+
+    // Drawn smaller, limited by the dimension that shrinks least.
+    try testing.expectEqual(1, mipLevel(100, 100, 50, 50));
+    try testing.expectEqual(1, mipLevel(100, 100, 49, 30));
+    try testing.expectEqual(2, mipLevel(1000, 1000, 200, 200));
+    try testing.expectEqual(max_mip_level, mipLevel(10000, 10000, 1, 1));
+}
+
+test downscale {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    // A 3x2 gray image, which is a partial block on the right.
+    const data = [_]u8{
+        0,   100, 7,
+        200, 50,  9,
+    };
+
+    const level0 = try downscale(alloc, &data, 3, 2, 1, 0);
+    defer alloc.free(level0);
+    try testing.expectEqualSlices(u8, &data, level0);
+
+    const level1 = try downscale(alloc, &data, 3, 2, 1, 1);
+    defer alloc.free(level1);
+    try testing.expectEqualSlices(u8, &.{ 88, 8 }, level1);
+
+    // Channels are averaged separately.
+    const rgba = [_]u8{
+        255, 0, 0, 255, 0, 255, 0, 255,
+        255, 0, 0, 255, 0, 255, 0, 255,
+    };
+    const rgba1 = try downscale(alloc, &rgba, 2, 2, 4, 1);
+    defer alloc.free(rgba1);
+    try testing.expectEqualSlices(u8, &.{ 128, 128, 0, 255 }, rgba1);
+}
+
+test crop {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    // A 3x3 gray image.
+    const data = [_]u8{
+        1, 2, 3,
+        4, 5, 6,
+        7, 8, 9,
+    };
+
+    const middle = try crop(alloc, &data, 3, 1, 1, 1, 2, 2);
+    defer alloc.free(middle);
+    try testing.expectEqualSlices(u8, &.{ 5, 6, 8, 9 }, middle);
+
+    const row = try crop(alloc, &data, 3, 1, 0, 2, 3, 1);
+    defer alloc.free(row);
+    try testing.expectEqualSlices(u8, &.{ 7, 8, 9 }, row);
+}
+
+test "Image prepForUpload downscales pending data" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    // A full size 3x2 gray image that's wanted at mip level 1.
+    const data = try alloc.dupe(u8, &.{
+        0,   100, 7,
+        200, 50,  9,
+    });
+    var img: Image = .{ .pending = .{
+        .width = 3,
+        .height = 2,
+        .pixel_format = .gray,
+        .data = data.ptr,
+        .level = 1,
+    } };
+    defer img.deinit(alloc);
+
+    try img.prepForUpload(alloc);
+    const p = img.getPending().?;
+    try testing.expectEqual(2, p.width);
+    try testing.expectEqual(1, p.height);
+    try testing.expectEqual(0, p.level);
+    try testing.expectEqual(.rgba, p.pixel_format);
+    try testing.expectEqualSlices(u8, &.{ 88, 88, 88, 255, 8, 8, 8, 255 }, p.dataSlice());
+}
@@ -0,0 +1,67 @@
+//! Wrapper for handling a single frame.
+const Self = @This();
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const assert = std.debug.assert;
+
+const Renderer = @import("../generic.zig").Renderer(Software);
+const Software = @import("../Software.zig");
+const Target = @import("Target.zig");
+const RenderPass = @import("RenderPass.zig");
+
+const log = std.log.scoped(.software);
+
+/// Options for beginning a frame.
+pub const Options = struct {};
+
+renderer: *Renderer,
+target: *Target,
+
+/// When the frame began, used to measure how long rasterization takes.
+start: ?std.time.Instant,
+
+/// Begin encoding a frame.
+pub fn begin(
+    opts: Options,
+    /// Once the frame has been completed, the `frameCompleted` method
+    /// on the renderer is called with the health status of the frame.
+    renderer: *Renderer,
+    /// The target is presented via the provided renderer's API when completed.
+    target: *Target,
+) !Self {
+    _ = opts;
+
+    return .{
+        .renderer = renderer,
+        .target = target,
+        .start = std.time.Instant.now() catch null,
+    };
+}
+
+/// Add a render pass to this frame with the provided attachments.
+/// Returns a RenderPass which allows render steps to be added.
+pub inline fn renderPass(
+    self: *const Self,
+    attachments: []const RenderPass.Options.Attachment,
+) RenderPass {
+    _ = self;
+    return RenderPass.begin(.{ .attachments = attachments });
+}
+
+/// Complete this frame and present the target.
+///
+/// NOTE: All drawing is done synchronously as steps are added, so by
+/// the time we get here the frame is finished and `sync` is ignored.
+pub fn complete(self: *const Self, sync: bool) void {
+    _ = sync;
+
+    if (self.start) |start| self.renderer.api.recordFrameTime(start);
+
+    self.renderer.api.present(self.target.*) catch |err| {
+        log.err("Failed to present render target: err={}", .{err});
+    };
+
+    // Rasterizing on the CPU can't fail part way through.
+    self.renderer.frameCompleted(.healthy);
+}
@@ -0,0 +1,26 @@
+//! Wrapper for handling render pipelines.
+//!
+//! There are no shader programs in the software renderer, each of our
+//! pipelines is a fixed rasterization routine in RenderPass, so this
+//! just identifies which one to run.
+const Self = @This();
+
+const std = @import("std");
+
+/// The rasterization routine to use, these match up
+/// one to one with our GLSL and MSL shader pairs.
+pub const Kind = enum {
+    bg_color,
+    cell_bg,
+    cell_text,
+    image,
+    bg_image,
+};
+
+kind: Kind,
+
+blending_enabled: bool = true,
+
+pub fn deinit(self: *const Self) void {
+    _ = self;
+}
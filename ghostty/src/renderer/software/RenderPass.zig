@@ -0,0 +1,451 @@
+//! Wrapper for handling render passes.
+//!
+//! Unlike the GPU renderers, steps are rasterized immediately when they
+//! are added. Each pipeline kind is a straight port of the corresponding
+//! GLSL shader pair in `../shaders/glsl`, so see those for the reasoning
+//! behind the color math.
+const Self = @This();
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const assert = std.debug.assert;
+
+const raster = @import("raster.zig");
+const shaders = @import("shaders.zig");
+const Target = @import("Target.zig");
+const Texture = @import("Texture.zig");
+const Pipeline = @import("Pipeline.zig");
+const bufferpkg = @import("buffer.zig");
+const Bytes = bufferpkg.Bytes;
+const Canvas = raster.Canvas;
+const Color = raster.Color;
+
+const log = std.log.scoped(.software);
+
+/// Options for beginning a render pass.
+pub const Options = struct {
+    /// Color attachments for this render pass.
+    attachments: []const Attachment,
+
+    /// Describes a color attachment.
+    pub const Attachment = struct {
+        target: union(enum) {
+            texture: Texture,
+            target: Target,
+        },
+        clear_color: ?[4]f32 = null,
+    };
+};
+
+/// Describes a step in a render pass.
+pub const Step = struct {
+    pipeline: Pipeline,
+    uniforms: ?Bytes = null,
+    buffers: []const ?Bytes = &.{},
+    textures: []const ?Texture = &.{},
+    draw: Draw,
+
+    /// Describes the draw call for this step.
+    pub const Draw = struct {
+        /// Our pipelines know their own geometry, so this is
+        /// only here for parity with the other renderers.
+        type: Primitive,
+        vertex_count: usize,
+        instance_count: usize = 1,
+    };
+
+    pub const Primitive = enum {
+        triangle,
+        triangle_strip,
+    };
+};
+
+attachments: []const Options.Attachment,
+
+step_number: usize = 0,
+
+/// Begin a render pass.
+pub fn begin(
+    opts: Options,
+) Self {
+    return .{
+        .attachments = opts.attachments,
+    };
+}
+
+/// Add a step to this render pass.
+///
+/// Like the OpenGL renderer, steps with missing inputs are silently ignored.
+pub fn step(self: *Self, s: Step) void {
+    if (s.draw.instance_count == 0) return;
+
+    const canvas: Canvas = switch (self.attachments[0].target) {
+        .target => |t| t.canvas(),
+        .texture => |t| canvas: {
+            // We only ever render to textures created with
+            // `textureOptions`, which are RGBA.
+            if (t.format != .rgba) return;
+            break :canvas .{
+                .pixels = t.data,
+                .width = t.width,
+                .height = t.height,
+                .srgb = t.srgb,
+            };
+        },
+    };
+
+    defer self.step_number += 1;
+
+    // If we have a clear color and this is the
+    // first step in the pass, go ahead and clear.
+    if (self.step_number == 0) if (self.attachments[0].clear_color) |c| {
+        canvas.clear(c);
+    };
+
+    const uniforms: *const shaders.Uniforms = @ptrCast(@alignCast(
+        (s.uniforms orelse return).ptr,
+    ));
+
+    switch (s.pipeline.kind) {
+        .bg_color => bgColor(canvas, uniforms),
+
+        .cell_bg => cellBg(
+            canvas,
+            uniforms,
+            bufferpkg.items(shaders.CellBg, s.buffers[1] orelse return),
+        ),
+
+        .cell_text => cellText(
+            canvas,
+            uniforms,
+            bufferpkg.items(shaders.CellText, s.buffers[0] orelse return),
+            bufferpkg.items(shaders.CellBg, s.buffers[1] orelse return),
+            s.textures[0] orelse return,
+            s.textures[1] orelse return,
+            s.draw.instance_count,
+        ),
+
+        .image => image(
+            canvas,
+            uniforms,
+            bufferpkg.items(shaders.Image, s.buffers[0] orelse return),
+            s.textures[0] orelse return,
+            s.draw.instance_count,
+        ),
+
+        .bg_image => bgImage(
+            canvas,
+            uniforms,
+            bufferpkg.items(shaders.BgImage, s.buffers[0] orelse return)[0],
+            s.textures[0] orelse return,
+        ),
+    }
+}
+
+/// Complete this render pass.
+/// This struct can no longer be used after calling this.
+pub fn complete(self: *const Self) void {
+    _ = self;
+}
+
+/// Transform a point in world space (the grid, with the origin at the top
+/// left of the padded area) to pixel coordinates on the target using the
+/// projection matrix, the same as the vertex shaders do.
+fn project(u: *const shaders.Uniforms, x: f32, y: f32) [2]f32 {
+    const m = u.projection_matrix;
+    const ndc_x = m[0][0] * x + m[1][0] * y + m[3][0];
+    const ndc_y = m[0][1] * x + m[1][1] * y + m[3][1];
+    return .{
+        (ndc_x + 1) / 2 * u.screen_size[0],
+        (1 - ndc_y) / 2 * u.screen_size[1],
+    };
+}
+
+/// bg_color.f.glsl
+fn bgColor(canvas: Canvas, u: *const shaders.Uniforms) void {
+    canvas.clear(raster.loadColor(u.bg_color, u.bools.use_linear_blending));
+}
+
+/// cell_bg.f.glsl
+///
+/// Rather than evaluating every pixel independently we walk the grid one
+/// cell at a time, since every pixel within a cell is the same color.
+fn cellBg(
+    canvas: Canvas,
+    u: *const shaders.Uniforms,
+    cells: []const shaders.CellBg,
+) void {
+    const cols: usize = u.grid_size[0];
+    const rows: usize = u.grid_size[1];
+    if (cols == 0 or rows == 0 or cells.len < cols * rows) return;
+
+    const linear = u.bools.use_linear_blending;
+    const extend = u.padding_extend;
+    const pad_top = u.grid_padding[0];
+    const pad_left = u.grid_padding[3];
+    const cell_w = u.cell_size[0];
+    const cell_h = u.cell_size[1];
+
+    // The pixel range covered by each column, with the padding on the
+    // left and right edges included if we're extending in to it.
+    const fcols: f32 = @floatFromInt(cols);
+    const frows: f32 = @floatFromInt(rows);
+    const grid_x0 = if (extend.left) -std.math.inf(f32) else pad_left;
+    const grid_x1 = if (extend.right) std.math.inf(f32) else pad_left + fcols * cell_w;
+    const grid_y0 = if (extend.up) -std.math.inf(f32) else pad_top;
+    const grid_y1 = if (extend.down) std.math.inf(f32) else pad_top + frows * cell_h;
+
+    for (0..rows) |row| {
+        const frow: f32 = @floatFromInt(row);
+        const y0, const y1 = raster.span(
+            if (row == 0) grid_y0 else pad_top + frow * cell_h,
+            if (row == rows - 1) grid_y1 else pad_top + (frow + 1) * cell_h,
+            canvas.height,
+        );
+        if (y0 >= y1) continue;
+
+        for (0..cols) |col| {
+            const fcol: f32 = @floatFromInt(col);
+            const x0, const x1 = raster.span(
+                if (col == 0) grid_x0 else pad_left + fcol * cell_w,
+                if (col == cols - 1) grid_x1 else pad_left + (fcol + 1) * cell_w,
+                canvas.width,
+            );
+            if (x0 >= x1) continue;
+
+            const c = raster.loadColor(cells[row * cols + col], linear);
+
+            // Fully transparent is the common case, nothing to do.
+            if (c[3] == 0) continue;
+
+            // Fully opaque means we can skip blending entirely.
+            if (c[3] == 1) {
+                canvas.fill(x0, x1, y0, y1, c);
+                continue;
+            }
+
+            for (y0..y1) |y| for (x0..x1) |x| canvas.blend(x, y, c);
+        }
+    }
+}
+
+/// cell_text.v.glsl and cell_text.f.glsl
+fn cellText(
+    canvas: Canvas,
+    u: *const shaders.Uniforms,
+    cells: []const shaders.CellText,
+    bg_cells: []const shaders.CellBg,
+    atlas_grayscale: Texture,
+    atlas_color: Texture,
+    count: usize,
+) void {
+    const cols: usize = u.grid_size[0];
+    const linear = u.bools.use_linear_blending;
+    const correction = u.bools.use_linear_correction;
+    const global_bg = raster.loadColor(u.bg_color, true);
+    const cursor_color = raster.loadColor(u.cursor_color, linear);
+
+    for (cells[0..@min(count, cells.len)]) |cell| {
+        if (cell.glyph_size[0] == 0 or cell.glyph_size[1] == 0) continue;
+
+        const gx: f32 = @floatFromInt(cell.grid_pos[0]);
+        const gy: f32 = @floatFromInt(cell.grid_pos[1]);
+        const gw: f32 = @floatFromInt(cell.glyph_size[0]);
+        const gh: f32 = @floatFromInt(cell.glyph_size[1]);
+
+        // Top left and bottom right of the glyph in pixels.
+        const wx = u.cell_size[0] * gx + @as(f32, @floatFromInt(cell.bearings[0]));
+        const wy = u.cell_size[1] * gy + u.cell_size[1] -
+            @as(f32, @floatFromInt(cell.bearings[1]));
+        const p0 = project(u, wx, wy);
+        const p1 = project(u, wx + gw, wy + gh);
+        const x0, const x1 = raster.span(p0[0], p1[0], canvas.width);
+        const y0, const y1 = raster.span(p0[1], p1[1], canvas.height);
+        if (x0 >= x1 or y0 >= y1) continue;
+
+        // Our color is always linear to start with, to
+        // make the minimum contrast calculations easier.
+        var color = raster.loadColor(cell.color, true);
+
+        var bg: Color = @splat(0);
+        const bg_index = @as(usize, cell.grid_pos[1]) * cols + cell.grid_pos[0];
+        if (bg_index < bg_cells.len) bg = raster.loadColor(bg_cells[bg_index], true);
+        bg += global_bg * @as(Color, @splat(1 - bg[3]));
+
+        if (u.min_contrast > 1 and !cell.bools.no_min_contrast) {
+            color = raster.contrastedColor(u.min_contrast, color, bg);
+        }
+
+        const is_cursor_pos =
+            (cell.grid_pos[0] == u.cursor_pos[0] or
+                (u.bools.cursor_wide and cell.grid_pos[0] == u.cursor_pos[0] +% 1)) and
+            cell.grid_pos[1] == u.cursor_pos[1];
+        if (!cell.bools.is_cursor_glyph and is_cursor_pos) color = cursor_color;
+
+        // Re-apply the gamma encoding if we're not blending linearly.
+        if (!linear) color = raster.premultiply(
+            raster.unlinearizeLut(raster.unpremultiply(color)),
+        );
+
+        // The luminances for linear correction are constant per glyph.
+        const fg_l = raster.luminance(color);
+        const bg_l = raster.luminance(bg);
+        const correct = correction and @abs(fg_l - bg_l) > 0.001;
+
+        // Glyphs are drawn at their native size so this is 1 unless
+        // the projection is scaling, but we handle it to be safe.
+        const sx = gw / (p1[0] - p0[0]);
+        const sy = gh / (p1[1] - p0[1]);
+        const tx0: f32 = @floatFromInt(cell.glyph_pos[0]);
+        const ty0: f32 = @floatFromInt(cell.glyph_pos[1]);
+
+        for (y0..y1) |y| {
+            const ty = ty0 + (@as(f32, @floatFromInt(y)) + 0.5 - p0[1]) * sy;
+            for (x0..x1) |x| {
+                const tx = tx0 + (@as(f32, @floatFromInt(x)) + 0.5 - p0[0]) * sx;
+                switch (cell.atlas) {
+                    .grayscale => {
+                        var a = atlas_grayscale.sample(tx, ty)[0];
+                        if (a == 0) continue;
+                        if (correct) {
+                            const blend_l = raster.linearize(
+                                raster.unlinearize(fg_l) * a +
+                                    raster.unlinearize(bg_l) * (1 - a),
+                            );
+                            a = std.math.clamp((blend_l - bg_l) / (fg_l - bg_l), 0, 1);
+                        }
+                        canvas.blend(x, y, color * @as(Color, @splat(a)));
+                    },
+
+                    .color => {
+                        // Color glyphs are already premultiplied linear.
+                        var c = atlas_color.sample(tx, ty);
+                        if (c[3] == 0) continue;
+                        if (!linear) c = raster.premultiply(
+                            raster.unlinearizeLut(raster.unpremultiply(c)),
+                        );
+                        canvas.blend(x, y, c);
+                    },
+                }
+            }
+        }
+    }
+}
+
+/// image.v.glsl and image.f.glsl
+///
+/// We use nearest neighbor sampling, so scaled images will look
+/// blockier than they do on the GPU.
+fn image(
+    canvas: Canvas,
+    u: *const shaders.Uniforms,
+    images: []const shaders.Image,
+    texture: Texture,
+    count: usize,
+) void {
+    const linear = u.bools.use_linear_blending;
+
+    for (images[0..@min(count, images.len)]) |img| {
+        const wx = u.cell_size[0] * img.grid_pos[0] + img.cell_offset[0];
+        const wy = u.cell_size[1] * img.grid_pos[1] + img.cell_offset[1];
+        const p0 = project(u, wx, wy);
+        const p1 = project(u, wx + img.dest_size[0], wy + img.dest_size[1]);
+        const x0, const x1 = raster.span(p0[0], p1[0], canvas.width);
+        const y0, const y1 = raster.span(p0[1], p1[1], canvas.height);
+        if (x0 >= x1 or y0 >= y1) continue;
+
+        const src = img.source_rect;
+        const sx = src[2] / (p1[0] - p0[0]);
+        const sy = src[3] / (p1[1] - p0[1]);
+
+        for (y0..y1) |y| {
+            const ty = src[1] + (@as(f32, @floatFromInt(y)) + 0.5 - p0[1]) * sy;
+            for (x0..x1) |x| {
+                const tx = src[0] + (@as(f32, @floatFromInt(x)) + 0.5 - p0[0]) * sx;
+                var c = texture.sample(tx, ty);
+                if (c[3] == 0) continue;
+                if (!linear) c = raster.unlinearizeLut(c);
+                canvas.blend(x, y, raster.premultiply(c));
+            }
+        }
+    }
+}
+
+/// bg_image.v.glsl and bg_image.f.glsl
+fn bgImage(
+    canvas: Canvas,
+    u: *const shaders.Uniforms,
+    info: shaders.BgImage,
+    texture: Texture,
+) void {
+    const linear = u.bools.use_linear_blending;
+    const screen: @Vector(2, f32) = u.screen_size;
+    const tex_size: @Vector(2, f32) = .{
+        @floatFromInt(texture.width),
+        @floatFromInt(texture.height),
+    };
+
+    const dest_size: @Vector(2, f32) = switch (info.info.fit) {
+        .contain => tex_size * @as(@Vector(2, f32), @splat(@min(
+            screen[0] / tex_size[0],
+            screen[1] / tex_size[1],
+        ))),
+        .cover => tex_size * @as(@Vector(2, f32), @splat(@max(
+            screen[0] / tex_size[0],
+            screen[1] / tex_size[1],
+        ))),
+        .stretch => screen,
+        .none => tex_size,
+    };
+
+    const start: @Vector(2, f32) = @splat(0);
+    const mid = (screen - dest_size) / @as(@Vector(2, f32), @splat(2));
+    const end = screen - dest_size;
+    const offset: @Vector(2, f32) = switch (info.info.position) {
+        .tl => .{ start[0], start[1] },
+        .tc => .{ mid[0], start[1] },
+        .tr => .{ end[0], start[1] },
+        .ml => .{ start[0], mid[1] },
+        .mc => .{ mid[0], mid[1] },
+        .mr => .{ end[0], mid[1] },
+        .bl => .{ start[0], end[1] },
+        .bc => .{ mid[0], end[1] },
+        .br => .{ end[0], end[1] },
+    };
+    const scale = tex_size / dest_size;
+
+    // A fully opaque version of the bg color, with the alpha separate.
+    const bg_alpha = @as(f32, @floatFromInt(u.bg_color[3])) / 255;
+    var bg_color = raster.loadColor(.{ u.bg_color[0], u.bg_color[1], u.bg_color[2], 255 }, linear);
+    bg_color[3] = 1;
+    const opacity = @min(info.opacity, 1 / bg_alpha);
+
+    for (0..canvas.height) |y| {
+        for (0..canvas.width) |x| {
+            var tex: @Vector(2, f32) = (@Vector(2, f32){
+                @floatFromInt(x),
+                @floatFromInt(y),
+            } + @as(@Vector(2, f32), @splat(0.5)) - offset) * scale;
+
+            if (info.info.repeat) {
+                tex[0] = @mod(tex[0], tex_size[0]);
+                tex[1] = @mod(tex[1], tex_size[1]);
+            }
+
+            var c: Color = @splat(0);
+            if (tex[0] >= 0 and tex[1] >= 0 and
+                tex[0] <= tex_size[0] and tex[1] <= tex_size[1])
+            {
+                c = texture.sample(tex[0], tex[1]);
+                if (!linear) c = raster.unlinearizeLut(c);
+                c = raster.premultiply(c);
+            }
+
+            c *= @as(Color, @splat(opacity));
+            c += @max(@as(Color, @splat(0)), bg_color * @as(Color, @splat(1 - c[3])));
+            c *= @as(Color, @splat(bg_alpha));
+
+            canvas.blend(x, y, c);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+//! Represents a render target.
+//!
+//! In this case, an RGBA8 framebuffer in system memory. The pixel values
+//! are premultiplied and, if `srgb` is set, sRGB encoded.
+const Self = @This();
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const assert = std.debug.assert;
+
+const raster = @import("raster.zig");
+
+const log = std.log.scoped(.software);
+
+/// Options for initializing a Target
+pub const Options = struct {
+    alloc: Allocator,
+
+    /// Desired width
+    width: usize,
+    /// Desired height
+    height: usize,
+
+    /// Whether the framebuffer is sRGB encoded, meaning
+    /// that blending is performed in linear space.
+    srgb: bool,
+};
+
+alloc: Allocator,
+
+/// The pixel data, tightly packed RGBA8 with no row padding.
+pixels: []u8,
+
+/// Current width of this target.
+width: usize,
+/// Current height of this target.
+height: usize,
+
+/// Whether the pixel data is sRGB encoded.
+srgb: bool,
+
+pub fn init(opts: Options) !Self {
+    const pixels = try opts.alloc.alloc(u8, opts.width * opts.height * 4);
+    @memset(pixels, 0);
+
+    return .{
+        .alloc = opts.alloc,
+        .pixels = pixels,
+        .width = opts.width,
+        .height = opts.height,
+        .srgb = opts.srgb,
+    };
+}
+
+pub fn deinit(self: *Self) void {
+    self.alloc.free(self.pixels);
+}
+
+/// Returns a canvas which draws to this target.
+pub fn canvas(self: Self) raster.Canvas {
+    return .{
+        .pixels = self.pixels,
+        .width = self.width,
+        .height = self.height,
+        .srgb = self.srgb,
+    };
+}
+
+/// Returns the pixel at the given coordinates as RGBA8.
+pub fn pixel(self: Self, x: usize, y: usize) [4]u8 {
+    assert(x < self.width and y < self.height);
+    return self.pixels[(y * self.width + x) * 4 ..][0..4].*;
+}
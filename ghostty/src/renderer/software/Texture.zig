@@ -0,0 +1,172 @@
+//! A texture stored in system memory.
+const Self = @This();
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const assert = std.debug.assert;
+
+const raster = @import("raster.zig");
+const Color = raster.Color;
+
+const log = std.log.scoped(.software);
+
+/// Options for initializing a texture.
+pub const Options = struct {
+    /// The allocator for the pixel data. Since the texture is freed by
+    /// value it has to carry this with it.
+    alloc: Allocator,
+
+    format: Format,
+
+    /// If true, the RGB components of the data are sRGB encoded
+    /// and will be linearized when sampled, like an `*_srgb` texture
+    /// format on the GPU. Alpha is always linear.
+    srgb: bool,
+};
+
+/// The pixel format of the texture data.
+pub const Format = enum {
+    /// 1 byte per pixel. Sampled as (v, 0, 0, 1).
+    gray,
+    /// 4 bytes per pixel RGBA.
+    rgba,
+    /// 4 bytes per pixel BGRA.
+    bgra,
+
+    pub fn bytesPerPixel(self: Format) usize {
+        return switch (self) {
+            .gray => 1,
+            .rgba, .bgra => 4,
+        };
+    }
+};
+
+alloc: Allocator,
+
+/// The pixel data, tightly packed with no row padding.
+data: []u8,
+
+/// The width of this texture.
+width: usize,
+/// The height of this texture.
+height: usize,
+
+/// Format for this texture.
+format: Format,
+
+/// Whether the RGB data is sRGB encoded.
+srgb: bool,
+
+pub const Error = error{
+    OutOfMemory,
+};
+
+/// Initialize a texture
+pub fn init(
+    opts: Options,
+    width: usize,
+    height: usize,
+    data: ?[]const u8,
+) Error!Self {
+    const buf = try opts.alloc.alloc(
+        u8,
+        width * height * opts.format.bytesPerPixel(),
+    );
+    errdefer opts.alloc.free(buf);
+
+    if (data) |d| @memcpy(buf, d[0..buf.len]) else @memset(buf, 0);
+
+    return .{
+        .alloc = opts.alloc,
+        .data = buf,
+        .width = width,
+        .height = height,
+        .format = opts.format,
+        .srgb = opts.srgb,
+    };
+}
+
+pub fn deinit(self: Self) void {
+    self.alloc.free(self.data);
+}
+
+/// Replace a region of the texture with the provided data.
+///
+/// Does NOT check the dimensions of the data to ensure correctness.
+pub fn replaceRegion(
+    self: Self,
+    x: usize,
+    y: usize,
+    width: usize,
+    height: usize,
+    data: []const u8,
+) Error!void {
+    const bpp = self.format.bytesPerPixel();
+    const row_len = width * bpp;
+
+    // Fast path for the common case of replacing everything,
+    // which is what we do every time an atlas is modified.
+    if (x == 0 and width == self.width) {
+        @memcpy(
+            self.data[y * row_len ..][0 .. height * row_len],
+            data[0 .. height * row_len],
+        );
+        return;
+    }
+
+    for (0..height) |row| {
+        @memcpy(
+            self.data[((y + row) * self.width + x) * bpp ..][0..row_len],
+            data[row * row_len ..][0..row_len],
+        );
+    }
+}
+
+/// Fetch the texel at the given coordinates, which must be in bounds.
+/// The result is not premultiplied unless the data itself is.
+pub inline fn fetch(self: Self, x: usize, y: usize) Color {
+    assert(x < self.width and y < self.height);
+    const i = y * self.width + x;
+    const c: Color = switch (self.format) {
+        .gray => .{ @as(f32, @floatFromInt(self.data[i])) / 255, 0, 0, 1 },
+        .rgba => raster.unpack(self.data[i * 4 ..][0..4].*),
+        .bgra => bgra: {
+            const p = self.data[i * 4 ..][0..4].*;
+            break :bgra raster.unpack(.{ p[2], p[1], p[0], p[3] });
+        },
+    };
+    return if (self.srgb) raster.linearizeLut(c) else c;
+}
+
+/// Fetch the texel nearest to the given coordinates in pixels,
+/// clamping to the edge of the texture.
+pub inline fn sample(self: Self, x: f32, y: f32) Color {
+    const w: f32 = @floatFromInt(self.width - 1);
+    const h: f32 = @floatFromInt(self.height - 1);
+    return self.fetch(
+        @intFromFloat(std.math.clamp(@floor(x), 0, w)),
+        @intFromFloat(std.math.clamp(@floor(y), 0, h)),
+    );
+}
+
+test "Texture replaceRegion and fetch" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    const tex: Self = try .init(.{
+        .alloc = alloc,
+        .format = .bgra,
+        .srgb = false,
+    }, 4, 4, null);
+    defer tex.deinit();
+
+    try tex.replaceRegion(1, 2, 2, 1, &.{
+        255, 0, 0, 255,
+        0,   0, 0, 0,
+    });
+
+    try testing.expectEqual(Color{ 0, 0, 1, 1 }, tex.fetch(1, 2));
+    try testing.expectEqual(Color{ 0, 0, 0, 0 }, tex.fetch(2, 2));
+    try testing.expectEqual(Color{ 0, 0, 1, 1 }, tex.sample(1.5, 2.9));
+    try testing.expectEqual(Color{ 0, 0, 0, 0 }, tex.sample(-4, -4));
+}
@@ -0,0 +1,139 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const assert = std.debug.assert;
+
+const log = std.log.scoped(.software);
+
+/// The alignment of buffer storage. This is enough for any of our
+/// shader types, so the bytes can be reinterpreted in place.
+pub const alignment = 16;
+
+/// The untyped view of a buffer that is handed to render passes.
+pub const Bytes = []align(alignment) const u8;
+
+/// Options for initializing a buffer.
+pub const Options = struct {
+    alloc: Allocator,
+};
+
+/// Storage for a certain set of equal types in system memory. This has
+/// the same interface as the GPU buffers so that the renderer doesn't
+/// need to know the difference.
+pub fn Buffer(comptime T: type) type {
+    comptime assert(@alignOf(T) <= alignment);
+
+    return struct {
+        const Self = @This();
+
+        /// The underlying storage. This is the full allocated
+        /// capacity, not just the portion that was last synced.
+        buffer: []align(alignment) u8,
+
+        /// Options this buffer was allocated with.
+        opts: Options,
+
+        /// Current allocated length of the data store.
+        /// Note this is the number of `T`s, not the size in bytes.
+        len: usize,
+
+        /// Initialize a buffer with the given length pre-allocated.
+        pub fn init(opts: Options, len: usize) !Self {
+            const buffer = try opts.alloc.alignedAlloc(
+                u8,
+                alignment,
+                len * @sizeOf(T),
+            );
+            @memset(buffer, 0);
+
+            return .{
+                .buffer = buffer,
+                .opts = opts,
+                .len = len,
+            };
+        }
+
+        /// Init the buffer filled with the given data.
+        pub fn initFill(opts: Options, data: []const T) !Self {
+            var self: Self = try .init(opts, data.len);
+            errdefer self.deinit();
+            try self.sync(data);
+            return self;
+        }
+
+        pub fn deinit(self: Self) void {
+            self.opts.alloc.free(self.buffer);
+        }
+
+        /// Sync new contents to the buffer. The data is expected to be the
+        /// complete contents of the buffer. If the amount of data is larger
+        /// than the buffer length, the buffer will be reallocated.
+        ///
+        /// If the amount of data is smaller than the buffer length, the
+        /// remaining data in the buffer is left untouched.
+        pub fn sync(self: *Self, data: []const T) !void {
+            if (data.len > self.len) try self.grow(data.len * 2);
+            @memcpy(
+                self.buffer[0 .. data.len * @sizeOf(T)],
+                std.mem.sliceAsBytes(data),
+            );
+        }
+
+        /// Like Buffer.sync but takes data from an array of ArrayLists,
+        /// rather than a single array. Returns the number of items synced.
+        pub fn syncFromArrayLists(self: *Self, lists: []const std.ArrayListUnmanaged(T)) !usize {
+            var total_len: usize = 0;
+            for (lists) |list| {
+                total_len += list.items.len;
+            }
+
+            if (total_len > self.len) try self.grow(total_len * 2);
+
+            var i: usize = 0;
+            for (lists) |list| {
+                const bytes = std.mem.sliceAsBytes(list.items);
+                @memcpy(self.buffer[i..][0..bytes.len], bytes);
+                i += bytes.len;
+            }
+
+            return total_len;
+        }
+
+        /// Reallocate the buffer to hold `len` items. Existing contents
+        /// are not preserved since every sync replaces them anyway.
+        fn grow(self: *Self, len: usize) !void {
+            const buffer = try self.opts.alloc.alignedAlloc(
+                u8,
+                alignment,
+                len * @sizeOf(T),
+            );
+            self.opts.alloc.free(self.buffer);
+            self.buffer = buffer;
+            self.len = len;
+        }
+    };
+}
+
+/// Reinterpret the bytes of a buffer as a slice of `T`.
+pub fn items(comptime T: type, bytes: Bytes) []const T {
+    const ptr: [*]const T = @ptrCast(@alignCast(bytes.ptr));
+    return ptr[0 .. bytes.len / @sizeOf(T)];
+}
+
+test Buffer {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var buf: Buffer(u32) = try .init(.{ .alloc = alloc }, 1);
+    defer buf.deinit();
+
+    var lists: [2]std.ArrayListUnmanaged(u32) = .{ .{}, .{} };
+    defer for (&lists) |*l| l.deinit(alloc);
+    try lists[0].appendSlice(alloc, &.{ 1, 2 });
+    try lists[1].appendSlice(alloc, &.{3});
+
+    try testing.expectEqual(3, try buf.syncFromArrayLists(&lists));
+    try testing.expectEqualSlices(u32, &.{ 1, 2, 3 }, items(u32, buf.buffer)[0..3]);
+
+    try buf.sync(&.{4});
+    try testing.expectEqualSlices(u32, &.{ 4, 2, 3 }, items(u32, buf.buffer)[0..3]);
+}
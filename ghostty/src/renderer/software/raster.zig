@@ -0,0 +1,227 @@
+//! Pixel math shared by the software rasterizer. Colors are handled as
+//! 4-wide float vectors (RGBA) so that blending and color conversion
+//! compile down to SIMD operations on targets that support it.
+const std = @import("std");
+const assert = std.debug.assert;
+
+/// An RGBA color with components in the range 0 to 1.
+pub const Color = @Vector(4, f32);
+
+/// A region of RGBA8 pixels that can be drawn to. This is either a
+/// render target or an RGBA texture that is being used as an attachment.
+///
+/// The stored values are premultiplied. If `srgb` is true then the stored
+/// RGB values are sRGB encoded and blending is performed in linear space,
+/// the same as an sRGB framebuffer on the GPU.
+pub const Canvas = struct {
+    pixels: []u8,
+    width: usize,
+    height: usize,
+    srgb: bool,
+
+    /// Fill the whole canvas with the provided (linear if `srgb`) color.
+    pub fn clear(self: Canvas, c: Color) void {
+        self.fill(0, self.width, 0, self.height, c);
+    }
+
+    /// Fill a rectangle with a color, ignoring whatever was there before.
+    /// The rectangle must be within the bounds of the canvas.
+    pub fn fill(
+        self: Canvas,
+        x0: usize,
+        x1: usize,
+        y0: usize,
+        y1: usize,
+        c: Color,
+    ) void {
+        assert(x1 <= self.width and y1 <= self.height);
+        if (x0 >= x1) return;
+
+        // Every pixel is the same so we encode once and splat
+        // it across the row as a single 32-bit value.
+        const v: u32 = @bitCast(self.encode(c));
+        for (y0..y1) |y| {
+            const row = std.mem.bytesAsSlice(
+                u32,
+                self.pixels[(y * self.width + x0) * 4 ..][0 .. (x1 - x0) * 4],
+            );
+            @memset(row, v);
+        }
+    }
+
+    /// Load a pixel, returning it in the space that blending is done in.
+    pub inline fn load(self: Canvas, x: usize, y: usize) Color {
+        const p: @Vector(4, u8) = self.pixels[(y * self.width + x) * 4 ..][0..4].*;
+        const c = unpack(p);
+        return if (self.srgb) linearizeLut(c) else c;
+    }
+
+    /// Store a pixel provided in the space that blending is done in.
+    pub inline fn store(self: Canvas, x: usize, y: usize, c: Color) void {
+        self.pixels[(y * self.width + x) * 4 ..][0..4].* = self.encode(c);
+    }
+
+    /// Blend a premultiplied color over a pixel. This is equivalent to
+    /// the `ONE, ONE_MINUS_SRC_ALPHA` blend function used on the GPU.
+    pub inline fn blend(self: Canvas, x: usize, y: usize, src: Color) void {
+        const dst = self.load(x, y);
+        self.store(x, y, src + dst * @as(Color, @splat(1 - src[3])));
+    }
+
+    fn encode(self: Canvas, c: Color) [4]u8 {
+        return pack(if (self.srgb) unlinearizeLut(c) else c);
+    }
+};
+
+/// Convert 4 bytes in to a color.
+pub inline fn unpack(p: @Vector(4, u8)) Color {
+    const f: Color = @floatFromInt(p);
+    return f / @as(Color, @splat(255));
+}
+
+/// Convert a color in to 4 bytes, clamping as necessary.
+pub inline fn pack(c: Color) [4]u8 {
+    const clamped = @min(@max(c, @as(Color, @splat(0))), @as(Color, @splat(1)));
+    const v: @Vector(4, u8) = @intFromFloat(@round(clamped * @as(Color, @splat(255))));
+    return v;
+}
+
+/// Load a 4 byte RGBA non-premultiplied color, linearizing
+/// it if requested and premultiplying it by its alpha.
+///
+/// This matches `load_color` in the GLSL shaders.
+pub inline fn loadColor(p: [4]u8, linear: bool) Color {
+    var c = unpack(p);
+    if (linear) c = linearizeLut(c);
+    return premultiply(c);
+}
+
+pub inline fn premultiply(c: Color) Color {
+    return c * Color{ c[3], c[3], c[3], 1 };
+}
+
+/// Divide the alpha out of a premultiplied color.
+pub inline fn unpremultiply(c: Color) Color {
+    if (c[3] == 0) return c;
+    return c / Color{ c[3], c[3], c[3], 1 };
+}
+
+/// Converts an sRGB encoded value to linear.
+pub fn linearize(v: f32) f32 {
+    return if (v <= 0.04045) v / 12.92 else std.math.pow(f32, (v + 0.055) / 1.055, 2.4);
+}
+
+/// Converts a linear value to sRGB encoding.
+pub fn unlinearize(v: f32) f32 {
+    return if (v <= 0.0031308) v * 12.92 else std.math.pow(f32, v, 1.0 / 2.4) * 1.055 - 0.055;
+}
+
+/// Linearize the RGB components of a color, leaving alpha alone.
+/// Exact for 8-bit inputs, since it's backed by a 256 entry table.
+pub inline fn linearizeLut(c: Color) Color {
+    const i: @Vector(4, u8) = @intFromFloat(@round(c * @as(Color, @splat(255))));
+    return .{ linear_lut[i[0]], linear_lut[i[1]], linear_lut[i[2]], c[3] };
+}
+
+/// Unlinearize the RGB components of a color, leaving alpha alone.
+/// The table has enough entries that the result is exact when the
+/// output is quantized to 8 bits.
+pub inline fn unlinearizeLut(c: Color) Color {
+    const n: f32 = @floatFromInt(srgb_lut.len - 1);
+    const clamped = @min(@max(c, @as(Color, @splat(0))), @as(Color, @splat(1)));
+    const i: @Vector(4, u32) = @intFromFloat(@round(clamped * @as(Color, @splat(n))));
+    return .{ srgb_lut[i[0]], srgb_lut[i[1]], srgb_lut[i[2]], c[3] };
+}
+
+const linear_lut: [256]f32 = lut: {
+    @setEvalBranchQuota(100_000);
+    var table: [256]f32 = undefined;
+    for (&table, 0..) |*v, i| v.* = linearize(@as(f32, @floatFromInt(i)) / 255);
+    break :lut table;
+};
+
+const srgb_lut: [4096]f32 = lut: {
+    @setEvalBranchQuota(1_000_000);
+    var table: [4096]f32 = undefined;
+    for (&table, 0..) |*v, i| v.* = unlinearize(@as(f32, @floatFromInt(i)) / 4095);
+    break :lut table;
+};
+
+/// https://www.w3.org/TR/2008/REC-WCAG20-20081211/#contrast-ratiodef
+///
+/// These take linear colors, see the equivalent functions in the
+/// GLSL shaders for details.
+pub fn luminance(c: Color) f32 {
+    return c[0] * 0.2126 + c[1] * 0.7152 + c[2] * 0.0722;
+}
+
+pub fn contrastRatio(a: Color, b: Color) f32 {
+    const la = luminance(a) + 0.05;
+    const lb = luminance(b) + 0.05;
+    return @max(la, lb) / @min(la, lb);
+}
+
+/// Return the fg if the contrast ratio is greater than min, otherwise
+/// return white or black, whichever has the highest contrast ratio.
+pub fn contrastedColor(min_ratio: f32, fg: Color, bg: Color) Color {
+    if (contrastRatio(fg, bg) >= min_ratio) return fg;
+    const white: Color = @splat(1);
+    const black: Color = @splat(0);
+    return if (contrastRatio(white, bg) > contrastRatio(black, bg)) white else black;
+}
+
+/// Returns the range of pixel indices whose centers are in `[a, b)`,
+/// clamped to `[0, max)`. This is the same coverage rule the GPU uses
+/// for pixels along the edges of a primitive.
+pub fn span(a: f32, b: f32, max: usize) struct { usize, usize } {
+    const lo = @max(0, @ceil(a - 0.5));
+    const hi = @min(@as(f32, @floatFromInt(max)), @max(0, @ceil(b - 0.5)));
+    if (hi <= lo) return .{ 0, 0 };
+    return .{ @intFromFloat(lo), @intFromFloat(hi) };
+}
+
+test "Canvas blend" {
+    const testing = std.testing;
+
+    var pixels: [4 * 4]u8 = undefined;
+    const canvas: Canvas = .{
+        .pixels = &pixels,
+        .width = 2,
+        .height = 2,
+        .srgb = false,
+    };
+
+    canvas.clear(.{ 1, 0, 0, 1 });
+    try testing.expectEqual([4]u8{ 255, 0, 0, 255 }, pixels[12..16].*);
+
+    // Half transparent blue over red.
+    canvas.blend(1, 1, .{ 0, 0, 0.5, 0.5 });
+    try testing.expectEqual([4]u8{ 128, 0, 128, 255 }, pixels[12..16].*);
+    try testing.expectEqual([4]u8{ 255, 0, 0, 255 }, pixels[8..12].*);
+}
+
+test "sRGB round trip" {
+    const testing = std.testing;
+
+    for (0..256) |i| {
+        const p: @Vector(4, u8) = .{ @intCast(i), @intCast(i), @intCast(i), 255 };
+        const c = unlinearizeLut(linearizeLut(unpack(p)));
+        try testing.expectEqual(@as([4]u8, p), pack(c));
+    }
+}
+
+test span {
+    const testing = std.testing;
+    const cases: []const struct { f32, f32, usize, usize } = &.{
+        .{ 0, 10, 0, 10 },
+        .{ -3, 5, 0, 5 },
+        .{ 98, 120, 98, 100 },
+        .{ 5, 5, 0, 0 },
+        .{ 0.6, 2.4, 1, 2 },
+    };
+    for (cases) |c| {
+        const lo, const hi = span(c[0], c[1], 100);
+        try testing.expectEqual(c[2], lo);
+        try testing.expectEqual(c[3], hi);
+    }
+}
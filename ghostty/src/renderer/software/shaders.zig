@@ -0,0 +1,196 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const assert = std.debug.assert;
+const math = @import("../../math.zig");
+
+const Pipeline = @import("Pipeline.zig");
+
+const log = std.log.scoped(.software);
+
+/// This contains the state for the shaders used by the software renderer.
+pub const Shaders = struct {
+    /// Collection of available render pipelines.
+    pipelines: struct {
+        bg_color: Pipeline,
+        cell_bg: Pipeline,
+        cell_text: Pipeline,
+        image: Pipeline,
+        bg_image: Pipeline,
+    },
+
+    /// Custom shaders are not supported by the software
+    /// renderer so this is always empty.
+    post_pipelines: []const Pipeline = &.{},
+
+    /// Set to true when deinited, if you try to deinit a defunct set
+    /// of shaders it will just be ignored, to prevent double-free.
+    defunct: bool = false,
+
+    /// Initialize our shader set.
+    ///
+    /// "post_shaders" is accepted for parity with the other renderers,
+    /// but we can't run them so we warn and ignore them.
+    pub fn init(
+        alloc: Allocator,
+        post_shaders: []const [:0]const u8,
+    ) !Shaders {
+        _ = alloc;
+
+        if (post_shaders.len > 0) log.warn(
+            "custom shaders are not supported by the software renderer, ignoring count={}",
+            .{post_shaders.len},
+        );
+
+        return .{
+            .pipelines = .{
+                .bg_color = .{ .kind = .bg_color, .blending_enabled = false },
+                .cell_bg = .{ .kind = .cell_bg },
+                .cell_text = .{ .kind = .cell_text },
+                .image = .{ .kind = .image },
+                .bg_image = .{ .kind = .bg_image },
+            },
+        };
+    }
+
+    pub fn deinit(self: *Shaders, alloc: Allocator) void {
+        _ = alloc;
+        if (self.defunct) return;
+        self.defunct = true;
+    }
+};
+
+/// The uniforms that are passed to our shaders.
+///
+/// This is the same layout as the other renderers. See
+/// the OpenGL or Metal shaders for more detail on each field.
+pub const Uniforms = extern struct {
+    /// The projection matrix for turning world coordinates to normalized.
+    /// This is calculated based on the size of the screen.
+    projection_matrix: math.Mat align(16),
+
+    /// Size of the screen (render target) in pixels.
+    screen_size: [2]f32 align(8),
+
+    /// Size of a single cell in pixels, unscaled.
+    cell_size: [2]f32 align(8),
+
+    /// Size of the grid in columns and rows.
+    grid_size: [2]u16 align(4),
+
+    /// The padding around the terminal grid in pixels. In order:
+    /// top, right, bottom, left.
+    grid_padding: [4]f32 align(16),
+
+    /// Bit mask defining which directions to
+    /// extend cell colors in to the padding.
+    /// Order, LSB first: left, right, up, down
+    padding_extend: PaddingExtend align(4),
+
+    /// The minimum contrast ratio for text. The contrast ratio is calculated
+    /// according to the WCAG 2.0 spec.
+    min_contrast: f32 align(4),
+
+    /// The cursor position and color.
+    cursor_pos: [2]u16 align(4),
+    cursor_color: [4]u8 align(4),
+
+    /// The background color for the whole surface.
+    bg_color: [4]u8 align(4),
+
+    /// Various booleans, in a packed struct for space efficiency.
+    bools: Bools align(4),
+
+    const Bools = packed struct(u32) {
+        /// Whether the cursor is 2 cells wide.
+        cursor_wide: bool,
+
+        /// Indicates that colors provided to the shader are already in
+        /// the P3 color space, so they don't need to be converted from
+        /// sRGB. This is ignored by the software renderer.
+        use_display_p3: bool,
+
+        /// Indicates that the target is sRGB encoded, which means the
+        /// rasterizer needs to output linear RGB colors rather than
+        /// gamma encoded colors, since blending will be performed in
+        /// linear space.
+        use_linear_blending: bool,
+
+        /// Enables a weight correction step that makes text rendered
+        /// with linear alpha blending have a similar apparent weight
+        /// (thickness) to gamma-incorrect blending.
+        use_linear_correction: bool = false,
+
+        _padding: u28 = 0,
+    };
+
+    const PaddingExtend = packed struct(u32) {
+        left: bool = false,
+        right: bool = false,
+        up: bool = false,
+        down: bool = false,
+        _padding: u28 = 0,
+    };
+};
+
+/// This is a single parameter for the terminal cell shader.
+pub const CellText = extern struct {
+    glyph_pos: [2]u32 align(8) = .{ 0, 0 },
+    glyph_size: [2]u32 align(8) = .{ 0, 0 },
+    bearings: [2]i16 align(4) = .{ 0, 0 },
+    grid_pos: [2]u16 align(4),
+    color: [4]u8 align(4),
+    atlas: Atlas align(1),
+    bools: packed struct(u8) {
+        no_min_contrast: bool = false,
+        is_cursor_glyph: bool = false,
+        _padding: u6 = 0,
+    } align(1) = .{},
+
+    pub const Atlas = enum(u8) {
+        grayscale = 0,
+        color = 1,
+    };
+};
+
+/// This is a single parameter for the cell bg shader.
+pub const CellBg = [4]u8;
+
+/// Single parameter for the image shader. See shader for field details.
+pub const Image = extern struct {
+    grid_pos: [2]f32 align(8),
+    cell_offset: [2]f32 align(8),
+    source_rect: [4]f32 align(16),
+    dest_size: [2]f32 align(8),
+};
+
+/// Single parameter for the bg image shader.
+pub const BgImage = extern struct {
+    opacity: f32 align(4),
+    info: Info align(1),
+
+    pub const Info = packed struct(u8) {
+        position: Position,
+        fit: Fit,
+        repeat: bool,
+        _padding: u1 = 0,
+
+        pub const Position = enum(u4) {
+            tl = 0,
+            tc = 1,
+            tr = 2,
+            ml = 3,
+            mc = 4,
+            mr = 5,
+            bl = 6,
+            bc = 7,
+            br = 8,
+        };
+
+        pub const Fit = enum(u2) {
+            contain = 0,
+            cover = 1,
+            stretch = 2,
+            none = 3,
+        };
+    };
+};
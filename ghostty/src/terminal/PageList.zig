@@ -15,6 +15,8 @@ const point = @import("point.zig");
 const pagepkg = @import("page.zig");
 const stylepkg = @import("style.zig");
 const size = @import("size.zig");
+const PagePool = @import("PagePool.zig");
+const PageSummary = @import("PageSummary.zig");
 const Selection = @import("Selection.zig");
 const OffsetBuf = size.OffsetBuf;
 const Capacity = pagepkg.Capacity;
@@ -43,46 +45,43 @@ const Node = struct {
     prev: ?*Node = null,
     next: ?*Node = null,
     data: Page,
+
+    /// The search summary for this page. This is built lazily by search
+    /// once the page is entirely in the scrollback. Any operation that
+    /// modifies the contents of a scrollback page in place must
+    /// invalidate this.
+    summary: PageSummary = .{},
 };
 
 /// The memory pool we get page nodes from.
 const NodePool = std.heap.MemoryPool(List.Node);
 
 const std_capacity = pagepkg.std_capacity;
-const std_size = Page.layout(std_capacity).total_size;
-
-/// The memory pool we use for page memory buffers. We use a separate pool
-/// so we can allocate these with a page allocator. We have to use a page
-/// allocator because we need memory that is zero-initialized and page-aligned.
-const PagePool = std.heap.MemoryPoolAligned(
-    [std_size]u8,
-    std.heap.page_size_min,
-);
+const std_size = PagePool.item_size;
 
 /// List of pins, known as "tracked" pins. These are pins that are kept
 /// up to date automatically through page-modifying operations.
 const PinSet = std.AutoArrayHashMapUnmanaged(*Pin, void);
 const PinPool = std.heap.MemoryPool(Pin);
 
-/// The pool of memory used for a pagelist. This can be shared between
-/// multiple pagelists but it is not threadsafe.
+/// The pool of memory used for a pagelist. The node and pin pools can be
+/// shared between multiple pagelists but are not threadsafe. Page memory
+/// always comes from the process-wide PagePool which is threadsafe.
 pub const MemoryPool = struct {
     alloc: Allocator,
     nodes: NodePool,
-    pages: PagePool,
+    pages: *PagePool,
     pins: PinPool,
 
     pub const ResetMode = std.heap.ArenaAllocator.ResetMode;
 
     pub fn init(
         gen_alloc: Allocator,
-        page_alloc: Allocator,
+        page_pool: *PagePool,
         preheat: usize,
     ) !MemoryPool {
         var node_pool = try NodePool.initPreheated(gen_alloc, preheat);
         errdefer node_pool.deinit();
-        var page_pool = try PagePool.initPreheated(page_alloc, preheat);
-        errdefer page_pool.deinit();
         var pin_pool = try PinPool.initPreheated(gen_alloc, 8);
         errdefer pin_pool.deinit();
         return .{
@@ -93,14 +92,14 @@ pub const MemoryPool = struct {
         };
     }
 
+    /// Deinit the pool. Page memory is not owned by the pool and must
+    /// be returned to the page pool separately (see freePages).
     pub fn deinit(self: *MemoryPool) void {
-        self.pages.deinit();
         self.nodes.deinit();
         self.pins.deinit();
     }
 
     pub fn reset(self: *MemoryPool, mode: ResetMode) void {
-        _ = self.pages.reset(mode);
         _ = self.nodes.reset(mode);
         _ = self.pins.reset(mode);
     }
@@ -113,6 +112,12 @@ pool_owned: bool,
 /// The list of pages in the screen.
 pages: List,
 
+/// The page pool client this list belongs to, if any. This is used to
+/// track activity so the page pool can evict scrollback from the
+/// coldest terminals first when the client's budget is exceeded. This is
+/// set by the owner of the terminal (see PagePool.Client).
+client: ?*PagePool.Client = null,
+
 /// Byte size of the total amount of allocated pages. Note this does
 /// not include the total allocated amount in the pool which may be more
 /// than this due to preheating.
@@ -131,6 +136,18 @@ min_max_size: usize,
 /// The list of tracked pins. These are kept up to date automatically.
 tracked_pins: PinSet,
 
+/// The total number of rows ever added to the bottom by grow. This only
+/// ever increases (wrapping) and is used by the renderer to tell how far
+/// the active area scrolled between two frames.
+grow_count: usize = 0,
+
+/// Incremented (wrapping) every time page nodes are freed, such as by
+/// erasing rows, evicting scrollback or resetting. Pins into the list
+/// that were saved before any of these may point to freed or reused
+/// nodes, so anything comparing saved pins must start over when this
+/// changes.
+erase_count: usize = 0,
+
 /// The top-left of certain parts of the screen that are frequently
 /// accessed so we don't have to traverse the linked list to find them.
 ///
@@ -235,9 +252,10 @@ pub fn init(
     // The screen starts with a single page that is the entire viewport,
     // and we'll split it thereafter if it gets too large and add more as
     // necessary.
-    var pool = try MemoryPool.init(alloc, std.heap.page_allocator, page_preheat);
+    var pool = try MemoryPool.init(alloc, PagePool.global(), page_preheat);
     errdefer pool.deinit();
-    const page_list, const page_size = try initPages(&pool, cols, rows);
+    var page_list, const page_size = try initPages(&pool, cols, rows);
+    errdefer freePages(&pool, &page_list);
 
     // Get our minimum max size, see doc comments for more details.
     const min_max_size = try minMaxSize(cols, rows);
@@ -271,6 +289,7 @@ fn initPages(
 ) !struct { List, usize } {
     var page_list: List = .{};
     var page_size: usize = 0;
+    errdefer freePages(pool, &page_list);
 
     // Add pages as needed to create our initial viewport.
     const cap = try std_capacity.adjust(.{ .cols = cols });
@@ -278,7 +297,8 @@ fn initPages(
     while (rem > 0) {
         const node = try pool.nodes.create();
         const page_buf = try pool.pages.create();
-        // no errdefer because the pool deinit will clean these up
+        // no errdefer because nothing below fails and the list is
+        // freed above on error.
 
         // In runtime safety modes we have to memset because the Zig allocator
         // interface will always memset to 0xAA for undefined. In non-safe modes
@@ -312,18 +332,11 @@ pub fn deinit(self: *PageList) void {
     // Always deallocate our hashmap.
     self.tracked_pins.deinit(self.pool.alloc);
 
-    // Go through our linked list and deallocate all pages that are
-    // not standard size.
-    const page_alloc = self.pool.pages.arena.child_allocator;
-    var it = self.pages.first;
-    while (it) |node| : (it = node.next) {
-        if (node.data.memory.len > std_size) {
-            page_alloc.free(node.data.memory);
-        }
-    }
+    // Return all our page memory.
+    freePages(&self.pool, &self.pages);
 
-    // Deallocate all the pages. We don't need to deallocate the list or
-    // nodes because they all reside in the pool.
+    // Deallocate all the nodes. We don't need to deallocate the list or
+    // nodes individually because they all reside in the pool.
     if (self.pool_owned) {
         self.pool.deinit();
     } else {
@@ -336,9 +349,12 @@ pub fn deinit(self: *PageList) void {
 /// stability of tracked pins (they're moved to the top-left since
 /// all contents are cleared).
 ///
-/// This can't fail because we always retain at least enough allocated
-/// memory to fit the active area.
+/// This can't fail because we keep the page memory we need to fit the
+/// active area rather than giving it back to the page pool, which may
+/// have released it by the time we'd ask for it again.
 pub fn reset(self: *PageList) void {
+    self.erase_count +%= 1;
+
     // We need enough pages/nodes to keep our active area. This should
     // never fail since we by definition have allocated a page already
     // that fits our size but I'm not confident to make that assertion.
@@ -355,56 +371,68 @@ pub fn reset(self: *PageList) void {
         cap.rows,
     ) catch unreachable;
 
-    // Before resetting our pools we need to free any pages that
-    // are non-standard size since those were allocated outside
-    // the pool.
+    // Keep the standard size page memory we need and return the rest
+    // to the page pool. The nodes don't survive resetting the node pool
+    // below, so we chain the kept memory through its first bytes.
+    var kept: ?PagePool.ItemPtr = null;
+    var kept_count: usize = 0;
     {
-        const page_alloc = self.pool.pages.arena.child_allocator;
         var it = self.pages.first;
         while (it) |node| : (it = node.next) {
-            if (node.data.memory.len > std_size) {
-                page_alloc.free(node.data.memory);
+            const page = &node.data;
+            if (kept_count == page_count or page.memory.len > std_size) {
+                destroyPageMemory(&self.pool, page);
+                continue;
             }
+
+            const buf: PagePool.ItemPtr = @ptrCast(page.memory.ptr);
+            std.mem.bytesAsValue(?PagePool.ItemPtr, buf[0..@sizeOf(?PagePool.ItemPtr)]).* = kept;
+            kept = buf;
+            kept_count += 1;
         }
+        self.pages = .{};
     }
 
-    // Reset our pools to free as much memory as possible while retaining
-    // the capacity for at least the minimum number of pages we need.
-    // The return value is whether memory was reclaimed or not, but in
-    // either case the pool is left in a valid state.
-    _ = self.pool.pages.reset(.{
-        .retain_with_limit = page_count * PagePool.item_size,
-    });
+    // Reset our node pool to free as much memory as possible while
+    // retaining the capacity for at least the minimum number of nodes
+    // we need. The return value is whether memory was reclaimed or not,
+    // but in either case the pool is left in a valid state.
     _ = self.pool.nodes.reset(.{
         .retain_with_limit = page_count * NodePool.item_size,
     });
 
-    // Our page pool relies on mmap to zero our page memory. Since we're
-    // retaining a certain amount of memory, it won't use mmap and won't
-    // be zeroed. This block zeroes out all the memory in the pool arena.
-    {
-        // Note: we only have to do this for the page pool because the
-        // nodes are always fully overwritten on each allocation.
-        const page_arena = &self.pool.pages.arena;
-        var it = page_arena.state.buffer_list.first;
-        while (it) |node| : (it = node.next) {
-            // The fully allocated buffer
-            const alloc_buf = @as([*]u8, @ptrCast(node))[0..node.data];
+    // Initialize our pages. Node creation can't fail since we retained
+    // node capacity. We have all the page memory we need unless some of
+    // our pages were non-standard, which practically never happens for
+    // all pages, so only then can this fail.
+    self.page_size = 0;
+    var rem = self.rows;
+    while (rem > 0) {
+        const node = self.pool.nodes.create() catch unreachable;
+        const page_buf: PagePool.ItemPtr = if (kept) |buf| buf: {
+            kept = std.mem.bytesAsValue(?PagePool.ItemPtr, buf[0..@sizeOf(?PagePool.ItemPtr)]).*;
+
+            // Unlike the page pool, nothing zeroed our own memory.
+            @memset(buf, 0);
+            break :buf buf;
+        } else buf: {
+            const buf = self.pool.pages.create() catch @panic("reset: out of page memory");
+            if (comptime std.debug.runtime_safety) @memset(buf, 0);
+            break :buf buf;
+        };
 
-            // The buffer minus our header
-            const BufNode = @TypeOf(page_arena.state.buffer_list).Node;
-            const data_buf = alloc_buf[@sizeOf(BufNode)..];
-            @memset(data_buf, 0);
-        }
+        node.* = .{
+            .data = .initBuf(
+                .init(page_buf),
+                Page.layout(cap),
+            ),
+        };
+        node.data.size.rows = @min(rem, node.data.capacity.rows);
+        rem -= node.data.size.rows;
+        self.pages.append(node);
+        self.page_size += page_buf.len;
     }
-
-    // Initialize our pages. This should not be able to fail since
-    // we retained the capacity for the minimum number of pages we need.
-    self.pages, self.page_size = initPages(
-        &self.pool,
-        self.cols,
-        self.rows,
-    ) catch @panic("initPages failed");
+    assert(kept == null);
 
     // Update all our tracked pins to point to our first page top-left
     {
@@ -475,7 +503,7 @@ pub fn clone(
             // Setup our pools
             break :alloc try .init(
                 alloc,
-                std.heap.page_allocator,
+                PagePool.global(),
                 page_count,
             );
         },
@@ -497,15 +525,7 @@ pub fn clone(
 
     // Our list of pages
     var page_list: List = .{};
-    errdefer {
-        const page_alloc = pool.pages.arena.child_allocator;
-        var page_it = page_list.first;
-        while (page_it) |node| : (page_it = node.next) {
-            if (node.data.memory.len > std_size) {
-                page_alloc.free(node.data.memory);
-            }
-        }
-    }
+    errdefer freePages(pool, &page_list);
 
     // Copy our pages
     var total_rows: usize = 0;
@@ -617,6 +637,11 @@ pub fn resize(self: *PageList, opts: Resize) !void {
         if (opts.rows) |v| assert(v > 0);
     }
 
+    // Resizing can modify scrollback pages in place (truncation) or
+    // move scrollback back into the active area, so any search summaries
+    // are no longer trustworthy.
+    self.invalidateSummaries();
+
     if (!opts.reflow) return try self.resizeWithoutReflow(opts);
 
     // Recalculate our minimum max size. This allows grow to work properly
@@ -1847,6 +1872,12 @@ pub fn scrollClear(self: *PageList) !void {
     for (0..non_empty) |_| _ = try self.grow();
 }
 
+/// Invalidate the search summaries of all pages.
+fn invalidateSummaries(self: *PageList) void {
+    var it = self.pages.first;
+    while (it) |node| : (it = node.next) node.summary.invalidate();
+}
+
 /// Returns the actual max size. This may be greater than the explicit
 /// value if the explicit value is less than the min_max_size.
 ///
@@ -1878,6 +1909,10 @@ fn growRequiredForActive(self: *const PageList) bool {
 ///
 /// This returns the newly allocated page node if there is one.
 pub fn grow(self: *PageList) !?*List.Node {
+    // Every path below either adds a row or fails.
+    self.grow_count +%= 1;
+    errdefer self.grow_count -%= 1;
+
     const last = self.pages.last.?;
     if (last.data.capacity.rows > last.data.size.rows) {
         // Fast path: we have capacity in the last page.
@@ -1887,6 +1922,16 @@ pub fn grow(self: *PageList) !?*List.Node {
     }
 
     // Slower path: we have no space, we need to allocate a new page.
+    if (self.client) |client| client.touch();
+
+    // If allocation would exceed our client's page budget, ask colder
+    // terminals to give up their scrollback first. If that doesn't free
+    // enough then we prune our own scrollback below.
+    const over_budget = if (self.client) |client|
+        self.pool.pages.overBudget(client.budget) and
+            !self.pool.pages.reclaim(client)
+    else
+        false;
 
     // If allocation would exceed our max size, we prune the first page.
     // We don't need to reallocate because we can simply reuse that first
@@ -1898,12 +1943,25 @@ pub fn grow(self: *PageList) !?*List.Node {
     // initial allocation.
     if (self.pages.first != null and
         self.pages.first != self.pages.last and
-        self.page_size + PagePool.item_size > self.maxSize())
+        (over_budget or self.page_size + PagePool.item_size > self.maxSize()))
     prune: {
         // If we need to add more memory to ensure our active area is
         // satisfied then we do not prune.
         if (self.growRequiredForActive()) break :prune;
 
+        // If we're only pruning for the budget then our max size doesn't
+        // guarantee that the first page is entirely scrollback, so verify
+        // the active area (including the row we're growing) fits without it.
+        if (over_budget) {
+            var rows: usize = 1;
+            var it = self.pages.last;
+            while (it) |node| : (it = node.prev) {
+                if (node == self.pages.first) break :prune;
+                rows += node.data.size.rows;
+                if (rows >= self.rows) break;
+            }
+        }
+
         const layout = Page.layout(try std_capacity.adjust(.{ .cols = self.cols }));
 
         // Get our first page and reset it to prepare for reuse.
@@ -1914,6 +1972,7 @@ pub fn grow(self: *PageList) !?*List.Node {
 
         // Initialize our new page and reinsert it as the last
         first.data = .initBuf(.init(buf), layout);
+        first.summary.invalidate();
         first.data.size.rows = 1;
         self.pages.insertAfter(last, first);
 
@@ -2063,7 +2122,7 @@ fn createPageExt(
 
     const layout = Page.layout(cap);
     const pooled = layout.total_size <= std_size;
-    const page_alloc = pool.pages.arena.child_allocator;
+    const page_alloc = PagePool.backing_allocator;
 
     // Our page buffer comes from our standard memory pool if it
     // is within our standard size since this is what the pool
@@ -2102,6 +2161,7 @@ fn createPageExt(
 /// and return it to the pool. The node is assumed to already be removed
 /// from the linked list.
 fn destroyNode(self: *PageList, node: *List.Node) void {
+    self.erase_count +%= 1;
     destroyNodeExt(&self.pool, node, &self.page_size);
 }
 
@@ -2115,16 +2175,28 @@ fn destroyNodeExt(
     // Update our accounting for page size
     if (total_size) |v| v.* -= page.memory.len;
 
+    // The page pool zeroes the memory if it is retained for reuse.
+    destroyPageMemory(pool, page);
+    pool.nodes.destroy(node);
+}
+
+/// Return the memory of a page to wherever it came from: the page pool
+/// for standard size pages or the backing allocator otherwise.
+fn destroyPageMemory(pool: *MemoryPool, page: *const Page) void {
     if (page.memory.len <= std_size) {
-        // Reset the memory to zero so it can be reused
-        @memset(page.memory, 0);
         pool.pages.destroy(@ptrCast(page.memory.ptr));
     } else {
-        const page_alloc = pool.pages.arena.child_allocator;
-        page_alloc.free(page.memory);
+        PagePool.backing_allocator.free(page.memory);
     }
+}
 
-    pool.nodes.destroy(node);
+/// Return the page memory of every page in the list. This does not
+/// destroy the nodes, which must be done by resetting or deinitializing
+/// the node pool. The list is empty after this.
+fn freePages(pool: *MemoryPool, list: *List) void {
+    var it = list.first;
+    while (it) |node| : (it = node.next) destroyPageMemory(pool, &node.data);
+    list.* = .{};
 }
 
 /// Fast-path function to erase exactly 1 row. Erasing means that the row
@@ -2392,6 +2464,7 @@ pub fn eraseRows(
                 erased += page.size.rows;
                 page.reinit();
                 page.size.rows = 0;
+                chunk.node.summary.invalidate();
                 break;
             }
 
@@ -2402,6 +2475,7 @@ pub fn eraseRows(
 
         // We are modifying our chunk so make sure it is in a good state.
         defer chunk.node.data.assertIntegrity();
+        chunk.node.summary.invalidate();
 
         // The chunk is not a full page so we need to move the rows.
         // This is a cheap operation because we're just moving cell offsets,
@@ -2481,6 +2555,34 @@ pub fn eraseRows(
     }
 }
 
+/// Erase the oldest scrollback pages until at least `bytes` of page
+/// memory has been freed or there is no more scrollback that can be
+/// erased without touching the active area. This is used to give up
+/// memory when the page budget is exceeded. Returns the number
+/// of bytes freed.
+pub fn evictScrollback(self: *PageList, bytes: usize) usize {
+    const active = self.getTopLeft(.active).node;
+
+    // Only erase whole pages that are entirely scrollback. Partial pages
+    // wouldn't free any memory.
+    var freed: usize = 0;
+    var rows: usize = 0;
+    var it = self.pages.first;
+    while (it) |node| : (it = node.next) {
+        if (freed >= bytes or node == active) break;
+        freed += node.data.memory.len;
+        rows += node.data.size.rows;
+    }
+    if (rows == 0) return 0;
+
+    self.eraseRows(
+        .{ .history = .{} },
+        .{ .history = .{ .y = @intCast(rows - 1) } },
+    );
+
+    return freed;
+}
+
 /// Erase a single page, freeing all its resources. The page can be
 /// anywhere in the linked list but must NOT be the final page in the
 /// entire list (i.e. must not make the list empty).
@@ -4510,7 +4612,8 @@ test "PageList grow allocate" {
     // Grow to capacity
     const last_node = s.pages.last.?;
     const last = &s.pages.last.?.data;
-    for (0..last.capacity.rows - last.size.rows) |_| {
+    const grows = last.capacity.rows - last.size.rows;
+    for (0..grows) |_| {
         try testing.expect(try s.grow() == null);
     }
 
@@ -4518,6 +4621,7 @@ test "PageList grow allocate" {
     const new = (try s.grow()).?;
     try testing.expect(s.pages.last.? == new);
     try testing.expect(last_node.next.? == new);
+    try testing.expectEqual(grows + 1, s.grow_count);
     {
         const cell = s.getCell(.{ .active = .{ .y = s.rows - 1 } }).?;
         try testing.expect(cell.node == new);
@@ -4574,6 +4678,77 @@ test "PageList grow prune scrollback" {
     try testing.expect(p.y == 0);
 }
 
+test "PageList grow prune scrollback over budget" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    // No max size so only the budget can cause pruning.
+    var s = try init(alloc, 80, 24, null);
+    defer s.deinit();
+
+    // A client that isn't registered with the pool so that no other
+    // client's scrollback is evicted.
+    var mutex: std.Thread.Mutex = .{};
+    var client: PagePool.Client = .{
+        .mutex = &mutex,
+        .userdata = &s,
+        .evict = struct {
+            fn evict(_: *anyopaque, _: usize) usize {
+                return 0;
+            }
+        }.evict,
+    };
+    s.client = &client;
+
+    // Fill two pages
+    for (0..2) |_| {
+        const last = s.pages.last.?;
+        for (0..last.data.capacity.rows - last.data.size.rows) |_| {
+            try testing.expect(try s.grow() == null);
+        }
+        if (s.pages.first == s.pages.last) _ = (try s.grow()).?;
+    }
+    const first = s.pages.first.?;
+    const old_page_size = s.page_size;
+
+    // Set the budget to exactly what is in use now.
+    client.setBudget(s.pool.pages.used.load(.monotonic));
+
+    // Growing should reuse our first page rather than allocate.
+    const new = (try s.grow()).?;
+    try testing.expectEqual(first, new);
+    try testing.expectEqual(old_page_size, s.page_size);
+}
+
+test "PageList evictScrollback" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var s = try init(alloc, 80, 24, null);
+    defer s.deinit();
+
+    // Grow until we have three pages
+    while (s.totalPages() < 3) _ = try s.grow();
+    const active = s.getTopLeft(.active).node;
+    try testing.expect(active != s.pages.first.?);
+
+    // Evicting nothing does nothing
+    const erase_count = s.erase_count;
+    try testing.expectEqual(0, s.evictScrollback(0));
+    try testing.expectEqual(erase_count, s.erase_count);
+
+    // Evict one page
+    const old_page_size = s.page_size;
+    try testing.expectEqual(std_size, s.evictScrollback(1));
+    try testing.expectEqual(old_page_size - std_size, s.page_size);
+    try testing.expect(s.erase_count != erase_count);
+
+    // We never evict the active area
+    _ = s.evictScrollback(std.math.maxInt(usize));
+    try testing.expectEqual(active, s.pages.first.?);
+    try testing.expectEqual(active, s.getTopLeft(.active).node);
+}
+
 test "PageList adjustCapacity to increase styles" {
     const testing = std.testing;
     const alloc = testing.allocator;
@@ -9054,6 +9229,25 @@ test "PageList reset" {
     }, s.getTopLeft(.active));
 }
 
+test "PageList reset keeps its page memory" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var s = try init(alloc, 80, 24, null);
+    defer s.deinit();
+    try s.growRows(1000);
+    try testing.expect(s.totalPages() > 1);
+    const memory = s.pages.first.?.data.memory.ptr;
+
+    // The active area fits in one page, which reuses the first page's
+    // memory rather than getting it from the page pool again.
+    s.reset();
+    try testing.expectEqual(1, s.totalPages());
+    try testing.expectEqual(memory, s.pages.first.?.data.memory.ptr);
+    try testing.expectEqual(PagePool.item_size, s.page_size);
+    try testing.expectEqual(@as(usize, s.rows), s.totalRows());
+}
+
 test "PageList reset across two pages" {
     const testing = std.testing;
     const alloc = testing.allocator;
@@ -0,0 +1,821 @@
+//! PagePool is a process-wide, thread-safe pool of standard size page
+//! memory that is shared by every PageList. Previously each PageList
+//! owned its own page pool and retained every page it ever freed, so with
+//! many mostly idle surfaces a lot of zeroed memory sat unused in dozens
+//! of private free lists.
+//!
+//! The pool is two-level: each thread keeps a tiny cache of free pages
+//! that can be used without any synchronization (the termio thread grows
+//! and prunes pages constantly) and overflows into a global free list
+//! protected by a mutex. The global free list only retains a bounded
+//! number of pages, anything beyond that is returned to the OS.
+//!
+//! Free pages are always zeroed. Pages are zeroed when they're returned
+//! to the pool only if the pool retains them. Pages that are released to
+//! the OS are not zeroed since mmap guarantees fresh pages are zero.
+//!
+//! The pool also tracks the total amount of page memory in use across
+//! all PageLists so that clients (terminals) can enforce a budget on it.
+//! When a client's budget is exceeded, the pool evicts scrollback from
+//! the least recently active registered clients first. See `reclaim`.
+//!
+//! Retained free pages still consume physical memory. After the pool
+//! has been idle for a while, or on memory pressure, the physical memory
+//! of free pages is returned to the OS with madvise while keeping the
+//! pages in the free list. See `purge` and `Purger`.
+//!
+//! Optionally (Linux only), new items can be allocated in 2 MiB chunks
+//! backed by transparent huge pages with several items packed into each
+//! chunk. With large amounts of scrollback this significantly reduces
+//! TLB misses when walking pages (scrolling, search, reflow). Items from
+//! a chunk are otherwise treated exactly like other items. In particular
+//! they can be individually returned to the OS, which simply splits the
+//! huge page. See `setHugePages`.
+const PagePool = @This();
+
+const std = @import("std");
+const builtin = @import("builtin");
+const posix = std.posix;
+const assert = std.debug.assert;
+const Allocator = std.mem.Allocator;
+const DoublyLinkedList = @import("../datastruct/main.zig").IntrusiveDoublyLinkedList;
+const pagepkg = @import("page.zig");
+const Page = pagepkg.Page;
+
+const log = std.log.scoped(.page_pool);
+
+/// The size of a single item in the pool. This is the size of a page
+/// with the standard capacity. Pages that require more memory than this
+/// are allocated directly and never pooled.
+pub const item_size = Page.layout(pagepkg.std_capacity).total_size;
+
+/// A single pooled page buffer.
+pub const Item = [item_size]u8;
+pub const ItemPtr = *align(std.heap.page_size_min) Item;
+
+/// The allocator used for all page memory. This must be a page allocator
+/// since pages must be page-aligned and we rely on the OS to zero fresh
+/// memory.
+pub const backing_allocator = std.heap.page_allocator;
+
+/// The size of a transparent huge page. We only support the common 2 MiB
+/// size (x86_64 and aarch64 with 4 KiB base pages).
+pub const huge_page_size = 2 * 1024 * 1024;
+
+/// The size of a chunk of items allocated at once in huge page mode and
+/// the number of items in it. Any remainder of the chunk is unused.
+const huge_chunk_size = std.mem.alignForward(usize, item_size, huge_page_size);
+const huge_chunk_items = huge_chunk_size / item_size;
+
+/// The number of free pages each thread caches without synchronization.
+/// This is small since the cache is per-thread and is only meant to absorb
+/// the common grow/prune churn of a single terminal.
+const thread_cache_len = 4;
+
+/// The default number of free pages retained in the global free list.
+/// Anything beyond this is returned to the OS immediately.
+const default_retain_limit = 64;
+
+/// Intrusive free list node stored in the first bytes of a free item.
+const FreeNode = struct {
+    next: ?*FreeNode,
+
+    /// True if the physical memory of the item (except the OS page
+    /// containing this node) was returned to the OS with `purge`.
+    purged: bool = false,
+};
+
+/// Whether purged memory is guaranteed to read as zero. On Linux we use
+/// MADV_DONTNEED which guarantees zero-fill for private anonymous memory.
+/// Elsewhere we use MADV_FREE which may or may not preserve the contents
+/// so purged items must be zeroed on reuse.
+const purge_zeroes = builtin.os.tag == .linux;
+
+const ThreadCache = struct {
+    /// The pool the cached items belong to. The cache is only used
+    /// for a single pool (in practice, the global pool) so that items
+    /// never migrate between pools.
+    pool: ?*PagePool = null,
+    items: [thread_cache_len]ItemPtr = undefined,
+    len: usize = 0,
+};
+
+threadlocal var thread_cache: ThreadCache = .{};
+
+/// The global pool shared by all PageLists.
+var global_pool: PagePool = .{};
+
+/// Protects free, free_count.
+mutex: std.Thread.Mutex = .{},
+free: ?*FreeNode = null,
+free_count: usize = 0,
+
+/// The maximum number of items retained in the global free list.
+retain_limit: usize = default_retain_limit,
+
+/// The bytes of page memory currently handed out by this pool. This
+/// does not include free items retained by the pool.
+used: std.atomic.Value(usize) = .init(0),
+
+/// Whether new items are allocated in huge page backed chunks.
+huge_pages: std.atomic.Value(bool) = .init(false),
+
+/// Timestamp (milliseconds) of the last create or destroy. This is used
+/// to determine if the pool is idle.
+last_activity: std.atomic.Value(i64) = .init(0),
+
+/// Statistics about memory returned to the OS.
+stats: Stats = .{},
+
+/// Protects clients. This is separate from `mutex` because evicting
+/// scrollback frees pages back into this pool (which takes `mutex`).
+clients_mutex: std.Thread.Mutex = .{},
+clients: ClientList = .{},
+
+const ClientList = DoublyLinkedList(Client);
+
+/// Statistics about memory returned to the OS. These are updated
+/// atomically and may be read from any thread.
+pub const Stats = struct {
+    /// Total bytes of free pages whose physical memory was reclaimed
+    /// with madvise by `purge`.
+    purged_bytes: std.atomic.Value(usize) = .init(0),
+
+    /// Total bytes of free pages unmapped because the free list was
+    /// full or trimmed.
+    released_bytes: std.atomic.Value(usize) = .init(0),
+
+    /// The number of purges that reclaimed any memory.
+    purges: std.atomic.Value(usize) = .init(0),
+};
+
+/// A client is a consumer of the pool that can give up memory when
+/// the pool is over budget. In practice there is one client per terminal
+/// and it is shared by the primary and alternate screens.
+pub const Client = struct {
+    prev: ?*Client = null,
+    next: ?*Client = null,
+
+    /// The maximum bytes of page memory that may be in use across all
+    /// clients before this client starts evicting scrollback. This is a
+    /// soft limit: active areas are never evicted so this can be exceeded.
+    /// This is only accessed by the owner of the client.
+    budget: usize = std.math.maxInt(usize),
+
+    /// The last time (milliseconds timestamp) this client allocated a page.
+    /// Clients that haven't allocated for the longest time are evicted
+    /// first.
+    last_active: std.atomic.Value(i64) = .init(0),
+
+    /// The mutex that protects the memory of this client. The pool only
+    /// ever tries to acquire this mutex so it never deadlocks against a
+    /// client that is itself waiting on the pool.
+    mutex: *std.Thread.Mutex,
+
+    /// Called with the mutex held to free at least the given number of
+    /// bytes, if possible. Returns the number of bytes freed.
+    userdata: *anyopaque,
+    evict: *const fn (userdata: *anyopaque, bytes: usize) usize,
+
+    /// Mark this client as active now.
+    pub fn touch(self: *Client) void {
+        self.last_active.store(std.time.milliTimestamp(), .monotonic);
+    }
+
+    /// Set the budget in bytes. Zero disables the budget.
+    pub fn setBudget(self: *Client, bytes: usize) void {
+        self.budget = if (bytes == 0) std.math.maxInt(usize) else bytes;
+    }
+};
+
+/// Returns the global pool.
+pub fn global() *PagePool {
+    return &global_pool;
+}
+
+/// Free all memory retained by the pool. This does not free items that
+/// are still in use. This is only useful for pools other than the global
+/// pool, such as in tests.
+pub fn deinit(self: *PagePool) void {
+    self.flushThreadCache();
+    self.trim(0);
+    assert(self.clients.first == null);
+    self.* = undefined;
+}
+
+/// Create a zeroed item from the pool.
+pub fn create(self: *PagePool) Allocator.Error!ItemPtr {
+    const item = self.take() orelse item: {
+        if (self.huge_pages.load(.monotonic)) break :item try self.allocChunk();
+        const buf = try backing_allocator.alignedAlloc(
+            u8,
+            std.heap.page_size_min,
+            item_size,
+        );
+        break :item buf[0..item_size];
+    };
+
+    _ = self.used.fetchAdd(item_size, .monotonic);
+    self.last_activity.store(std.time.milliTimestamp(), .monotonic);
+    return item;
+}
+
+/// Return an item to the pool. The item may contain any data, it will
+/// be zeroed if it is retained.
+pub fn destroy(self: *PagePool, item: ItemPtr) void {
+    _ = self.used.fetchSub(item_size, .monotonic);
+    self.last_activity.store(std.time.milliTimestamp(), .monotonic);
+
+    // Fast path: our thread cache has room.
+    const cache = &thread_cache;
+    if (cache.pool == null) cache.pool = self;
+    if (cache.pool == self and cache.len < thread_cache_len) {
+        @memset(item, 0);
+        cache.items[cache.len] = item;
+        cache.len += 1;
+        return;
+    }
+
+    // Check if we'll retain this item before zeroing it so we don't
+    // zero memory we're about to release. We don't hold the lock while
+    // zeroing so this is racy and the free list may briefly exceed the
+    // retain limit, which is fine.
+    self.mutex.lock();
+    const retain = self.free_count < self.retain_limit;
+    self.mutex.unlock();
+    if (!retain) {
+        self.release(item);
+        return;
+    }
+
+    @memset(item, 0);
+    self.mutex.lock();
+    defer self.mutex.unlock();
+    self.push(item);
+}
+
+/// Take a free item from the thread cache or global free list, if any.
+fn take(self: *PagePool) ?ItemPtr {
+    const cache = &thread_cache;
+    if (cache.pool == self and cache.len > 0) {
+        cache.len -= 1;
+        return cache.items[cache.len];
+    }
+
+    self.mutex.lock();
+    defer self.mutex.unlock();
+    const node = self.free orelse return null;
+    self.free = node.next;
+    self.free_count -= 1;
+
+    // The free list node was stored in the item so restore the zeroed
+    // invariant for those bytes. If the item was purged and the OS
+    // doesn't guarantee zero-fill, we have to zero all of it.
+    const item: ItemPtr = @ptrCast(@alignCast(node));
+    if (!purge_zeroes and node.purged) {
+        @memset(item, 0);
+    } else {
+        @memset(item[0..@sizeOf(FreeNode)], 0);
+    }
+
+    return item;
+}
+
+/// Allocate a huge page backed chunk of items. The first item is returned
+/// and the remaining items are added to the free list.
+fn allocChunk(self: *PagePool) Allocator.Error!ItemPtr {
+    const chunk = try backing_allocator.alignedAlloc(
+        u8,
+        huge_page_size,
+        huge_chunk_size,
+    );
+
+    // This is only a hint. If THP is disabled system-wide this fails
+    // or does nothing and we just have normal pages.
+    if (comptime builtin.os.tag == .linux) {
+        posix.madvise(chunk.ptr, chunk.len, posix.MADV.HUGEPAGE) catch |err| {
+            log.debug("madvise MADV_HUGEPAGE failed err={}", .{err});
+        };
+    }
+
+    if (huge_chunk_items > 1) {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        for (1..huge_chunk_items) |i| {
+            self.push(@alignCast(chunk[i * item_size ..][0..item_size]));
+        }
+    }
+
+    return chunk[0..item_size];
+}
+
+/// Enable or disable allocating new items in huge page backed chunks.
+/// This is only supported on Linux with 4 KiB base pages, otherwise
+/// enabling does nothing. Existing items are not affected.
+pub fn setHugePages(self: *PagePool, enabled: bool) void {
+    if (enabled and !hugePagesSupported()) {
+        log.warn("huge pages are not supported on this system, ignoring", .{});
+        return;
+    }
+
+    self.huge_pages.store(enabled, .monotonic);
+}
+
+/// Returns true if huge page chunks are supported. We require 4 KiB
+/// base pages because items within a chunk may be individually unmapped,
+/// which requires item boundaries to be aligned to the OS page size.
+fn hugePagesSupported() bool {
+    if (comptime builtin.os.tag != .linux) return false;
+    return std.heap.pageSize() == 4096;
+}
+
+/// Return an item's memory to the OS.
+fn release(self: *PagePool, item: ItemPtr) void {
+    backing_allocator.free(@as([]align(std.heap.page_size_min) u8, item));
+    _ = self.stats.released_bytes.fetchAdd(item_size, .monotonic);
+}
+
+/// Push a zeroed item onto the global free list. Mutex must be held.
+fn push(self: *PagePool, item: ItemPtr) void {
+    const node: *FreeNode = @ptrCast(item);
+    node.* = .{ .next = self.free };
+    self.free = node;
+    self.free_count += 1;
+}
+
+/// Move all items in the calling thread's cache to the global free list
+/// so other threads can use them. This should be called by threads that
+/// allocate pages before they exit.
+pub fn flushThreadCache(self: *PagePool) void {
+    const cache = &thread_cache;
+    if (cache.pool != self) return;
+    defer cache.* = .{};
+
+    self.mutex.lock();
+    defer self.mutex.unlock();
+    for (cache.items[0..cache.len]) |item| {
+        if (self.free_count >= self.retain_limit) {
+            self.release(item);
+            continue;
+        }
+
+        // Items in the cache are zeroed.
+        self.push(item);
+    }
+}
+
+/// Release free items to the OS until at most `retain` items remain in
+/// the global free list. Thread caches are not affected.
+pub fn trim(self: *PagePool, retain: usize) void {
+    self.mutex.lock();
+    defer self.mutex.unlock();
+    while (self.free_count > retain) {
+        const node = self.free.?;
+        self.free = node.next;
+        self.free_count -= 1;
+        self.release(@ptrCast(@alignCast(node)));
+    }
+}
+
+/// The number of bytes retained in the global free list.
+pub fn freeBytes(self: *PagePool) usize {
+    self.mutex.lock();
+    defer self.mutex.unlock();
+    return self.free_count * item_size;
+}
+
+/// Returns true if there have been no allocations or frees for at
+/// least the given number of milliseconds.
+pub fn idle(self: *const PagePool, ms: u32) bool {
+    const last = self.last_activity.load(.monotonic);
+    return std.time.milliTimestamp() -| last >= ms;
+}
+
+/// Return the physical memory of all free items in the global free list
+/// to the OS while keeping the items in the pool. Reusing a purged item
+/// faults fresh pages back in. Thread caches are not purged since they're
+/// tiny. Returns the number of bytes reclaimed.
+pub fn purge(self: *PagePool) usize {
+    // madvise is only available on POSIX systems. Elsewhere the best we
+    // can do is release the free items entirely.
+    if (comptime builtin.os.tag == .windows) {
+        const bytes = self.freeBytes();
+        self.trim(0);
+        return bytes;
+    }
+
+    // Detach the free list so we don't hold the lock during madvise.
+    self.mutex.lock();
+    const list = self.free;
+    const count = self.free_count;
+    self.free = null;
+    self.free_count = 0;
+    self.mutex.unlock();
+
+    // We keep the first OS page of every item resident because it
+    // contains the free list node. The purged length must be a multiple
+    // of the page size since madvise rounds up and we must not touch
+    // the memory following the item.
+    const page_size = std.heap.pageSize();
+    const len = (item_size -| page_size) / page_size * page_size;
+    const advice = if (comptime builtin.os.tag == .linux)
+        posix.MADV.DONTNEED
+    else
+        posix.MADV.FREE;
+
+    var purged: usize = 0;
+    var tail: ?*FreeNode = null;
+    var it = list;
+    while (it) |node| : (it = node.next) {
+        tail = node;
+        if (node.purged or len == 0) continue;
+        const item: ItemPtr = @ptrCast(@alignCast(node));
+        const rest: [*]align(std.heap.page_size_min) u8 = @alignCast(item[page_size..].ptr);
+        posix.madvise(rest, len, advice) catch |err| {
+            log.warn("failed to purge page memory err={}", .{err});
+            continue;
+        };
+
+        node.purged = true;
+        purged += len;
+    }
+
+    // Reattach the list
+    if (tail) |t| {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        t.next = self.free;
+        self.free = list;
+        self.free_count += count;
+    }
+
+    if (purged > 0) {
+        _ = self.stats.purged_bytes.fetchAdd(purged, .monotonic);
+        _ = self.stats.purges.fetchAdd(1, .monotonic);
+        log.debug("purged free page memory bytes={}", .{purged});
+    }
+
+    return purged;
+}
+
+/// Returns true if allocating another item would exceed the budget.
+pub fn overBudget(self: *const PagePool, budget: usize) bool {
+    const used = self.used.load(.monotonic);
+    return used +| item_size > budget;
+}
+
+/// Register a client that can be asked to give up memory.
+pub fn register(self: *PagePool, client: *Client) void {
+    client.touch();
+    self.clients_mutex.lock();
+    defer self.clients_mutex.unlock();
+    self.clients.append(client);
+}
+
+/// Unregister a client. After this returns the pool will never call
+/// the client again. The caller must NOT hold the client mutex.
+pub fn unregister(self: *PagePool, client: *Client) void {
+    self.clients_mutex.lock();
+    defer self.clients_mutex.unlock();
+    self.clients.remove(client);
+}
+
+/// Try to bring memory usage back under the requester's budget by
+/// evicting scrollback from other registered clients, least recently
+/// active first. The requester is never asked to evict (its mutex is
+/// typically held by the caller) and clients whose mutex is busy are
+/// skipped rather than waited on.
+///
+/// Returns true if usage is within budget when this returns, in which
+/// case the requester doesn't need to free any of its own memory.
+pub fn reclaim(self: *PagePool, requester: *const Client) bool {
+    const budget = requester.budget;
+    if (!self.overBudget(budget)) return true;
+
+    self.clients_mutex.lock();
+    defer self.clients_mutex.unlock();
+
+    // Gather our candidates. We only consider a bounded number of
+    // clients to avoid allocation. This is sorted coldest first below.
+    var buf: [64]*Client = undefined;
+    var len: usize = 0;
+    var it = self.clients.first;
+    while (it) |client| : (it = client.next) {
+        if (client == requester) continue;
+        if (len == buf.len) break;
+        buf[len] = client;
+        len += 1;
+    }
+
+    const candidates = buf[0..len];
+    std.mem.sort(*Client, candidates, {}, struct {
+        fn lessThan(_: void, a: *Client, b: *Client) bool {
+            return a.last_active.load(.monotonic) <
+                b.last_active.load(.monotonic);
+        }
+    }.lessThan);
+
+    for (candidates) |client| {
+        const used = self.used.load(.monotonic);
+
+        // We want room for one more item.
+        const target = used +| item_size;
+        if (target <= budget) return true;
+
+        if (!client.mutex.tryLock()) continue;
+        defer client.mutex.unlock();
+        const freed = client.evict(client.userdata, target - budget);
+        if (freed > 0) log.debug("evicted scrollback bytes={}", .{freed});
+    }
+
+    return !self.overBudget(budget);
+}
+
+/// A background thread that purges the free memory of a pool once the
+/// pool has been idle for a while, or immediately when a memory pressure
+/// event is received.
+///
+/// This is only supported on POSIX systems.
+pub const Purger = struct {
+    pool: *PagePool,
+    opts: Options,
+    thread: std.Thread,
+
+    /// The pipe used to stop the thread. We write to the write end to
+    /// wake up poll.
+    stop_pipe: [2]posix.fd_t,
+
+    pub const Options = struct {
+        /// How long the pool must be idle before free memory is purged.
+        idle_ms: u32 = 10 * std.time.ms_per_s,
+
+        /// An optional file that signals memory pressure with a priority
+        /// poll event, such as a cgroup v2 memory.events file. Any event
+        /// triggers an immediate purge. The purger takes ownership.
+        pressure: ?std.fs.File = null,
+    };
+
+    pub fn create(alloc: Allocator, pool: *PagePool, opts: Options) !*Purger {
+        const self = try alloc.create(Purger);
+        errdefer alloc.destroy(self);
+
+        const stop_pipe = try posix.pipe2(.{ .CLOEXEC = true });
+        errdefer for (stop_pipe) |fd| posix.close(fd);
+
+        self.* = .{
+            .pool = pool,
+            .opts = opts,
+            .thread = undefined,
+            .stop_pipe = stop_pipe,
+        };
+        self.thread = try std.Thread.spawn(.{}, threadMain, .{self});
+        self.thread.setName("page-purger") catch {};
+        return self;
+    }
+
+    pub fn destroy(self: *Purger, alloc: Allocator) void {
+        _ = posix.write(self.stop_pipe[1], "x") catch {};
+        self.thread.join();
+        for (self.stop_pipe) |fd| posix.close(fd);
+        if (self.opts.pressure) |f| f.close();
+        alloc.destroy(self);
+    }
+
+    fn threadMain(self: *Purger) void {
+        var fds = [_]posix.pollfd{
+            .{ .fd = self.stop_pipe[0], .events = posix.POLL.IN, .revents = 0 },
+            .{ .fd = -1, .events = posix.POLL.PRI, .revents = 0 },
+        };
+        if (self.opts.pressure) |f| {
+            fds[1].fd = f.handle;
+
+            // Read the file once so that we only get events for changes.
+            self.drainPressure();
+        }
+
+        while (true) {
+            // We wake up periodically to check for idleness. We don't
+            // try to be exact since this is a background heuristic.
+            const n = posix.poll(&fds, @intCast(self.opts.idle_ms)) catch |err| {
+                log.warn("page purger poll failed err={}", .{err});
+                return;
+            };
+
+            // Stop requested
+            if (fds[0].revents != 0) return;
+
+            // Memory pressure: purge now regardless of activity.
+            if (n > 0 and fds[1].revents != 0) {
+                self.drainPressure();
+                const bytes = self.pool.purge();
+                log.info("memory pressure, purged free page memory bytes={}", .{bytes});
+                continue;
+            }
+
+            if (self.pool.idle(self.opts.idle_ms)) _ = self.pool.purge();
+        }
+    }
+
+    /// Read the pressure file from the start. For kernfs files (cgroups)
+    /// reading is what re-arms the poll event.
+    fn drainPressure(self: *Purger) void {
+        const f = self.opts.pressure orelse return;
+        var buf: [512]u8 = undefined;
+        _ = f.preadAll(&buf, 0) catch {};
+    }
+};
+
+test "PagePool create and destroy" {
+    const testing = std.testing;
+
+    var pool: PagePool = .{};
+    defer pool.deinit();
+
+    const a = try pool.create();
+    try testing.expectEqual(item_size, pool.used.load(.monotonic));
+    a[0] = 42;
+    a[item_size - 1] = 42;
+    pool.destroy(a);
+    try testing.expectEqual(0, pool.used.load(.monotonic));
+
+    // Reused items are always zeroed
+    const b = try pool.create();
+    defer pool.destroy(b);
+    try testing.expectEqual(0, b[0]);
+    try testing.expectEqual(0, b[item_size - 1]);
+}
+
+test "PagePool global free list" {
+    const testing = std.testing;
+
+    var pool: PagePool = .{};
+    defer pool.deinit();
+    pool.retain_limit = 2;
+
+    // Fill the thread cache and then some
+    var items: [thread_cache_len + 4]ItemPtr = undefined;
+    for (&items) |*item| item.* = try pool.create();
+    for (items) |item| {
+        item[0] = 1;
+        pool.destroy(item);
+    }
+
+    // Only the retain limit is kept globally
+    try testing.expectEqual(2, pool.free_count);
+
+    // Flushing the cache respects the retain limit
+    pool.flushThreadCache();
+    try testing.expectEqual(2, pool.free_count);
+
+    // Items from the free list are zeroed, including the free list node
+    const item = try pool.create();
+    defer pool.destroy(item);
+    for (item[0..64]) |v| try testing.expectEqual(0, v);
+}
+
+test "PagePool reclaim coldest first" {
+    const testing = std.testing;
+
+    var pool: PagePool = .{};
+    defer pool.deinit();
+
+    const Test = struct {
+        pool: *PagePool,
+        mutex: std.Thread.Mutex = .{},
+        items: std.BoundedArray(ItemPtr, 4) = .{},
+
+        fn evict(ud: *anyopaque, bytes: usize) usize {
+            const self: *@This() = @ptrCast(@alignCast(ud));
+            var freed: usize = 0;
+            while (freed < bytes) {
+                if (self.items.len == 0) break;
+                const item = self.items.get(self.items.len - 1);
+                self.items.len -= 1;
+                self.pool.destroy(item);
+                freed += item_size;
+            }
+            return freed;
+        }
+    };
+
+    var cold: Test = .{ .pool = &pool };
+    var hot: Test = .{ .pool = &pool };
+    var cold_client: Client = .{
+        .mutex = &cold.mutex,
+        .userdata = &cold,
+        .evict = Test.evict,
+    };
+    var hot_client: Client = .{
+        .mutex = &hot.mutex,
+        .userdata = &hot,
+        .evict = Test.evict,
+    };
+    pool.register(&cold_client);
+    defer pool.unregister(&cold_client);
+    pool.register(&hot_client);
+    defer pool.unregister(&hot_client);
+    cold_client.last_active.store(1, .monotonic);
+    hot_client.last_active.store(2, .monotonic);
+
+    for (0..2) |_| {
+        cold.items.appendAssumeCapacity(try pool.create());
+        hot.items.appendAssumeCapacity(try pool.create());
+    }
+    defer for ([_]*Test{ &cold, &hot }) |t| {
+        for (t.items.slice()) |item| pool.destroy(item);
+    };
+
+    // A requester that owns no memory, whose budget applies.
+    var other: Test = .{ .pool = &pool };
+    var other_client: Client = .{
+        .mutex = &other.mutex,
+        .userdata = &other,
+        .evict = Test.evict,
+    };
+
+    // Under budget nothing happens
+    other_client.setBudget(5 * item_size);
+    try testing.expect(pool.reclaim(&other_client));
+    try testing.expectEqual(2, cold.items.len);
+
+    // Over budget we evict the cold client first
+    other_client.setBudget(4 * item_size);
+    try testing.expect(pool.reclaim(&other_client));
+    try testing.expectEqual(1, cold.items.len);
+    try testing.expectEqual(2, hot.items.len);
+
+    // Busy clients are skipped
+    other_client.setBudget(2 * item_size);
+    cold.mutex.lock();
+    try testing.expect(pool.reclaim(&other_client));
+    cold.mutex.unlock();
+    try testing.expectEqual(1, cold.items.len);
+    try testing.expectEqual(1, hot.items.len);
+
+    // The requester is never evicted
+    cold_client.setBudget(1 * item_size);
+    try testing.expect(!pool.reclaim(&cold_client));
+    try testing.expectEqual(1, cold.items.len);
+    try testing.expectEqual(0, hot.items.len);
+}
+
+test "PagePool purge" {
+    const testing = std.testing;
+
+    var pool: PagePool = .{};
+    defer pool.deinit();
+
+    // Bypass the thread cache so items land on the global free list.
+    var items: [thread_cache_len + 2]ItemPtr = undefined;
+    for (&items) |*item| item.* = try pool.create();
+    for (items) |item| {
+        @memset(item, 0xFF);
+        pool.destroy(item);
+    }
+    const free = pool.free_count;
+    try testing.expect(free > 0);
+
+    // Purging keeps the items in the pool
+    const purged = pool.purge();
+    try testing.expectEqual(free, pool.free_count);
+    try testing.expectEqual(purged, pool.stats.purged_bytes.load(.monotonic));
+    if (item_size > 2 * std.heap.pageSize()) try testing.expect(purged > 0);
+
+    // Purging again does nothing since everything is purged
+    try testing.expectEqual(0, pool.purge());
+
+    // Purged items are zeroed when reused
+    pool.flushThreadCache();
+    for (&items) |*item| {
+        item.* = try pool.create();
+        try testing.expectEqual(0, item.*[0]);
+        try testing.expectEqual(0, item.*[item_size - 1]);
+    }
+    for (items) |item| pool.destroy(item);
+}
+
+test "PagePool huge pages" {
+    const testing = std.testing;
+    if (!hugePagesSupported()) return error.SkipZigTest;
+
+    var pool: PagePool = .{};
+    defer pool.deinit();
+    pool.setHugePages(true);
+
+    // The first allocation allocates a whole chunk and the rest of the
+    // chunk is available in the free list.
+    const a = try pool.create();
+    defer pool.destroy(a);
+    try testing.expectEqual(0, @intFromPtr(a) % huge_page_size);
+    try testing.expectEqual(huge_chunk_items - 1, pool.free_count);
+
+    // The next item comes from the same chunk.
+    if (huge_chunk_items > 1) {
+        const b = try pool.create();
+        defer pool.destroy(b);
+        try testing.expectEqual(
+            @intFromPtr(a) / huge_page_size,
+            @intFromPtr(b) / huge_page_size,
+        );
+    }
+}
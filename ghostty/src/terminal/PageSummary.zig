@@ -0,0 +1,186 @@
+//! A compact, probabilistic summary of the text within a single page
+//! used to accelerate scrollback search.
+//!
+//! The summary is a bloom filter of every trigram (3-byte sequence) in
+//! the UTF-8 encoding of the page (the same encoding that search uses)
+//! plus a copy of the first and last few bytes of that encoding. With
+//! this, search can answer "can any match of this needle overlap this
+//! page?" without re-encoding or scanning the page. The answer may have
+//! false positives but never false negatives.
+//!
+//! The trigram filter alone can only rule out matches that are fully
+//! contained within the page. Matches that straddle a page boundary
+//! are ruled out using the head/tail copies: the portion of the match
+//! within the page must be a prefix or suffix of the page text.
+//!
+//! A summary is only valid for pages that are entirely in the scrollback.
+//! Pages in the active area change constantly and are never summarized.
+//! The PageList is responsible for invalidating summaries of pages that
+//! are modified in place (i.e. erased rows, resize) or reused.
+const PageSummary = @This();
+
+const std = @import("std");
+const assert = std.debug.assert;
+
+/// The number of bits in the bloom filter. A standard page encodes to
+/// at most a few tens of kilobytes of text and typical scrollback (logs,
+/// source code) has a few thousand distinct trigrams per page. With two
+/// hash functions this gives a per-trigram false positive rate of roughly
+/// 25% which compounds quickly for realistic needles: a 10 byte needle
+/// has 8 trigrams and a false positive rate below 0.01%.
+pub const bloom_bits = 1 << bloom_bits_log2;
+const bloom_bits_log2 = 13;
+
+/// The number of bytes we retain from the start and end of the page
+/// text to rule out matches that straddle page boundaries.
+pub const edge_len = 32;
+
+const Bloom = std.StaticBitSet(bloom_bits);
+
+/// Whether this summary reflects the current page contents. If this
+/// is false then all other fields are undefined.
+valid: bool = false,
+
+bloom: Bloom = undefined,
+head: [edge_len]u8 = undefined,
+head_len: u8 = 0,
+tail: [edge_len]u8 = undefined,
+tail_len: u8 = 0,
+
+/// Invalidate the summary. This must be called whenever the contents
+/// of the page change in any way.
+pub inline fn invalidate(self: *PageSummary) void {
+    self.valid = false;
+}
+
+/// Build the summary from the encoded text of the page. The text must
+/// be the full encoding used by search (see `Page.encodeUtf8`).
+pub fn build(self: *PageSummary, text: []const u8) void {
+    self.bloom = .initEmpty();
+    if (text.len >= 3) {
+        for (0..text.len - 2) |i| self.setTrigram(text[i..][0..3]);
+    }
+
+    const edge = @min(text.len, edge_len);
+    @memcpy(self.head[0..edge], text[0..edge]);
+    @memcpy(self.tail[0..edge], text[text.len - edge ..]);
+    self.head_len = @intCast(edge);
+    self.tail_len = @intCast(edge);
+    self.valid = true;
+}
+
+/// Returns true if any occurrence of needle in the concatenated text
+/// of the page list may overlap this page by at least one byte. If this
+/// returns false then the page can be skipped entirely during search.
+///
+/// The summary must be valid.
+pub fn mayOverlap(self: *const PageSummary, needle: []const u8) bool {
+    assert(self.valid);
+
+    // Trigrams can't tell us anything about very short needles.
+    if (needle.len < 3) return true;
+
+    // A match fully contained within the page must have all of its
+    // trigrams in our filter.
+    if (self.mayContain(needle)) return true;
+
+    // A match that starts before this page and continues into it must
+    // have some suffix of the needle as a prefix of the page text (or
+    // the entire page text is within the needle).
+    const head = self.head[0..self.head_len];
+    for (1..needle.len) |j| {
+        const rem = needle[j..];
+        const len = @min(rem.len, head.len);
+        if (std.mem.eql(u8, rem[0..len], head[0..len])) return true;
+    }
+
+    // A match that starts within this page and continues past it must
+    // have some prefix of the needle as a suffix of the page text.
+    const tail = self.tail[0..self.tail_len];
+    for (1..needle.len) |j| {
+        const rem = needle[0..j];
+        const len = @min(rem.len, tail.len);
+        if (std.mem.eql(
+            u8,
+            rem[rem.len - len ..],
+            tail[tail.len - len ..],
+        )) return true;
+    }
+
+    return false;
+}
+
+/// Returns true if all the trigrams in needle may be in the page.
+fn mayContain(self: *const PageSummary, needle: []const u8) bool {
+    assert(needle.len >= 3);
+    for (0..needle.len - 2) |i| {
+        if (!self.hasTrigram(needle[i..][0..3])) return false;
+    }
+
+    return true;
+}
+
+fn setTrigram(self: *PageSummary, tri: *const [3]u8) void {
+    const idx = indexes(tri);
+    self.bloom.set(idx[0]);
+    self.bloom.set(idx[1]);
+}
+
+fn hasTrigram(self: *const PageSummary, tri: *const [3]u8) bool {
+    const idx = indexes(tri);
+    return self.bloom.isSet(idx[0]) and self.bloom.isSet(idx[1]);
+}
+
+/// The two bloom filter bit indexes for a trigram. We derive both from
+/// a single multiplicative hash since the key is only 24 bits.
+inline fn indexes(tri: *const [3]u8) [2]usize {
+    const key: u64 = std.mem.readInt(u24, tri, .little);
+    const h = key *% 0x9E3779B97F4A7C15;
+    return .{
+        @intCast(h >> (64 - bloom_bits_log2)),
+        @intCast((h >> 16) & (bloom_bits - 1)),
+    };
+}
+
+test "PageSummary contains" {
+    const testing = std.testing;
+
+    var s: PageSummary = .{};
+    s.build("hello world\nthe quick brown fox\n");
+    try testing.expect(s.mayOverlap("quick"));
+    try testing.expect(s.mayOverlap("fox"));
+    try testing.expect(!s.mayOverlap("zebra crossing"));
+}
+
+test "PageSummary short needle" {
+    const testing = std.testing;
+
+    var s: PageSummary = .{};
+    s.build("hello world");
+    try testing.expect(s.mayOverlap("zz"));
+}
+
+test "PageSummary straddling head" {
+    const testing = std.testing;
+
+    var s: PageSummary = .{};
+    s.build("llo world");
+    try testing.expect(s.mayOverlap("zzz hello"));
+    try testing.expect(!s.mayOverlap("zzzzzzzz"));
+}
+
+test "PageSummary straddling tail" {
+    const testing = std.testing;
+
+    var s: PageSummary = .{};
+    s.build("the quick bro");
+    try testing.expect(s.mayOverlap("brown zzz"));
+}
+
+test "PageSummary page within needle" {
+    const testing = std.testing;
+
+    var s: PageSummary = .{};
+    s.build("ick");
+    try testing.expect(s.mayOverlap("the quick brown fox"));
+}
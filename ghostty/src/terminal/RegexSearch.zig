@@ -0,0 +1,441 @@
+//! Regular expression search over a PageList.
+//!
+//! The search never materializes the whole PageList as a single string.
+//! Instead, it processes one chunk at a time where a chunk is the
+//! remainder of the current page, extended into following pages for as
+//! long as the final row is soft-wrapped (see `Row.wrap`). Since chunks
+//! always end on a hard line break, a chunk is exactly the overlap window
+//! required for any regex that doesn't match across newlines, and soft
+//! wrapped lines are always searched as a single logical line.
+//!
+//! Each call to `next` processes exactly one chunk, which bounds the
+//! amount of time spent per call. This lets callers interleave search
+//! with other work that requires the PageList (i.e. rendering) and
+//! report results progressively. See `Worker` for a helper that runs
+//! a search on a dedicated thread.
+//!
+//! The position of the search is kept in a tracked pin so that the
+//! PageList can be freely modified between calls to `next`. Because the
+//! search moves from the oldest page to the newest, pruned scrollback
+//! moves the pin to the oldest remaining (and unsearched) page.
+const RegexSearch = @This();
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const assert = std.debug.assert;
+const oni = @import("oniguruma");
+const PageList = @import("PageList.zig");
+const Page = @import("page.zig").Page;
+const Selection = @import("Selection.zig");
+const Pin = PageList.Pin;
+
+const log = std.log.scoped(.regex_search);
+
+/// The list we're searching.
+list: *PageList,
+
+/// The regex to search with. This is not owned.
+regex: *oni.Regex,
+
+/// The tracked start of the next chunk to search. This is null once
+/// we've reached the end of the PageList.
+cursor: ?*Pin,
+
+/// The encoded text of the current chunk and the mapping of each byte
+/// back to its cell. The cell map is relative to the page of the segment
+/// containing the byte.
+text: std.ArrayListUnmanaged(u8) = .{},
+cell_map: Page.CellMap,
+segments: std.ArrayListUnmanaged(Segment) = .{},
+
+/// Reused across matches to avoid repeated allocation within oniguruma.
+region: oni.Region = .{},
+
+/// A contiguous set of rows from a single page within a chunk.
+const Segment = struct {
+    node: *PageList.List.Node,
+
+    /// The byte offset in the chunk text where this segment begins.
+    start: usize,
+};
+
+/// Initialize a search starting at the top of the PageList. The regex
+/// must remain valid for the lifetime of the search.
+pub fn init(
+    alloc: Allocator,
+    list: *PageList,
+    regex: *oni.Regex,
+) Allocator.Error!RegexSearch {
+    const cursor = try list.trackPin(list.getTopLeft(.screen));
+    errdefer list.untrackPin(cursor);
+
+    return .{
+        .list = list,
+        .regex = regex,
+        .cursor = cursor,
+        .cell_map = .init(alloc),
+    };
+}
+
+pub fn deinit(self: *RegexSearch, alloc: Allocator) void {
+    if (self.cursor) |p| self.list.untrackPin(p);
+    self.text.deinit(alloc);
+    self.cell_map.deinit();
+    self.segments.deinit(alloc);
+    self.region.deinit();
+}
+
+/// Search the next chunk, appending all matches to results. This
+/// returns false if there was nothing left to search, in which case
+/// results is not modified.
+pub fn next(
+    self: *RegexSearch,
+    alloc: Allocator,
+    results: *std.ArrayListUnmanaged(Selection),
+) !bool {
+    const cursor = self.cursor orelse return false;
+
+    // Encode our chunk, following soft-wraps across pages.
+    self.text.clearRetainingCapacity();
+    self.cell_map.clearRetainingCapacity();
+    self.segments.clearRetainingCapacity();
+    const next_pin: ?Pin = next: {
+        var node = cursor.node;
+        var start_y = cursor.y;
+        var preceding: Page.EncodeUtf8Options.TrailingUtf8State = .{};
+        while (true) {
+            const page: *const Page = &node.data;
+            try self.segments.append(alloc, .{
+                .node = node,
+                .start = self.text.items.len,
+            });
+            preceding = page.encodeUtf8(self.text.writer(alloc), .{
+                .start_y = @min(start_y, page.size.rows),
+                .preceding = preceding,
+                .cell_map = &self.cell_map,
+            }) catch {
+                // writer uses anyerror but the only realistic error on
+                // an ArrayList is out of memory.
+                return error.OutOfMemory;
+            };
+
+            const next_node = node.next orelse break :next null;
+            const wrapped = page.size.rows > 0 and
+                page.getRow(page.size.rows - 1).wrap;
+            if (!wrapped) break :next .{ .node = next_node };
+            node = next_node;
+            start_y = 0;
+        }
+    };
+    assert(self.cell_map.items.len == self.text.items.len);
+
+    // Find all the matches in the chunk. We never allow empty matches
+    // since they can't be represented as a selection.
+    const text = self.text.items;
+    var pos: usize = 0;
+    while (pos < text.len) {
+        _ = self.regex.searchAdvanced(
+            text,
+            pos,
+            text.len,
+            &self.region,
+            .{ .find_not_empty = true },
+        ) catch |err| switch (err) {
+            error.Mismatch => break,
+            else => return err,
+        };
+
+        const start: usize = @intCast(self.region.starts()[0]);
+        const end: usize = @intCast(self.region.ends()[0]);
+        assert(end > start);
+        try results.append(alloc, .init(
+            self.pin(start),
+            self.pin(end - 1),
+            false,
+        ));
+        pos = end;
+    }
+
+    // Move to our next chunk or finish.
+    if (next_pin) |p| {
+        cursor.* = p;
+    } else {
+        self.list.untrackPin(cursor);
+        self.cursor = null;
+    }
+
+    return true;
+}
+
+/// Convert a byte offset in the current chunk into a pin.
+fn pin(self: *const RegexSearch, idx: usize) Pin {
+    const entry = self.cell_map.items[idx];
+    var seg = self.segments.items[0];
+    for (self.segments.items[1..]) |s| {
+        if (s.start > idx) break;
+        seg = s;
+    }
+
+    return .{ .node = seg.node, .y = entry.y, .x = entry.x };
+}
+
+/// Runs a RegexSearch to completion on a dedicated thread.
+///
+/// The PageList is only accessed while holding the given mutex, and the
+/// mutex is only held for a single chunk at a time so the thread owning
+/// the PageList (and the renderer) are never blocked for long. Results
+/// are delivered progressively via the callback as each chunk is
+/// searched.
+pub const Worker = struct {
+    alloc: Allocator,
+    search: RegexSearch,
+
+    /// The mutex protecting the PageList.
+    mutex: *std.Thread.Mutex,
+
+    callback: Callback,
+
+    /// Set to true to stop the search at the next chunk boundary.
+    cancelled: std.atomic.Value(bool) = .init(false),
+
+    thread: ?std.Thread = null,
+
+    pub const Callback = struct {
+        userdata: ?*anyopaque = null,
+
+        /// Called with the mutex held after each chunk that produced
+        /// matches and one final time with done set to true once the
+        /// search is complete (not called if cancelled). The matches
+        /// are only valid for the duration of the call since the
+        /// PageList may change once the mutex is released; callers
+        /// that retain them should convert them to tracked pins.
+        func: *const fn (
+            userdata: ?*anyopaque,
+            matches: []const Selection,
+            done: bool,
+        ) void,
+    };
+
+    /// Create a new worker. The caller must hold the mutex. The worker
+    /// doesn't run until start is called.
+    pub fn create(
+        alloc: Allocator,
+        list: *PageList,
+        regex: *oni.Regex,
+        mutex: *std.Thread.Mutex,
+        callback: Callback,
+    ) !*Worker {
+        const self = try alloc.create(Worker);
+        errdefer alloc.destroy(self);
+        self.* = .{
+            .alloc = alloc,
+            .search = try .init(alloc, list, regex),
+            .mutex = mutex,
+            .callback = callback,
+        };
+
+        return self;
+    }
+
+    /// Cancel the search (if it is still running), wait for the thread
+    /// to exit, and free all resources. The caller must NOT hold
+    /// the mutex.
+    pub fn destroy(self: *Worker) void {
+        self.cancel();
+        if (self.thread) |thr| thr.join();
+
+        {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            self.search.deinit(self.alloc);
+        }
+
+        self.alloc.destroy(self);
+    }
+
+    /// Start the search thread.
+    pub fn start(self: *Worker) !void {
+        assert(self.thread == null);
+        self.thread = try std.Thread.spawn(.{}, threadMain, .{self});
+    }
+
+    /// Request that the search stop. This returns immediately, the
+    /// search will stop at the next chunk boundary.
+    pub fn cancel(self: *Worker) void {
+        self.cancelled.store(true, .release);
+    }
+
+    fn threadMain(self: *Worker) void {
+        var results: std.ArrayListUnmanaged(Selection) = .{};
+        defer results.deinit(self.alloc);
+
+        while (!self.cancelled.load(.acquire)) {
+            results.clearRetainingCapacity();
+
+            self.mutex.lock();
+            defer self.mutex.unlock();
+
+            const more = self.search.next(
+                self.alloc,
+                &results,
+            ) catch |err| err: {
+                log.warn("regex search failed, stopping err={}", .{err});
+                break :err false;
+            };
+
+            if (!more) {
+                self.callback.func(self.callback.userdata, &.{}, true);
+                return;
+            }
+
+            if (results.items.len > 0) self.callback.func(
+                self.callback.userdata,
+                results.items,
+                false,
+            );
+        }
+    }
+};
+
+test "RegexSearch soft-wrapped lines" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+    const Screen = @import("Screen.zig");
+    const point = @import("point.zig");
+
+    try oni.testing.ensureInit();
+    var re = try oni.Regex.init(
+        "error\\[E\\d+\\]",
+        .{},
+        oni.Encoding.utf8,
+        oni.Syntax.default,
+        null,
+    );
+    defer re.deinit();
+
+    var s = try Screen.init(alloc, 10, 5, 0);
+    defer s.deinit();
+    try s.testWriteString("error[E0308] ok\nfoo error[E1]");
+
+    var search = try RegexSearch.init(alloc, &s.pages, &re);
+    defer search.deinit(alloc);
+
+    var results: std.ArrayListUnmanaged(Selection) = .{};
+    defer results.deinit(alloc);
+    while (try search.next(alloc, &results)) {}
+    try testing.expectEqual(2, results.items.len);
+
+    {
+        const sel = results.items[0];
+        try testing.expectEqual(point.Point{ .screen = .{
+            .x = 0,
+            .y = 0,
+        } }, s.pages.pointFromPin(.screen, sel.start()).?);
+        try testing.expectEqual(point.Point{ .screen = .{
+            .x = 1,
+            .y = 1,
+        } }, s.pages.pointFromPin(.screen, sel.end()).?);
+    }
+    {
+        const sel = results.items[1];
+        try testing.expectEqual(point.Point{ .screen = .{
+            .x = 4,
+            .y = 2,
+        } }, s.pages.pointFromPin(.screen, sel.start()).?);
+        try testing.expectEqual(point.Point{ .screen = .{
+            .x = 2,
+            .y = 3,
+        } }, s.pages.pointFromPin(.screen, sel.end()).?);
+    }
+
+    // Finished searches stay finished.
+    try testing.expect(!try search.next(alloc, &results));
+    try testing.expectEqual(2, results.items.len);
+}
+
+test "RegexSearch multiple pages" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+    const Screen = @import("Screen.zig");
+
+    try oni.testing.ensureInit();
+    var re = try oni.Regex.init(
+        "boo!",
+        .{},
+        oni.Encoding.utf8,
+        oni.Syntax.default,
+        null,
+    );
+    defer re.deinit();
+
+    var s = try Screen.init(alloc, 80, 24, 1000);
+    defer s.deinit();
+
+    // Write a match that soft-wraps across the page boundary.
+    const first_page_rows = s.pages.pages.first.?.data.capacity.rows;
+    for (0..first_page_rows - 1) |_| try s.testWriteString("\n");
+    for (0..s.pages.cols - 2) |_| try s.testWriteString("x");
+    try s.testWriteString("boo!");
+    try testing.expect(s.pages.pages.first != s.pages.pages.last);
+    try s.testWriteString(" boo!");
+
+    var search = try RegexSearch.init(alloc, &s.pages, &re);
+    defer search.deinit(alloc);
+
+    var results: std.ArrayListUnmanaged(Selection) = .{};
+    defer results.deinit(alloc);
+    while (try search.next(alloc, &results)) {}
+    try testing.expectEqual(2, results.items.len);
+    try testing.expect(results.items[0].start().node == s.pages.pages.first.?);
+    try testing.expect(results.items[0].end().node == s.pages.pages.last.?);
+}
+
+test "RegexSearch worker" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+    const Screen = @import("Screen.zig");
+
+    try oni.testing.ensureInit();
+    var re = try oni.Regex.init(
+        "b[o]+!",
+        .{},
+        oni.Encoding.utf8,
+        oni.Syntax.default,
+        null,
+    );
+    defer re.deinit();
+
+    var s = try Screen.init(alloc, 80, 24, 0);
+    defer s.deinit();
+    try s.testWriteString("hello. boo! hello. booo!");
+
+    const State = struct {
+        count: usize = 0,
+        done: std.Thread.ResetEvent = .{},
+
+        fn callback(
+            ud: ?*anyopaque,
+            matches: []const Selection,
+            done: bool,
+        ) void {
+            const self: *@This() = @ptrCast(@alignCast(ud.?));
+            self.count += matches.len;
+            if (done) self.done.set();
+        }
+    };
+
+    var mutex: std.Thread.Mutex = .{};
+    var state: State = .{};
+    const worker = worker: {
+        mutex.lock();
+        defer mutex.unlock();
+        break :worker try Worker.create(alloc, &s.pages, &re, &mutex, .{
+            .userdata = &state,
+            .func = State.callback,
+        });
+    };
+    defer worker.destroy();
+    try worker.start();
+    state.done.wait();
+    try testing.expectEqual(2, state.count);
+}
@@ -92,6 +92,10 @@ modes: modespkg.ModeState = .{},
 /// The most recently set mouse shape for the terminal.
 mouse_shape: mouse_shape_pkg.MouseShape = .text,
 
+/// If set, Kitty graphics images that need decoding are decoded with
+/// this rather than while executing the command. See `kittyGraphicsDecoded`.
+kitty_decoder: ?kitty.graphics.Decoder = null,
+
 /// These are just a packed set of flags we may set on the terminal.
 flags: packed struct {
     // This isn't a mode, this is set by OSC 133 using the "A" event.
@@ -2314,6 +2318,17 @@ pub fn kittyGraphics(
     return kitty.graphics.execute(alloc, self, cmd);
 }
 
+/// Finish a Kitty graphics image decoded by `kitty_decoder`. This takes
+/// ownership of the job. The returned response, if any, must be sent the
+/// same way as a response from `kittyGraphics`.
+pub fn kittyGraphicsDecoded(
+    self: *Terminal,
+    alloc: Allocator,
+    job: *kitty.graphics.DecodeJob,
+) ?kitty.graphics.Response {
+    return kitty.graphics.decoded(alloc, self, job);
+}
+
 /// Set a style attribute.
 pub fn setAttribute(self: *Terminal, attr: sgr.Attribute) !void {
     try self.screen.setAttribute(attr);
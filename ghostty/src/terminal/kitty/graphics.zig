@@ -6,7 +6,7 @@
 //! Unimplemented features that are still todo:
 //! - shared memory transmit
 //! - virtual placement w/ unicode
-//! - animation
+//! - deleting animation frames
 //!
 //! Performance:
 //! The performance of this particular subsystem of Ghostty is not great.
@@ -16,20 +16,26 @@
 //! aim to ship a v1 of this implementation came at some cost. I learned a lot
 //! though and I think we can go back through and fix this up.
 
+const animation = @import("graphics_animation.zig");
 const render = @import("graphics_render.zig");
 const command = @import("graphics_command.zig");
+const decode = @import("graphics_decode.zig");
 const exec = @import("graphics_exec.zig");
 const image = @import("graphics_image.zig");
 const storage = @import("graphics_storage.zig");
 pub const unicode = @import("graphics_unicode.zig");
+pub const Animation = animation.Animation;
 pub const Command = command.Command;
 pub const CommandParser = command.Parser;
+pub const DecodeJob = decode.Job;
+pub const Decoder = decode.Decoder;
 pub const Image = image.Image;
 pub const ImageStorage = storage.ImageStorage;
 pub const RenderPlacement = render.Placement;
 pub const Response = command.Response;
 
 pub const execute = exec.execute;
+pub const decoded = exec.decoded;
 
 test {
     @import("std").testing.refAllDecls(@This());
@@ -0,0 +1,743 @@
+//! Animated images: the frame (a=f), animation control (a=a) and frame
+//! composition (a=c) actions of the Kitty graphics protocol.
+//!
+//! The root frame of an animation (frame 1) is the image data itself.
+//! Every other frame is stored as a delta: the frame it is drawn on top
+//! of (or a background color) and the rectangles drawn on top of that.
+//! Clients typically send each frame as a small change to the previous
+//! one, so this is much smaller than storing every frame in full, and
+//! moving to such a frame only has to draw the changed rectangles.
+//!
+//! The displayed frame is composed into `Animation.canvas`, which the
+//! renderer draws instead of the image data. Playback is driven by the
+//! renderer, which calls `advance` for the images it displays so that
+//! animations that aren't visible cost nothing.
+const std = @import("std");
+const assert = std.debug.assert;
+const Allocator = std.mem.Allocator;
+
+const command = @import("graphics_command.zig");
+const Image = @import("graphics_image.zig").Image;
+const CompositionMode = command.CompositionMode;
+
+const log = std.log.scoped(.kitty_gfx);
+
+/// The gap used for frames that don't specify one, taken from Kitty.
+pub const default_gap_ms = 40;
+
+/// A rectangle of pixels within an image.
+pub const Region = struct {
+    x: u32 = 0,
+    y: u32 = 0,
+    width: u32 = 0,
+    height: u32 = 0,
+
+    /// Returns true if the region fits in an image of the given size.
+    pub fn within(self: Region, width: u32, height: u32) bool {
+        return self.x <= width and self.width <= width - self.x and
+            self.y <= height and self.height <= height - self.y;
+    }
+
+    /// Returns true if the regions overlap.
+    pub fn intersects(self: Region, other: Region) bool {
+        return self.x < other.x + other.width and other.x < self.x + self.width and
+            self.y < other.y + other.height and other.y < self.y + self.height;
+    }
+
+    /// The smallest region containing both regions.
+    pub fn merge(self: Region, other: Region) Region {
+        const x = @min(self.x, other.x);
+        const y = @min(self.y, other.y);
+        return .{
+            .x = x,
+            .y = y,
+            .width = @max(self.x + self.width, other.x + other.width) - x,
+            .height = @max(self.y + self.height, other.y + other.height) - y,
+        };
+    }
+};
+
+/// Pixels drawn on top of a frame.
+pub const Delta = struct {
+    region: Region,
+    mode: CompositionMode,
+
+    /// The RGBA pixels of the region.
+    data: []u8,
+};
+
+/// A frame after the root frame.
+pub const Frame = struct {
+    /// The frame number this frame is drawn on top of, or zero if it is
+    /// drawn on top of `background`. This is always an earlier frame.
+    base: u32 = 0,
+
+    /// The RGBA color of the frame if it has no base.
+    background: [4]u8 = @splat(0),
+
+    /// See `Animation.gap`.
+    gap_ms: i32 = 0,
+
+    /// The pixels drawn on top of the base, in order.
+    deltas: std.ArrayListUnmanaged(Delta) = .empty,
+
+    fn deinit(self: *Frame, alloc: Allocator) void {
+        for (self.deltas.items) |d| alloc.free(d.data);
+        self.deltas.deinit(alloc);
+    }
+};
+
+pub const Animation = struct {
+    width: u32,
+    height: u32,
+
+    /// The root frame, which is the RGBA image data. The image owns this
+    /// memory but the animation is the only thing that modifies it.
+    root: []u8,
+
+    /// The gap of the root frame, see `gap`.
+    root_gap_ms: i32 = 0,
+
+    /// Frames 2 and on.
+    frames: std.ArrayListUnmanaged(Frame) = .empty,
+
+    /// Scratch space used by `compose`, big enough for every frame.
+    chain: std.ArrayListUnmanaged(u32) = .empty,
+
+    state: State = .stopped,
+
+    /// The number of times to loop, or zero to loop forever.
+    loops: u32 = 0,
+
+    /// The number of times we've looped since we started running.
+    loop_count: u32 = 0,
+
+    /// The displayed frame and the time it was first displayed. The time
+    /// is null until the renderer has displayed it while running.
+    current: u32 = 1,
+    current_time: ?std.time.Instant = null,
+
+    /// The composed pixels of a frame, in RGBA. This is always the
+    /// current frame except while `compose` is used to read another.
+    canvas: []u8,
+    canvas_frame: u32 = 1,
+
+    /// Incremented every time the canvas changes. The renderer compares
+    /// this to the value it last uploaded.
+    generation: u64 = 1,
+
+    /// The region of the canvas that changed since `takeDirty` was last
+    /// called, if any.
+    dirty: ?Region = null,
+
+    /// The total size of all delta data.
+    delta_bytes: usize = 0,
+
+    pub const State = enum {
+        /// The current frame is displayed until changed.
+        stopped,
+
+        /// Play the frames, but stop at the last frame (rather than
+        /// loop) until more frames are transmitted.
+        loading,
+
+        /// Play and loop over the frames.
+        running,
+    };
+
+    pub const Error = Allocator.Error || error{InvalidData};
+
+    /// Make the image animated. This converts the image data to RGBA and
+    /// takes ownership of it since the root frame can be modified.
+    pub fn create(alloc: Allocator, img: *Image) Allocator.Error!*Animation {
+        assert(img.animation == null);
+
+        const root = try toRgba(alloc, img.data, img.format);
+        errdefer alloc.free(root);
+        const canvas = try alloc.dupe(u8, root);
+        errdefer alloc.free(canvas);
+
+        const anim = try alloc.create(Animation);
+        errdefer alloc.destroy(anim);
+        anim.* = .{
+            .width = img.width,
+            .height = img.height,
+            .root = root,
+            .canvas = canvas,
+        };
+        try anim.chain.ensureTotalCapacity(alloc, 1);
+
+        // The image now holds the RGBA data instead.
+        img.deinit(alloc);
+        img.data = root;
+        img.format = .rgba;
+        img.animation = anim;
+        return anim;
+    }
+
+    /// Destroy the animation. This doesn't free the root frame, which
+    /// belongs to the image.
+    pub fn destroy(self: *Animation, alloc: Allocator) void {
+        for (self.frames.items) |*f| f.deinit(alloc);
+        self.frames.deinit(alloc);
+        self.chain.deinit(alloc);
+        alloc.free(self.canvas);
+        alloc.destroy(self);
+    }
+
+    /// The memory used by the animation, not including the root frame.
+    pub fn byteSize(self: *const Animation) usize {
+        return self.canvas.len + self.delta_bytes;
+    }
+
+    /// The number of frames, including the root frame.
+    pub fn frameCount(self: *const Animation) u32 {
+        return @intCast(self.frames.items.len + 1);
+    }
+
+    /// The time in milliseconds to display a frame. Zero means the
+    /// default and negative means the frame is gapless: it is skipped
+    /// during playback but other frames can be drawn on top of it.
+    pub fn gap(self: *const Animation, frame: u32) i32 {
+        const v = if (frame == 1) self.root_gap_ms else self.frames.items[frame - 2].gap_ms;
+        return if (v == 0) default_gap_ms else v;
+    }
+
+    /// Set the gap of a frame, see `gap`.
+    pub fn setGap(self: *Animation, frame: u32, gap_ms: i32) void {
+        assert(frame >= 1 and frame <= self.frameCount());
+        if (frame == 1) {
+            self.root_gap_ms = gap_ms;
+        } else {
+            self.frames.items[frame - 2].gap_ms = gap_ms;
+        }
+    }
+
+    /// Add a new frame drawn on top of `base` (or the background color
+    /// if `base` is zero) with the given pixels. This takes ownership of
+    /// the delta data, including on error. Returns the new frame number.
+    pub fn addFrame(
+        self: *Animation,
+        alloc: Allocator,
+        base: u32,
+        background: [4]u8,
+        gap_ms: i32,
+        delta: Delta,
+    ) Error!u32 {
+        errdefer alloc.free(delta.data);
+        if (base > self.frameCount()) return error.InvalidData;
+        if (!delta.region.within(self.width, self.height)) return error.InvalidData;
+
+        // We always have enough room to compose any frame.
+        try self.chain.ensureTotalCapacity(alloc, self.frames.items.len + 2);
+        try self.frames.ensureUnusedCapacity(alloc, 1);
+
+        var frame: Frame = .{
+            .base = base,
+            .background = background,
+            .gap_ms = gap_ms,
+        };
+        try frame.deltas.append(alloc, delta);
+        if (self.covers(delta)) frame.base = 0;
+
+        self.frames.appendAssumeCapacity(frame);
+        self.delta_bytes += delta.data.len;
+        return self.frameCount();
+    }
+
+    /// Draw pixels on top of an existing frame. This takes ownership of
+    /// the delta data, including on error.
+    pub fn editFrame(
+        self: *Animation,
+        alloc: Allocator,
+        frame: u32,
+        delta: Delta,
+    ) Error!void {
+        errdefer alloc.free(delta.data);
+        if (frame == 0 or frame > self.frameCount()) return error.InvalidData;
+        if (!delta.region.within(self.width, self.height)) return error.InvalidData;
+
+        // Frames drawn on top of this one must keep looking the same.
+        try self.detach(alloc, frame);
+
+        if (frame == 1) {
+            // The root frame is modified in place.
+            draw(self.root, self.width, delta);
+            alloc.free(delta.data);
+        } else {
+            const f = &self.frames.items[frame - 2];
+            try f.deltas.ensureUnusedCapacity(alloc, 1);
+
+            // If the new pixels replace the whole frame then we
+            // don't need anything we had before.
+            if (self.covers(delta)) {
+                for (f.deltas.items) |d| {
+                    self.delta_bytes -= d.data.len;
+                    alloc.free(d.data);
+                }
+                f.deltas.clearRetainingCapacity();
+                f.base = 0;
+            }
+
+            f.deltas.appendAssumeCapacity(delta);
+            self.delta_bytes += delta.data.len;
+        }
+
+        // If we're displaying this frame then draw the change.
+        if (self.canvas_frame == frame) {
+            draw(self.canvas, self.width, delta);
+            self.markDirty(delta.region);
+        }
+    }
+
+    /// Copy a region of one frame onto another frame (a=c). The regions
+    /// must be within the image and can't overlap if the frames are the
+    /// same.
+    pub fn composeFrames(
+        self: *Animation,
+        alloc: Allocator,
+        src_frame: u32,
+        src: Region,
+        dst_frame: u32,
+        dst: Region,
+        mode: CompositionMode,
+    ) Error!void {
+        assert(src.width == dst.width and src.height == dst.height);
+        if (src_frame == 0 or src_frame > self.frameCount()) return error.InvalidData;
+        if (!src.within(self.width, self.height)) return error.InvalidData;
+        if (!dst.within(self.width, self.height)) return error.InvalidData;
+        if (src_frame == dst_frame and src.intersects(dst)) return error.InvalidData;
+
+        const data = try alloc.alloc(u8, @as(usize, src.width) * src.height * 4);
+        errdefer alloc.free(data);
+
+        // Compose the source frame in our canvas to copy from it, then
+        // go back to the current frame.
+        self.compose(src_frame);
+        copyRegion(data, self.canvas, self.width, src);
+        self.compose(self.current);
+
+        try self.editFrame(alloc, dst_frame, .{
+            .region = dst,
+            .mode = mode,
+            .data = data,
+        });
+    }
+
+    /// Control playback (a=a).
+    pub fn setState(self: *Animation, state: State) void {
+        if (self.state == state) return;
+        self.state = state;
+        self.loop_count = 0;
+        self.current_time = null;
+    }
+
+    /// Display the given frame.
+    pub fn setCurrent(self: *Animation, frame: u32) error{InvalidData}!void {
+        if (frame == 0 or frame > self.frameCount()) return error.InvalidData;
+        self.show(frame);
+        self.current_time = null;
+    }
+
+    /// Advance the animation to the frame that should be displayed at
+    /// the given time. This returns the number of nanoseconds until the
+    /// frame should be advanced again, or null if the animation isn't
+    /// playing (i.e. it's stopped or waiting for more frames).
+    pub fn advance(self: *Animation, now: std.time.Instant) ?u64 {
+        if (self.state == .stopped) return null;
+        if (self.frameCount() < 2) return null;
+
+        // Timing starts when a running animation is first displayed.
+        const start = self.current_time orelse {
+            self.current_time = now;
+            return self.remaining(0);
+        };
+
+        const left = self.remaining(now.since(start));
+        if (left > 0) return left;
+
+        // Move to the next frame that isn't gapless. If every frame is
+        // gapless there is nothing to show so we give up.
+        var next = self.current;
+        for (0..self.frameCount()) |_| {
+            if (next == self.frameCount()) {
+                switch (self.state) {
+                    .stopped => unreachable,
+
+                    // Wait for more frames.
+                    .loading => break,
+
+                    .running => {
+                        if (self.loops > 0) {
+                            self.loop_count += 1;
+                            if (self.loop_count >= self.loops) {
+                                self.state = .stopped;
+                                break;
+                            }
+                        }
+                        next = 1;
+                    },
+                }
+            } else next += 1;
+
+            if (self.gap(next) >= 0) break;
+        } else {
+            log.warn("animation has only gapless frames, stopping", .{});
+            self.state = .stopped;
+        }
+
+        self.show(next);
+        self.current_time = now;
+        if (self.state == .stopped) return null;
+        if (self.state == .loading and next == self.frameCount()) return null;
+        return self.remaining(0);
+    }
+
+    /// The nanoseconds left to display the current frame after it was
+    /// displayed for `elapsed` nanoseconds.
+    fn remaining(self: *const Animation, elapsed: u64) u64 {
+        const gap_ms = self.gap(self.current);
+        if (gap_ms < 0) return 0;
+        const gap_ns = @as(u64, @intCast(gap_ms)) * std.time.ns_per_ms;
+        return gap_ns -| elapsed;
+    }
+
+    /// Returns the region of the canvas that changed since the last
+    /// call and resets it.
+    pub fn takeDirty(self: *Animation) ?Region {
+        defer self.dirty = null;
+        return self.dirty;
+    }
+
+    fn markDirty(self: *Animation, region: Region) void {
+        self.generation +%= 1;
+        self.dirty = if (self.dirty) |d| d.merge(region) else region;
+    }
+
+    /// Returns true if the delta replaces every pixel of a frame.
+    fn covers(self: *const Animation, delta: Delta) bool {
+        return delta.mode == .overwrite and
+            delta.region.width == self.width and
+            delta.region.height == self.height;
+    }
+
+    /// Make every frame drawn directly on top of the given frame a
+    /// complete frame so that the given frame can be modified. This is
+    /// uncommon: clients typically draw new frames instead.
+    fn detach(self: *Animation, alloc: Allocator, frame: u32) Allocator.Error!void {
+        const full: Region = .{ .width = self.width, .height = self.height };
+        defer self.compose(self.current);
+        for (self.frames.items, 2..) |*f, i| {
+            if (f.base != frame) continue;
+
+            // Draw this frame and keep the result as its only delta.
+            const data = try alloc.alloc(u8, self.canvas.len);
+            errdefer alloc.free(data);
+            try f.deltas.ensureTotalCapacity(alloc, 1);
+            self.compose(@intCast(i));
+            @memcpy(data, self.canvas);
+
+            for (f.deltas.items) |d| self.delta_bytes -= d.data.len;
+            for (f.deltas.items) |d| alloc.free(d.data);
+            f.deltas.clearRetainingCapacity();
+            f.deltas.appendAssumeCapacity(.{
+                .region = full,
+                .mode = .overwrite,
+                .data = data,
+            });
+            f.base = 0;
+            self.delta_bytes += data.len;
+        }
+    }
+
+    /// Make a frame the current frame.
+    fn show(self: *Animation, frame: u32) void {
+        self.compose(frame);
+        self.current = frame;
+    }
+
+    /// Compose a frame into the canvas. If the canvas has a frame this
+    /// one is drawn on top of, only the frames after it are drawn. For
+    /// the common case of each frame drawn on top of the previous one,
+    /// moving to the next frame only draws its changes.
+    fn compose(self: *Animation, frame: u32) void {
+        const full: Region = .{ .width = self.width, .height = self.height };
+
+        // Find the frames to draw, from the last to the first.
+        self.chain.clearRetainingCapacity();
+        var i = frame;
+        while (i != self.canvas_frame) {
+            self.chain.appendAssumeCapacity(i);
+            if (i == 1) break;
+            i = self.frames.items[i - 2].base;
+            if (i == 0) break;
+        }
+
+        var it = std.mem.reverseIterator(self.chain.items);
+        while (it.next()) |n| {
+            if (n == 1) {
+                @memcpy(self.canvas, self.root);
+                self.markDirty(full);
+                continue;
+            }
+
+            const f = &self.frames.items[n - 2];
+            if (f.base == 0) {
+                fill(self.canvas, f.background);
+                self.markDirty(full);
+            }
+            for (f.deltas.items) |d| {
+                draw(self.canvas, self.width, d);
+                self.markDirty(d.region);
+            }
+        }
+
+        self.canvas_frame = frame;
+    }
+};
+
+/// Convert image data to RGBA. The result is always a new allocation.
+pub fn toRgba(
+    alloc: Allocator,
+    data: []const u8,
+    format: command.Transmission.Format,
+) Allocator.Error![]u8 {
+    const bpp: usize = format.bpp();
+    const result = try alloc.alloc(u8, data.len / bpp * 4);
+    for (0..result.len / 4) |i| {
+        const src = data[i * bpp ..][0..bpp];
+        result[i * 4 ..][0..4].* = switch (format) {
+            .gray => .{ src[0], src[0], src[0], 255 },
+            .gray_alpha => .{ src[0], src[0], src[0], src[1] },
+            .rgb => .{ src[0], src[1], src[2], 255 },
+            .rgba => src[0..4].*,
+            .png => unreachable, // decoded by now
+        };
+    }
+    return result;
+}
+
+/// Fill RGBA pixels with a color.
+fn fill(pixels: []u8, color: [4]u8) void {
+    const px = std.mem.bytesAsSlice([4]u8, pixels);
+    @memset(px, color);
+}
+
+/// Draw the delta on top of an RGBA canvas of the given width.
+fn draw(canvas: []u8, width: u32, delta: Delta) void {
+    const r = delta.region;
+    const row_len = @as(usize, r.width) * 4;
+    for (0..r.height) |y| {
+        const dst = canvas[((r.y + y) * width + r.x) * 4 ..][0..row_len];
+        const src = delta.data[y * row_len ..][0..row_len];
+        switch (delta.mode) {
+            .overwrite => @memcpy(dst, src),
+            .alpha_blend => for (
+                std.mem.bytesAsSlice([4]u8, dst),
+                std.mem.bytesAsSlice([4]u8, src),
+            ) |*d, s| blend(d, s),
+        }
+    }
+}
+
+/// Copy a region of an RGBA canvas of the given width.
+fn copyRegion(dst: []u8, canvas: []const u8, width: u32, r: Region) void {
+    const row_len = @as(usize, r.width) * 4;
+    for (0..r.height) |y| {
+        @memcpy(
+            dst[y * row_len ..][0..row_len],
+            canvas[((r.y + y) * width + r.x) * 4 ..][0..row_len],
+        );
+    }
+}
+
+/// Draw a pixel on top of another (the "over" operator) with straight,
+/// not premultiplied, alpha.
+fn blend(dst: *[4]u8, src: [4]u8) void {
+    const sa: u32 = src[3];
+    if (sa == 255) {
+        dst.* = src;
+        return;
+    }
+    if (sa == 0) return;
+
+    // Both of these are scaled by 255 * 255.
+    const src_w = sa * 255;
+    const dst_w = @as(u32, dst[3]) * (255 - sa);
+    const total = src_w + dst_w;
+    for (0..3) |i| {
+        const v = @as(u32, src[i]) * src_w + @as(u32, dst[i]) * dst_w;
+        dst[i] = @intCast((v + total / 2) / total);
+    }
+    dst[3] = @intCast((total + 127) / 255);
+}
+
+fn testImage(alloc: Allocator, width: u32, height: u32, color: [4]u8) !Image {
+    const data = try alloc.alloc(u8, @as(usize, width) * height * 4);
+    fill(data, color);
+    return .{
+        .id = 1,
+        .width = width,
+        .height = height,
+        .format = .rgba,
+        .data = data,
+    };
+}
+
+fn testDelta(alloc: Allocator, region: Region, color: [4]u8) !Delta {
+    const data = try alloc.alloc(u8, @as(usize, region.width) * region.height * 4);
+    fill(data, color);
+    return .{ .region = region, .mode = .overwrite, .data = data };
+}
+
+fn testPixel(anim: *const Animation, x: u32, y: u32) [4]u8 {
+    return anim.canvas[(y * anim.width + x) * 4 ..][0..4].*;
+}
+
+test "animation: frames are drawn on top of their base" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var img = try testImage(alloc, 4, 4, .{ 255, 0, 0, 255 });
+    defer img.deinit(alloc);
+    const anim = try Animation.create(alloc, &img);
+
+    // Frame 2 is frame 1 with a green pixel, frame 3 is frame 2 with
+    // a blue pixel.
+    const green: [4]u8 = .{ 0, 255, 0, 255 };
+    const blue: [4]u8 = .{ 0, 0, 255, 255 };
+    try testing.expectEqual(2, try anim.addFrame(alloc, 1, @splat(0), 0, try testDelta(
+        alloc,
+        .{ .x = 1, .y = 1, .width = 1, .height = 1 },
+        green,
+    )));
+    try testing.expectEqual(3, try anim.addFrame(alloc, 2, @splat(0), 0, try testDelta(
+        alloc,
+        .{ .x = 2, .y = 2, .width = 1, .height = 1 },
+        blue,
+    )));
+
+    // Moving to the next frame only draws its changes.
+    try anim.setCurrent(2);
+    _ = anim.takeDirty();
+    try anim.setCurrent(3);
+    try testing.expectEqual(Region{ .x = 2, .y = 2, .width = 1, .height = 1 }, anim.takeDirty().?);
+    try testing.expectEqual(green, testPixel(anim, 1, 1));
+    try testing.expectEqual(blue, testPixel(anim, 2, 2));
+    try testing.expectEqual([4]u8{ 255, 0, 0, 255 }, testPixel(anim, 0, 0));
+
+    // Going back to the root redraws everything.
+    try anim.setCurrent(1);
+    try testing.expectEqual(Region{ .width = 4, .height = 4 }, anim.takeDirty().?);
+    try testing.expectEqual([4]u8{ 255, 0, 0, 255 }, testPixel(anim, 1, 1));
+}
+
+test "animation: editing a base frame doesn't change frames on top of it" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var img = try testImage(alloc, 2, 2, .{ 255, 0, 0, 255 });
+    defer img.deinit(alloc);
+    const anim = try Animation.create(alloc, &img);
+
+    const green: [4]u8 = .{ 0, 255, 0, 255 };
+    _ = try anim.addFrame(alloc, 1, @splat(0), 0, try testDelta(
+        alloc,
+        .{ .width = 1, .height = 1 },
+        green,
+    ));
+
+    // Paint the root frame white.
+    try anim.editFrame(alloc, 1, try testDelta(alloc, .{ .width = 2, .height = 2 }, @splat(255)));
+    try testing.expectEqual([4]u8{ 255, 255, 255, 255 }, testPixel(anim, 1, 1));
+
+    try anim.setCurrent(2);
+    try testing.expectEqual(green, testPixel(anim, 0, 0));
+    try testing.expectEqual([4]u8{ 255, 0, 0, 255 }, testPixel(anim, 1, 1));
+}
+
+test "animation: compose frames" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var img = try testImage(alloc, 2, 1, .{ 255, 0, 0, 255 });
+    defer img.deinit(alloc);
+    const anim = try Animation.create(alloc, &img);
+    _ = try anim.addFrame(alloc, 0, .{ 0, 0, 255, 255 }, 0, try testDelta(
+        alloc,
+        .{ .width = 0, .height = 0 },
+        @splat(0),
+    ));
+
+    // Copy the left pixel of frame 1 to the right pixel of frame 2.
+    try anim.composeFrames(
+        alloc,
+        1,
+        .{ .width = 1, .height = 1 },
+        2,
+        .{ .x = 1, .width = 1, .height = 1 },
+        .overwrite,
+    );
+    try testing.expectEqual(1, anim.current);
+
+    try anim.setCurrent(2);
+    try testing.expectEqual([4]u8{ 0, 0, 255, 255 }, testPixel(anim, 0, 0));
+    try testing.expectEqual([4]u8{ 255, 0, 0, 255 }, testPixel(anim, 1, 0));
+
+    // Overlapping regions of the same frame are invalid.
+    try testing.expectError(error.InvalidData, anim.composeFrames(
+        alloc,
+        2,
+        .{ .width = 1, .height = 1 },
+        2,
+        .{ .width = 1, .height = 1 },
+        .overwrite,
+    ));
+}
+
+test "animation: advance" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var img = try testImage(alloc, 1, 1, @splat(0));
+    defer img.deinit(alloc);
+    const anim = try Animation.create(alloc, &img);
+    _ = try anim.addFrame(alloc, 1, @splat(0), 10, try testDelta(
+        alloc,
+        .{ .width = 1, .height = 1 },
+        @splat(255),
+    ));
+    anim.loops = 1;
+
+    // Stopped animations don't advance.
+    const start = try std.time.Instant.now();
+    try testing.expectEqual(null, anim.advance(start));
+
+    anim.setState(.running);
+    try testing.expectEqual(default_gap_ms * std.time.ns_per_ms, anim.advance(start).?);
+    try testing.expectEqual(1, anim.current);
+
+    // Once the root frame's gap passed we move on, and only loop once.
+    var later = start;
+    later.timestamp = addNs(start.timestamp, default_gap_ms * std.time.ns_per_ms);
+    try testing.expectEqual(10 * std.time.ns_per_ms, anim.advance(later).?);
+    try testing.expectEqual(2, anim.current);
+    later.timestamp = addNs(later.timestamp, 10 * std.time.ns_per_ms);
+    try testing.expectEqual(null, anim.advance(later));
+    try testing.expectEqual(.stopped, anim.state);
+}
+
+/// Add nanoseconds to an Instant timestamp, for tests.
+fn addNs(timestamp: anytype, ns: u64) @TypeOf(timestamp) {
+    return switch (@TypeOf(timestamp)) {
+        u64 => timestamp + ns,
+        std.posix.timespec => ts: {
+            const total = @as(u64, @intCast(timestamp.nsec)) + ns;
+            break :ts .{
+                .sec = timestamp.sec + @as(@TypeOf(timestamp.sec), @intCast(total / std.time.ns_per_s)),
+                .nsec = @intCast(total % std.time.ns_per_s),
+            };
+        },
+        else => @compileError("unsupported timestamp"),
+    };
+}
@@ -175,7 +175,10 @@ pub const Parser = struct {
             } },
             'p' => .{ .display = try .parse(self.kv) },
             'd' => .{ .delete = try .parse(self.kv) },
-            'f' => .{ .transmit_animation_frame = try .parse(self.kv) },
+            'f' => .{ .transmit_animation_frame = .{
+                .transmission = try .parse(self.kv),
+                .frame = try .parse(self.kv),
+            } },
             'a' => .{ .control_animation = try .parse(self.kv) },
             'c' => .{ .compose_animation = try .parse(self.kv) },
             else => return error.InvalidFormat,
@@ -344,7 +347,10 @@ pub const Command = struct {
         },
         display: Display,
         delete: Delete,
-        transmit_animation_frame: AnimationFrameLoading,
+        transmit_animation_frame: struct {
+            transmission: Transmission,
+            frame: AnimationFrameLoading,
+        },
         control_animation: AnimationControl,
         compose_animation: AnimationFrameComposition,
     };
@@ -363,6 +369,7 @@ pub const Command = struct {
             .query => |t| t,
             .transmit => |t| t,
             .transmit_and_display => |t| t.transmission,
+            .transmit_animation_frame => |t| t.transmission,
             else => null,
         };
     }
@@ -676,6 +683,8 @@ pub const AnimationFrameLoading = struct {
 };
 
 pub const AnimationFrameComposition = struct {
+    image_id: u32 = 0, // i
+    image_number: u32 = 0, // I
     frame: u32 = 0, // c
     edit_frame: u32 = 0, // r
     x: u32 = 0, // x
@@ -689,6 +698,14 @@ pub const AnimationFrameComposition = struct {
     fn parse(kv: KV) !AnimationFrameComposition {
         var result: AnimationFrameComposition = .{};
 
+        if (kv.get('i')) |v| {
+            result.image_id = v;
+        }
+
+        if (kv.get('I')) |v| {
+            result.image_number = v;
+        }
+
         if (kv.get('c')) |v| {
             result.frame = v;
         }
@@ -734,6 +751,8 @@ pub const AnimationFrameComposition = struct {
 };
 
 pub const AnimationControl = struct {
+    image_id: u32 = 0, // i
+    image_number: u32 = 0, // I
     action: AnimationAction = .invalid, // s
     frame: u32 = 0, // r
     gap_ms: u32 = 0, // z
@@ -750,6 +769,14 @@ pub const AnimationControl = struct {
     fn parse(kv: KV) !AnimationControl {
         var result: AnimationControl = .{};
 
+        if (kv.get('i')) |v| {
+            result.image_id = v;
+        }
+
+        if (kv.get('I')) |v| {
+            result.image_number = v;
+        }
+
         if (kv.get('s')) |v| {
             result.action = switch (v) {
                 0 => .invalid,
@@ -1071,6 +1098,50 @@ test "delete command" {
     try testing.expectEqual(@as(u32, 4), dv.y);
 }
 
+test "animation frame command" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+    var p = Parser.init(alloc);
+    defer p.deinit();
+
+    const input = "a=f,f=24,i=7,s=2,v=1,x=3,y=4,c=1,z=-1,X=1;AAAAAAAA";
+    for (input) |c| try p.feed(c);
+    const command = try p.complete();
+    defer command.deinit(alloc);
+
+    try testing.expect(command.control == .transmit_animation_frame);
+    const v = command.control.transmit_animation_frame;
+    try testing.expectEqual(Transmission.Format.rgb, v.transmission.format);
+    try testing.expectEqual(@as(u32, 7), v.transmission.image_id);
+    try testing.expectEqual(@as(u32, 2), v.transmission.width);
+    try testing.expectEqual(@as(u32, 1), v.transmission.height);
+    try testing.expectEqual(@as(u32, 3), v.frame.x);
+    try testing.expectEqual(@as(u32, 4), v.frame.y);
+    try testing.expectEqual(@as(u32, 1), v.frame.create_frame);
+    try testing.expectEqual(@as(i32, -1), @as(i32, @bitCast(v.frame.gap_ms)));
+    try testing.expectEqual(CompositionMode.overwrite, v.frame.composition_mode);
+    try testing.expectEqual(v.transmission, command.transmission().?);
+}
+
+test "animation control command" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+    var p = Parser.init(alloc);
+    defer p.deinit();
+
+    const input = "a=a,i=7,s=3,v=1,c=2";
+    for (input) |c| try p.feed(c);
+    const command = try p.complete();
+    defer command.deinit(alloc);
+
+    try testing.expect(command.control == .control_animation);
+    const v = command.control.control_animation;
+    try testing.expectEqual(@as(u32, 7), v.image_id);
+    try testing.expectEqual(AnimationControl.AnimationAction.run, v.action);
+    try testing.expectEqual(@as(u32, 1), v.loops);
+    try testing.expectEqual(@as(u32, 2), v.current_frame);
+}
+
 test "no control data" {
     const testing = std.testing;
     const alloc = testing.allocator;
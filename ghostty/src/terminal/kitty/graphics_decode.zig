@@ -0,0 +1,77 @@
+//! Decoding images off the thread that parses terminal output.
+//!
+//! Decompressing and decoding (i.e. PNG) a transmitted image can take a
+//! long time for large images, and commands are executed while holding
+//! the terminal lock. If the terminal has a `Decoder`, transmissions that
+//! need decoding and whose dimensions are known up front are added to the
+//! image storage as pending images (see `Image.pending`) and decoded with
+//! a `Job` instead. Placements for pending images work as usual, they're
+//! just not drawn until the image is complete.
+//!
+//! Once the job is decoded, the owner of the terminal must call
+//! `Terminal.kittyGraphicsDecoded` with the terminal locked to finish
+//! the image, and then send the response it returns (if any).
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const command = @import("graphics_command.zig");
+const image = @import("graphics_image.zig");
+const LoadingImage = image.LoadingImage;
+
+/// Something that can decode jobs, typically on a pool of threads.
+pub const Decoder = struct {
+    ptr: *anyopaque,
+
+    /// Queue the job to be decoded. This takes ownership of the job.
+    /// This is called with the terminal locked so it must not block.
+    queueFn: *const fn (ptr: *anyopaque, job: *Job) void,
+
+    pub fn queue(self: Decoder, job: *Job) void {
+        self.queueFn(self.ptr, job);
+    }
+};
+
+/// A transmitted image waiting to be decoded.
+pub const Job = struct {
+    /// The image being decoded, with all of its data.
+    loading: LoadingImage,
+
+    /// The response to the transmission, as it would be if the decode
+    /// succeeds. This includes the result of displaying the image if
+    /// the command also displayed it.
+    response: command.Response,
+
+    /// The quiet setting of the transmission.
+    quiet: command.Command.Quiet,
+
+    /// The result of `decode`.
+    result: DecodeError!void = {},
+
+    pub const DecodeError = image.Image.Error || Allocator.Error;
+
+    pub fn create(
+        alloc: Allocator,
+        loading: LoadingImage,
+        response: command.Response,
+        quiet: command.Command.Quiet,
+    ) Allocator.Error!*Job {
+        const job = try alloc.create(Job);
+        job.* = .{
+            .loading = loading,
+            .response = response,
+            .quiet = quiet,
+        };
+        return job;
+    }
+
+    pub fn destroy(self: *Job, alloc: Allocator) void {
+        self.loading.deinit(alloc);
+        alloc.destroy(self);
+    }
+
+    /// Decode the image. This doesn't access the terminal so it's
+    /// safe to call from any thread.
+    pub fn decode(self: *Job, alloc: Allocator) void {
+        self.result = self.loading.decode(alloc);
+    }
+};
@@ -7,11 +7,15 @@ const point = @import("../point.zig");
 const Terminal = @import("../Terminal.zig");
 const command = @import("graphics_command.zig");
 const image = @import("graphics_image.zig");
+const animation = @import("graphics_animation.zig");
+const Animation = animation.Animation;
+const DecodeJob = @import("graphics_decode.zig").Job;
 const Command = command.Command;
 const Response = command.Response;
 const LoadingImage = image.LoadingImage;
 const Image = image.Image;
 const ImageStorage = @import("graphics_storage.zig").ImageStorage;
+const Screen = @import("../Screen.zig");
 
 const log = std.log.scoped(.kitty_gfx);
 
@@ -50,7 +54,7 @@ pub fn execute(
         .display => display(alloc, terminal, cmd),
         .delete => delete(alloc, terminal, cmd),
 
-        .transmit, .transmit_and_display => resp: {
+        .transmit, .transmit_and_display, .transmit_animation_frame => resp: {
             // If we're transmitting, then our `q` setting value is complicated.
             // The `q` setting inherits the value from the starting command
             // unless `q` is set >= 1 on this command. If it is, then we save
@@ -67,29 +71,106 @@ pub fn execute(
                 },
             };
 
-            break :resp transmit(alloc, terminal, cmd);
+            // Chunks after the first don't say whether they're for an
+            // image or a frame, the first chunk does.
+            const frame = if (storage.loading) |loading|
+                loading.frame != null
+            else
+                cmd.control == .transmit_animation_frame;
+            if (frame) break :resp transmitFrame(alloc, terminal, cmd);
+
+            break :resp transmit(alloc, terminal, cmd, quiet);
         },
 
-        .transmit_animation_frame,
-        .control_animation,
-        .compose_animation,
-        => .{ .message = "ERROR: unimplemented action" },
+        .control_animation => |c| controlAnimation(
+            alloc,
+            &terminal.screen.kitty_images,
+            c,
+        ),
+        .compose_animation => |c| composeAnimation(
+            alloc,
+            &terminal.screen.kitty_images,
+            c,
+        ),
     };
 
-    // Handle the quiet settings
-    if (resp_) |resp| {
-        if (!resp.ok()) {
-            log.warn("erroneous kitty graphics response: {s}", .{resp.message});
-        }
+    return quietResponse(quiet, resp_ orelse return null);
+}
 
-        return switch (quiet) {
-            .no => if (resp.empty()) null else resp,
-            .ok => if (resp.ok()) null else resp,
-            .failures => null,
+/// Finish an image that was decoded off-thread (see graphics_decode.zig).
+/// This returns the response to the transmission, which is sent as if
+/// it had been returned by `execute` for the transmission command.
+///
+/// This takes ownership of the job and destroys it.
+pub fn decoded(
+    alloc: Allocator,
+    terminal: *Terminal,
+    job: *DecodeJob,
+) ?Response {
+    defer job.destroy(alloc);
+
+    // Find the pending image. It may have been deleted or replaced while
+    // it was being decoded, in which case there is nothing to do. It may
+    // also have moved to the other screen if the screens were switched.
+    const id = job.loading.image.id;
+    const screen: *Screen = screen: for ([_]*Screen{
+        &terminal.screen,
+        &terminal.secondary_screen,
+    }) |s| {
+        const img = s.kitty_images.imageById(id) orelse continue;
+        if (img.pending == job) break :screen s;
+    } else {
+        log.debug("decoded image no longer pending id={}", .{id});
+        terminal.screen.kitty_images.discardDeferred(alloc, job);
+        terminal.secondary_screen.kitty_images.discardDeferred(alloc, job);
+        return null;
+    };
+    const storage = &screen.kitty_images;
+
+    var result = job.response;
+    finish: {
+        job.result catch |err| {
+            encodeError(&result, err);
+            break :finish;
+        };
+
+        // Validate the decoded image and replace the pending one.
+        var img = job.loading.complete(alloc) catch |err| {
+            encodeError(&result, err);
+            break :finish;
         };
+        storage.addImage(alloc, img) catch |err| {
+            img.deinit(alloc);
+            encodeError(&result, err);
+            break :finish;
+        };
+
+        // Now the image has data, animate it.
+        replayDeferred(alloc, storage, job);
+
+        // If the image was assigned its ID automatically,
+        // not based on a number or explicit ID, we don't respond.
+        if (img.implicit_id) return null;
+        return quietResponse(job.quiet, result);
     }
 
-    return null;
+    // The image failed to load so remove it and its placements.
+    storage.discardDeferred(alloc, job);
+    storage.deleteById(alloc, screen, id, 0, true);
+    return quietResponse(job.quiet, result);
+}
+
+/// Apply the quiet setting of a command to its response.
+fn quietResponse(quiet: Command.Quiet, resp: Response) ?Response {
+    if (!resp.ok()) {
+        log.warn("erroneous kitty graphics response: {s}", .{resp.message});
+    }
+
+    return switch (quiet) {
+        .no => if (resp.empty()) null else resp,
+        .ok => if (resp.ok()) null else resp,
+        .failures => null,
+    };
 }
 /// Execute a "query" command.
 ///
@@ -131,6 +212,7 @@ fn transmit(
     alloc: Allocator,
     terminal: *Terminal,
     cmd: *const Command,
+    quiet: Command.Quiet,
 ) Response {
     const t = cmd.transmission().?;
     var result: Response = .{
@@ -164,6 +246,15 @@ fn transmit(
     // If there are more chunks expected we do not respond.
     if (load.more) return .{};
 
+    // If the image is being decoded, we respond once it's done.
+    if (load.job) |job| {
+        job.response = result;
+        job.response.id = load.image.id;
+        job.quiet = quiet;
+        terminal.kitty_decoder.?.queue(job);
+        return .{};
+    }
+
     // If the loaded image was assigned its ID automatically, not based
     // on a number or explicitly specified ID, then we don't respond.
     if (load.image.implicit_id) return .{};
@@ -294,6 +385,365 @@ fn delete(
     return .{};
 }
 
+/// Transmit an animation frame for a previously transmitted image, or
+/// draw on top of an existing frame.
+fn transmitFrame(
+    alloc: Allocator,
+    terminal: *Terminal,
+    cmd: *const Command,
+) Response {
+    const t = cmd.transmission().?;
+    const storage = &terminal.screen.kitty_images;
+
+    // Load the frame data. This is chunked the same way as images.
+    const loading: LoadingImage = loading: {
+        if (storage.loading) |ptr| {
+            ptr.addData(alloc, cmd.data) catch |err| {
+                var result: Response = .{
+                    .id = ptr.image.id,
+                    .image_number = ptr.image.number,
+                };
+                encodeError(&result, err);
+                return result;
+            };
+            if (t.more_chunks) return .{};
+
+            defer {
+                alloc.destroy(ptr);
+                storage.loading = null;
+            }
+            break :loading ptr.*;
+        }
+
+        var first = LoadingImage.init(alloc, cmd) catch |err| {
+            var result: Response = .{
+                .id = t.image_id,
+                .image_number = t.image_number,
+            };
+            encodeError(&result, err);
+            return result;
+        };
+        if (t.more_chunks) {
+            const ptr = alloc.create(LoadingImage) catch |err| {
+                first.deinit(alloc);
+                var result: Response = .{
+                    .id = t.image_id,
+                    .image_number = t.image_number,
+                };
+                encodeError(&result, err);
+                return result;
+            };
+            ptr.* = first;
+            storage.loading = ptr;
+            return .{};
+        }
+        break :loading first;
+    };
+    return addFrame(alloc, storage, loading);
+}
+
+/// Add a fully loaded frame (see transmitFrame) to its image. This takes
+/// ownership of the loading frame.
+fn addFrame(
+    alloc: Allocator,
+    storage: *ImageStorage,
+    loading_: LoadingImage,
+) Response {
+    var loading = loading_;
+    var deferred = false;
+    defer if (!deferred) loading.deinit(alloc);
+    const frame = loading.frame.?;
+
+    var result: Response = .{
+        .id = loading.image.id,
+        .image_number = loading.image.number,
+    };
+    const img = switch (animatedImage(alloc, storage, &result)) {
+        .image => |img| img,
+        .failed => return result,
+        .pending => |job| {
+            // The image number may refer to another image by the time
+            // we replay this, so we keep the image we found.
+            loading.image.id = result.id;
+            loading.image.number = 0;
+            storage.deferCommand(alloc, job, .{ .frame = loading }) catch |err| {
+                encodeError(&result, err);
+                return result;
+            };
+            deferred = true;
+            return result;
+        },
+    };
+    const anim = img.animation.?;
+    const old_size = img.byteSize();
+    defer storage.resized(old_size, img.byteSize());
+
+    // Raw frame data is the size of the image unless specified.
+    if (loading.image.format != .png) {
+        if (loading.image.width == 0) loading.image.width = img.width;
+        if (loading.image.height == 0) loading.image.height = img.height;
+    }
+
+    var data = loading.complete(alloc) catch |err| {
+        encodeError(&result, err);
+        return result;
+    };
+    defer data.deinit(alloc);
+
+    const pixels = animation.toRgba(alloc, data.data, data.format) catch |err| {
+        encodeError(&result, err);
+        return result;
+    };
+    if (storage.total_bytes + pixels.len > storage.total_limit) {
+        alloc.free(pixels);
+        result.message = "ENOSPC: not enough storage for frame";
+        return result;
+    }
+
+    // The animation takes ownership of the pixels.
+    const delta: animation.Delta = .{
+        .region = .{
+            .x = frame.x,
+            .y = frame.y,
+            .width = data.width,
+            .height = data.height,
+        },
+        .mode = frame.composition_mode,
+        .data = pixels,
+    };
+    const gap_ms: i32 = @bitCast(frame.gap_ms);
+    if (frame.edit_frame > 0) {
+        anim.editFrame(alloc, frame.edit_frame, delta) catch |err| {
+            encodeError(&result, err);
+            return result;
+        };
+        if (gap_ms != 0) anim.setGap(frame.edit_frame, gap_ms);
+    } else {
+        // The background color is 0xRRGGBBAA.
+        const bg: u32 = @bitCast(frame.background);
+        _ = anim.addFrame(
+            alloc,
+            frame.create_frame,
+            std.mem.toBytes(std.mem.nativeToBig(u32, bg)),
+            gap_ms,
+            delta,
+        ) catch |err| {
+            encodeError(&result, err);
+            return result;
+        };
+    }
+
+    return result;
+}
+
+/// Control the playback of an animation.
+fn controlAnimation(
+    alloc: Allocator,
+    storage: *ImageStorage,
+    c: command.AnimationControl,
+) Response {
+    var result: Response = .{
+        .id = c.image_id,
+        .image_number = c.image_number,
+    };
+    const img = switch (animatedImage(alloc, storage, &result)) {
+        .image => |img| img,
+        .failed => return result,
+        .pending => |job| {
+            var copy = c;
+            copy.image_id = result.id;
+            copy.image_number = 0;
+            storage.deferCommand(alloc, job, .{ .control = copy }) catch |err| {
+                encodeError(&result, err);
+                return result;
+            };
+            return .{};
+        },
+    };
+    const anim = img.animation.?;
+    const old_size = img.byteSize();
+    defer storage.resized(old_size, img.byteSize());
+
+    if (c.frame > 0 and c.gap_ms != 0) {
+        if (c.frame > anim.frameCount()) {
+            result.message = "ENOENT: frame not found";
+            return result;
+        }
+        anim.setGap(c.frame, @bitCast(c.gap_ms));
+    }
+
+    if (c.current_frame > 0) anim.setCurrent(c.current_frame) catch {
+        result.message = "ENOENT: frame not found";
+        return result;
+    };
+
+    // One means loop forever, otherwise this is one more than
+    // the number of loops.
+    if (c.loops > 0) anim.loops = c.loops - 1;
+
+    switch (c.action) {
+        .invalid => {},
+        .stop => anim.setState(.stopped),
+        .run_wait => anim.setState(.loading),
+        .run => anim.setState(.running),
+    }
+
+    // Animation control only responds on failure.
+    return .{};
+}
+
+/// Copy a region of one frame of an animation onto another frame.
+fn composeAnimation(
+    alloc: Allocator,
+    storage: *ImageStorage,
+    c: command.AnimationFrameComposition,
+) Response {
+    var result: Response = .{
+        .id = c.image_id,
+        .image_number = c.image_number,
+    };
+    const img = switch (animatedImage(alloc, storage, &result)) {
+        .image => |img| img,
+        .failed => return result,
+        .pending => |job| {
+            var copy = c;
+            copy.image_id = result.id;
+            copy.image_number = 0;
+            storage.deferCommand(alloc, job, .{ .compose = copy }) catch |err| {
+                encodeError(&result, err);
+                return result;
+            };
+            return .{};
+        },
+    };
+    const anim = img.animation.?;
+    const old_size = img.byteSize();
+    defer storage.resized(old_size, img.byteSize());
+
+    // The source is frame r at X/Y and the destination is frame c at x/y.
+    // Both must be within the image before we size the copy from them.
+    const width = if (c.width > 0) c.width else anim.width;
+    const height = if (c.height > 0) c.height else anim.height;
+    const src: animation.Region = .{
+        .x = c.left_edge,
+        .y = c.top_edge,
+        .width = width,
+        .height = height,
+    };
+    const dst: animation.Region = .{
+        .x = c.x,
+        .y = c.y,
+        .width = width,
+        .height = height,
+    };
+    if (!src.within(anim.width, anim.height) or !dst.within(anim.width, anim.height)) {
+        encodeError(&result, error.InvalidData);
+        return result;
+    }
+    if (storage.total_bytes + @as(usize, width) * height * 4 > storage.total_limit) {
+        result.message = "ENOSPC: not enough storage for frame";
+        return result;
+    }
+    anim.composeFrames(
+        alloc,
+        c.edit_frame,
+        src,
+        c.frame,
+        dst,
+        c.composition_mode,
+    ) catch |err| {
+        encodeError(&result, err);
+        return result;
+    };
+
+    // Composition only responds on failure.
+    return .{};
+}
+
+/// The result of `animatedImage`.
+const AnimatedImage = union(enum) {
+    /// The image, which is animated.
+    image: *Image,
+
+    /// The image is still being decoded so it has no data to animate yet.
+    /// The command must be deferred until the decode finishes, see
+    /// `ImageStorage.deferCommand`.
+    pending: *const DecodeJob,
+
+    /// The error is set in the response.
+    failed,
+};
+
+/// Find the image that an animation command is for and make it animated
+/// if it isn't already. This sets the ID of the image in the response.
+fn animatedImage(
+    alloc: Allocator,
+    storage: *ImageStorage,
+    result: *Response,
+) AnimatedImage {
+    if (result.id == 0 and result.image_number == 0) {
+        result.message = "EINVAL: image ID or number required";
+        return .failed;
+    }
+
+    const id = if (result.id > 0) result.id else id: {
+        const img = storage.imageByNumber(result.image_number) orelse break :id 0;
+        break :id img.id;
+    };
+    const img = storage.imagePtrById(id) orelse {
+        result.message = "ENOENT: image not found";
+        return .failed;
+    };
+    result.id = img.id;
+
+    if (img.pending) |job| return .{ .pending = job };
+
+    if (img.animation == null) {
+        // The image data is converted to RGBA and the animation keeps a
+        // canvas of the same size.
+        const old_size = img.byteSize();
+        const rgba_len = @as(usize, img.width) * img.height * 4;
+        if (storage.total_bytes + (rgba_len * 2 -| old_size) > storage.total_limit) {
+            result.message = "ENOSPC: not enough storage for animation";
+            return .failed;
+        }
+        _ = Animation.create(alloc, img) catch |err| {
+            encodeError(result, err);
+            return .failed;
+        };
+        storage.resized(old_size, img.byteSize());
+    }
+
+    return .{ .image = img };
+}
+
+/// Run the animation commands that were deferred while the image of the
+/// given job was decoded, in order. These commands were already answered
+/// as if they succeeded, so failures are only logged.
+fn replayDeferred(
+    alloc: Allocator,
+    storage: *ImageStorage,
+    job: *const DecodeJob,
+) void {
+    var i: usize = 0;
+    while (i < storage.deferred.items.len) {
+        if (storage.deferred.items[i].job != job) {
+            i += 1;
+            continue;
+        }
+
+        const d = storage.deferred.orderedRemove(i);
+        const resp = switch (d.op) {
+            .frame => |loading| addFrame(alloc, storage, loading),
+            .control => |c| controlAnimation(alloc, storage, c),
+            .compose => |c| composeAnimation(alloc, storage, c),
+        };
+        if (!resp.ok()) {
+            log.warn("deferred animation command failed: {s}", .{resp.message});
+        }
+    }
+}
+
 fn loadAndAddImage(
     alloc: Allocator,
     terminal: *Terminal,
@@ -302,6 +752,10 @@ fn loadAndAddImage(
     image: Image,
     more: bool = false,
     display: ?command.Display = null,
+
+    /// Set if the image is pending, see graphics_decode.zig. The caller
+    /// must queue this with the terminal decoder.
+    job: ?*DecodeJob = null,
 } {
     const t = cmd.transmission().?;
     const storage = &terminal.screen.kitty_images;
@@ -356,6 +810,31 @@ fn loadAndAddImage(
     // Dump the image data before it is decompressed
     // loading.debugDump() catch unreachable;
 
+    // If we can decode the image on another thread, add it as a pending
+    // image with the dimensions it will have. We need the dimensions now
+    // since placements and cursor movement depend on them.
+    if (terminal.kitty_decoder != null and loading.needsDecode()) pending: {
+        const dims = loading.dimensions() orelse break :pending;
+
+        var img = loading.image;
+        img.width = dims.width;
+        img.height = dims.height;
+        img.format = if (img.format == .png) .rgba else img.format;
+        img.compression = .none;
+        img.transmit_time = std.time.Instant.now() catch |err| {
+            log.warn("failed to get time: {}", .{err});
+            return error.InternalError;
+        };
+
+        // The job owns the data from here on, including on error.
+        const job = try DecodeJob.create(alloc, loading, .{}, cmd.quiet);
+        errdefer job.destroy(alloc);
+        loading.data = .{};
+        img.pending = job;
+        try storage.addImage(alloc, img);
+        return .{ .image = img, .display = loading.display, .job = job };
+    }
+
     // Validate and store our image
     var img = try loading.complete(alloc);
     errdefer img.deinit(alloc);
@@ -570,3 +1049,246 @@ test "kittygfx no response with no image ID or number load and display" {
         try testing.expect(resp == null);
     }
 }
+
+test "kittygfx decode off-thread" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var t = try Terminal.init(alloc, .{ .rows = 5, .cols = 5 });
+    defer t.deinit(alloc);
+
+    // A decoder that holds on to the job so we can decode it ourselves.
+    const Queue = struct {
+        job: ?*DecodeJob = null,
+
+        fn queue(ptr: *anyopaque, job: *DecodeJob) void {
+            const self: *@This() = @ptrCast(@alignCast(ptr));
+            self.job = job;
+        }
+    };
+    var q: Queue = .{};
+    t.kitty_decoder = .{ .ptr = &q, .queueFn = Queue.queue };
+
+    const png = @embedFile("testdata/image-png-none-50x76-2147483647-raw.data");
+    const encoder = std.base64.standard.Encoder;
+    const prefix = "a=T,f=100,t=d,i=1,C=1;";
+    const str = try alloc.alloc(u8, prefix.len + encoder.calcSize(png.len));
+    defer alloc.free(str);
+    @memcpy(str[0..prefix.len], prefix);
+    _ = encoder.encode(str[prefix.len..], png);
+
+    // The image is added and displayed right away, but pending.
+    const cmd = try command.Parser.parseString(alloc, str);
+    defer cmd.deinit(alloc);
+    try testing.expect(execute(alloc, &t, &cmd) == null);
+    const storage = &t.screen.kitty_images;
+    {
+        const img = storage.imageById(1).?;
+        try testing.expect(img.pending != null);
+        try testing.expectEqual(50, img.width);
+        try testing.expectEqual(76, img.height);
+        try testing.expectEqual(1, storage.placements.count());
+
+        // The decoded size is reserved while decoding.
+        try testing.expectEqual(50 * 76 * 4, storage.total_bytes);
+    }
+
+    // Finishing the decode completes the image and responds.
+    const job = q.job.?;
+    job.decode(alloc);
+    const resp = decoded(alloc, &t, job).?;
+    try testing.expect(resp.ok());
+    try testing.expectEqual(1, resp.id);
+    {
+        const img = storage.imageById(1).?;
+        try testing.expect(img.pending == null);
+        try testing.expectEqual(50 * 76 * 4, img.data.len);
+        try testing.expectEqual(1, storage.placements.count());
+        try testing.expectEqual(50 * 76 * 4, storage.total_bytes);
+    }
+}
+
+test "kittygfx animation frames while the root frame decodes" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var t = try Terminal.init(alloc, .{ .rows = 5, .cols = 5 });
+    defer t.deinit(alloc);
+
+    // A decoder that holds on to the job so we can decode it ourselves.
+    const Queue = struct {
+        job: ?*DecodeJob = null,
+
+        fn queue(ptr: *anyopaque, job: *DecodeJob) void {
+            const self: *@This() = @ptrCast(@alignCast(ptr));
+            self.job = job;
+        }
+    };
+    var q: Queue = .{};
+    t.kitty_decoder = .{ .ptr = &q, .queueFn = Queue.queue };
+
+    // A compressed root frame, which is decoded off-thread.
+    const data = @embedFile("testdata/image-rgb-zlib_deflate-128x96-2147483647-raw.data");
+    const encoder = std.base64.standard.Encoder;
+    const prefix = "a=t,f=24,o=z,t=d,i=1,s=128,v=96;";
+    const str = try alloc.alloc(u8, prefix.len + encoder.calcSize(data.len));
+    defer alloc.free(str);
+    @memcpy(str[0..prefix.len], prefix);
+    _ = encoder.encode(str[prefix.len..], data);
+    {
+        const cmd = try command.Parser.parseString(alloc, str);
+        defer cmd.deinit(alloc);
+        try testing.expect(execute(alloc, &t, &cmd) == null);
+    }
+    const storage = &t.screen.kitty_images;
+    try testing.expect(storage.imageById(1).?.pending != null);
+
+    // Frames and control commands sent right away wait for the decode.
+    {
+        const cmd = try command.Parser.parseString(
+            alloc,
+            "a=f,i=1,f=32,s=1,v=1;/////w==",
+        );
+        defer cmd.deinit(alloc);
+        const resp = execute(alloc, &t, &cmd).?;
+        try testing.expect(resp.ok());
+        try testing.expectEqual(@as(u32, 1), resp.id);
+    }
+    {
+        const cmd = try command.Parser.parseString(alloc, "a=a,i=1,c=2");
+        defer cmd.deinit(alloc);
+        try testing.expect(execute(alloc, &t, &cmd) == null);
+    }
+    try testing.expectEqual(2, storage.deferred.items.len);
+    try testing.expect(storage.imageById(1).?.animation == null);
+
+    // Finishing the decode runs them.
+    const job = q.job.?;
+    job.decode(alloc);
+    const resp = decoded(alloc, &t, job).?;
+    try testing.expect(resp.ok());
+    try testing.expectEqual(0, storage.deferred.items.len);
+
+    const anim = storage.imageById(1).?.animation.?;
+    try testing.expectEqual(@as(u32, 2), anim.frameCount());
+    try testing.expectEqual(@as(u32, 2), anim.current);
+    try testing.expectEqual([4]u8{ 255, 255, 255, 255 }, anim.canvas[0..4].*);
+}
+
+test "kittygfx animation frames" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var t = try Terminal.init(alloc, .{ .rows = 5, .cols = 5 });
+    defer t.deinit(alloc);
+    const storage = &t.screen.kitty_images;
+
+    // A black 2x1 image
+    {
+        const cmd = try command.Parser.parseString(
+            alloc,
+            "a=t,f=24,t=d,i=1,s=2,v=1;AAAAAAAA",
+        );
+        defer cmd.deinit(alloc);
+        const resp = execute(alloc, &t, &cmd).?;
+        try testing.expect(resp.ok());
+    }
+
+    // Frame 2 is the root frame with a white pixel on the right
+    {
+        const cmd = try command.Parser.parseString(
+            alloc,
+            "a=f,i=1,f=32,s=1,v=1,x=1,c=1;/////w==",
+        );
+        defer cmd.deinit(alloc);
+        const resp = execute(alloc, &t, &cmd).?;
+        try testing.expect(resp.ok());
+        try testing.expectEqual(@as(u32, 1), resp.id);
+    }
+
+    // Frame 3 is frame 2 with a white pixel on the left, in chunks
+    {
+        const cmd = try command.Parser.parseString(
+            alloc,
+            "a=f,i=1,f=32,s=1,v=1,c=2,m=1;////",
+        );
+        defer cmd.deinit(alloc);
+        try testing.expect(execute(alloc, &t, &cmd) == null);
+    }
+    {
+        const cmd = try command.Parser.parseString(alloc, "m=0;/w==");
+        defer cmd.deinit(alloc);
+        const resp = execute(alloc, &t, &cmd).?;
+        try testing.expect(resp.ok());
+    }
+
+    const anim = storage.imageById(1).?.animation.?;
+    try testing.expectEqual(@as(u32, 3), anim.frameCount());
+
+    // Show frame 3 and run the animation
+    {
+        const cmd = try command.Parser.parseString(alloc, "a=a,i=1,s=3,c=3");
+        defer cmd.deinit(alloc);
+        try testing.expect(execute(alloc, &t, &cmd) == null);
+    }
+    try testing.expectEqual(Animation.State.running, anim.state);
+    try testing.expectEqualSlices(u8, &([_]u8{255} ** 8), anim.canvas);
+
+    // Copy the left black pixel of the root frame onto frame 3
+    {
+        const cmd = try command.Parser.parseString(
+            alloc,
+            "a=c,i=1,r=1,c=3,w=1,h=1,x=1",
+        );
+        defer cmd.deinit(alloc);
+        try testing.expect(execute(alloc, &t, &cmd) == null);
+    }
+    try testing.expectEqualSlices(u8, &.{ 255, 255, 255, 255, 0, 0, 0, 255 }, anim.canvas);
+
+    // Errors
+    {
+        const cmd = try command.Parser.parseString(alloc, "a=a,i=1,c=9");
+        defer cmd.deinit(alloc);
+        const resp = execute(alloc, &t, &cmd).?;
+        try testing.expect(!resp.ok());
+    }
+    {
+        const cmd = try command.Parser.parseString(
+            alloc,
+            "a=f,i=2,f=32,s=1,v=1;/////w==",
+        );
+        defer cmd.deinit(alloc);
+        const resp = execute(alloc, &t, &cmd).?;
+        try testing.expect(!resp.ok());
+    }
+    {
+        // Regions are checked before they're used to size the copy.
+        const cmd = try command.Parser.parseString(
+            alloc,
+            "a=c,i=1,r=1,c=3,w=4294967295,h=4294967295",
+        );
+        defer cmd.deinit(alloc);
+        const resp = execute(alloc, &t, &cmd).?;
+        try testing.expect(!resp.ok());
+    }
+    {
+        const cmd = try command.Parser.parseString(
+            alloc,
+            "a=c,i=1,r=3,c=3,w=1,h=1,x=4294967295",
+        );
+        defer cmd.deinit(alloc);
+        const resp = execute(alloc, &t, &cmd).?;
+        try testing.expect(!resp.ok());
+    }
+
+    // Replacing the image removes the animation
+    {
+        const cmd = try command.Parser.parseString(
+            alloc,
+            "a=t,f=24,t=d,i=1,s=2,v=1;AAAAAAAA",
+        );
+        defer cmd.deinit(alloc);
+        _ = execute(alloc, &t, &cmd);
+    }
+    try testing.expect(storage.imageById(1).?.animation == null);
+}
@@ -11,6 +11,8 @@ const point = @import("../point.zig");
 const PageList = @import("../PageList.zig");
 const internal_os = @import("../../os/main.zig");
 const wuffs = @import("wuffs");
+const DecodeJob = @import("graphics_decode.zig").Job;
+const Animation = @import("graphics_animation.zig").Animation;
 
 const log = std.log.scoped(.kitty_gfx);
 
@@ -36,6 +38,10 @@ pub const LoadingImage = struct {
     /// so that we display the image after it is fully loaded.
     display: ?command.Display = null,
 
+    /// This is non-null when this is an animation frame rather than an
+    /// image, see graphics_animation.zig.
+    frame: ?command.AnimationFrameLoading = null,
+
     /// Quiet is the quiet settings for the initial load command. This is
     /// used if q isn't set on subsequent chunks.
     quiet: command.Command.Quiet,
@@ -59,6 +65,10 @@ pub const LoadingImage = struct {
             },
 
             .display = cmd.display(),
+            .frame = switch (cmd.control) {
+                .transmit_animation_frame => |v| v.frame,
+                else => null,
+            },
             .quiet = cmd.quiet,
         };
 
@@ -186,6 +196,7 @@ pub const LoadingImage = struct {
             @as(usize, @intCast(t.offset)) + @as(usize, @intCast(t.size)),
             expected_size,
         ) else expected_size;
+        if (start > end) return error.InvalidData;
 
         assert(self.data.items.len == 0);
         try self.data.appendSlice(alloc, map[start..end]);
@@ -322,15 +333,58 @@ pub const LoadingImage = struct {
         fastmem.copy(u8, self.data.items[start_i..], data);
     }
 
-    /// Complete the chunked image, returning a completed image.
-    pub fn complete(self: *LoadingImage, alloc: Allocator) !Image {
-        const img = &self.image;
+    /// Returns true if the data must be decompressed or decoded before
+    /// the image can be completed. This is the slow part of loading an
+    /// image, see `decode`.
+    pub fn needsDecode(self: *const LoadingImage) bool {
+        return self.image.compression != .none or self.image.format == .png;
+    }
 
+    /// Returns the dimensions the image will have once it is complete,
+    /// if they can be known without decoding the data. For PNG images
+    /// this reads the dimensions from the header. Returns null if the
+    /// dimensions aren't known or aren't valid, in which case `complete`
+    /// will report the error.
+    pub fn dimensions(self: *const LoadingImage) ?struct {
+        width: u32,
+        height: u32,
+    } {
+        var width = self.image.width;
+        var height = self.image.height;
+        if (self.image.format == .png) {
+            // We can't read the header of compressed data.
+            if (self.image.compression != .none) return null;
+
+            // The IHDR chunk must come first, right after the signature.
+            const data = self.data.items;
+            if (data.len < 24) return null;
+            if (!std.mem.eql(u8, data[0..8], "\x89PNG\r\n\x1a\n")) return null;
+            if (!std.mem.eql(u8, data[12..16], "IHDR")) return null;
+            width = std.mem.readInt(u32, data[16..20], .big);
+            height = std.mem.readInt(u32, data[20..24], .big);
+        }
+
+        if (width == 0 or height == 0) return null;
+        if (width > max_dimension or height > max_dimension) return null;
+        return .{ .width = width, .height = height };
+    }
+
+    /// Decompress and decode the data, if necessary. This is done by
+    /// `complete` so it only needs to be called separately to do this
+    /// work at a different time, e.g. on a different thread.
+    pub fn decode(self: *LoadingImage, alloc: Allocator) !void {
         // Decompress the data if it is compressed.
         try self.decompress(alloc);
 
         // Decode the png if we have to
-        if (img.format == .png) try self.decodePng(alloc);
+        if (self.image.format == .png) try self.decodePng(alloc);
+    }
+
+    /// Complete the chunked image, returning a completed image.
+    pub fn complete(self: *LoadingImage, alloc: Allocator) !Image {
+        const img = &self.image;
+
+        try self.decode(alloc);
 
         // Validate our dimensions.
         if (img.width == 0 or img.height == 0) return error.DimensionsRequired;
@@ -458,12 +512,28 @@ pub const Image = struct {
     data: []const u8 = "",
     transmit_time: std.time.Instant = undefined,
 
+    /// The last time the image was displayed, if it has been displayed
+    /// since it was transmitted. See `ImageStorage.markDisplayed`.
+    display_time: ?std.time.Instant = null,
+
     /// Set this to true if this image was loaded by a command that
     /// doesn't specify an ID or number, since such commands should
     /// not be responded to, even though we do currently give them
     /// IDs in the public range (which is bad!).
     implicit_id: bool = false,
 
+    /// Non-null while the image data is being decoded on another thread.
+    /// The image has its final dimensions and can have placements, but
+    /// it has no data yet so it can't be drawn. This identifies the
+    /// decode so that a stale one never completes a newer image with
+    /// the same ID.
+    pending: ?*const DecodeJob = null,
+
+    /// Set if frames were added to the image, see graphics_animation.zig.
+    /// The image data is then the root frame of the animation. This is
+    /// shared by every copy of the image.
+    animation: ?*Animation = null,
+
     pub const Error = error{
         InternalError,
         InvalidData,
@@ -479,9 +549,22 @@ pub const Image = struct {
     };
 
     pub fn deinit(self: *Image, alloc: Allocator) void {
+        if (self.animation) |a| a.destroy(alloc);
         if (self.data.len > 0) alloc.free(self.data);
     }
 
+    /// The memory used by the image, including any animation frames.
+    /// Images being decoded count the size their data will have, so that
+    /// decodes in progress are bounded by the storage limit as well.
+    pub fn byteSize(self: *const Image) usize {
+        if (self.pending != null) {
+            return @as(usize, self.width) *| self.height *| self.format.bpp();
+        }
+
+        const frames = if (self.animation) |a| a.byteSize() else 0;
+        return self.data.len + frames;
+    }
+
     /// Mostly for logging
     pub fn withoutData(self: *const Image) Image {
         var copy = self.*;
@@ -752,6 +835,8 @@ test "image load: rgb, not compressed, temporary file" {
     defer img.deinit(alloc);
     try testing.expect(img.compression == .none);
 
+    try testing.expectEqualSlices(u8, data, img.data);
+
     // Temporary file should be gone
     try testing.expectError(error.FileNotFound, tmp_dir.dir.access(path, .{}));
 }
@@ -826,3 +911,38 @@ test "image load: png, not compressed, regular file" {
     try testing.expect(img.format == .rgba);
     try tmp_dir.dir.access(path, .{});
 }
+
+test "image load: png dimensions without decoding" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var cmd: command.Command = .{
+        .control = .{ .transmit = .{
+            .format = .png,
+            .medium = .direct,
+            .compression = .none,
+            .width = 0,
+            .height = 0,
+            .image_id = 31,
+        } },
+        .data = try alloc.dupe(
+            u8,
+            @embedFile("testdata/image-png-none-50x76-2147483647-raw.data"),
+        ),
+    };
+    defer cmd.deinit(alloc);
+    var loading = try LoadingImage.init(alloc, &cmd);
+    defer loading.deinit(alloc);
+    try testing.expect(loading.needsDecode());
+    const dims = loading.dimensions().?;
+    try testing.expectEqual(50, dims.width);
+    try testing.expectEqual(76, dims.height);
+
+    // Decoding separately still completes the same image.
+    try loading.decode(alloc);
+    try testing.expect(!loading.needsDecode());
+    var img = try loading.complete(alloc);
+    defer img.deinit(alloc);
+    try testing.expectEqual(dims.width, img.width);
+    try testing.expectEqual(dims.height, img.height);
+}
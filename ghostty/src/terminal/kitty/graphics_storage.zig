@@ -12,6 +12,7 @@ const Screen = @import("../Screen.zig");
 const LoadingImage = @import("graphics_image.zig").LoadingImage;
 const Image = @import("graphics_image.zig").Image;
 const Rect = @import("graphics_image.zig").Rect;
+const DecodeJob = @import("graphics_decode.zig").Job;
 const Command = command.Command;
 
 const log = std.log.scoped(.kitty_gfx);
@@ -52,11 +53,38 @@ pub const ImageStorage = struct {
     loading: ?*LoadingImage = null,
 
     /// The total bytes of image data that have been loaded and the limit.
-    /// If the limit is reached, the oldest images will be evicted to make
-    /// space. Unused images take priority.
+    /// If the limit is reached, the least recently used images will be
+    /// evicted to make space. Unused images take priority.
     total_bytes: usize = 0,
     total_limit: usize = 320 * 1000 * 1000, // 320MB
 
+    /// Animation commands for images that were still being decoded when
+    /// the commands were executed, in order. They're run once the image
+    /// is decoded, see `deferCommand`.
+    deferred: std.ArrayListUnmanaged(Deferred) = .empty,
+
+    /// An animation command waiting for an image to be decoded.
+    pub const Deferred = struct {
+        /// The decode the command is waiting for, see `Image.pending`.
+        job: *const DecodeJob,
+
+        op: Op,
+
+        pub const Op = union(enum) {
+            /// A transmitted frame with all of its data.
+            frame: LoadingImage,
+            control: command.AnimationControl,
+            compose: command.AnimationFrameComposition,
+        };
+
+        pub fn deinit(self: *Deferred, alloc: Allocator) void {
+            switch (self.op) {
+                .frame => |*loading| loading.deinit(alloc),
+                .control, .compose => {},
+            }
+        }
+    };
+
     pub fn deinit(
         self: *ImageStorage,
         alloc: Allocator,
@@ -64,6 +92,9 @@ pub const ImageStorage = struct {
     ) void {
         if (self.loading) |loading| loading.destroy(alloc);
 
+        for (self.deferred.items) |*d| d.deinit(alloc);
+        self.deferred.deinit(alloc);
+
         var it = self.images.iterator();
         while (it.next()) |kv| kv.value_ptr.deinit(alloc);
         self.images.deinit(alloc);
@@ -109,10 +140,14 @@ pub const ImageStorage = struct {
     /// free any existing image with the same ID.
     pub fn addImage(self: *ImageStorage, alloc: Allocator, img: Image) Allocator.Error!void {
         // If the image itself is over the limit, then error immediately
-        if (img.data.len > self.total_limit) return error.OutOfMemory;
-
-        // If this would put us over the limit, then evict.
-        const total_bytes = self.total_bytes + img.data.len;
+        const size = img.byteSize();
+        if (size > self.total_limit) return error.OutOfMemory;
+
+        // If this would put us over the limit, then evict. An image we
+        // replace, such as the placeholder of a pending decode, is freed
+        // so it doesn't count.
+        const existing: usize = if (self.images.getPtr(img.id)) |v| v.byteSize() else 0;
+        const total_bytes = self.total_bytes - existing + size;
         if (total_bytes > self.total_limit) {
             const req_bytes = total_bytes - self.total_limit;
             log.info("evicting images to make space for {} bytes", .{req_bytes});
@@ -133,16 +168,67 @@ pub const ImageStorage = struct {
 
         // Write our new image
         if (gop.found_existing) {
-            self.total_bytes -= gop.value_ptr.data.len;
+            self.total_bytes -= gop.value_ptr.byteSize();
             gop.value_ptr.deinit(alloc);
         }
 
         gop.value_ptr.* = img;
-        self.total_bytes += img.data.len;
+        self.total_bytes += size;
 
         self.dirty = true;
     }
 
+    /// Defer an animation command until the image of the given job is
+    /// decoded. Clients send frames right after the root frame, which may
+    /// still be decoding, so these must be run once it's done rather than
+    /// fail. This takes ownership of the command. Deferred frames count
+    /// towards the limit with the images but they're never evicted.
+    pub fn deferCommand(
+        self: *ImageStorage,
+        alloc: Allocator,
+        job: *const DecodeJob,
+        op: Deferred.Op,
+    ) Allocator.Error!void {
+        const size = switch (op) {
+            .frame => |loading| loading.data.items.len,
+            .control, .compose => 0,
+        };
+        if (self.total_bytes + self.deferredBytes() + size > self.total_limit) {
+            return error.OutOfMemory;
+        }
+
+        try self.deferred.append(alloc, .{ .job = job, .op = op });
+    }
+
+    /// Free the deferred commands for the given job, i.e. because its
+    /// image failed to decode or was deleted.
+    pub fn discardDeferred(
+        self: *ImageStorage,
+        alloc: Allocator,
+        job: *const DecodeJob,
+    ) void {
+        var i: usize = 0;
+        while (i < self.deferred.items.len) {
+            if (self.deferred.items[i].job != job) {
+                i += 1;
+                continue;
+            }
+
+            var d = self.deferred.orderedRemove(i);
+            d.deinit(alloc);
+        }
+    }
+
+    /// The bytes of frame data waiting in deferred commands.
+    fn deferredBytes(self: *const ImageStorage) usize {
+        var total: usize = 0;
+        for (self.deferred.items) |d| switch (d.op) {
+            .frame => |loading| total += loading.data.items.len,
+            .control, .compose => {},
+        };
+        return total;
+    }
+
     /// Add a placement for a given image. The caller must verify in advance
     /// the image exists to prevent memory corruption.
     pub fn addPlacement(
@@ -190,11 +276,38 @@ pub const ImageStorage = struct {
         self.placements.clearRetainingCapacity();
     }
 
+    /// Record that an image was displayed at the given time. This is
+    /// called by the renderer so that images that are still being looked
+    /// at are evicted last. This doesn't mark the storage dirty.
+    pub fn markDisplayed(
+        self: *ImageStorage,
+        image_id: u32,
+        time: std.time.Instant,
+    ) void {
+        const img = self.images.getPtr(image_id) orelse return;
+        img.display_time = time;
+    }
+
     /// Get an image by its ID. If the image doesn't exist, null is returned.
     pub fn imageById(self: *const ImageStorage, image_id: u32) ?Image {
         return self.images.get(image_id);
     }
 
+    /// Get a pointer to an image by its ID to modify it in place, i.e. to
+    /// add animation frames. If the image's size changes, `resized` must
+    /// be called. The pointer is invalidated by adding or removing images.
+    pub fn imagePtrById(self: *ImageStorage, image_id: u32) ?*Image {
+        return self.images.getPtr(image_id);
+    }
+
+    /// Record that an image modified in place (see `imagePtrById`) changed
+    /// from `old` to `new` bytes. This doesn't evict any images so the
+    /// caller must check the limit before growing an image.
+    pub fn resized(self: *ImageStorage, old: usize, new: usize) void {
+        self.total_bytes = self.total_bytes - old + new;
+        self.dirty = true;
+    }
+
     /// Get an image by its number. If the image doesn't exist, return null.
     pub fn imageByNumber(self: *const ImageStorage, image_number: u32) ?Image {
         var newest: ?Image = null;
@@ -421,13 +534,16 @@ pub const ImageStorage = struct {
                 self.dirty = true;
             },
 
-            // We don't support animation frames yet so they are successfully
-            // deleted!
+            // We don't support deleting animation frames yet (the command
+            // doesn't have the image) so they are successfully deleted!
             .animation_frames => {},
         }
     }
 
-    fn deleteById(
+    /// Delete the placements of an image, or only the given placement
+    /// if the placement ID is non-zero, and optionally the image if it
+    /// is no longer used.
+    pub fn deleteById(
         self: *ImageStorage,
         alloc: Allocator,
         s: *terminal.Screen,
@@ -473,7 +589,7 @@ pub const ImageStorage = struct {
 
         // If we get here, we can delete the image.
         if (self.images.getEntry(image_id)) |entry| {
-            self.total_bytes -= entry.value_ptr.data.len;
+            self.total_bytes -= entry.value_ptr.byteSize();
             entry.value_ptr.deinit(alloc);
             self.images.removeByPtr(entry.key_ptr);
         }
@@ -508,9 +624,9 @@ pub const ImageStorage = struct {
         self.dirty = true;
     }
 
-    /// Evict image to make space. This will evict the oldest image,
-    /// prioritizing unused images first, as recommended by the published
-    /// Kitty spec.
+    /// Evict image to make space. This will evict the least recently used
+    /// image, i.e. displayed or transmitted, prioritizing unused images
+    /// first, as recommended by the published Kitty spec.
     ///
     /// This will evict as many images as necessary to make space for
     /// req bytes.
@@ -533,6 +649,10 @@ pub const ImageStorage = struct {
         while (it.next()) |kv| {
             const img = kv.value_ptr;
 
+            // Pending images have no data yet so evicting them frees
+            // nothing, and they're about to be completed.
+            if (img.pending != null) continue;
+
             // This is a huge waste. See comment above about redesigning
             // our data structures to avoid this. Eviction should be very
             // rare though and we never have that many images/placements
@@ -550,7 +670,7 @@ pub const ImageStorage = struct {
 
             try candidates.append(.{
                 .id = img.id,
-                .time = img.transmit_time,
+                .time = img.display_time orelse img.transmit_time,
                 .used = used,
             });
         }
@@ -593,10 +713,10 @@ pub const ImageStorage = struct {
             }
 
             if (self.images.getEntry(c.id)) |entry| {
-                log.info("evicting image id={} bytes={}", .{ c.id, entry.value_ptr.data.len });
+                log.info("evicting image id={} bytes={}", .{ c.id, entry.value_ptr.byteSize() });
 
-                evicted += entry.value_ptr.data.len;
-                self.total_bytes -= entry.value_ptr.data.len;
+                evicted += entry.value_ptr.byteSize();
+                self.total_bytes -= entry.value_ptr.byteSize();
 
                 entry.value_ptr.deinit(alloc);
                 self.images.removeByPtr(entry.key_ptr);
@@ -845,6 +965,31 @@ test "storage: add placement with zero placement id" {
     }) != null);
 }
 
+test "storage: replacing an image doesn't count it twice" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+    var t = try terminal.Terminal.init(alloc, .{ .cols = 3, .rows = 3 });
+    defer t.deinit(alloc);
+
+    var s: ImageStorage = .{};
+    defer s.deinit(alloc, &t.screen);
+    s.total_limit = 100;
+
+    const data1 = try alloc.alloc(u8, 60);
+    @memset(data1, 0);
+    try s.addImage(alloc, .{ .id = 1, .data = data1 });
+    const data2 = try alloc.alloc(u8, 30);
+    @memset(data2, 0);
+    try s.addImage(alloc, .{ .id = 2, .data = data2 });
+
+    // Replacing image 1 with one of the same size fits without evicting.
+    const data3 = try alloc.alloc(u8, 60);
+    @memset(data3, 0);
+    try s.addImage(alloc, .{ .id = 1, .data = data3 });
+    try testing.expectEqual(@as(usize, 2), s.images.count());
+    try testing.expectEqual(@as(usize, 90), s.total_bytes);
+}
+
 test "storage: delete all placements and images" {
     const testing = std.testing;
     const alloc = testing.allocator;
@@ -1357,3 +1502,36 @@ test "storage: aspect ratio calculation when only columns or rows specified" {
         try testing.expectEqual(@as(u32, 100), calc_size.height);
     }
 }
+
+test "storage: evicts least recently displayed images first" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+    var t = try terminal.Terminal.init(alloc, .{ .rows = 3, .cols = 3 });
+    defer t.deinit(alloc);
+
+    var s: ImageStorage = .{ .total_limit = 30 };
+    defer s.deinit(alloc, &t.screen);
+
+    // All images are transmitted at the same time, so
+    // without display times the lowest ID is evicted first.
+    const now = try std.time.Instant.now();
+    for (1..4) |id| try s.addImage(alloc, .{
+        .id = @intCast(id),
+        .data = try alloc.dupe(u8, &([_]u8{0} ** 10)),
+        .transmit_time = now,
+    });
+
+    var later = try std.time.Instant.now();
+    while (later.order(now) != .gt) later = try std.time.Instant.now();
+    s.markDisplayed(1, later);
+
+    try s.addImage(alloc, .{
+        .id = 4,
+        .data = try alloc.dupe(u8, &([_]u8{0} ** 5)),
+        .transmit_time = later,
+    });
+    try testing.expect(s.imageById(1) != null);
+    try testing.expect(s.imageById(2) == null);
+    try testing.expect(s.imageById(3) != null);
+    try testing.expect(s.imageById(4) != null);
+}
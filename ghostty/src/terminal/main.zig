@@ -33,6 +33,7 @@ pub const DCS = Parser.Action.DCS;
 pub const MouseShape = @import("mouse_shape.zig").MouseShape;
 pub const Page = page.Page;
 pub const PageList = @import("PageList.zig");
+pub const PagePool = @import("PagePool.zig");
 pub const Parser = @import("Parser.zig");
 pub const Pin = PageList.Pin;
 pub const Point = point.Point;
@@ -67,6 +68,8 @@ test {
     // Internals
     _ = @import("bitmap_allocator.zig");
     _ = @import("hash_map.zig");
+    _ = @import("PageSummary.zig");
+    _ = @import("RegexSearch.zig");
     _ = @import("ref_counted_set.zig");
     _ = @import("size.zig");
 }
@@ -1570,11 +1570,13 @@ pub const Page = struct {
                 try writer.writeByte('\n');
 
                 // This is tested in Screen.zig, i.e. one test is
-                // "cell map with newlines"
+                // "cell map with newlines". Blank rows may be carried
+                // over from a preceding page so we saturate at the top
+                // of this page.
                 if (opts.cell_map) |cell_map| {
                     try cell_map.append(.{
                         .x = last_x,
-                        .y = @intCast(y - blank_rows + i - 1),
+                        .y = @intCast((y + i - 1) -| blank_rows),
                     });
                     last_x = 0;
                 }
@@ -1609,8 +1611,10 @@ pub const Page = struct {
                 if (blank_cells > 0) {
                     try writer.writeByteNTimes(' ', blank_cells);
                     if (opts.cell_map) |cell_map| {
+                        // Blank cells may be carried over from the prior
+                        // (wrapped) row so we saturate at the row start.
                         for (0..blank_cells) |i| try cell_map.append(.{
-                            .x = @intCast(x - blank_cells + i),
+                            .x = @intCast((x + i) -| blank_cells),
                             .y = y,
                         });
                     }
@@ -1623,10 +1627,10 @@ pub const Page = struct {
                         try writer.print("{u}", .{cell.content.codepoint});
                         if (opts.cell_map) |cell_map| {
                             last_x = x + 1;
-                            try cell_map.append(.{
+                            try cell_map.appendNTimes(.{
                                 .x = x,
                                 .y = y,
-                            });
+                            }, utf8Len(cell.content.codepoint));
                         }
                     },
 
@@ -1634,18 +1638,18 @@ pub const Page = struct {
                         try writer.print("{u}", .{cell.content.codepoint});
                         if (opts.cell_map) |cell_map| {
                             last_x = x + 1;
-                            try cell_map.append(.{
+                            try cell_map.appendNTimes(.{
                                 .x = x,
                                 .y = y,
-                            });
+                            }, utf8Len(cell.content.codepoint));
                         }
 
                         for (self.lookupGrapheme(cell).?) |cp| {
                             try writer.print("{u}", .{cp});
-                            if (opts.cell_map) |cell_map| try cell_map.append(.{
+                            if (opts.cell_map) |cell_map| try cell_map.appendNTimes(.{
                                 .x = x,
                                 .y = y,
-                            });
+                            }, utf8Len(cp));
                         }
                     },
 
@@ -1660,6 +1664,12 @@ pub const Page = struct {
         return .{ .rows = blank_rows, .cells = blank_cells };
     }
 
+    /// The number of bytes the "{u}" format specifier writes for a
+    /// codepoint. Invalid codepoints are written as U+FFFD.
+    fn utf8Len(cp: u21) usize {
+        return std.unicode.utf8CodepointSequenceLength(cp) catch 3;
+    }
+
     /// Returns the bitset for the dirty bits on this page.
     ///
     /// The returned value is a DynamicBitSetUnmanaged but it is NOT
@@ -3210,3 +3220,58 @@ test "Page verifyIntegrity zero cols" {
         page.verifyIntegrity(testing.allocator),
     );
 }
+
+test "Page encodeUtf8 cell map multi-byte and wide" {
+    const alloc = testing.allocator;
+
+    var page = try Page.init(.{
+        .cols = 10,
+        .rows = 10,
+        .styles = 8,
+    });
+    defer page.deinit();
+
+    // Row 0: "aé 中e\u{301}" where 中 is wide and the last cell
+    // is a grapheme. Row 1 is blank and row 2 is "b".
+    page.getRowAndCell(0, 0).cell.* = .init('a');
+    page.getRowAndCell(1, 0).cell.* = .init(0xE9);
+    {
+        const cell = page.getRowAndCell(3, 0).cell;
+        cell.* = .init(0x4E2D);
+        cell.wide = .wide;
+        page.getRowAndCell(4, 0).cell.wide = .spacer_tail;
+    }
+    {
+        const rac = page.getRowAndCell(5, 0);
+        rac.cell.* = .init('e');
+        try page.appendGrapheme(rac.row, rac.cell, 0x301);
+    }
+    page.getRowAndCell(0, 2).cell.* = .init('b');
+
+    var buf = std.ArrayList(u8).init(alloc);
+    defer buf.deinit();
+    var cell_map = Page.CellMap.init(alloc);
+    defer cell_map.deinit();
+    _ = try page.encodeUtf8(buf.writer(), .{ .cell_map = &cell_map });
+    try testing.expectEqualStrings("aé 中e\u{301}\n\nb", buf.items);
+
+    // Every byte maps to the cell it was encoded from. Newlines map to
+    // the end of the row they terminate.
+    const expected = [_]Page.CellMapEntry{
+        .{ .x = 0, .y = 0 }, // a
+        .{ .x = 1, .y = 0 }, // é
+        .{ .x = 1, .y = 0 },
+        .{ .x = 2, .y = 0 }, // blank
+        .{ .x = 3, .y = 0 }, // 中
+        .{ .x = 3, .y = 0 },
+        .{ .x = 3, .y = 0 },
+        .{ .x = 5, .y = 0 }, // e
+        .{ .x = 5, .y = 0 }, // U+0301
+        .{ .x = 5, .y = 0 },
+        .{ .x = 6, .y = 0 }, // newline
+        .{ .x = 0, .y = 1 }, // newline
+        .{ .x = 0, .y = 2 }, // b
+    };
+    try testing.expectEqual(buf.items.len, cell_map.items.len);
+    try testing.expectEqualSlices(Page.CellMapEntry, &expected, cell_map.items);
+}
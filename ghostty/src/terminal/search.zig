@@ -13,6 +13,14 @@
 //! in memory to search for a needle (i.e. `needle.len - 1` bytes of overlap
 //! between terminal pages).
 //!
+//! Pages that are entirely in the scrollback are summarized the first
+//! time they're searched (see PageSummary). Subsequent searches consult
+//! the summary and skip pages that can't possibly contain any part of
+//! a match without encoding them at all. This makes repeated searches
+//! over a large, mostly unchanging scrollback much faster.
+//!
+//! Regular expression search is implemented separately in RegexSearch.
+//!
 //! Future work:
 //!
 //!   - PageListSearch on a PageList concurrently with another thread
@@ -33,6 +41,8 @@ const Pin = PageList.Pin;
 const Selection = terminal.Selection;
 const Screen = terminal.Screen;
 
+pub const RegexSearch = @import("RegexSearch.zig");
+
 /// Searches for a term in a PageList structure.
 ///
 /// At the time of writing, this does not support searching a pagelist
@@ -45,6 +55,23 @@ pub const PageListSearch = struct {
     /// The sliding window of page contents and nodes to search.
     window: SlidingWindow,
 
+    /// The last node that we processed, either by appending it to
+    /// the window or skipping it via its summary. Null if we haven't
+    /// processed any nodes yet.
+    last: ?*PageList.List.Node = null,
+
+    /// True until we process the first node of the active area. Pages
+    /// before it are scrollback and can be summarized.
+    history: bool = true,
+
+    /// Whether to use (and build) page summaries to skip pages that
+    /// can't contain the needle. This is only exposed so that it can be
+    /// disabled for benchmarking and testing.
+    summaries: bool = true,
+
+    /// The number of pages skipped via their summary so far.
+    skipped: usize = 0,
+
     /// Initialize the page list search.
     ///
     /// The needle is not copied and must be kept alive for the duration
@@ -77,19 +104,39 @@ pub const PageListSearch = struct {
         // then we can return that and we're done.
         if (self.window.next()) |sel| return sel;
 
-        // Get our next node. If we have a value in our window then we
-        // can determine the next node. If we don't, we've never setup the
-        // window so we use our first node.
-        var node_: ?*PageList.List.Node = if (self.window.meta.last()) |meta|
-            meta.node.next
+        // Get our next node. If we've processed a node then we continue
+        // after it, otherwise we start at the very first node.
+        var node_: ?*PageList.List.Node = if (self.last) |last|
+            last.next
         else
             self.list.pages.first;
 
+        // Our search may cross into the active area so we track whether
+        // we're still in the scrollback.
+        const active = self.list.getTopLeft(.active).node;
+
         // Add one pagelist node at a time, look for matches, and repeat
         // until we find a match or we reach the end of the pagelist.
         // This append then next pattern limits memory usage of the window.
         while (node_) |node| : (node_ = node.next) {
-            try self.window.append(alloc, node);
+            self.last = node;
+            if (node == active) self.history = false;
+            const summarize = self.summaries and self.history;
+
+            // If we have a valid summary for this page and it tells us
+            // that no match can overlap it, then we skip the page. Since
+            // no match can overlap it, no match can cross it either, so
+            // we can drop the overlap data retained in the window.
+            if (summarize and
+                node.summary.valid and
+                !node.summary.mayOverlap(self.window.needle))
+            {
+                self.window.clearAndRetainCapacity();
+                self.skipped += 1;
+                continue;
+            }
+
+            try self.window.appendExt(alloc, node, summarize);
             if (self.window.next()) |sel| return sel;
         }
 
@@ -413,6 +460,19 @@ const SlidingWindow = struct {
         self: *SlidingWindow,
         alloc: Allocator,
         node: *PageList.List.Node,
+    ) Allocator.Error!void {
+        try self.appendExt(alloc, node, false);
+    }
+
+    /// Same as append, but if summarize is true then the search summary
+    /// of the node is built from the encoded page if it isn't already
+    /// valid. The caller must only set summarize for nodes that are
+    /// entirely in the scrollback.
+    pub fn appendExt(
+        self: *SlidingWindow,
+        alloc: Allocator,
+        node: *PageList.List.Node,
+        summarize: bool,
     ) Allocator.Error!void {
         // Initialize our metadata for the node.
         var meta: Meta = .{
@@ -440,6 +500,9 @@ const SlidingWindow = struct {
         };
         assert(meta.cell_map.items.len == encoded.items.len);
 
+        // We have the full encoded page so summarizing is nearly free.
+        if (summarize and !node.summary.valid) node.summary.build(encoded.items);
+
         // Ensure our buffers are big enough to store what we need.
         try self.data.ensureUnusedCapacity(alloc, encoded.items.len);
         try self.meta.ensureUnusedCapacity(alloc, 1);
@@ -509,6 +572,69 @@ test "PageListSearch single page" {
     try testing.expect((try search.next(alloc)) == null);
 }
 
+test "PageListSearch summarizes scrollback pages" {
+    const testing = std.testing;
+    const alloc = testing.allocator;
+
+    var s = try Screen.init(alloc, 80, 24, 1000);
+    defer s.deinit();
+
+    // Fill up the first page. The final bytes in the first page
+    // are "boo!". Then scroll enough that the first page is entirely
+    // in the scrollback.
+    const first_page_rows = s.pages.pages.first.?.data.capacity.rows;
+    for (0..first_page_rows - 1) |_| try s.testWriteString("\n");
+    for (0..s.pages.cols - 4) |_| try s.testWriteString("x");
+    try s.testWriteString("boo!");
+    for (0..s.pages.rows + 1) |_| try s.testWriteString("\n");
+    try s.testWriteString("hello. boo!");
+    const first = s.pages.pages.first.?;
+    try testing.expect(first != s.pages.getTopLeft(.active).node);
+
+    // Searching builds the summary for the first page only.
+    {
+        var search = try PageListSearch.init(alloc, &s.pages, "boo!");
+        defer search.deinit(alloc);
+        try testing.expect((try search.next(alloc)) != null);
+        try testing.expect((try search.next(alloc)) != null);
+        try testing.expect((try search.next(alloc)) == null);
+        try testing.expectEqual(0, search.skipped);
+    }
+    try testing.expect(first.summary.valid);
+    try testing.expect(!s.pages.pages.last.?.summary.valid);
+
+    // Searching again uses the summary and finds the same matches.
+    {
+        var search = try PageListSearch.init(alloc, &s.pages, "boo!");
+        defer search.deinit(alloc);
+        {
+            const sel = (try search.next(alloc)).?;
+            try testing.expectEqual(point.Point{ .screen = .{
+                .x = 76,
+                .y = first_page_rows - 1,
+            } }, s.pages.pointFromPin(.screen, sel.start()).?);
+        }
+        try testing.expect((try search.next(alloc)) != null);
+        try testing.expect((try search.next(alloc)) == null);
+        try testing.expectEqual(0, search.skipped);
+    }
+
+    // A needle that isn't in the first page skips it.
+    {
+        var search = try PageListSearch.init(alloc, &s.pages, "hello");
+        defer search.deinit(alloc);
+        try testing.expect(!first.summary.mayOverlap("hello"));
+        try testing.expect((try search.next(alloc)) != null);
+        try testing.expectEqual(1, search.skipped);
+        try testing.expect((try search.next(alloc)) == null);
+        try testing.expectEqual(1, search.skipped);
+    }
+
+    // Resizing invalidates summaries.
+    try s.pages.resize(.{ .rows = 30, .reflow = false });
+    try testing.expect(!first.summary.valid);
+}
+
 test "SlidingWindow empty on init" {
     const testing = std.testing;
     const alloc = testing.allocator;
@@ -15,6 +15,7 @@ const build_config = @import("../build_config.zig");
 const configpkg = @import("../config.zig");
 const crash = @import("../crash/main.zig");
 const fastmem = @import("../fastmem.zig");
+const trace = @import("../trace.zig");
 const internal_os = @import("../os/main.zig");
 const renderer = @import("../renderer.zig");
 const shell_integration = @import("shell_integration.zig");
@@ -417,6 +418,8 @@ pub fn queueWrite(
     // If our process is exited then we don't send any more writes.
     if (exec.exited) return;
 
+    trace.instant(.pty_write, std.math.lossyCast(u32, data.len));
+
     // We go through and chunk the data if necessary to fit into
     // our cached buffers that we can queue to the stream.
     var i: usize = 0;
@@ -1242,6 +1245,9 @@ pub const ReadThread = struct {
         };
         defer crash.sentry.thread_state = null;
 
+        // Release our trace buffer for reuse when we exit.
+        defer trace.threadExit();
+
         // First thing, we want to set the fd to non-blocking. We do this
         // so that we can try to read from the fd in a tight loop and only
         // check the quit fd occasionally.
@@ -1302,6 +1308,7 @@ pub const ReadThread = struct {
                 if (n == 0) break;
 
                 // log.info("DATA: {d}", .{n});
+                trace.instant(.pty_read, @intCast(n));
                 @call(.always_inline, termio.Termio.processOutput, .{ io, buf[0..n] });
             }
 
@@ -1337,6 +1344,9 @@ pub const ReadThread = struct {
         };
         defer crash.sentry.thread_state = null;
 
+        // Release our trace buffer for reuse when we exit.
+        defer trace.threadExit();
+
         var buf: [1024]u8 = undefined;
         while (true) {
             while (true) {
@@ -1354,6 +1364,7 @@ pub const ReadThread = struct {
                     }
                 }
 
+                trace.instant(.pty_read, @intCast(n));
                 @call(.always_inline, termio.Termio.processOutput, .{ io, buf[0..n] });
             }
 
@@ -0,0 +1,120 @@
+//! Decodes Kitty graphics images for a terminal on a pool of worker
+//! threads, so that decompressing and decoding large images doesn't block
+//! the thread parsing terminal output (which holds the terminal lock).
+//!
+//! Decoded jobs are sent back to the termio thread through the mailbox,
+//! which finishes the image and sends the response. See
+//! terminal/kitty/graphics_decode.zig for the terminal side of this.
+const ImageDecoder = @This();
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const termio = @import("../termio.zig");
+const terminal = @import("../terminal/main.zig");
+
+const DecodeJob = terminal.kitty.graphics.DecodeJob;
+
+const log = std.log.scoped(.io_image_decoder);
+
+/// The maximum number of images decoded at the same time.
+const max_threads = 2;
+
+/// How long a worker waits for room in a full mailbox before checking
+/// whether we're stopping.
+const send_timeout_ns = 10 * std.time.ns_per_ms;
+
+alloc: Allocator,
+
+/// The mailbox decoded jobs are sent to.
+mailbox: *termio.Mailbox,
+
+/// The terminal lock, which is held whenever jobs are queued.
+mutex: *std.Thread.Mutex,
+
+/// The worker threads. This is created on the first job since most
+/// terminals never see an image that needs decoding.
+pool: ?*std.Thread.Pool = null,
+
+/// Set when we're being deinitialized. Jobs that finish after this are
+/// dropped, since there is no longer a thread to receive them.
+stopping: std.atomic.Value(bool) = .init(false),
+
+pub fn init(
+    alloc: Allocator,
+    mailbox: *termio.Mailbox,
+    mutex: *std.Thread.Mutex,
+) ImageDecoder {
+    return .{ .alloc = alloc, .mailbox = mailbox, .mutex = mutex };
+}
+
+/// Deinit. This waits for all queued jobs to finish. This must be called
+/// after the termio thread has stopped.
+pub fn deinit(self: *ImageDecoder) void {
+    self.stopping.store(true, .release);
+    if (self.pool) |pool| {
+        pool.deinit();
+        self.alloc.destroy(pool);
+    }
+}
+
+/// The decoder to set on the terminal. The decoder must be at a stable
+/// address for as long as the terminal uses this.
+pub fn decoder(self: *ImageDecoder) terminal.kitty.graphics.Decoder {
+    return .{ .ptr = self, .queueFn = queue };
+}
+
+fn queue(ptr: *anyopaque, job: *DecodeJob) void {
+    const self: *ImageDecoder = @ptrCast(@alignCast(ptr));
+
+    // If we can't start any threads we decode right away, which
+    // is what would happen if we had no decoder at all.
+    const pool = self.getPool() catch |err| {
+        log.warn("error starting image decode threads, decoding inline err={}", .{err});
+        self.runLocked(job);
+        return;
+    };
+
+    pool.spawn(run, .{ self, job }) catch |err| {
+        log.warn("error queueing image decode, decoding inline err={}", .{err});
+        self.runLocked(job);
+    };
+}
+
+/// Decode the job on the calling thread, which holds the terminal lock.
+fn runLocked(self: *ImageDecoder, job: *DecodeJob) void {
+    job.decode(self.alloc);
+    self.mailbox.send(.{ .kitty_image_decoded = job }, self.mutex);
+    self.mailbox.notify();
+}
+
+fn getPool(self: *ImageDecoder) !*std.Thread.Pool {
+    if (self.pool) |pool| return pool;
+
+    const pool = try self.alloc.create(std.Thread.Pool);
+    errdefer self.alloc.destroy(pool);
+    try pool.init(.{
+        .allocator = self.alloc,
+        .n_jobs = @min(max_threads, std.Thread.getCpuCount() catch 1),
+    });
+
+    self.pool = pool;
+    return pool;
+}
+
+fn run(self: *ImageDecoder, job: *DecodeJob) void {
+    job.decode(self.alloc);
+
+    // We can't block forever on a full mailbox since the termio thread
+    // may be gone by the time it's full, so we retry until we're stopped.
+    while (!self.stopping.load(.acquire)) {
+        if (self.mailbox.sendTimeout(
+            .{ .kitty_image_decoded = job },
+            send_timeout_ns,
+        )) {
+            self.mailbox.notify();
+            return;
+        }
+    }
+
+    job.destroy(self.alloc);
+}
@@ -22,10 +22,12 @@ const xev = @import("../global.zig").xev;
 const renderer = @import("../renderer.zig");
 const apprt = @import("../apprt.zig");
 const fastmem = @import("../fastmem.zig");
+const trace = @import("../trace.zig");
 const internal_os = @import("../os/main.zig");
 const windows = internal_os.windows;
 const configpkg = @import("../config.zig");
 const shell_integration = @import("shell_integration.zig");
+const ImageDecoder = @import("ImageDecoder.zig");
 
 const log = std.log.scoped(.io_exec);
 
@@ -59,9 +61,18 @@ surface_mailbox: apprt.surface.Mailbox,
 /// The cached size info
 size: renderer.Size,
 
+/// Our registration with the shared page pool. This lets the page pool
+/// evict our scrollback when the total scrollback memory across all
+/// terminals exceeds the configured limit.
+page_client: terminalpkg.PagePool.Client,
+
 /// The mailbox implementation to use.
 mailbox: termio.Mailbox,
 
+/// Decodes Kitty graphics images off the read thread. Decoded
+/// images are finished by `kittyImageDecoded`.
+image_decoder: ImageDecoder,
+
 /// The stream parser. This parses the stream of escape codes and so on
 /// from the child process and calls callbacks in the stream handler.
 terminal_stream: terminalpkg.Stream(StreamHandler),
@@ -161,6 +172,8 @@ pub const DerivedConfig = struct {
 
     palette: terminalpkg.color.Palette,
     image_storage_limit: usize,
+    scrollback_total_limit: usize,
+    scrollback_huge_pages: bool,
     cursor_style: terminalpkg.CursorStyle,
     cursor_blink: ?bool,
     cursor_color: ?configpkg.Config.TerminalColor,
@@ -181,6 +194,8 @@ pub const DerivedConfig = struct {
         return .{
             .palette = config.palette.value,
             .image_storage_limit = config.@"image-storage-limit",
+            .scrollback_total_limit = config.@"scrollback-total-limit",
+            .scrollback_huge_pages = config.@"scrollback-huge-pages",
             .cursor_style = config.@"cursor-style",
             .cursor_blink = config.@"cursor-style-blink",
             .cursor_color = config.@"cursor-color",
@@ -223,6 +238,10 @@ pub fn init(self: *Termio, alloc: Allocator, opts: termio.Options) !void {
         break :modes modes;
     };
 
+    // Configure the shared page pool before we allocate any pages.
+    const page_pool = terminalpkg.PagePool.global();
+    page_pool.setHugePages(opts.config.scrollback_huge_pages);
+
     // Create our terminal
     var term = try terminalpkg.Terminal.init(alloc, opts: {
         const grid_size = opts.size.grid();
@@ -313,6 +332,7 @@ pub fn init(self: *Termio, alloc: Allocator, opts: termio.Options) !void {
         .size = opts.size,
         .backend = backend,
         .mailbox = opts.mailbox,
+        .image_decoder = .init(alloc, &self.mailbox, opts.renderer_state.mutex),
         .terminal_stream = stream: {
             var s: terminalpkg.Stream(StreamHandler) = .init(handler);
             // Populate the OSC parser allocator (optional) because
@@ -321,11 +341,34 @@ pub fn init(self: *Termio, alloc: Allocator, opts: termio.Options) !void {
             break :stream s;
         },
         .thread_enter_state = thread_enter_state,
+        .page_client = .{
+            .mutex = opts.renderer_state.mutex,
+            .userdata = self,
+            .evict = evictScrollback,
+        },
     };
+
+    // Register with the shared page pool. Both screens share our client
+    // since they're swapped by value when switching screens.
+    self.page_client.setBudget(opts.config.scrollback_total_limit);
+    self.terminal.screen.pages.client = &self.page_client;
+    self.terminal.secondary_screen.pages.client = &self.page_client;
+    page_pool.register(&self.page_client);
+
+    self.terminal.kitty_decoder = self.image_decoder.decoder();
 }
 
 pub fn deinit(self: *Termio) void {
+    // This must happen before the terminal is freed and must not hold
+    // the renderer mutex (see PagePool.unregister).
+    terminalpkg.PagePool.global().unregister(&self.page_client);
+
     self.backend.deinit();
+
+    // This waits for in-progress decodes so it must happen before the
+    // terminal and mailbox are freed. Decoded images that were sent but
+    // never received are freed with the mailbox.
+    self.image_decoder.deinit();
     self.terminal.deinit(self.alloc);
     self.config.deinit();
     self.mailbox.deinit(self.alloc);
@@ -338,6 +381,24 @@ pub fn deinit(self: *Termio) void {
     if (self.thread_enter_state) |v| v.destroy();
 }
 
+/// PagePool.Client callback to give up scrollback memory. This is called
+/// with the renderer mutex held, from any thread.
+fn evictScrollback(ud: *anyopaque, bytes: usize) usize {
+    const self: *Termio = @ptrCast(@alignCast(ud));
+
+    // The primary screen may be the secondary screen if we're on the
+    // alternate screen, so try both.
+    var freed = self.terminal.screen.pages.evictScrollback(bytes);
+    if (freed < bytes) freed += self.terminal.secondary_screen.pages.evictScrollback(
+        bytes - freed,
+    );
+
+    // Our viewport may have changed, wake up the renderer.
+    if (freed > 0) self.renderer_wakeup.notify() catch {};
+
+    return freed;
+}
+
 pub fn threadEnter(
     self: *Termio,
     thread: *termio.Thread,
@@ -449,6 +510,8 @@ pub fn changeConfig(self: *Termio, td: *ThreadData, config: *DerivedConfig) !voi
     // from another thread.
     self.terminal_stream.handler.changeConfig(&self.config);
     td.backend.changeConfig(&self.config);
+    terminalpkg.PagePool.global().setHugePages(self.config.scrollback_huge_pages);
+    self.page_client.setBudget(self.config.scrollback_total_limit);
 
     // Update the configuration that we know about.
     //
@@ -660,6 +723,30 @@ pub fn jumpToPrompt(self: *Termio, delta: isize) !void {
     try self.renderer_wakeup.notify();
 }
 
+/// Finish a Kitty graphics image that was decoded off-thread and send
+/// the response to the transmission, if any.
+pub fn kittyImageDecoded(
+    self: *Termio,
+    td: *ThreadData,
+    job: *terminalpkg.kitty.graphics.DecodeJob,
+    linefeed: bool,
+) !void {
+    const resp = resp: {
+        self.renderer_state.mutex.lock();
+        defer self.renderer_state.mutex.unlock();
+        break :resp self.terminal.kittyGraphicsDecoded(self.alloc, job);
+    } orelse return;
+
+    var buf: [1024]u8 = undefined;
+    var buf_stream = std.io.fixedBufferStream(&buf);
+    try resp.encode(buf_stream.writer());
+    const final = buf_stream.getWritten();
+    if (final.len > 2) {
+        log.debug("kitty graphics response: {s}", .{std.fmt.fmtSliceHexLower(final)});
+        try self.queueWrite(td, final, linefeed);
+    }
+}
+
 /// Called when focus is gained or lost (when focus events are enabled)
 pub fn focusGained(self: *Termio, td: *ThreadData, focused: bool) !void {
     self.renderer_state.mutex.lock();
@@ -689,6 +776,9 @@ pub fn processOutput(self: *Termio, buf: []const u8) void {
 
 /// Process output from readdata but the lock is already held.
 fn processOutputLocked(self: *Termio, buf: []const u8) void {
+    const span = trace.begin();
+    defer trace.end(span, .parse, std.math.lossyCast(u32, buf.len));
+
     // Schedule a render. We can call this first because we have the lock.
     self.terminal_stream.handler.queueRender() catch unreachable;
 
@@ -17,8 +17,10 @@ const builtin = @import("builtin");
 const xev = @import("../global.zig").xev;
 const crash = @import("../crash/main.zig");
 const internal_os = @import("../os/main.zig");
+const trace = @import("../trace.zig");
 const termio = @import("../termio.zig");
 const renderer = @import("../renderer.zig");
+const terminalpkg = @import("../terminal/main.zig");
 const BlockingQueue = @import("../datastruct/main.zig").BlockingQueue;
 
 const Allocator = std.mem.Allocator;
@@ -237,6 +239,13 @@ pub fn threadMain(self: *Thread, io: *termio.Termio) void {
 fn threadMain_(self: *Thread, io: *termio.Termio) !void {
     defer log.debug("IO thread exited", .{});
 
+    // Page memory freed on this thread is cached per-thread, so give
+    // it back to the shared pool when we exit.
+    defer terminalpkg.PagePool.global().flushThreadCache();
+
+    // Release our trace buffer for reuse when we exit.
+    defer trace.threadExit();
+
     // Right now, on Darwin, `std.Thread.setName` can only name the current
     // thread, and we have no way to get the current thread from within it,
     // so instead we use this code to name the thread instead.
@@ -296,9 +305,14 @@ fn drainMailbox(
     const io = cb.io;
     const data = &cb.data;
 
-    // If we're draining, we just drain the mailbox and return.
+    // If we're draining, we just drain the mailbox and return. Messages
+    // that own memory are freed like the mailbox does on deinit.
     if (self.flags.drain) {
-        while (mailbox.pop()) |_| {}
+        while (mailbox.pop()) |message| switch (message) {
+            .kitty_image_decoded => |job| job.destroy(io.alloc),
+            .write_alloc => |w| w.alloc.free(w.data),
+            else => {},
+        };
         return;
     }
 
@@ -333,6 +347,11 @@ fn drainMailbox(
             .start_synchronized_output => self.startSynchronizedOutput(cb),
             .linefeed_mode => |v| self.flags.linefeed_mode = v,
             .focused => |v| try io.focusGained(data, v),
+            .kitty_image_decoded => |v| try io.kittyImageDecoded(
+                data,
+                v,
+                self.flags.linefeed_mode,
+            ),
             .write_small => |v| try io.queueWrite(
                 data,
                 v.data[0..v.len],
@@ -45,9 +45,21 @@ pub const Mailbox = union(enum) {
         return .{ .spsc = .{ .queue = queue, .wakeup = wakeup } };
     }
 
+    /// Deinit the mailbox. Messages that were never processed are freed,
+    /// i.e. images that finished decoding after the termio thread stopped.
     pub fn deinit(self: *Mailbox, alloc: Allocator) void {
         switch (self.*) {
             .spsc => |*v| {
+                {
+                    var it = v.queue.drain();
+                    defer it.deinit();
+                    while (it.next()) |msg| switch (msg) {
+                        .kitty_image_decoded => |job| job.destroy(alloc),
+                        .write_alloc => |w| w.alloc.free(w.data),
+                        else => {},
+                    };
+                }
+
                 v.queue.destroy(alloc);
                 v.wakeup.deinit();
             },
@@ -96,6 +108,19 @@ pub const Mailbox = union(enum) {
         }
     }
 
+    /// Sends the given message without notifying there are messages,
+    /// waiting at most the given time for room if the queue is full.
+    /// Returns false if the message wasn't sent.
+    pub fn sendTimeout(
+        self: *Mailbox,
+        msg: termio.Message,
+        timeout_ns: u64,
+    ) bool {
+        return switch (self.*) {
+            .spsc => |*mb| mb.queue.push(msg, .{ .ns = timeout_ns }) > 0,
+        };
+    }
+
     /// Notify that there are new messages. This may be a noop depending
     /// on the writer type.
     pub fn notify(self: *Mailbox) void {
@@ -68,6 +68,10 @@ pub const Message = union(enum) {
     /// The surface gained or lost focus.
     focused: bool,
 
+    /// A Kitty graphics image finished decoding off-thread. The image
+    /// must be finished with the terminal and the job is then freed.
+    kitty_image_decoded: *terminal.kitty.graphics.DecodeJob,
+
     /// Write where the data fits in the union.
     write_small: WriteReq.Small,
 
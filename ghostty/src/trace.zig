@@ -0,0 +1,449 @@
+//! Low overhead tracing of the path from input to pixels on screen.
+//!
+//! Each thread that records an event gets its own fixed size ring buffer
+//! of records. Only the owning thread ever writes to a ring, so recording
+//! is lock-free: it's a clock read, a plain store, and a release store of
+//! the ring head. Readers (the inspector, or an export) copy the rings
+//! without blocking writers and discard anything that may have been
+//! overwritten while they were copying.
+//!
+//! Tracing is disabled by default. When disabled, recording is a single
+//! atomic load and no memory is allocated.
+//!
+//! In addition to the raw events, we derive an approximate end-to-end
+//! input latency: the time from a key press, through the pty echoing
+//! something back, to the next frame being drawn. This is process wide,
+//! so with multiple surfaces it measures whichever one was typed in.
+const std = @import("std");
+const assert = std.debug.assert;
+const Allocator = std.mem.Allocator;
+const Histogram = @import("renderer/Histogram.zig");
+
+const log = std.log.scoped(.trace);
+
+/// The events that can be traced. Events are either instants, which have
+/// no duration, or spans.
+pub const Event = enum(u8) {
+    /// Instant: a key press was received by a surface.
+    key_input,
+
+    /// Instant: data was queued to be written to the pty. The arg
+    /// is the number of bytes.
+    pty_write,
+
+    /// Instant: data was read from the pty. The arg is the number of bytes.
+    pty_read,
+
+    /// Span: parsing pty data and applying it to the terminal. The arg
+    /// is the number of bytes.
+    parse,
+
+    /// Span: waiting to acquire the terminal lock in the renderer.
+    lock_wait,
+
+    /// Span: rebuilding the cell contents in the renderer. The arg is
+    /// 1 if this was a full rebuild.
+    rebuild_cells,
+
+    /// Span: uploading a font atlas to its texture. The arg is the
+    /// number of bytes uploaded.
+    atlas_upload,
+
+    /// Span: drawing and submitting a frame.
+    draw_frame,
+
+    /// Span: finding the font for a codepoint that wasn't cached, while
+    /// holding the font grid lock. The arg is the codepoint.
+    font_resolve,
+
+    /// Span: searching for and loading a fallback font on the fallback
+    /// thread. The arg is the codepoint.
+    font_fallback,
+
+    /// Span: rendering common glyphs when a font grid is created. The
+    /// arg is the number of glyphs.
+    font_warmup,
+
+    /// Span: from a key press to the end of the first frame drawn
+    /// after the pty had output something in response.
+    input_latency,
+
+    pub fn isSpan(self: Event) bool {
+        return switch (self) {
+            .key_input, .pty_write, .pty_read => false,
+            .parse,
+            .lock_wait,
+            .rebuild_cells,
+            .atlas_upload,
+            .draw_frame,
+            .font_resolve,
+            .font_fallback,
+            .font_warmup,
+            .input_latency,
+            => true,
+        };
+    }
+};
+
+/// A single recorded event.
+pub const Record = struct {
+    /// Start time in nanoseconds since tracing was first enabled.
+    start: u64,
+
+    /// Duration in nanoseconds. Always zero for instant events.
+    duration: u64 = 0,
+
+    event: Event,
+
+    /// Event specific value, see Event.
+    arg: u32 = 0,
+};
+
+/// A single producer ring buffer of records.
+pub const Ring = struct {
+    pub const capacity = 2048;
+
+    records: [capacity]Record = undefined,
+
+    /// The total number of records ever written to this ring. The
+    /// record for index `i` is at `records[i % capacity]`.
+    head: std.atomic.Value(u64) = .init(0),
+
+    /// The index of the first record written by the thread that owns
+    /// this ring. Records before it belong to a previous owner. We don't
+    /// reset the head instead so that it only ever grows, which readers
+    /// rely on to detect overwritten records.
+    base: std.atomic.Value(u64) = .init(0),
+
+    /// The id of the thread that owns this ring. This changes when the
+    /// ring is reused, together with `base`, under the global mutex.
+    tid: std.atomic.Value(std.Thread.Id),
+
+    /// The next ring in the global list of all rings.
+    next: ?*Ring = null,
+
+    /// The next ring in the list of free rings, protected by the global
+    /// mutex. Only valid while this ring is free.
+    next_free: ?*Ring = null,
+
+    /// The records copied by `snapshot` and the thread that wrote them.
+    pub const Snapshot = struct {
+        tid: std.Thread.Id,
+        records: []const Record,
+    };
+
+    fn push(self: *Ring, record: Record) void {
+        // We are the only writer so a relaxed load is fine.
+        const head = self.head.load(.monotonic);
+        self.records[head % capacity] = record;
+        self.head.store(head + 1, .release);
+    }
+
+    /// Copy the records in this ring, oldest first, in to buf.
+    ///
+    /// The writer stores the record at `head` before it increments the
+    /// head, so the slot of the oldest record, `head - capacity`, may be
+    /// in the middle of being written. Snapshots therefore contain at
+    /// most `capacity - 1` records.
+    pub fn snapshot(self: *const Ring, buf: *[capacity]Record) Snapshot {
+        // The owner and base only change together when the ring is
+        // reused, which happens under the mutex, so we read them
+        // together to know whose records these are.
+        const base: u64, const tid = owner: {
+            mutex.lock();
+            defer mutex.unlock();
+            break :owner .{ self.base.load(.acquire), self.tid.load(.acquire) };
+        };
+
+        const empty: Snapshot = .{ .tid = tid, .records = &.{} };
+        const end = self.head.load(.acquire);
+        const start = @max(base, end -| (capacity - 1));
+        if (start >= end) return empty;
+        for (start..end, 0..) |i, j| buf[j] = self.records[i % capacity];
+
+        // If the ring was reused while we were copying then we don't
+        // know which thread the records belong to.
+        if (self.base.load(.acquire) != base) return empty;
+
+        // The writer may have wrapped around and overwritten the oldest
+        // records while we were copying, so we drop any that could have
+        // been touched, including the one that may be being written.
+        const after = self.head.load(.acquire);
+        const valid = @max(start, (after + 1) -| capacity);
+        if (valid >= end) return empty;
+        return .{ .tid = tid, .records = buf[valid - start .. end - start] };
+    }
+};
+
+/// A span that was started with `begin`.
+pub const Span = struct {
+    start: u64,
+};
+
+var enabled: std.atomic.Value(bool) = .init(false);
+
+/// Protects the registration of rings and the epoch. This is never
+/// taken when recording, except the first time a thread records.
+var mutex: std.Thread.Mutex = .{};
+
+/// The instant that all timestamps are relative to. This is set once,
+/// before `enabled` is first published with release ordering, and never
+/// changes afterwards. Recording only reads it after observing `enabled`
+/// with acquire ordering (`end` requires a span from `begin`), so it is
+/// safe to read without the mutex.
+var epoch: ?std.time.Instant = null;
+
+/// All rings ever created. Rings are never freed, but are reused
+/// when their thread calls `threadExit`, see below. Free rings are
+/// linked through `Ring.next_free` so freeing never allocates.
+var rings: ?*Ring = null;
+var free_rings: ?*Ring = null;
+
+/// The ring for the current thread, if it has one.
+threadlocal var local: ?*Ring = null;
+
+/// The timestamp of the first key press that hasn't been responded to
+/// yet, and the timestamp of the key press whose response we're waiting
+/// to draw. Both are zero when there is nothing pending. These are
+/// stored plus one so that zero is never a valid timestamp.
+var pending_input: std.atomic.Value(u64) = .init(0);
+var pending_echo: std.atomic.Value(u64) = .init(0);
+
+pub fn isEnabled() bool {
+    return enabled.load(.monotonic);
+}
+
+/// Enable or disable tracing. Records from previous sessions are kept
+/// when tracing is re-enabled.
+pub fn setEnabled(v: bool) void {
+    mutex.lock();
+    defer mutex.unlock();
+    if (v and epoch == null) epoch = std.time.Instant.now() catch |err| {
+        log.warn("failed to read the clock, tracing disabled err={}", .{err});
+        return;
+    };
+    pending_input.store(0, .monotonic);
+    pending_echo.store(0, .monotonic);
+    enabled.store(v, .release);
+}
+
+/// Must be called by threads that record events before they exit so
+/// that their ring can be reused. Threads that don't call this (i.e.
+/// the main thread) keep their ring forever.
+pub fn threadExit() void {
+    const ring = local orelse return;
+    local = null;
+
+    mutex.lock();
+    defer mutex.unlock();
+    ring.next_free = free_rings;
+    free_rings = ring;
+}
+
+/// Record an instant event.
+pub fn instant(event: Event, arg: u32) void {
+    assert(!event.isSpan());
+    if (!enabled.load(.acquire)) return;
+    const t = now() orelse return;
+    push(.{ .start = t, .event = event, .arg = arg });
+
+    switch (event) {
+        .key_input => _ = pending_input.cmpxchgStrong(0, t + 1, .monotonic, .monotonic),
+        .pty_read => {
+            const input = pending_input.swap(0, .monotonic);
+            if (input != 0) _ = pending_echo.cmpxchgStrong(0, input, .monotonic, .monotonic);
+        },
+        else => {},
+    }
+}
+
+/// Begin a span. The result should be passed to `end`. This returns
+/// null if tracing is disabled.
+pub fn begin() ?Span {
+    if (!enabled.load(.acquire)) return null;
+    return .{ .start = now() orelse return null };
+}
+
+/// End a span started with `begin`.
+pub fn end(span: ?Span, event: Event, arg: u32) void {
+    assert(event.isSpan());
+    const s = span orelse return;
+    const t = now() orelse return;
+    push(.{
+        .start = s.start,
+        .duration = t -| s.start,
+        .event = event,
+        .arg = arg,
+    });
+
+    // A drawn frame completes any pending input latency measurement.
+    if (event == .draw_frame) {
+        const input = pending_echo.swap(0, .monotonic);
+        if (input != 0) push(.{
+            .start = input - 1,
+            .duration = t -| (input - 1),
+            .event = .input_latency,
+        });
+    }
+}
+
+fn now() ?u64 {
+    const e = epoch orelse return null;
+    const t = std.time.Instant.now() catch return null;
+    return t.since(e);
+}
+
+fn push(record: Record) void {
+    const ring = local orelse ring: {
+        const ring = acquireRing() catch return;
+        local = ring;
+        break :ring ring;
+    };
+    ring.push(record);
+}
+
+fn acquireRing() !*Ring {
+    mutex.lock();
+    defer mutex.unlock();
+
+    const tid = std.Thread.getCurrentId();
+    if (free_rings) |ring| {
+        free_rings = ring.next_free;
+        ring.next_free = null;
+
+        // Records of the previous owner must not be attributed to us.
+        // We're the only writer now so the head can't change.
+        ring.tid.store(tid, .release);
+        ring.base.store(ring.head.load(.monotonic), .release);
+        return ring;
+    }
+
+    // Rings are long lived and page sized so we go straight to the OS.
+    const ring = try std.heap.page_allocator.create(Ring);
+    ring.* = .{ .tid = .init(tid), .next = rings };
+    rings = ring;
+    return ring;
+}
+
+/// A summary of all the records currently in the rings.
+pub const Summary = struct {
+    /// The durations of each span event. Instant events only have counts.
+    events: std.EnumArray(Event, Histogram) = .initFill(.{}),
+
+    pub fn get(self: *const Summary, event: Event) *const Histogram {
+        return self.events.getPtrConst(event);
+    }
+};
+
+/// Summarize all the records currently in the rings.
+pub fn summarize(alloc: Allocator) !Summary {
+    const buf = try alloc.create([Ring.capacity]Record);
+    defer alloc.destroy(buf);
+
+    var result: Summary = .{};
+    var it = firstRing();
+    while (it) |ring| : (it = ring.next) {
+        for (ring.snapshot(buf).records) |r| result.events.getPtr(r.event).record(r.duration);
+    }
+
+    return result;
+}
+
+/// Write all the records currently in the rings in the Chrome trace
+/// event JSON format. This can be loaded in to chrome://tracing or
+/// https://ui.perfetto.dev.
+pub fn writeChromeTrace(alloc: Allocator, writer: anytype) !void {
+    const buf = try alloc.create([Ring.capacity]Record);
+    defer alloc.destroy(buf);
+
+    try writer.writeAll("{\"traceEvents\":[");
+    var first = true;
+    var it = firstRing();
+    while (it) |ring| : (it = ring.next) {
+        const snapshot = ring.snapshot(buf);
+        for (snapshot.records) |r| {
+            if (!first) try writer.writeAll(",");
+            first = false;
+
+            // Chrome traces use microseconds but accept fractions.
+            try writer.print(
+                "\n{{\"name\":\"{s}\",\"pid\":1,\"tid\":{},\"ts\":{d:.3},\"args\":{{\"arg\":{}}}",
+                .{
+                    @tagName(r.event),
+                    snapshot.tid,
+                    @as(f64, @floatFromInt(r.start)) / std.time.ns_per_us,
+                    r.arg,
+                },
+            );
+            if (r.event.isSpan()) {
+                try writer.print(",\"ph\":\"X\",\"dur\":{d:.3}}}", .{
+                    @as(f64, @floatFromInt(r.duration)) / std.time.ns_per_us,
+                });
+            } else {
+                try writer.writeAll(",\"ph\":\"i\",\"s\":\"t\"}");
+            }
+        }
+    }
+    try writer.writeAll("\n]}\n");
+}
+
+fn firstRing() ?*Ring {
+    mutex.lock();
+    defer mutex.unlock();
+    return rings;
+}
+
+test "Ring snapshot" {
+    const testing = std.testing;
+
+    const ring = try testing.allocator.create(Ring);
+    defer testing.allocator.destroy(ring);
+    ring.* = .{ .tid = .init(0) };
+
+    var buf: [Ring.capacity]Record = undefined;
+    try testing.expectEqual(0, ring.snapshot(&buf).records.len);
+
+    for (0..Ring.capacity + 10) |i| ring.push(.{
+        .start = i,
+        .event = .pty_read,
+    });
+
+    // The oldest slot may be being written so it's never included.
+    const records = ring.snapshot(&buf).records;
+    try testing.expectEqual(Ring.capacity - 1, records.len);
+    try testing.expectEqual(11, records[0].start);
+    try testing.expectEqual(Ring.capacity + 9, records[records.len - 1].start);
+
+    // Records of a previous owner are dropped when the ring is reused.
+    ring.base.store(ring.head.load(.monotonic), .release);
+    try testing.expectEqual(0, ring.snapshot(&buf).records.len);
+    ring.push(.{ .start = 1, .event = .pty_read });
+    const reused = ring.snapshot(&buf).records;
+    try testing.expectEqual(1, reused.len);
+    try testing.expectEqual(1, reused[0].start);
+}
+
+test "input latency" {
+    const testing = std.testing;
+
+    setEnabled(true);
+    defer setEnabled(false);
+    defer threadExit();
+
+    instant(.key_input, 0);
+    instant(.pty_write, 1);
+    instant(.pty_read, 1);
+    const span = begin();
+    try testing.expect(span != null);
+    end(span, .draw_frame, 0);
+
+    const summary = try summarize(testing.allocator);
+    try testing.expect(summary.get(.key_input).count >= 1);
+    try testing.expect(summary.get(.draw_frame).count >= 1);
+    try testing.expect(summary.get(.input_latency).count >= 1);
+
+    var out: std.ArrayListUnmanaged(u8) = .{};
+    defer out.deinit(testing.allocator);
+    try writeChromeTrace(testing.allocator, out.writer(testing.allocator));
+    try testing.expect(std.mem.indexOf(u8, out.items, "\"input_latency\"") != null);
+}